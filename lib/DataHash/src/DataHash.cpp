@@ -0,0 +1,315 @@
+/*
+ * Checksum and message digest functions suitable for embedded systems.
+ *
+ *  Copyright (c) 2023 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "DataHash.h"
+#include <string.h>
+
+// Both supported CPU architectures and the PC used for tests are little-endian.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error DataHash assumes little-endian byte order
+#endif
+
+/*************************************
+ * CRC-32                            *
+ *************************************/
+
+#if DATAHASH_CRC32_SMALL
+
+// Single table generated at compile time, so it is stored in flash
+// and takes no RAM. Processes one byte per iteration.
+struct crc32_table_t
+{
+    uint32_t entry[256];
+};
+
+static constexpr crc32_table_t crc32_make_table()
+{
+    crc32_table_t table = {};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        table.entry[i] = c;
+    }
+    return table;
+}
+
+static constexpr crc32_table_t g_crc32_table = crc32_make_table();
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len > 0)
+    {
+        crc = g_crc32_table.entry[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    return ~crc;
+}
+
+#else
+
+// Slice-by-4, tables are generated on first use and kept in RAM.
+// On RP2040 this avoids flash cache misses on the random table accesses.
+static uint32_t g_crc32_table[4][256];
+static bool g_crc32_table_valid;
+
+static void crc32_init_table()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+        g_crc32_table[0][i] = c;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = g_crc32_table[0][i];
+        for (int t = 1; t < 4; t++)
+        {
+            c = g_crc32_table[0][c & 0xFF] ^ (c >> 8);
+            g_crc32_table[t][i] = c;
+        }
+    }
+
+    g_crc32_table_valid = true;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    if (!g_crc32_table_valid)
+    {
+        crc32_init_table();
+    }
+
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+
+    // Process bytes until word aligned
+    while (len > 0 && ((uintptr_t)p & 3) != 0)
+    {
+        crc = g_crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    // Process four bytes at a time
+    const uint32_t *w = (const uint32_t*)p;
+    while (len >= 4)
+    {
+        crc ^= *w++;
+        crc = g_crc32_table[3][crc & 0xFF] ^
+              g_crc32_table[2][(crc >> 8) & 0xFF] ^
+              g_crc32_table[1][(crc >> 16) & 0xFF] ^
+              g_crc32_table[0][crc >> 24];
+        len -= 4;
+    }
+
+    // Remaining bytes
+    p = (const uint8_t*)w;
+    while (len > 0)
+    {
+        crc = g_crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    return ~crc;
+}
+
+#endif
+
+/*************************************
+ * MD5                               *
+ *************************************/
+
+#define MD5_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Round functions, F and G use forms that need one less operation than in RFC 1321
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+    (a) += f((b), (c), (d)) + (x) + (t); \
+    (a) = MD5_ROTL((a), (s)) + (b);
+
+// Process one 64-byte block, X must be word aligned
+static void md5_block(uint32_t state[4], const uint32_t *X)
+{
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+
+    MD5_STEP(MD5_F, a, b, c, d, X[ 0], 0xd76aa478,  7)
+    MD5_STEP(MD5_F, d, a, b, c, X[ 1], 0xe8c7b756, 12)
+    MD5_STEP(MD5_F, c, d, a, b, X[ 2], 0x242070db, 17)
+    MD5_STEP(MD5_F, b, c, d, a, X[ 3], 0xc1bdceee, 22)
+    MD5_STEP(MD5_F, a, b, c, d, X[ 4], 0xf57c0faf,  7)
+    MD5_STEP(MD5_F, d, a, b, c, X[ 5], 0x4787c62a, 12)
+    MD5_STEP(MD5_F, c, d, a, b, X[ 6], 0xa8304613, 17)
+    MD5_STEP(MD5_F, b, c, d, a, X[ 7], 0xfd469501, 22)
+    MD5_STEP(MD5_F, a, b, c, d, X[ 8], 0x698098d8,  7)
+    MD5_STEP(MD5_F, d, a, b, c, X[ 9], 0x8b44f7af, 12)
+    MD5_STEP(MD5_F, c, d, a, b, X[10], 0xffff5bb1, 17)
+    MD5_STEP(MD5_F, b, c, d, a, X[11], 0x895cd7be, 22)
+    MD5_STEP(MD5_F, a, b, c, d, X[12], 0x6b901122,  7)
+    MD5_STEP(MD5_F, d, a, b, c, X[13], 0xfd987193, 12)
+    MD5_STEP(MD5_F, c, d, a, b, X[14], 0xa679438e, 17)
+    MD5_STEP(MD5_F, b, c, d, a, X[15], 0x49b40821, 22)
+
+    MD5_STEP(MD5_G, a, b, c, d, X[ 1], 0xf61e2562,  5)
+    MD5_STEP(MD5_G, d, a, b, c, X[ 6], 0xc040b340,  9)
+    MD5_STEP(MD5_G, c, d, a, b, X[11], 0x265e5a51, 14)
+    MD5_STEP(MD5_G, b, c, d, a, X[ 0], 0xe9b6c7aa, 20)
+    MD5_STEP(MD5_G, a, b, c, d, X[ 5], 0xd62f105d,  5)
+    MD5_STEP(MD5_G, d, a, b, c, X[10], 0x02441453,  9)
+    MD5_STEP(MD5_G, c, d, a, b, X[15], 0xd8a1e681, 14)
+    MD5_STEP(MD5_G, b, c, d, a, X[ 4], 0xe7d3fbc8, 20)
+    MD5_STEP(MD5_G, a, b, c, d, X[ 9], 0x21e1cde6,  5)
+    MD5_STEP(MD5_G, d, a, b, c, X[14], 0xc33707d6,  9)
+    MD5_STEP(MD5_G, c, d, a, b, X[ 3], 0xf4d50d87, 14)
+    MD5_STEP(MD5_G, b, c, d, a, X[ 8], 0x455a14ed, 20)
+    MD5_STEP(MD5_G, a, b, c, d, X[13], 0xa9e3e905,  5)
+    MD5_STEP(MD5_G, d, a, b, c, X[ 2], 0xfcefa3f8,  9)
+    MD5_STEP(MD5_G, c, d, a, b, X[ 7], 0x676f02d9, 14)
+    MD5_STEP(MD5_G, b, c, d, a, X[12], 0x8d2a4c8a, 20)
+
+    MD5_STEP(MD5_H, a, b, c, d, X[ 5], 0xfffa3942,  4)
+    MD5_STEP(MD5_H, d, a, b, c, X[ 8], 0x8771f681, 11)
+    MD5_STEP(MD5_H, c, d, a, b, X[11], 0x6d9d6122, 16)
+    MD5_STEP(MD5_H, b, c, d, a, X[14], 0xfde5380c, 23)
+    MD5_STEP(MD5_H, a, b, c, d, X[ 1], 0xa4beea44,  4)
+    MD5_STEP(MD5_H, d, a, b, c, X[ 4], 0x4bdecfa9, 11)
+    MD5_STEP(MD5_H, c, d, a, b, X[ 7], 0xf6bb4b60, 16)
+    MD5_STEP(MD5_H, b, c, d, a, X[10], 0xbebfbc70, 23)
+    MD5_STEP(MD5_H, a, b, c, d, X[13], 0x289b7ec6,  4)
+    MD5_STEP(MD5_H, d, a, b, c, X[ 0], 0xeaa127fa, 11)
+    MD5_STEP(MD5_H, c, d, a, b, X[ 3], 0xd4ef3085, 16)
+    MD5_STEP(MD5_H, b, c, d, a, X[ 6], 0x04881d05, 23)
+    MD5_STEP(MD5_H, a, b, c, d, X[ 9], 0xd9d4d039,  4)
+    MD5_STEP(MD5_H, d, a, b, c, X[12], 0xe6db99e5, 11)
+    MD5_STEP(MD5_H, c, d, a, b, X[15], 0x1fa27cf8, 16)
+    MD5_STEP(MD5_H, b, c, d, a, X[ 2], 0xc4ac5665, 23)
+
+    MD5_STEP(MD5_I, a, b, c, d, X[ 0], 0xf4292244,  6)
+    MD5_STEP(MD5_I, d, a, b, c, X[ 7], 0x432aff97, 10)
+    MD5_STEP(MD5_I, c, d, a, b, X[14], 0xab9423a7, 15)
+    MD5_STEP(MD5_I, b, c, d, a, X[ 5], 0xfc93a039, 21)
+    MD5_STEP(MD5_I, a, b, c, d, X[12], 0x655b59c3,  6)
+    MD5_STEP(MD5_I, d, a, b, c, X[ 3], 0x8f0ccc92, 10)
+    MD5_STEP(MD5_I, c, d, a, b, X[10], 0xffeff47d, 15)
+    MD5_STEP(MD5_I, b, c, d, a, X[ 1], 0x85845dd1, 21)
+    MD5_STEP(MD5_I, a, b, c, d, X[ 8], 0x6fa87e4f,  6)
+    MD5_STEP(MD5_I, d, a, b, c, X[15], 0xfe2ce6e0, 10)
+    MD5_STEP(MD5_I, c, d, a, b, X[ 6], 0xa3014314, 15)
+    MD5_STEP(MD5_I, b, c, d, a, X[13], 0x4e0811a1, 21)
+    MD5_STEP(MD5_I, a, b, c, d, X[ 4], 0xf7537e82,  6)
+    MD5_STEP(MD5_I, d, a, b, c, X[11], 0xbd3af235, 10)
+    MD5_STEP(MD5_I, c, d, a, b, X[ 2], 0x2ad7d2bb, 15)
+    MD5_STEP(MD5_I, b, c, d, a, X[ 9], 0xeb86d391, 21)
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void md5_init(md5_ctx_t *ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+}
+
+void md5_update(md5_ctx_t *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    size_t used = ctx->length & 63;
+    ctx->length += len;
+
+    // Fill up partial block from previous call
+    if (used > 0)
+    {
+        size_t space = 64 - used;
+        if (len < space)
+        {
+            memcpy(ctx->buffer + used, p, len);
+            return;
+        }
+
+        memcpy(ctx->buffer + used, p, space);
+        md5_block(ctx->state, (const uint32_t*)ctx->buffer);
+        p += space;
+        len -= space;
+    }
+
+    if (((uintptr_t)p & 3) == 0)
+    {
+        // Aligned data can be processed in place
+        while (len >= 64)
+        {
+            md5_block(ctx->state, (const uint32_t*)p);
+            p += 64;
+            len -= 64;
+        }
+    }
+    else
+    {
+        while (len >= 64)
+        {
+            memcpy(ctx->buffer, p, 64);
+            md5_block(ctx->state, (const uint32_t*)ctx->buffer);
+            p += 64;
+            len -= 64;
+        }
+    }
+
+    memcpy(ctx->buffer, p, len);
+}
+
+void md5_final(md5_ctx_t *ctx, uint8_t digest[MD5_DIGEST_SIZE])
+{
+    uint64_t bitlength = ctx->length * 8;
+    size_t used = ctx->length & 63;
+
+    // Padding: 0x80, zeros and 64-bit length at the end of last block
+    ctx->buffer[used++] = 0x80;
+    if (used > 56)
+    {
+        memset(ctx->buffer + used, 0, 64 - used);
+        md5_block(ctx->state, (const uint32_t*)ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, 56 - used);
+    memcpy(ctx->buffer + 56, &bitlength, 8);
+    md5_block(ctx->state, (const uint32_t*)ctx->buffer);
+
+    memcpy(digest, ctx->state, MD5_DIGEST_SIZE);
+}
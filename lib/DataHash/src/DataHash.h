@@ -0,0 +1,48 @@
+/*
+ * Checksum and message digest functions suitable for embedded systems.
+ * Used for verifying data integrity of drive images.
+ *
+ *  Copyright (c) 2023 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 as used by zlib, Ethernet and .sfv files.
+// Start with crc = 0 and pass the previous result for continuing calculation.
+// Processes four bytes per iteration using 4 kB of lookup tables in RAM.
+// Build with DATAHASH_CRC32_SMALL=1 to use a single 1 kB table in flash instead.
+#ifndef DATAHASH_CRC32_SMALL
+#define DATAHASH_CRC32_SMALL 0
+#endif
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+// MD5 message digest, RFC 1321.
+// Processes data in 64 byte blocks. Aligned input is read directly,
+// unaligned input is copied through the internal buffer.
+#define MD5_DIGEST_SIZE 16
+
+struct md5_ctx_t {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t buffer[64];
+};
+
+void md5_init(md5_ctx_t *ctx);
+void md5_update(md5_ctx_t *ctx, const void *data, size_t len);
+void md5_final(md5_ctx_t *ctx, uint8_t digest[MD5_DIGEST_SIZE]);
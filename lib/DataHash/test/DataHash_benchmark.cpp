@@ -0,0 +1,84 @@
+// Measure throughput of the hash kernels.
+// Results on PC are only indicative, but relative differences between
+// kernels are similar on the embedded targets.
+
+#include "DataHash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Byte-at-a-time table lookup, for comparison with slice-by-4
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static uint32_t table[256];
+    if (table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (len--) crc = table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// BSD checksum that was previously used for the SCSI debug log
+static uint16_t bsd_checksum(uint16_t sum, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        sum = (sum >> 1) + ((sum & 1) << 15);
+        sum += data[i];
+    }
+    return sum;
+}
+
+int main()
+{
+    // Same size as the SCSI transfer buffer on RP2040
+    const size_t bufsize = 65536;
+    const int rounds = 2000;
+    uint8_t *buf = (uint8_t*)malloc(bufsize);
+    for (size_t i = 0; i < bufsize; i++) buf[i] = rand();
+
+    double total_mb = (double)bufsize * rounds / 1e6;
+    volatile uint32_t sink = 0;
+
+    double start = now();
+    for (int i = 0; i < rounds; i++) sink += bsd_checksum(0, buf, bufsize);
+    double t = now() - start;
+    printf("BSD checksum:     %8.1f MB/s\n", total_mb / t);
+
+    start = now();
+    for (int i = 0; i < rounds; i++) sink += crc32_bytewise(0, buf, bufsize);
+    t = now() - start;
+    printf("CRC32 bytewise:   %8.1f MB/s\n", total_mb / t);
+
+    start = now();
+    for (int i = 0; i < rounds; i++) sink += crc32_update(0, buf, bufsize);
+    t = now() - start;
+    printf("CRC32 slice-by-4: %8.1f MB/s\n", total_mb / t);
+
+    start = now();
+    md5_ctx_t ctx;
+    md5_init(&ctx);
+    for (int i = 0; i < rounds; i++) md5_update(&ctx, buf, bufsize);
+    uint8_t digest[MD5_DIGEST_SIZE];
+    md5_final(&ctx, digest);
+    t = now() - start;
+    printf("MD5:              %8.1f MB/s\n", total_mb / t);
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "DataHash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+// Bit-by-bit reference implementation
+static uint32_t crc32_reference(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc & 1) ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1);
+        }
+    }
+    return ~crc;
+}
+
+static void md5_hex(const void *data, size_t len, char *hex)
+{
+    md5_ctx_t ctx;
+    uint8_t digest[MD5_DIGEST_SIZE];
+    md5_init(&ctx);
+    md5_update(&ctx, data, len);
+    md5_final(&ctx, digest);
+    for (int i = 0; i < MD5_DIGEST_SIZE; i++)
+    {
+        sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+}
+
+bool test_crc32()
+{
+    bool status = true;
+
+    COMMENT("test_crc32()");
+    TEST(crc32_update(0, "123456789", 9) == 0xCBF43926);
+    TEST(crc32_update(0, "", 0) == 0);
+
+    COMMENT("Compare against reference with random data and alignments");
+    uint8_t buf[4096 + 8];
+    srand(1234);
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = rand();
+
+    bool all_ok = true;
+    for (int offset = 0; offset < 4; offset++)
+    {
+        for (size_t len = 0; len < 70; len++)
+        {
+            if (crc32_update(0, buf + offset, len) != crc32_reference(buf + offset, len)) all_ok = false;
+        }
+        if (crc32_update(0, buf + offset, 4096) != crc32_reference(buf + offset, 4096)) all_ok = false;
+    }
+    TEST(all_ok);
+
+    COMMENT("Calculation in multiple pieces");
+    uint32_t crc = crc32_update(0, buf, 13);
+    crc = crc32_update(crc, buf + 13, 1000);
+    crc = crc32_update(crc, buf + 1013, 4096 - 1013);
+    TEST(crc == crc32_reference(buf, 4096));
+
+    return status;
+}
+
+bool test_md5()
+{
+    bool status = true;
+    char hex[MD5_DIGEST_SIZE * 2 + 1];
+
+    COMMENT("test_md5() with RFC 1321 test suite");
+    md5_hex("", 0, hex);
+    TEST(strcmp(hex, "d41d8cd98f00b204e9800998ecf8427e") == 0);
+    md5_hex("a", 1, hex);
+    TEST(strcmp(hex, "0cc175b9c0f1b6a831c399e269772661") == 0);
+    md5_hex("abc", 3, hex);
+    TEST(strcmp(hex, "900150983cd24fb0d6963f7d28e17f72") == 0);
+    md5_hex("message digest", 14, hex);
+    TEST(strcmp(hex, "f96b697d7cb7938d525a2f31aaf161d0") == 0);
+    md5_hex("abcdefghijklmnopqrstuvwxyz", 26, hex);
+    TEST(strcmp(hex, "c3fcd3d76192e4007dfb496cca67e13b") == 0);
+    const char *alnum = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    md5_hex(alnum, 62, hex);
+    TEST(strcmp(hex, "d174ab98d277d9f5a5611c2c9f419d9f") == 0);
+    const char *digits = "12345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    md5_hex(digits, 80, hex);
+    TEST(strcmp(hex, "57edf4a22be3c955ac49da2e2107b67a") == 0);
+
+    COMMENT("Calculation in multiple unaligned pieces");
+    uint8_t buf[1000];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = i * 7;
+    char expected[MD5_DIGEST_SIZE * 2 + 1];
+    md5_hex(buf, sizeof(buf), expected);
+
+    md5_ctx_t ctx;
+    uint8_t digest[MD5_DIGEST_SIZE];
+    md5_init(&ctx);
+    md5_update(&ctx, buf, 1);
+    md5_update(&ctx, buf + 1, 63);
+    md5_update(&ctx, buf + 64, 3);
+    md5_update(&ctx, buf + 67, 500);
+    md5_update(&ctx, buf + 567, 1000 - 567);
+    md5_final(&ctx, digest);
+    for (int i = 0; i < MD5_DIGEST_SIZE; i++) sprintf(hex + i * 2, "%02x", digest[i]);
+    TEST(strcmp(hex, expected) == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_crc32() && test_md5())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,226 @@
+/*
+ * Small LZ4 block format compressor and decompressor for embedded systems.
+ *
+ *  Copyright (c) 2023 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "LZ4Block.h"
+#include <string.h>
+
+// Format constraints from the LZ4 block specification:
+// last 5 bytes are always literals, and the last match must
+// start at least 12 bytes before end of block.
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ4BLOCK_HASH_BITS);
+}
+
+// Write a length that did not fit in the token nibble
+static bool write_length(uint8_t *dst, uint32_t dst_size, uint32_t *op, uint32_t len)
+{
+    while (len >= 255)
+    {
+        if (*op >= dst_size) return false;
+        dst[(*op)++] = 255;
+        len -= 255;
+    }
+
+    if (*op >= dst_size) return false;
+    dst[(*op)++] = (uint8_t)len;
+    return true;
+}
+
+// Write one sequence of literals followed by a match.
+// Match length 0 writes the final literals-only sequence.
+static bool write_sequence(uint8_t *dst, uint32_t dst_size, uint32_t *op,
+                           const uint8_t *literals, uint32_t litlen,
+                           uint32_t offset, uint32_t matchlen)
+{
+    if (*op >= dst_size) return false;
+    uint32_t token_pos = (*op)++;
+
+    uint8_t token = (litlen >= 15) ? 0xF0 : (litlen << 4);
+    if (litlen >= 15 && !write_length(dst, dst_size, op, litlen - 15))
+    {
+        return false;
+    }
+
+    if (*op + litlen > dst_size) return false;
+    memcpy(dst + *op, literals, litlen);
+    *op += litlen;
+
+    if (matchlen > 0)
+    {
+        if (*op + 2 > dst_size) return false;
+        dst[(*op)++] = (uint8_t)offset;
+        dst[(*op)++] = (uint8_t)(offset >> 8);
+
+        uint32_t len = matchlen - LZ4_MIN_MATCH;
+        token |= (len >= 15) ? 0x0F : len;
+        if (len >= 15 && !write_length(dst, dst_size, op, len - 15))
+        {
+            return false;
+        }
+    }
+
+    dst[token_pos] = token;
+    return true;
+}
+
+uint32_t lz4block_compress(const uint8_t *src, uint32_t src_size,
+                           uint8_t *dst, uint32_t dst_size,
+                           uint16_t hashtable[LZ4BLOCK_HASH_SIZE])
+{
+    if (src_size > LZ4BLOCK_MAX_INPUT)
+    {
+        return 0;
+    }
+
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    uint32_t op = 0;
+
+    if (src_size > LZ4_MF_LIMIT)
+    {
+        // Stale entries are harmless, every candidate is verified
+        memset(hashtable, 0, LZ4BLOCK_HASH_SIZE * sizeof(uint16_t));
+
+        uint32_t match_limit = src_size - LZ4_MF_LIMIT;
+        while (ip < match_limit)
+        {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = lz4_hash(seq);
+            uint32_t ref = hashtable[h];
+            hashtable[h] = ip;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(src + ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            uint32_t matchlen = LZ4_MIN_MATCH;
+            uint32_t maxlen = src_size - LZ4_LAST_LITERALS - ip;
+            while (matchlen < maxlen && src[ref + matchlen] == src[ip + matchlen])
+            {
+                matchlen++;
+            }
+
+            if (!write_sequence(dst, dst_size, &op, src + anchor, ip - anchor, ip - ref, matchlen))
+            {
+                return 0;
+            }
+
+            ip += matchlen;
+            anchor = ip;
+        }
+    }
+
+    if (!write_sequence(dst, dst_size, &op, src + anchor, src_size - anchor, 0, 0))
+    {
+        return 0;
+    }
+
+    return op;
+}
+
+// Read a length that did not fit in the token nibble
+static bool read_length(const uint8_t *src, uint32_t src_size, uint32_t *ip, uint32_t *len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= src_size) return false;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+int32_t lz4block_decompress(const uint8_t *src, uint32_t src_size,
+                            uint8_t *dst, uint32_t dst_size)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < src_size && op < dst_size)
+    {
+        uint8_t token = src[ip++];
+
+        uint32_t litlen = token >> 4;
+        if (litlen == 15 && !read_length(src, src_size, &ip, &litlen))
+        {
+            return -1;
+        }
+
+        if (litlen > src_size - ip || litlen > dst_size - op)
+        {
+            return -1;
+        }
+
+        memcpy(dst + op, src + ip, litlen);
+        ip += litlen;
+        op += litlen;
+
+        if (ip >= src_size || op >= dst_size)
+        {
+            // Final sequence has only literals
+            break;
+        }
+
+        if (src_size - ip < 2)
+        {
+            return -1;
+        }
+
+        uint32_t offset = src[ip] | ((uint32_t)src[ip + 1] << 8);
+        ip += 2;
+
+        uint32_t matchlen = token & 0x0F;
+        if (matchlen == 15 && !read_length(src, src_size, &ip, &matchlen))
+        {
+            return -1;
+        }
+        matchlen += LZ4_MIN_MATCH;
+
+        if (offset == 0 || offset > op || matchlen > dst_size - op)
+        {
+            return -1;
+        }
+
+        // Match can overlap the output, so copy byte by byte
+        const uint8_t *ref = dst + op - offset;
+        uint8_t *out = dst + op;
+        for (uint32_t i = 0; i < matchlen; i++)
+        {
+            out[i] = ref[i];
+        }
+        op += matchlen;
+    }
+
+    return op;
+}
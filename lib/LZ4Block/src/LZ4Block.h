@@ -0,0 +1,43 @@
+/*
+ * Small LZ4 block format compressor and decompressor for embedded systems.
+ * Used for storing compressed ROM drive images in microcontroller flash.
+ *
+ *  Copyright (c) 2023 Rabbit Hole Computing
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Compressor uses a caller-provided hash table of this many entries.
+// Positions are stored as 16 bits, so input can be at most 65535 bytes.
+#define LZ4BLOCK_HASH_BITS 12
+#define LZ4BLOCK_HASH_SIZE (1 << LZ4BLOCK_HASH_BITS)
+#define LZ4BLOCK_MAX_INPUT 65535
+
+// Compress src to dst in LZ4 block format, using greedy matching.
+// Returns the compressed size, or 0 if it would exceed dst_size bytes.
+uint32_t lz4block_compress(const uint8_t *src, uint32_t src_size,
+                           uint8_t *dst, uint32_t dst_size,
+                           uint16_t hashtable[LZ4BLOCK_HASH_SIZE]);
+
+// Decompress LZ4 block data from src to dst.
+// Stops when src is consumed or dst is full, so trailing padding after
+// a full block is ignored. Returns number of bytes written to dst,
+// or -1 if the data is corrupt.
+int32_t lz4block_decompress(const uint8_t *src, uint32_t src_size,
+                            uint8_t *dst, uint32_t dst_size);
@@ -0,0 +1,134 @@
+#include "LZ4Block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static uint16_t g_hashtable[LZ4BLOCK_HASH_SIZE];
+
+// Compress and decompress, return compressed size or 0 on mismatch
+static uint32_t roundtrip(const uint8_t *data, uint32_t len)
+{
+    static uint8_t compressed[70000];
+    static uint8_t output[70000];
+
+    uint32_t clen = lz4block_compress(data, len, compressed, sizeof(compressed), g_hashtable);
+    if (clen == 0) return 0;
+
+    memset(output, 0xAA, sizeof(output));
+    int32_t olen = lz4block_decompress(compressed, clen, output, len);
+    if (olen != (int32_t)len || memcmp(data, output, len) != 0) return 0;
+
+    return clen;
+}
+
+bool test_known_block()
+{
+    bool status = true;
+    COMMENT("test_known_block()");
+
+    // Literals "abcd", match offset 4 length 8, final literals "xyz12"
+    const uint8_t block[] = {0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x50, 'x', 'y', 'z', '1', '2'};
+    uint8_t out[32] = {0};
+    TEST(lz4block_decompress(block, sizeof(block), out, sizeof(out)) == 17);
+    TEST(memcmp(out, "abcdabcdabcdxyz12", 17) == 0);
+
+    COMMENT("Decoding stops when output is full, ignoring padding");
+    const uint8_t padded[] = {0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x50, 'x', 'y', 'z', '1', '2', 0, 0, 0};
+    TEST(lz4block_decompress(padded, sizeof(padded), out, 17) == 17);
+
+    return status;
+}
+
+bool test_corrupt()
+{
+    bool status = true;
+    uint8_t out[64];
+    COMMENT("test_corrupt()");
+
+    const uint8_t bad_offset[] = {0x14, 'a', 0x05, 0x00, 0x50, 'x', 'y', 'z', '1', '2'};
+    TEST(lz4block_decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)) == -1);
+
+    const uint8_t zero_offset[] = {0x14, 'a', 0x00, 0x00, 0x50, 'x', 'y', 'z', '1', '2'};
+    TEST(lz4block_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)) == -1);
+
+    const uint8_t truncated_literals[] = {0x80, 'a', 'b'};
+    TEST(lz4block_decompress(truncated_literals, sizeof(truncated_literals), out, sizeof(out)) == -1);
+
+    const uint8_t too_long[] = {0x14, 'a', 0x01, 0x00, 0x0F, 0xFF, 0x00};
+    TEST(lz4block_decompress(too_long, sizeof(too_long), out, sizeof(out)) == -1);
+
+    return status;
+}
+
+bool test_roundtrip()
+{
+    bool status = true;
+    static uint8_t data[65535];
+    COMMENT("test_roundtrip()");
+
+    COMMENT("Short inputs are stored as literals");
+    TEST(roundtrip((const uint8_t*)"", 0) == 1);
+    TEST(roundtrip((const uint8_t*)"hello", 5) == 6);
+    TEST(roundtrip((const uint8_t*)"aaaaaaaaaaaaa", 13) > 0);
+
+    COMMENT("Zero-filled block compresses well");
+    memset(data, 0, 4096);
+    uint32_t clen = roundtrip(data, 4096);
+    TEST(clen > 0 && clen < 32);
+
+    COMMENT("Random data does not compress but fits in worst case size");
+    srand(1);
+    for (uint32_t i = 0; i < sizeof(data); i++) data[i] = rand();
+    clen = roundtrip(data, 4096);
+    TEST(clen > 4096 && clen <= 4096 + 4096 / 255 + 16);
+    TEST(roundtrip(data, sizeof(data)) > 0);
+
+    COMMENT("Compression fails cleanly when output does not fit");
+    uint8_t small[4092];
+    TEST(lz4block_compress(data, 4096, small, sizeof(small), g_hashtable) == 0);
+
+    COMMENT("Text-like data with repetitions");
+    const char *words[] = {"System ", "Finder ", "Desktop ", "Folder ", "\0\0\0\0", "Macintosh HD "};
+    uint32_t pos = 0;
+    while (pos < 4096)
+    {
+        const char *w = words[rand() % 6];
+        uint32_t len = strlen(w) ? strlen(w) : 4;
+        for (uint32_t i = 0; i < len && pos < 4096; i++) data[pos++] = w[i];
+    }
+    clen = roundtrip(data, 4096);
+    TEST(clen > 0 && clen < 2048);
+
+    COMMENT("Long matches and literal runs");
+    for (uint32_t i = 0; i < sizeof(data); i++) data[i] = (i < 1000) ? rand() : (i % 7);
+    TEST(roundtrip(data, sizeof(data)) > 0);
+
+    COMMENT("Input size limit");
+    TEST(lz4block_compress(data, LZ4BLOCK_MAX_INPUT + 1, data, 10, g_hashtable) == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_known_block() && test_corrupt() && test_roundtrip())
+    {
+        printf("All tests passed\n");
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -145,13 +145,20 @@ void scsiReadBuffer()
 {
 	// READ BUFFER
 	// Used for testing the speed of the SCSI interface.
-	uint8_t mode = scsiDev.data[1] & 7;
+	uint8_t mode = scsiDev.cdb[1] & 7;
 
 	int allocLength =
 		(((uint32_t) scsiDev.cdb[6]) << 16) +
 		(((uint32_t) scsiDev.cdb[7]) << 8) +
 		scsiDev.cdb[8];
 
+	int statsLength = 0;
+	if (mode == 0x1)
+	{
+		// Vendor specific: per-target performance statistics
+		statsLength = scsiStatsReadBuffer(scsiDev.cdb[2], scsiDev.data, sizeof(scsiDev.data));
+	}
+
 	if (mode == 0)
 	{
 		uint32_t maxSize = sizeof(scsiDev.data) - 4;
@@ -172,6 +179,12 @@ void scsiReadBuffer()
 			(allocLength > sizeof(scsiDev.data)) ? sizeof(scsiDev.data) : allocLength;
 		scsiDev.phase = DATA_IN;
 	}
+	else if (statsLength > 0)
+	{
+		scsiDev.dataLen =
+			(allocLength > statsLength) ? statsLength : allocLength;
+		scsiDev.phase = DATA_IN;
+	}
 	else if (mode == 0x3)
 	{
 		uint32_t maxSize = sizeof(scsiDev.data) - 4;
@@ -211,7 +224,7 @@ void scsiWriteBuffer()
 {
 	// WRITE BUFFER
 	// Used for testing the speed of the SCSI interface.
-	uint8_t mode = scsiDev.data[1] & 7;
+	uint8_t mode = scsiDev.cdb[1] & 7;
 
 	int allocLength =
 		(((uint32_t) scsiDev.cdb[6]) << 16) +
@@ -23,4 +23,8 @@ void doWriteBuffer(void);
 void scsiWriteBuffer(void);
 void scsiReadBuffer(void);
 
+// Fill vendor specific READ BUFFER data, returns length or 0 on error.
+// Implemented in ZuluSCSI_stats.cpp
+int scsiStatsReadBuffer(uint8_t bufferId, uint8_t *buf, uint32_t buflen);
+
 #endif
@@ -55,4 +55,8 @@ void scsiDiskReset(void);
 void scsiDiskPoll(void);
 int scsiDiskCommand(void);
 
+// Called at start of every command, completes opening of images
+// that was deferred at boot before the command can access them.
+void scsiDiskCompleteDeferredOpen(void);
+
 #endif
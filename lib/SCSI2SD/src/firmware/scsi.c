@@ -345,6 +345,7 @@ static void process_Command()
 
 	scsiDev.cmdCount++;
 	const S2S_TargetCfg* cfg = scsiDev.target->cfg;
+	scsiDiskCompleteDeferredOpen();
 
 	if (unlikely(scsiDev.resetFlag))
 	{
@@ -736,12 +737,31 @@ static void enter_SelectionPhase()
 
 static void process_SelectionPhase()
 {
+	// The selection status is latched until bus free, so the selected
+	// target can be looked up before the delays below.
+	uint8_t selStatus = *SCSI_STS_SELECTED;
+	if ((selStatus == 0) && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_SEL_LATCH))
+	{
+		selStatus = scsiDev.selFlag;
+	}
+
+	int tgtIndex;
+	TargetState* target = NULL;
+	for (tgtIndex = 0; tgtIndex < S2S_MAX_TARGETS; ++tgtIndex)
+	{
+		if (scsiDev.targets[tgtIndex].targetId == (selStatus & 7))
+		{
+			target = &scsiDev.targets[tgtIndex];
+			break;
+		}
+	}
+
 	// Selection delays.
 	// Many SCSI1 samplers that use a 5380 chip need a delay of at least 1ms.
 	// The Mac Plus boot-time (ie. rom code) selection abort time
 	// is < 1ms and must have no delay (standard suggests 250ms abort time)
 	// Most newer SCSI2 hosts don't care either way.
-	if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
+	if (target != NULL && target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
 	{
 		s2s_delay_ms(1); // Simply won't work if set to 0.
 	}
@@ -757,22 +777,6 @@ static void process_SelectionPhase()
 		s2s_delay_ms(scsiDev.boardCfg.selectionDelay);
 	}
 
-	uint8_t selStatus = *SCSI_STS_SELECTED;
-	if ((selStatus == 0) && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_SEL_LATCH))
-	{
-		selStatus = scsiDev.selFlag;
-	}
-
-	int tgtIndex;
-	TargetState* target = NULL;
-	for (tgtIndex = 0; tgtIndex < S2S_MAX_TARGETS; ++tgtIndex)
-	{
-		if (scsiDev.targets[tgtIndex].targetId == (selStatus & 7))
-		{
-			target = &scsiDev.targets[tgtIndex];
-			break;
-		}
-	}
 	if ((target != NULL) && (selStatus & 0x40))
 	{
 		// We've been selected!
@@ -1039,6 +1043,12 @@ static void process_MessageOut()
 				{
 					scsiDev.target->syncPeriod = transferPeriod;
 				}
+				else if ((scsiDev.boardCfg.scsiSpeed == S2S_CFG_SPEED_SYNC_20) &&
+					(transferPeriod <= 25))
+				{
+					// 50ns, 20MB/s, or anything between Fast-20 and Fast-10
+					scsiDev.target->syncPeriod = transferPeriod < 12 ? 12 : transferPeriod;
+				}
 				else if (transferPeriod <= 25 &&
 					((scsiDev.boardCfg.scsiSpeed == S2S_CFG_SPEED_NoLimit) ||
 						(scsiDev.boardCfg.scsiSpeed >= S2S_CFG_SPEED_SYNC_10)))
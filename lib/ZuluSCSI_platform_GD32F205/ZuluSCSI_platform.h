@@ -54,6 +54,10 @@ extern const char *g_platform_name;
 #   include "ZuluSCSI_v1_1_gpio.h"
 #endif
 
+// Address range of constant data in flash, used by binary debug log
+#define PLATFORM_FLASH_ADDR_START 0x08000000
+#define PLATFORM_FLASH_ADDR_END   0x08300000
+
 #ifndef PLATFORM_VDD_WARNING_LIMIT_mV
 #define PLATFORM_VDD_WARNING_LIMIT_mV 2800
 #endif
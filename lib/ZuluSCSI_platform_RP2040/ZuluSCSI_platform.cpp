@@ -25,6 +25,7 @@
 #include <SdFat.h>
 #include <scsi.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <hardware/gpio.h>
 #include <hardware/uart.h>
 #include <hardware/pll.h>
@@ -32,6 +33,7 @@
 #include <hardware/spi.h>
 #include <hardware/adc.h>
 #include <hardware/flash.h>
+#include <hardware/sync.h>
 #include <hardware/structs/xip_ctrl.h>
 #include <hardware/structs/usb.h>
 #include <platform/mbed_error.h>
@@ -39,6 +41,7 @@
 #include <USB/PluggableUSBSerial.h>
 #include "audio.h"
 #include "scsi_accel_target.h"
+#include "sd_worker.h"
 
 extern "C" {
 
@@ -46,6 +49,7 @@ const char *g_platform_name = PLATFORM_NAME;
 static bool g_scsi_initiator = false;
 static uint32_t g_flash_chip_size = 0;
 static bool g_uart_initialized = false;
+static spin_lock_t *g_log_spinlock = NULL;
 
 void mbed_error_hook(const mbed_error_ctx * error_context);
 
@@ -108,6 +112,7 @@ void platform_init()
 {
     // Make sure second core is stopped
     multicore_reset_core1();
+    g_log_spinlock = spin_lock_init(spin_lock_claim_unused(true));
 
     /* First configure the pins that affect external buffer directions.
      * RP2040 defaults to pulldowns, while these pins have external pull-ups.
@@ -319,9 +324,12 @@ void platform_late_init()
         gpio_conf(SCSI_IN_RST,    GPIO_FUNC_SIO, true, false, false, true, false);
 
 #ifdef ENABLE_AUDIO_OUTPUT
-        // one-time control setup for DMA channels and second core
+        // one-time control setup for DMA channels
         audio_setup();
 #endif
+
+        // Second core handles SD card access and audio processing
+        sd_worker_init();
     }
     else
     {
@@ -533,6 +541,24 @@ void platform_log(const char *s)
     }
 }
 
+uint32_t platform_log_lock()
+{
+    if (!g_log_spinlock)
+    {
+        return 0;
+    }
+
+    return spin_lock_blocking(g_log_spinlock);
+}
+
+void platform_log_unlock(uint32_t saved_irq)
+{
+    if (g_log_spinlock)
+    {
+        spin_unlock(g_log_spinlock, saved_irq);
+    }
+}
+
 static int g_watchdog_timeout;
 static bool g_watchdog_initialized;
 
@@ -695,6 +721,10 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
     assert(offset % PLATFORM_FLASH_PAGE_SIZE == 0);
     assert(offset >= PLATFORM_BOOTLOADER_SIZE);
 
+    // Core1 must not execute from flash while it is being written.
+    // It is normally not running in bootloader, then this does nothing.
+    sd_worker_pause();
+
     // Avoid any mbed timer interrupts triggering during the flashing.
     __disable_irq();
 
@@ -720,11 +750,13 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
         {
             logmsg("Flash verify failed at offset ", offset + i * 4, " got ", actual, " expected ", expected);
             __enable_irq();
+            sd_worker_resume();
             return false;
         }
     }
 
     __enable_irq();
+    sd_worker_resume();
 
     return true;
 }
@@ -814,20 +846,60 @@ bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count)
     return true;
 }
 
+const uint8_t *platform_romdrive_xip_ptr(uint32_t start, uint32_t count)
+{
+    if (start + count > platform_get_romdrive_maxsize())
+    {
+        return NULL;
+    }
+
+    // SCSI DMA reads the data one byte at a time. Through the cache bypass
+    // alias each byte would be a separate flash transaction, so use the
+    // cached alias that fetches whole cache lines.
+    return (const uint8_t*)(XIP_BASE + ROMDRIVE_OFFSET + start);
+}
+
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count)
 {
     assert(start < platform_get_romdrive_maxsize());
     assert((count % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
 
+    sd_worker_pause();
     __disable_irq();
     flash_range_erase(start + ROMDRIVE_OFFSET, count);
     flash_range_program(start + ROMDRIVE_OFFSET, data, count);
     __enable_irq();
+    sd_worker_resume();
     return true;
 }
 
 #endif
 
+/************************************/
+/* RAM drive in internal SRAM       */
+/************************************/
+
+// Amount of heap that is left free for the USB stack and other libraries
+#define RAMDRIVE_HEAP_RESERVE (16 * 1024)
+
+uint8_t *platform_alloc_ramdrive(uint32_t size)
+{
+    // Check that the heap has room for the reserve in addition to the drive
+    void *test = malloc(size + RAMDRIVE_HEAP_RESERVE);
+    if (!test)
+    {
+        return NULL;
+    }
+    free(test);
+
+    return (uint8_t*)malloc(size);
+}
+
+void platform_free_ramdrive(uint8_t *buffer)
+{
+    free(buffer);
+}
+
 /**********************************************/
 /* Mapping from data bytes to GPIO BOP values */
 /**********************************************/
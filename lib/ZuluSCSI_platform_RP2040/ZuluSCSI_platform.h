@@ -60,18 +60,25 @@ extern const char *g_platform_name;
 # define PLATFORM_HAS_INITIATOR_MODE 1
 #endif
 
-#define PLATFORM_MAX_SCSI_SPEED S2S_CFG_SPEED_SYNC_10
+#define PLATFORM_MAX_SCSI_SPEED S2S_CFG_SPEED_SYNC_20
 #define PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE 32768
 #define PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE 65536
 #define PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE 8192
 #define SD_USE_SDIO 1
 #define PLATFORM_HAS_PARITY_CHECK 1
+#define PLATFORM_HAS_SD_WORKER 1
+
+// Address range of constant data in flash, used by binary debug log
+#define PLATFORM_FLASH_ADDR_START 0x10000000
+#define PLATFORM_FLASH_ADDR_END   0x11000000
 
 #ifndef PLATFORM_VDD_WARNING_LIMIT_mV
 #define PLATFORM_VDD_WARNING_LIMIT_mV 2800
 #endif
 
-// NOTE: The driver supports synchronous speeds higher than 10MB/s, but this
+// NOTE: Fast-20 is only used when enabled with MaxSyncSpeed = 20 in the config file.
+// Writes to the bus use 56 ns period, reads are paced at 10 MB/s.
+// The driver supports other synchronous speeds higher than 10MB/s, but this
 // has not been tested due to lack of fast enough SCSI adapter.
 // #define PLATFORM_MAX_SCSI_SPEED S2S_CFG_SPEED_TURBO
 
@@ -80,10 +87,18 @@ extern const char *g_platform_name;
 void platform_log(const char *s);
 void platform_emergency_log_save();
 
+// Log messages can come from both cores, so updates to the log buffers
+// are done while holding a spinlock. Returns saved interrupt state.
+#define PLATFORM_HAS_LOG_LOCK 1
+uint32_t platform_log_lock();
+void platform_log_unlock(uint32_t saved_irq);
+
 // Timing and delay functions.
 // Arduino platform already provides these
 unsigned long millis(void);
+unsigned long micros(void);
 void delay(unsigned long ms);
+#define PLATFORM_HAS_MICROS 1
 
 // Short delays, can be called from interrupt mode
 static inline void delay_ns(unsigned long ns)
@@ -129,6 +144,16 @@ uint8_t platform_get_buttons();
 typedef void (*sd_callback_t)(uint32_t bytes_complete);
 void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer);
 
+// Report SD card bus speed mode and clock rate for the log
+#define PLATFORM_HAS_SD_BUS_INFO 1
+void platform_get_sd_bus_info(bool *high_speed, uint32_t *clock_khz);
+
+// Get SD card write sizes suitable for the inserted card.
+// These replace the PLATFORM_OPTIMAL_*_SD_WRITE_SIZE values at runtime.
+// au_size is the allocation unit of the card in bytes, or 0 if unknown.
+#define PLATFORM_HAS_SD_WRITE_SIZES 1
+void platform_get_sd_write_sizes(uint32_t *min_size, uint32_t *max_size, uint32_t *last_size, uint32_t *au_size);
+
 // Reprogram firmware in main program area.
 #ifndef RP2040_DISABLE_BOOTLOADER
 #define PLATFORM_BOOTLOADER_SIZE (128 * 1024)
@@ -150,8 +175,18 @@ bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count);
 // Reprogram ROM drive area
 #define PLATFORM_ROMDRIVE_PAGE_SIZE 4096
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count);
+
+// Get pointer to ROM drive area in memory-mapped flash.
+// This allows SCSI DMA to transfer data directly without copying it to RAM.
+#define PLATFORM_HAS_ROM_DRIVE_XIP 1
+const uint8_t *platform_romdrive_xip_ptr(uint32_t start, uint32_t count);
 #endif
 
+// RAM drive storage, allocated from the internal SRAM heap
+#define PLATFORM_HAS_RAM_DRIVE 1
+uint8_t *platform_alloc_ramdrive(uint32_t size);
+void platform_free_ramdrive(uint8_t *buffer);
+
 // Parity lookup tables for write and read from SCSI bus.
 // These are used by macros below and the code in scsi_accel_rp2040.cpp
 extern const uint16_t g_scsi_parity_lookup[256];
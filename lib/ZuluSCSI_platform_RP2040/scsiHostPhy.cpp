@@ -38,7 +38,9 @@ volatile int g_scsiHostPhyReset;
 // Dummy functions for platforms without hardware support for
 // SCSI initiator mode.
 void scsiHostPhyReset(void) {}
-bool scsiHostPhySelect(int target_id) { return false; }
+bool scsiHostPhySelect(int target_id, uint32_t timeout_us) { return false; }
+void scsiHostPhySetATN(bool state) {}
+void scsiHostPhySetSyncMode(int syncOffset, int syncPeriod) {}
 int scsiHostPhyGetPhase() { return 0; }
 bool scsiHostRequestWaiting() { return false; }
 uint32_t scsiHostWrite(const uint8_t *data, uint32_t count) { return 0; }
@@ -47,6 +49,9 @@ void scsiHostPhyRelease();
 
 #else
 
+// Negotiated synchronous offset, 0 for asynchronous mode
+static int g_scsiHostPhySyncOffset;
+
 // Release bus and pulse RST signal, initialize PHY to host mode.
 void scsiHostPhyReset(void)
 {
@@ -54,6 +59,7 @@ void scsiHostPhyReset(void)
     SCSI_ENABLE_INITIATOR();
 
     scsi_accel_host_init();
+    g_scsiHostPhySyncOffset = 0;
 
     SCSI_OUT(RST, 1);
     delay(2);
@@ -63,8 +69,8 @@ void scsiHostPhyReset(void)
 }
 
 // Select a device, id 0-7.
-// Returns true if the target answers to selection request.
-bool scsiHostPhySelect(int target_id)
+// Returns true if the target answers to selection request within timeout.
+bool scsiHostPhySelect(int target_id, uint32_t timeout_us)
 {
     SCSI_RELEASE_OUTPUTS();
 
@@ -82,6 +88,7 @@ bool scsiHostPhySelect(int target_id)
             dbgmsg("scsiHostPhySelect: bus is busy");
             scsiLogInitiatorPhaseChange(BUS_FREE);
             SCSI_RELEASE_OUTPUTS();
+            SCSI_OUT(ATN, 0);
             return false;
         }
     }
@@ -99,7 +106,7 @@ bool scsiHostPhySelect(int target_id)
     SCSI_OUT(BSY, 0);
 
     // Wait for target to respond
-    for (int wait = 0; wait < 2500; wait++)
+    for (uint32_t wait = 0; wait < timeout_us; wait += 100)
     {
         delayMicroseconds(100);
         if (SCSI_IN(BSY))
@@ -112,6 +119,7 @@ bool scsiHostPhySelect(int target_id)
     {
         // No response
         SCSI_RELEASE_OUTPUTS();
+        SCSI_OUT(ATN, 0);
         return false;
     }
 
@@ -122,6 +130,23 @@ bool scsiHostPhySelect(int target_id)
     return true;
 }
 
+void scsiHostPhySetATN(bool state)
+{
+    SCSI_OUT(ATN, state);
+}
+
+void scsiHostPhySetSyncMode(int syncOffset, int syncPeriod)
+{
+    g_scsiHostPhySyncOffset = syncOffset;
+    scsi_accel_host_setSyncMode(syncOffset, syncPeriod);
+}
+
+// Synchronous mode applies only to data phases, where CD and MSG are both inactive
+static bool scsiHostPhyIsSyncDataPhase()
+{
+    return g_scsiHostPhySyncOffset > 0 && !SCSI_IN(CD) && !SCSI_IN(MSG);
+}
+
 // Read the current communication phase as signaled by the target
 int scsiHostPhyGetPhase()
 {
@@ -228,6 +253,14 @@ uint32_t scsiHostWrite(const uint8_t *data, uint32_t count)
 {
     scsiLogDataOut(data, count);
 
+    if (scsiHostPhyIsSyncDataPhase())
+    {
+        // The handshake below would send data faster than the target
+        // allows, initiator must negotiate asynchronous mode for writes.
+        logmsg("scsiHostWrite: synchronous DATA OUT is not supported");
+        return 0;
+    }
+
     int cd_start = SCSI_IN(CD);
     int msg_start = SCSI_IN(MSG);
 
@@ -257,11 +290,18 @@ uint32_t scsiHostRead(uint8_t *data, uint32_t count)
     int cd_start = SCSI_IN(CD);
     int msg_start = SCSI_IN(MSG);
 
-    if ((count & 1) == 0 && ((uint32_t)data & 1) == 0)
+    if ((count & 1) == 0)
     {
-        // Even number of bytes, use accelerated routine
+        // Even number of bytes, use accelerated routine.
+        // It stores the data one byte at a time, so buffer alignment does not matter.
         count = scsi_accel_host_read(data, count, &parityError, &g_scsiHostPhyReset);
     }
+    else if (scsiHostPhyIsSyncDataPhase())
+    {
+        // Software handshake would miss the REQ pulses of synchronous transfer
+        logmsg("scsiHostRead: odd length ", (int)count, " is not supported in synchronous mode");
+        return 0;
+    }
     else
     {
         for (uint32_t i = 0; i < count; i++)
@@ -301,6 +341,7 @@ void scsiHostPhyRelease()
 {
     scsiLogInitiatorPhaseChange(BUS_FREE);
     SCSI_RELEASE_OUTPUTS();
+    SCSI_OUT(ATN, 0);
 }
 
 #endif
@@ -34,8 +34,17 @@ extern volatile int g_scsiHostPhyReset;
 void scsiHostPhyReset(void);
 
 // Select a device, id 0-7.
-// Returns true if the target answers to selection request.
-bool scsiHostPhySelect(int target_id);
+// Returns true if the target answers to selection request within timeout.
+bool scsiHostPhySelect(int target_id, uint32_t timeout_us);
+
+// Set ATN signal state.
+// Assert before selection to get MESSAGE OUT phase after IDENTIFY,
+// release before the last byte of the message.
+void scsiHostPhySetATN(bool state);
+
+// Set synchronous transfer parameters for the next data phase.
+// Offset 0 selects asynchronous mode, period is in 4 ns units.
+void scsiHostPhySetSyncMode(int syncOffset, int syncPeriod);
 
 // Read the current communication phase as signaled by the target
 // Matches SCSI_PHASE enumeration from scsi.h.
@@ -46,6 +55,7 @@ bool scsiHostRequestWaiting();
 
 // Blocking data transfer
 // These return the actual number of bytes transferred.
+// In synchronous mode only DATA IN is supported, and the byte count must be even.
 uint32_t scsiHostWrite(const uint8_t *data, uint32_t count);
 uint32_t scsiHostRead(uint8_t *data, uint32_t count);
 
@@ -0,0 +1,169 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2022 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "scsiHostSync.h"
+
+void scsiHostSyncInit(scsi_host_sync_t *sync, uint8_t min_period, uint8_t max_offset)
+{
+    sync->min_period = min_period;
+    sync->max_offset = max_offset;
+    scsiHostSyncReset(sync);
+}
+
+void scsiHostSyncReset(scsi_host_sync_t *sync)
+{
+    sync->state = SCSIHOST_SYNC_UNKNOWN;
+    sync->period = 0;
+    sync->offset = 0;
+}
+
+bool scsiHostSyncNeeded(const scsi_host_sync_t *sync)
+{
+    return sync->state == SCSIHOST_SYNC_UNKNOWN && sync->max_offset > 0;
+}
+
+size_t scsiHostSyncBuildRequest(scsi_host_sync_t *sync, uint8_t *msg)
+{
+    msg[0] = SCSI_MSG_IDENTIFY;
+    msg[1] = SCSI_MSG_EXTENDED;
+    msg[2] = 3;
+    msg[3] = SCSI_EXTMSG_SDTR;
+    msg[4] = sync->min_period;
+    msg[5] = sync->max_offset;
+    sync->state = SCSIHOST_SYNC_REQUESTED;
+    return 6;
+}
+
+size_t scsiHostSyncMessageLength(const uint8_t *msg, size_t received)
+{
+    if (received == 0)
+    {
+        return 1;
+    }
+    else if (msg[0] == SCSI_MSG_EXTENDED)
+    {
+        // Extended message: 0x01, length, code, arguments..
+        // Length value 0 means 256 bytes.
+        if (received < 2) return 2;
+        return 2 + (msg[1] == 0 ? 256 : msg[1]);
+    }
+    else if (msg[0] >= 0x20 && msg[0] <= 0x2F)
+    {
+        // Two-byte messages
+        return 2;
+    }
+    else
+    {
+        return 1;
+    }
+}
+
+size_t scsiHostSyncMessageIn(scsi_host_sync_t *sync, const uint8_t *msg, size_t msglen, uint8_t *reply)
+{
+    if (msglen == 0)
+    {
+        return 0;
+    }
+
+    if (msg[0] == SCSI_MSG_EXTENDED && msglen >= 5 && msg[1] == 3 && msg[2] == SCSI_EXTMSG_SDTR)
+    {
+        uint8_t period = msg[3];
+        uint8_t offset = msg[4];
+
+        if (sync->state == SCSIHOST_SYNC_REQUESTED)
+        {
+            // Response to our own request
+            sync->state = SCSIHOST_SYNC_DONE;
+
+            if (offset == 0)
+            {
+                // Target wants asynchronous transfers
+                sync->period = period;
+                sync->offset = 0;
+                return 0;
+            }
+            else if (period < sync->min_period || offset > sync->max_offset)
+            {
+                // Target responded with values faster than we asked for.
+                // Reject the message, which leaves both sides in asynchronous mode.
+                sync->period = 0;
+                sync->offset = 0;
+                reply[0] = SCSI_MSG_REJECT;
+                return 1;
+            }
+            else
+            {
+                sync->period = period;
+                sync->offset = offset;
+                return 0;
+            }
+        }
+        else
+        {
+            // Target initiated negotiation, respond with values we can accept
+            if (period < sync->min_period) period = sync->min_period;
+            if (offset > sync->max_offset) offset = sync->max_offset;
+
+            sync->state = SCSIHOST_SYNC_DONE;
+            sync->period = period;
+            sync->offset = offset;
+
+            reply[0] = SCSI_MSG_EXTENDED;
+            reply[1] = 3;
+            reply[2] = SCSI_EXTMSG_SDTR;
+            reply[3] = period;
+            reply[4] = offset;
+            return 5;
+        }
+    }
+    else if (msg[0] == SCSI_MSG_EXTENDED)
+    {
+        // Wide transfers and other extended messages are not supported
+        reply[0] = SCSI_MSG_REJECT;
+        return 1;
+    }
+    else if (msg[0] == SCSI_MSG_REJECT)
+    {
+        if (sync->state == SCSIHOST_SYNC_REQUESTED)
+        {
+            // Target does not support synchronous transfers
+            sync->state = SCSIHOST_SYNC_DONE;
+            sync->period = 0;
+            sync->offset = 0;
+        }
+        return 0;
+    }
+    else
+    {
+        // COMMAND COMPLETE, SAVE DATA POINTER, DISCONNECT etc. need no response
+        return 0;
+    }
+}
+
+void scsiHostSyncNoResponse(scsi_host_sync_t *sync)
+{
+    if (sync->state == SCSIHOST_SYNC_REQUESTED)
+    {
+        sync->state = SCSIHOST_SYNC_DONE;
+        sync->period = 0;
+        sync->offset = 0;
+    }
+}
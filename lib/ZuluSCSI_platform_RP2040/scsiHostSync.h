@@ -0,0 +1,90 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2022 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Synchronous transfer negotiation (SDTR) for SCSI initiator mode.
+// This has no hardware dependencies so that it can be unit tested on PC.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// SCSI message codes used in negotiation
+#define SCSI_MSG_COMMAND_COMPLETE 0x00
+#define SCSI_MSG_EXTENDED         0x01
+#define SCSI_MSG_REJECT           0x07
+#define SCSI_MSG_IDENTIFY         0x80
+#define SCSI_EXTMSG_SDTR          0x01
+
+// Transfer period factors for SDTR message, in units of 4 ns
+#define SCSI_SYNC_PERIOD_10MB     25
+#define SCSI_SYNC_PERIOD_5MB      50
+
+// Maximum length of message that scsiHostSyncMessageIn() can generate
+#define SCSI_HOST_SYNC_MAX_MSGLEN 6
+
+enum scsi_host_sync_state_t {
+    SCSIHOST_SYNC_UNKNOWN = 0,  // Negotiation has not been done yet
+    SCSIHOST_SYNC_REQUESTED,    // SDTR has been sent, waiting for response
+    SCSIHOST_SYNC_DONE          // Negotiation complete, period and offset are valid
+};
+
+struct scsi_host_sync_t {
+    scsi_host_sync_state_t state;
+
+    // Limits of what the initiator supports
+    uint8_t min_period;
+    uint8_t max_offset;
+
+    // Negotiated values, offset 0 means asynchronous transfers
+    uint8_t period;
+    uint8_t offset;
+};
+
+// Initialize negotiation state with the initiator limits.
+// max_offset 0 disables synchronous transfers.
+void scsiHostSyncInit(scsi_host_sync_t *sync, uint8_t min_period, uint8_t max_offset);
+
+// Reset to asynchronous mode, e.g. after bus reset.
+// The limits given to scsiHostSyncInit() are kept.
+void scsiHostSyncReset(scsi_host_sync_t *sync);
+
+// Returns true if SDTR should be sent at the start of next command
+bool scsiHostSyncNeeded(const scsi_host_sync_t *sync);
+
+// Build IDENTIFY + SDTR message to send in MESSAGE OUT phase after selection.
+// msg must have space for SCSI_HOST_SYNC_MAX_MSGLEN bytes.
+// Returns number of bytes stored.
+size_t scsiHostSyncBuildRequest(scsi_host_sync_t *sync, uint8_t *msg);
+
+// Returns the total length of message based on the bytes received so far.
+// Extended messages need the first two bytes before the length is known.
+size_t scsiHostSyncMessageLength(const uint8_t *msg, size_t received);
+
+// Process a complete message received in MESSAGE IN phase.
+// If the initiator needs to respond, the response is stored in reply
+// and its length is returned. Caller should then assert ATN.
+// reply must have space for SCSI_HOST_SYNC_MAX_MSGLEN bytes.
+size_t scsiHostSyncMessageIn(scsi_host_sync_t *sync, const uint8_t *msg, size_t msglen, uint8_t *reply);
+
+// Target went to another phase without responding to SDTR.
+// Falls back to asynchronous transfers.
+void scsiHostSyncNoResponse(scsi_host_sync_t *sync);
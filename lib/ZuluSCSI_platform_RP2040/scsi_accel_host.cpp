@@ -41,12 +41,28 @@
 #define SCSI_PIO pio0
 #define SCSI_SM 0
 
+// DMA channel used for synchronous reads.
+// Shared with target mode, which is never active at the same time.
+#define SCSI_HOST_DMA_CH 0
+
 static struct {
     // PIO configurations
     uint32_t pio_offset_async_read;
     pio_sm_config pio_cfg_async_read;
+
+    // Negotiated synchronous mode, offset 0 means asynchronous
+    int syncOffset;
+    int syncPeriod;
 } g_scsi_host;
 
+// In synchronous mode the target sends up to syncOffset bytes without waiting for ACK.
+// If the PIO state machine stalls on a full RX FIFO, REQ pulses would get lost.
+// DMA drains the FIFO to this ring buffer so that interrupts or flash cache misses
+// on the CPU side do not cause stalls.
+#define SCSI_HOST_SYNC_RING_WORDS 256
+#define SCSI_HOST_SYNC_RING_BITS 10
+static uint32_t g_scsi_host_sync_ring[SCSI_HOST_SYNC_RING_WORDS] __attribute__((aligned(SCSI_HOST_SYNC_RING_WORDS * 4)));
+
 enum scsidma_state_t { SCSIHOST_IDLE = 0,
                        SCSIHOST_READ };
 static volatile scsidma_state_t g_scsi_host_state;
@@ -89,27 +105,15 @@ static void scsi_accel_host_config_gpio()
     }
 }
 
-uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, volatile int *resetFlag)
+// Read words from PIO RX FIFO in software loop.
+// This is enough for asynchronous mode, because PIO will wait for FIFO space before sending ACK.
+static uint32_t scsi_accel_host_read_fifo(uint8_t *buf, uint32_t count, uint32_t *paritycheck, volatile int *resetFlag)
 {
-    // Currently this method just reads from the PIO RX fifo directly in software loop.
-    // The SD card access is parallelized using DMA, so there is limited benefit from using DMA here.
-    g_scsi_host_state = SCSIHOST_READ;
-
     int cd_start = SCSI_IN(CD);
     int msg_start = SCSI_IN(MSG);
 
-    pio_sm_init(SCSI_PIO, SCSI_SM, g_scsi_host.pio_offset_async_read, &g_scsi_host.pio_cfg_async_read);
-    scsi_accel_host_config_gpio();
-    pio_sm_set_enabled(SCSI_PIO, SCSI_SM, true);
-
-    // Set the number of bytes to read, must be divisible by 2.
-    assert((count & 1) == 0);
-    pio_sm_put(SCSI_PIO, SCSI_SM, count - 1);
-
-    // Read results from PIO RX FIFO
     uint8_t *dst = buf;
     uint8_t *end = buf + count;
-    uint32_t paritycheck = 0;
     while (dst < end)
     {
         uint32_t available = pio_sm_get_rx_fifo_level(SCSI_PIO, SCSI_SM);
@@ -128,13 +132,109 @@ uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, vo
         {
             available--;
             uint32_t word = pio_sm_get(SCSI_PIO, SCSI_SM);
-            paritycheck ^= word;
+            *paritycheck ^= word;
             word = ~word;
             *dst++ = word & 0xFF;
             *dst++ = word >> 16;
         }
     }
 
+    return count;
+}
+
+// Read words from DMA ring buffer, used in synchronous mode.
+// Returns number of bytes received, sets *overrun if CPU was too slow to process the data.
+static uint32_t scsi_accel_host_read_dma(uint8_t *buf, uint32_t count, uint32_t *paritycheck, volatile int *resetFlag, bool *overrun)
+{
+    int cd_start = SCSI_IN(CD);
+    int msg_start = SCSI_IN(MSG);
+
+    uint32_t words = count / 2;
+    dma_channel_config cfg = dma_channel_get_default_config(SCSI_HOST_DMA_CH);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_ring(&cfg, true, SCSI_HOST_SYNC_RING_BITS);
+    channel_config_set_dreq(&cfg, pio_get_dreq(SCSI_PIO, SCSI_SM, false));
+    dma_channel_configure(SCSI_HOST_DMA_CH, &cfg, g_scsi_host_sync_ring, &SCSI_PIO->rxf[SCSI_SM], words, true);
+
+    uint8_t *dst = buf;
+    uint32_t words_done = 0;
+    *overrun = false;
+    while (words_done < words)
+    {
+        uint32_t words_received = words - dma_hw->ch[SCSI_HOST_DMA_CH].transfer_count;
+
+        if (words_received == words_done)
+        {
+            if (*resetFlag || !SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
+            {
+                // Target switched out of DATA_IN mode
+                break;
+            }
+            continue;
+        }
+
+        uint32_t batch_start = words_done;
+        while (words_done < words_received)
+        {
+            uint32_t word = g_scsi_host_sync_ring[words_done % SCSI_HOST_SYNC_RING_WORDS];
+            words_done++;
+            *paritycheck ^= word;
+            word = ~word;
+            *dst++ = word & 0xFF;
+            *dst++ = word >> 16;
+        }
+
+        // Check that DMA did not overwrite the words while we were copying them
+        uint32_t words_now = words - dma_hw->ch[SCSI_HOST_DMA_CH].transfer_count;
+        if (words_now - batch_start > SCSI_HOST_SYNC_RING_WORDS)
+        {
+            logmsg("scsi_accel_host_read: DMA ring buffer overrun at byte ", (int)(batch_start * 2));
+            *overrun = true;
+            break;
+        }
+    }
+
+    dma_channel_abort(SCSI_HOST_DMA_CH);
+    return dst - buf;
+}
+
+uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, volatile int *resetFlag)
+{
+    // In asynchronous mode this method just reads from the PIO RX fifo directly in software loop.
+    // The SD card access is parallelized using DMA, so there is limited benefit from using DMA here.
+    // Synchronous mode needs DMA to guarantee that the PIO never stalls.
+    // The same PIO program works for both, as it follows REQ edges with ACK.
+    g_scsi_host_state = SCSIHOST_READ;
+
+    // Synchronous transfers are only used in DATA IN phase
+    bool sync = (g_scsi_host.syncOffset > 0 && !SCSI_IN(CD) && !SCSI_IN(MSG));
+
+    pio_sm_init(SCSI_PIO, SCSI_SM, g_scsi_host.pio_offset_async_read, &g_scsi_host.pio_cfg_async_read);
+    scsi_accel_host_config_gpio();
+    pio_sm_set_enabled(SCSI_PIO, SCSI_SM, true);
+
+    // Set the number of bytes to read, must be divisible by 2.
+    assert((count & 1) == 0);
+    pio_sm_put(SCSI_PIO, SCSI_SM, count - 1);
+
+    // Read results from PIO RX FIFO
+    uint32_t paritycheck = 0;
+    if (sync)
+    {
+        bool overrun;
+        count = scsi_accel_host_read_dma(buf, count, &paritycheck, resetFlag, &overrun);
+        if (overrun)
+        {
+            *parityError = 1;
+        }
+    }
+    else
+    {
+        count = scsi_accel_host_read_fifo(buf, count, &paritycheck, resetFlag);
+    }
+
     // Check parity errors in whole block
     // This doesn't detect if there is even number of parity errors in block.
     uint8_t byte0 = ~(paritycheck & 0xFF);
@@ -153,10 +253,19 @@ uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, vo
     return count;
 }
 
+void scsi_accel_host_setSyncMode(int syncOffset, int syncPeriod)
+{
+    // The PIO program follows the REQ pulses from target, so no timing
+    // parameters need to be adjusted. The period is stored for diagnostics.
+    g_scsi_host.syncOffset = syncOffset;
+    g_scsi_host.syncPeriod = syncPeriod;
+}
 
 void scsi_accel_host_init()
 {
     g_scsi_host_state = SCSIHOST_IDLE;
+    g_scsi_host.syncOffset = 0;
+    g_scsi_host.syncPeriod = 0;
     scsi_accel_host_config_gpio();
 
     // Load PIO programs
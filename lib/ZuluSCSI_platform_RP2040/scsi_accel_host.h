@@ -30,3 +30,7 @@ void scsi_accel_host_init();
 // Read data from SCSI bus.
 // Number of bytes to read must be divisible by two.
 uint32_t scsi_accel_host_read(uint8_t *buf, uint32_t count, int *parityError, volatile int *resetFlag);
+
+// Set synchronous transfer parameters negotiated with the target.
+// Offset 0 selects asynchronous mode. Period is in 4 ns units as in SDTR message.
+void scsi_accel_host_setSyncMode(int syncOffset, int syncPeriod);
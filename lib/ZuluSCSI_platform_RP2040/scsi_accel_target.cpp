@@ -30,6 +30,7 @@
 #include "ZuluSCSI_platform.h"
 #include "ZuluSCSI_log.h"
 #include "scsi_accel_target.h"
+#include "scsi_sync_timing.h"
 #include <hardware/pio.h>
 #include <hardware/dma.h>
 #include <hardware/irq.h>
@@ -61,6 +62,14 @@
 // C: Lookup from g_scsi_parity_lookup and copy to scsi_accel_async_write or scsi_sync_write PIO
 // D: For sync transfers, scsi_sync_write to scsi_sync_write_pacer PIO
 //
+// Computing the parity inside a single PIO program would remove channels B and C,
+// but PIO has no XOR operation: a bit-serial loop needs ~3 instructions per data bit,
+// which both limits throughput to under 5 MB/s and does not fit in the instruction
+// memory left next to the other programs. The interpolator could form the lookup
+// addresses, but it has to be fed by the CPU for every byte. The lookup chain is
+// therefore kept, and channels B and C run at high priority so that SD card DMA on
+// the other core does not stall the byte-by-byte handoff.
+//
 // SCSI bus read acceleration uses 4 DMA channels (data flow D->C->B->A):
 // A: Bytes from scsi_read_parity PIO to memory buffer
 // B: Lookup from g_scsi_parity_check_lookup and copy to scsi_read_parity PIO
@@ -925,6 +934,7 @@ void scsi_accel_rp2040_init()
     channel_config_set_read_increment(&cfg, false);
     channel_config_set_write_increment(&cfg, false);
     channel_config_set_dreq(&cfg, pio_get_dreq(SCSI_DMA_PIO, SCSI_PARITY_SM, false));
+    cfg.ctrl |= DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS;
     g_scsi_dma.dmacfg_write_chB = cfg;
 
     // Channel C: Lookup from g_scsi_parity_lookup and copy to scsi_accel_async_write or scsi_sync_write PIO
@@ -935,6 +945,7 @@ void scsi_accel_rp2040_init()
     channel_config_set_write_increment(&cfg, false);
     channel_config_set_dreq(&cfg, pio_get_dreq(SCSI_DMA_PIO, SCSI_DATA_SM, true));
     channel_config_set_chain_to(&cfg, SCSI_DMA_CH_B);
+    cfg.ctrl |= DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS;
     g_scsi_dma.dmacfg_write_chC = cfg;
 
     // Channel D: In synchronous mode a second DMA channel is used to transfer dummy bits
@@ -1010,87 +1021,41 @@ bool scsi_accel_rp2040_setSyncMode(int syncOffset, int syncPeriod)
 
         if (syncOffset > 0)
         {
-            // Set up offset amount to PIO state machine configs.
-            // The RX fifo of scsi_sync_write has 4 slots.
-            // We can preload it with 0-3 items and set the autopush threshold 1, 2, 4 ... 32
-            // to act as a divider. This allows offsets 1 to 128 bytes.
-            // SCSI2SD code currently only uses offsets up to 15.
-            if (syncOffset <= 4)
-            {
-                g_scsi_dma.syncOffsetDivider = 1;
-                g_scsi_dma.syncOffsetPreload = 5 - syncOffset;
-            }
-            else if (syncOffset <= 8)
+            scsi_sync_timing_t timing;
+            if (!scsi_sync_timing_calc(syncOffset, syncPeriod, &timing))
             {
-                g_scsi_dma.syncOffsetDivider = 2;
-                g_scsi_dma.syncOffsetPreload = 5 - syncOffset / 2;
+                logmsg("ERROR: Unsupported sync period ", syncPeriod, " offset ", syncOffset);
+                g_scsi_dma.syncOffset = 0;
+                g_scsi_dma.syncPeriod = 0;
+                return false;
             }
-            else if (syncOffset <= 16)
-            {
-                g_scsi_dma.syncOffsetDivider = 4;
-                g_scsi_dma.syncOffsetPreload = 5 - syncOffset / 4;
-            }
-            else
-            {
-                g_scsi_dma.syncOffsetDivider = 4;
-                g_scsi_dma.syncOffsetPreload = 0;
-            }
-
-            // To properly detect when all bytes have been ACKed,
-            // we need at least one vacant slot in the FIFO.
-            if (g_scsi_dma.syncOffsetPreload > 3)
-                g_scsi_dma.syncOffsetPreload = 3;
 
+            // Set up offset amount to PIO state machine configs.
+            g_scsi_dma.syncOffsetDivider = timing.offsetDivider;
+            g_scsi_dma.syncOffsetPreload = timing.offsetPreload;
             sm_config_set_out_shift(&g_scsi_dma.pio_cfg_sync_write_pacer, true, true, g_scsi_dma.syncOffsetDivider);
             sm_config_set_in_shift(&g_scsi_dma.pio_cfg_sync_write, true, true, g_scsi_dma.syncOffsetDivider);
 
-            // Set up the timing parameters to PIO program
-            // The scsi_sync_write PIO program consists of three instructions.
-            // The delays are in clock cycles, each taking 8 ns.
-            // delay0: Delay from data write to REQ assertion
-            // delay1: Delay from REQ assert to REQ deassert
-            // delay2: Delay from REQ deassert to data write
-            int delay0, delay1, delay2;
-            int totalDelay = syncPeriod * 4 / 8;
-
-            if (syncPeriod <= 25)
-            {
-                // Fast SCSI timing: 30 ns assertion period, 25 ns skew delay
-                // The hardware rise and fall time require some extra delay,
-                // the values below are tuned based on oscilloscope measurements.
-                delay0 = 3;
-                delay1 = 5;
-                delay2 = totalDelay - delay0 - delay1 - 3;
-                if (delay2 < 0) delay2 = 0;
-                if (delay2 > 15) delay2 = 15;
-            }
-            else
-            {
-                // Slow SCSI timing: 90 ns assertion period, 55 ns skew delay
-                delay0 = 6;
-                delay1 = 12;
-                delay2 = totalDelay - delay0 - delay1 - 3;
-                if (delay2 < 0) delay2 = 0;
-                if (delay2 > 15) delay2 = 15;
-            }
-
             // Patch the delay values into the instructions in scsi_sync_write.
             // The code in scsi_accel.pio must have delay set to 0 for this to work correctly.
-            uint16_t instr0 = scsi_sync_write_program_instructions[0] | pio_encode_delay(delay0);
-            uint16_t instr1 = scsi_sync_write_program_instructions[1] | pio_encode_delay(delay1);
-            uint16_t instr2 = scsi_sync_write_program_instructions[2] | pio_encode_delay(delay2);
+            uint16_t instr0 = scsi_sync_write_program_instructions[0] | pio_encode_delay(timing.writeDelay0);
+            uint16_t instr1 = scsi_sync_write_program_instructions[1] | pio_encode_delay(timing.writeDelay1);
+            uint16_t instr2 = scsi_sync_write_program_instructions[2] | pio_encode_delay(timing.writeDelay2);
             SCSI_DMA_PIO->instr_mem[g_scsi_dma.pio_offset_sync_write + 0] = instr0;
             SCSI_DMA_PIO->instr_mem[g_scsi_dma.pio_offset_sync_write + 1] = instr1;
             SCSI_DMA_PIO->instr_mem[g_scsi_dma.pio_offset_sync_write + 2] = instr2;
 
             // And similar patching for scsi_sync_read_pacer
-            int rdelay2 = totalDelay - delay1 - 2;
-            if (rdelay2 > 15) rdelay2 = 15;
-            if (rdelay2 < 5) rdelay2 = 5;
-            uint16_t rinstr0 = scsi_sync_read_pacer_program_instructions[0] | pio_encode_delay(rdelay2);
-            uint16_t rinstr1 = (scsi_sync_read_pacer_program_instructions[1] + g_scsi_dma.pio_offset_sync_read_pacer) | pio_encode_delay(delay1);
+            uint16_t rinstr0 = scsi_sync_read_pacer_program_instructions[0] | pio_encode_delay(timing.readDelay0);
+            uint16_t rinstr1 = (scsi_sync_read_pacer_program_instructions[1] + g_scsi_dma.pio_offset_sync_read_pacer) | pio_encode_delay(timing.readDelay1);
             SCSI_DMA_PIO->instr_mem[g_scsi_dma.pio_offset_sync_read_pacer + 0] = rinstr0;
             SCSI_DMA_PIO->instr_mem[g_scsi_dma.pio_offset_sync_read_pacer + 1] = rinstr1;
+
+            if (syncPeriod <= SCSI_SYNC_PERIOD_FAST20)
+            {
+                dbgmsg("Fast-20 timing: write period ", scsi_sync_timing_write_period_ns(&timing),
+                       " ns, read period ", scsi_sync_timing_read_period_ns(&timing), " ns");
+            }
         }
     }
 
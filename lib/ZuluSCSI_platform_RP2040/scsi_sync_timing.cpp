@@ -0,0 +1,156 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "scsi_sync_timing.h"
+
+static int clamp_delay(int delay, int min)
+{
+    if (delay < min) delay = min;
+    if (delay > SCSI_SYNC_MAX_DELAY) delay = SCSI_SYNC_MAX_DELAY;
+    return delay;
+}
+
+bool scsi_sync_timing_calc(int syncOffset, int syncPeriod, scsi_sync_timing_t *timing)
+{
+    if (syncOffset <= 0 || syncPeriod < SCSI_SYNC_PERIOD_FAST20)
+    {
+        return false;
+    }
+
+    // The RX fifo of scsi_sync_write has 4 slots.
+    // We can preload it with 0-3 items and set the autopush threshold 1, 2, 4 ... 32
+    // to act as a divider. This allows offsets 1 to 128 bytes.
+    // SCSI2SD code currently only uses offsets up to 15.
+    if (syncOffset <= 4)
+    {
+        timing->offsetDivider = 1;
+        timing->offsetPreload = 5 - syncOffset;
+    }
+    else if (syncOffset <= 8)
+    {
+        timing->offsetDivider = 2;
+        timing->offsetPreload = 5 - syncOffset / 2;
+    }
+    else if (syncOffset <= 16)
+    {
+        timing->offsetDivider = 4;
+        timing->offsetPreload = 5 - syncOffset / 4;
+    }
+    else
+    {
+        timing->offsetDivider = 4;
+        timing->offsetPreload = 0;
+    }
+
+    // To properly detect when all bytes have been ACKed,
+    // we need at least one vacant slot in the FIFO.
+    if (timing->offsetPreload > 3)
+        timing->offsetPreload = 3;
+
+    // Each instruction takes one clock in addition to its delay.
+    // The scsi_sync_write program has three instructions per byte.
+    int totalDelay = syncPeriod * 4 / SCSI_SYNC_PIO_CLK_NS;
+
+    if (syncPeriod < SCSI_SYNC_PERIOD_FAST10)
+    {
+        // Fast-20 timing: 15 ns assertion and negation period, 12 ns setup time.
+        // One extra clock of setup and assertion time is added to allow for
+        // the rise and fall times, which gives 56 ns period (17.8 MB/s) at Fast-20.
+        timing->writeDelay0 = 2;
+        timing->writeDelay1 = 2;
+        timing->writeDelay2 = clamp_delay(totalDelay - timing->writeDelay0 - timing->writeDelay1 - 3, 0);
+
+        // The data read path is a chain of DMA transfers per byte, which cannot
+        // keep up with 50 ns period. The target is free to issue REQ pulses
+        // slower than the negotiated period, so reads are paced with Fast-10 timing.
+        int readTotal = SCSI_SYNC_PERIOD_FAST10 * 4 / SCSI_SYNC_PIO_CLK_NS;
+        timing->readDelay1 = 5;
+        timing->readDelay0 = clamp_delay(readTotal - timing->readDelay1 - 2, 5);
+        return true;
+    }
+    else if (syncPeriod == SCSI_SYNC_PERIOD_FAST10)
+    {
+        // Fast SCSI timing: 30 ns assertion period, 25 ns skew delay
+        // The hardware rise and fall time require some extra delay,
+        // the values below are tuned based on oscilloscope measurements.
+        timing->writeDelay0 = 3;
+        timing->writeDelay1 = 5;
+    }
+    else
+    {
+        // Slow SCSI timing: 90 ns assertion period, 55 ns skew delay
+        timing->writeDelay0 = 6;
+        timing->writeDelay1 = 12;
+    }
+
+    // Remaining time goes to the negation period. For very slow periods
+    // the delay field overflows, and the rest is added to the setup time.
+    int remain = totalDelay - timing->writeDelay0 - timing->writeDelay1 - 3;
+    timing->writeDelay2 = clamp_delay(remain, 0);
+    timing->writeDelay0 = clamp_delay(timing->writeDelay0 + remain - timing->writeDelay2, timing->writeDelay0);
+
+    // The read pacer has two instructions per byte.
+    // Similarly extend the REQ assertion time if the deasserted time overflows.
+    timing->readDelay1 = timing->writeDelay1;
+    remain = totalDelay - timing->readDelay1 - 2;
+    timing->readDelay0 = clamp_delay(remain, 5);
+    timing->readDelay1 = clamp_delay(timing->readDelay1 + remain - timing->readDelay0, timing->readDelay1);
+    return true;
+}
+
+int scsi_sync_timing_period_ns(int syncPeriod)
+{
+    if (syncPeriod == SCSI_SYNC_PERIOD_FAST20)
+        return 50;
+    else
+        return syncPeriod * 4;
+}
+
+int scsi_sync_timing_write_period_ns(const scsi_sync_timing_t *timing)
+{
+    return (3 + timing->writeDelay0 + timing->writeDelay1 + timing->writeDelay2) * SCSI_SYNC_PIO_CLK_NS;
+}
+
+int scsi_sync_timing_write_setup_ns(const scsi_sync_timing_t *timing)
+{
+    return (1 + timing->writeDelay0) * SCSI_SYNC_PIO_CLK_NS;
+}
+
+int scsi_sync_timing_write_assert_ns(const scsi_sync_timing_t *timing)
+{
+    return (1 + timing->writeDelay1) * SCSI_SYNC_PIO_CLK_NS;
+}
+
+int scsi_sync_timing_write_negate_ns(const scsi_sync_timing_t *timing)
+{
+    return (2 + timing->writeDelay2 + timing->writeDelay0) * SCSI_SYNC_PIO_CLK_NS;
+}
+
+int scsi_sync_timing_read_period_ns(const scsi_sync_timing_t *timing)
+{
+    return (2 + timing->readDelay0 + timing->readDelay1) * SCSI_SYNC_PIO_CLK_NS;
+}
+
+int scsi_sync_timing_max_offset(const scsi_sync_timing_t *timing)
+{
+    // Bytes that can be sent before the RX fifo of scsi_sync_write fills up
+    return (4 - timing->offsetPreload + 1) * timing->offsetDivider;
+}
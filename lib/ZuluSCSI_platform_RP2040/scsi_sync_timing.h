@@ -0,0 +1,77 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Timing calculation for synchronous SCSI transfers in target mode.
+// Converts the negotiated SDTR period and offset into the FIFO settings
+// and instruction delays of the scsi_sync_write and scsi_sync_read_pacer
+// PIO programs. Kept separate from the hardware code so that it can be
+// tested on the build machine.
+
+#pragma once
+
+#include <stdint.h>
+
+// PIO runs at the 125 MHz system clock
+#define SCSI_SYNC_PIO_CLK_NS 8
+
+// Maximum delay field value with one side set bit
+#define SCSI_SYNC_MAX_DELAY 15
+
+// SDTR period factors, in units of 4 ns except for Fast-20 which is defined as 50 ns
+#define SCSI_SYNC_PERIOD_FAST20 12
+#define SCSI_SYNC_PERIOD_FAST10 25
+#define SCSI_SYNC_PERIOD_FAST5  50
+
+struct scsi_sync_timing_t
+{
+    // Autopush/autopull threshold and RX fifo preload for the offset counter
+    int offsetDivider;
+    int offsetPreload;
+
+    // scsi_sync_write delays in PIO clocks:
+    // delay0: Delay from data write to REQ assertion
+    // delay1: Delay from REQ assert to REQ deassert
+    // delay2: Delay from REQ deassert to data write
+    int writeDelay0;
+    int writeDelay1;
+    int writeDelay2;
+
+    // scsi_sync_read_pacer delays in PIO clocks:
+    // delay0: REQ deasserted time
+    // delay1: REQ asserted time
+    int readDelay0;
+    int readDelay1;
+};
+
+// Calculate the PIO settings for given negotiated offset and period factor.
+// Returns false if the parameters are not supported.
+bool scsi_sync_timing_calc(int syncOffset, int syncPeriod, scsi_sync_timing_t *timing);
+
+// Nominal transfer period in nanoseconds for a SDTR period factor
+int scsi_sync_timing_period_ns(int syncPeriod);
+
+// Resulting bus timing in nanoseconds, for verifying the calculated values
+int scsi_sync_timing_write_period_ns(const scsi_sync_timing_t *timing);
+int scsi_sync_timing_write_setup_ns(const scsi_sync_timing_t *timing);
+int scsi_sync_timing_write_assert_ns(const scsi_sync_timing_t *timing);
+int scsi_sync_timing_write_negate_ns(const scsi_sync_timing_t *timing);
+int scsi_sync_timing_read_period_ns(const scsi_sync_timing_t *timing);
+int scsi_sync_timing_max_offset(const scsi_sync_timing_t *timing);
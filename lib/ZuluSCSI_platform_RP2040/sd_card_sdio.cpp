@@ -27,7 +27,10 @@
 
 #include "ZuluSCSI_log.h"
 #include "sdio.h"
+#include "sdio_crc.h"
+#include "sdio_session.h"
 #include <hardware/gpio.h>
+#include <hardware/clocks.h>
 #include <SdFat.h>
 #include <SdCard/SdCardInfo.h>
 
@@ -40,6 +43,19 @@ static sdio_status_t g_sdio_error;
 static uint32_t g_sdio_dma_buf[128];
 static uint32_t g_sdio_sector_count;
 
+// High speed mode is tried at every card initialization, unless
+// it has been found unreliable with this card.
+static bool g_sdio_high_speed;
+static bool g_sdio_high_speed_failed;
+static uint32_t g_sdio_high_speed_failed_psn; // Serial number of the failed card
+
+// Allocation unit information from SD Status register (ACMD13)
+static uint32_t g_sdio_au_size; // Allocation unit size in bytes, 0 if not reported
+static uint8_t g_sdio_speed_class;
+
+// Number of sectors read for verifying the bus speed
+#define SDIO_SPEED_TEST_SECTORS 16
+
 #define checkReturnOk(call) ((g_sdio_error = (call)) == SDIO_OK ? true : logSDError(__LINE__))
 static bool logSDError(int line)
 {
@@ -48,6 +64,18 @@ static bool logSDError(int line)
     return false;
 }
 
+// Consecutive writeSectors() calls continue the same CMD25 write,
+// see sdio_session.h. Other card accesses must close the session first.
+static sdio_session_t g_sdio_session;
+static bool sdio_session_start_write(uint32_t sector);
+static bool sdio_session_send_blocks(uint32_t sector, const uint8_t *src, uint32_t num_blocks);
+static bool sdio_session_stop();
+static const sdio_session_ops_t g_sdio_session_ops = {
+    sdio_session_start_write,
+    sdio_session_send_blocks,
+    sdio_session_stop
+};
+
 // Callback used by SCSI code for simultaneous processing
 static sd_callback_t m_stream_callback;
 static const uint8_t *m_stream_buffer;
@@ -84,10 +112,131 @@ static sd_callback_t get_stream_callback(const uint8_t *buf, uint32_t count, con
     return NULL;
 }
 
+// Read the first sectors of the card and combine their checksums.
+// Used for verifying that data reads correctly after a bus speed change.
+static bool sdio_read_fingerprint(SdioCard *card, uint64_t *fingerprint)
+{
+    *fingerprint = 0;
+    for (uint32_t i = 0; i < SDIO_SPEED_TEST_SECTORS; i++)
+    {
+        if (!card->readSector(i, (uint8_t*)g_sdio_dma_buf))
+        {
+            return false;
+        }
+
+        uint64_t crc = sdio_crc16_4bit_checksum(g_sdio_dma_buf, SDIO_WORDS_PER_BLOCK);
+        *fingerprint = ((*fingerprint << 1) | (*fingerprint >> 63)) ^ crc;
+    }
+    return true;
+}
+
+// Switch card to high speed mode using CMD6 and verify that reads work.
+// Returns false if card does not support high speed mode.
+// Returns true if card was switched, and g_sdio_high_speed tells if
+// the verification succeeded.
+static bool sdio_switch_high_speed(SdioCard *card)
+{
+    uint64_t expected;
+    if (!sdio_read_fingerprint(card, &expected))
+    {
+        return false;
+    }
+
+    // Query function group 1 (access mode), function 1 is high speed.
+    // Support bits for group 1 are in status bits 415:400.
+    uint8_t *status = (uint8_t*)g_sdio_dma_buf;
+    if (!card->cardCMD6(0x00FFFFF1, status) || !(status[13] & 0x02))
+    {
+        dbgmsg("SD card does not support high speed mode");
+        return false;
+    }
+
+    // Perform the switch, selected function is returned in bits 379:376
+    if (!card->cardCMD6(0x80FFFFF1, status) || (status[16] & 0x0F) != 1)
+    {
+        dbgmsg("SD card failed to switch to high speed mode");
+        return false;
+    }
+
+    rp2040_sdio_init(1, true);
+
+    // Checksums of each block are verified during reception,
+    // and the data must match what was read at default speed.
+    uint64_t fingerprint;
+    g_sdio_high_speed = sdio_read_fingerprint(card, &fingerprint) && fingerprint == expected;
+    return true;
+}
+
+// Read SD Status register and store the allocation unit size.
+// Card works without this information, so failure is not fatal.
+static bool sdio_read_sd_status()
+{
+    // AU_SIZE field values 1 to 15, in kilobytes
+    static const uint32_t au_sizes_kb[16] = {
+        0, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096,
+        8192, 12288, 16384, 24576, 32768, 65536
+    };
+
+    SdStatus *status = (SdStatus*)g_sdio_dma_buf;
+    uint32_t reply;
+    if (!checkReturnOk(rp2040_sdio_command_R1(CMD55, g_sdio_rca, &reply)) || // APP_CMD
+        !checkReturnOk(rp2040_sdio_rx_start((uint8_t*)g_sdio_dma_buf, 1, 64)) ||
+        !checkReturnOk(rp2040_sdio_command_R1(ACMD13, 0, &reply))) // SD_STATUS
+    {
+        rp2040_sdio_stop();
+        return false;
+    }
+
+    do {
+        g_sdio_error = rp2040_sdio_rx_poll();
+    } while (g_sdio_error == SDIO_BUSY);
+
+    if (g_sdio_error != SDIO_OK)
+    {
+        dbgmsg("SDIO failed to read SD status: ", (int)g_sdio_error);
+        rp2040_sdio_stop();
+        return false;
+    }
+
+    g_sdio_au_size = au_sizes_kb[status->auSize >> 4] * 1024;
+    g_sdio_speed_class = status->speedClass;
+
+    // Erase timing is reported for information only, writes do not use pre-erase
+    uint32_t erase_size = ((uint32_t)status->eraseSize[0] << 8) | status->eraseSize[1];
+    uint32_t erase_timeout = status->eraseTimeoutOffset >> 2;
+    uint32_t erase_offset = status->eraseTimeoutOffset & 3;
+    dbgmsg("SD card allocation unit ", (int)(g_sdio_au_size / 1024), " kB, speed class code ", (int)g_sdio_speed_class,
+           ", erase ", (int)erase_size, " AU in ", (int)erase_timeout, " + ", (int)erase_offset, " s");
+    return true;
+}
+
+// Check if an error is caused by data corruption in high speed mode.
+// The caller should reinitialize the card, after which it runs in default speed.
+static bool sdio_need_speed_fallback()
+{
+    if (g_sdio_high_speed &&
+        (g_sdio_error == SDIO_ERR_DATA_CRC ||
+         g_sdio_error == SDIO_ERR_WRITE_CRC ||
+         g_sdio_error == SDIO_ERR_RESPONSE_CRC))
+    {
+        logmsg("SD card CRC error in high speed mode, switching to default speed");
+        g_sdio_high_speed_failed = true;
+        g_sdio_high_speed_failed_psn = g_sdio_cid.psn();
+        return true;
+    }
+
+    return false;
+}
+
 bool SdioCard::begin(SdioConfig sdioConfig)
 {
     uint32_t reply;
     sdio_status_t status;
+
+    sdio_session_init(&g_sdio_session, &g_sdio_session_ops);
+    g_sdio_high_speed = false;
+    g_sdio_au_size = 0;
+    g_sdio_speed_class = 0;
     
     // Initialize at 1 MHz clock speed
     rp2040_sdio_init(25);
@@ -136,6 +285,12 @@ bool SdioCard::begin(SdioConfig sdioConfig)
         return false;
     }
 
+    if (g_sdio_high_speed_failed && g_sdio_cid.psn() != g_sdio_high_speed_failed_psn)
+    {
+        // Different card has been inserted, try high speed mode again
+        g_sdio_high_speed_failed = false;
+    }
+
     // Get relative card address
     if (!checkReturnOk(rp2040_sdio_command_R1(CMD3, 0, &g_sdio_rca)))
     {
@@ -167,9 +322,31 @@ bool SdioCard::begin(SdioConfig sdioConfig)
         return false;
     }
 
+    // Set block length once here, it stays valid until the card is reinitialized.
+    if (!checkReturnOk(rp2040_sdio_command_R1(16, 512, &reply))) // SET_BLOCKLEN
+    {
+        dbgmsg("SDIO failed to set block length");
+        return false;
+    }
+
     // Increase to 25 MHz clock rate
     rp2040_sdio_init(1);
 
+    if (!g_sdio_high_speed_failed && sdio_switch_high_speed(this))
+    {
+        if (!g_sdio_high_speed)
+        {
+            // Card was switched but data did not read correctly.
+            // CMD0 in the new initialization returns it to default speed.
+            logmsg("SD card high speed mode failed verification, using default speed");
+            g_sdio_high_speed_failed = true;
+            g_sdio_high_speed_failed_psn = g_sdio_cid.psn();
+            return begin(sdioConfig);
+        }
+    }
+
+    sdio_read_sd_status();
+
     return true;
 }
 
@@ -188,14 +365,55 @@ uint32_t SdioCard::errorLine() const
     return g_sdio_error_line;
 }
 
-bool SdioCard::isBusy() 
+static bool sdio_is_busy()
 {
     return (sio_hw->gpio_in & (1 << SDIO_D0)) == 0;
 }
 
+bool SdioCard::isBusy() 
+{
+    return sdio_is_busy();
+}
+
+static uint32_t sdio_clock_khz()
+{
+    uint32_t pio_clkdiv = g_sdio_high_speed ? SDIO_PIO_CLKDIV_HS : SDIO_PIO_CLKDIV;
+    return clock_get_hz(clk_sys) / 1000 / pio_clkdiv;
+}
+
 uint32_t SdioCard::kHzSdClk()
 {
-    return 0;
+    return sdio_clock_khz();
+}
+
+void platform_get_sd_bus_info(bool *high_speed, uint32_t *clock_khz)
+{
+    *high_speed = g_sdio_high_speed;
+    *clock_khz = sdio_clock_khz();
+}
+
+void platform_get_sd_write_sizes(uint32_t *min_size, uint32_t *max_size, uint32_t *last_size, uint32_t *au_size)
+{
+    *min_size = PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE;
+    *max_size = PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE;
+    *last_size = PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE;
+    *au_size = g_sdio_au_size;
+
+    // Writes should not cross allocation unit boundaries
+    if (g_sdio_au_size != 0 && g_sdio_au_size < *max_size)
+    {
+        *max_size = g_sdio_au_size;
+    }
+
+    // Slow cards (speed class 0 and 2) have long busy periods between
+    // writes, so it is better to always use the largest writes.
+    if (g_sdio_au_size != 0 && g_sdio_speed_class < 2)
+    {
+        *min_size = *max_size;
+    }
+
+    if (*min_size > *max_size) *min_size = *max_size;
+    if (*last_size > *max_size) *last_size = *max_size;
 }
 
 bool SdioCard::readCID(cid_t* cid)
@@ -214,6 +432,9 @@ bool SdioCard::readOCR(uint32_t* ocr)
 {
     // SDIO mode does not have CMD58, but main program uses this to
     // poll for card presence. Return status register instead.
+    // This is also called when the card is otherwise idle, which is a good
+    // time to finish any open write.
+    sdio_session_close(&g_sdio_session);
     return checkReturnOk(rp2040_sdio_command_R1(CMD13, g_sdio_rca, ocr));
 }
 
@@ -242,6 +463,8 @@ uint32_t SdioCard::sectorCount()
 
 uint32_t SdioCard::status()
 {
+    sdio_session_close(&g_sdio_session);
+
     uint32_t reply;
     if (checkReturnOk(rp2040_sdio_command_R1(CMD13, g_sdio_rca, &reply)))
         return reply;
@@ -249,7 +472,7 @@ uint32_t SdioCard::status()
         return 0;
 }
 
-bool SdioCard::stopTransmission(bool blocking)
+static bool sdio_stop_transmission(bool blocking)
 {
     uint32_t reply;
     if (!checkReturnOk(rp2040_sdio_command_R1(CMD12, 0, &reply)))
@@ -264,14 +487,14 @@ bool SdioCard::stopTransmission(bool blocking)
     else
     {
         uint32_t end = millis() + 5000;
-        while (millis() < end && isBusy())
+        while (millis() < end && sdio_is_busy())
         {
             if (m_stream_callback)
             {
                 m_stream_callback(m_stream_count);
             }
         }
-        if (isBusy())
+        if (sdio_is_busy())
         {
             logmsg("SdioCard::stopTransmission() timeout");
             return false;
@@ -283,9 +506,14 @@ bool SdioCard::stopTransmission(bool blocking)
     }
 }
 
+bool SdioCard::stopTransmission(bool blocking)
+{
+    return sdio_stop_transmission(blocking);
+}
+
 bool SdioCard::syncDevice()
 {
-    return true;
+    return sdio_session_close(&g_sdio_session);
 }
 
 uint8_t SdioCard::type() const
@@ -320,9 +548,45 @@ bool SdioCard::erase(uint32_t firstSector, uint32_t lastSector)
     return false;
 }
 
-bool SdioCard::cardCMD6(uint32_t arg, uint8_t* status) {
-    logmsg("SdioCard::cardCMD6() not implemented");
-    return false;
+bool SdioCard::cardCMD6(uint32_t arg, uint8_t* status)
+{
+    if (!sdio_session_close(&g_sdio_session))
+    {
+        return false;
+    }
+
+    // Switch function status is returned as one 64 byte data block
+    uint8_t *dst = status;
+    if (((uint32_t)dst & 3) != 0)
+    {
+        dst = (uint8_t*)g_sdio_dma_buf;
+    }
+
+    uint32_t reply;
+    if (!checkReturnOk(rp2040_sdio_rx_start(dst, 1, 64)) ||
+        !checkReturnOk(rp2040_sdio_command_R1(CMD6, arg, &reply))) // SWITCH_FUNC
+    {
+        rp2040_sdio_stop();
+        return false;
+    }
+
+    do {
+        g_sdio_error = rp2040_sdio_rx_poll();
+    } while (g_sdio_error == SDIO_BUSY);
+
+    if (g_sdio_error != SDIO_OK)
+    {
+        logmsg("SdioCard::cardCMD6(", arg, ") failed: ", (int)g_sdio_error);
+        rp2040_sdio_stop();
+        return false;
+    }
+
+    if (dst != status)
+    {
+        memcpy(status, dst, 64);
+    }
+
+    return true;
 }
 
 bool SdioCard::readSCR(scr_t* scr) {
@@ -341,6 +605,11 @@ bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
         src = (uint8_t*)g_sdio_dma_buf;
     }
 
+    if (!sdio_session_close(&g_sdio_session))
+    {
+        return false;
+    }
+
     // If possible, report transfer status to application through callback.
     sd_callback_t callback = get_stream_callback(src, 512, "writeSector", sector);
 
@@ -348,8 +617,7 @@ bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
     uint32_t address = (type() == SD_CARD_TYPE_SDHC) ? sector : (sector * 512);
 
     uint32_t reply;
-    if (!checkReturnOk(rp2040_sdio_command_R1(16, 512, &reply)) || // SET_BLOCKLEN
-        !checkReturnOk(rp2040_sdio_command_R1(CMD24, address, &reply)) || // WRITE_BLOCK
+    if (!checkReturnOk(rp2040_sdio_command_R1(CMD24, address, &reply)) || // WRITE_BLOCK
         !checkReturnOk(rp2040_sdio_tx_start(src, 1))) // Start transmission
     {
         return false;
@@ -368,9 +636,15 @@ bool SdioCard::writeSector(uint32_t sector, const uint8_t* src)
     if (g_sdio_error != SDIO_OK)
     {
         logmsg("SdioCard::writeSector(", sector, ") failed: ", (int)g_sdio_error);
+
+        if (sdio_need_speed_fallback())
+        {
+            begin(SdioConfig(DMA_SDIO));
+        }
+        return false;
     }
 
-    return g_sdio_error == SDIO_OK;
+    return true;
 }
 
 bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
@@ -388,17 +662,34 @@ bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
         return true;
     }
 
-    sd_callback_t callback = get_stream_callback(src, n * 512, "writeSectors", sector);
+    if (!sdio_session_write(&g_sdio_session, sector, src, n))
+    {
+        if (sdio_need_speed_fallback())
+        {
+            begin(SdioConfig(DMA_SDIO));
+        }
+        return false;
+    }
+
+    return true;
+}
 
+// Start open-ended multiple block write.
+// Without preceding ACMD23 the write continues until CMD12.
+static bool sdio_session_start_write(uint32_t sector)
+{
     // Cards up to 2GB use byte addressing, SDHC cards use sector addressing
-    uint32_t address = (type() == SD_CARD_TYPE_SDHC) ? sector : (sector * 512);
+    uint32_t address = (g_sdio_ocr & (1 << 30)) ? sector : (sector * 512);
 
     uint32_t reply;
-    if (!checkReturnOk(rp2040_sdio_command_R1(16, 512, &reply)) || // SET_BLOCKLEN
-        !checkReturnOk(rp2040_sdio_command_R1(CMD55, g_sdio_rca, &reply)) || // APP_CMD
-        !checkReturnOk(rp2040_sdio_command_R1(ACMD23, n, &reply)) || // SET_WR_CLK_ERASE_COUNT
-        !checkReturnOk(rp2040_sdio_command_R1(CMD25, address, &reply)) || // WRITE_MULTIPLE_BLOCK
-        !checkReturnOk(rp2040_sdio_tx_start(src, n))) // Start transmission
+    return checkReturnOk(rp2040_sdio_command_R1(CMD25, address, &reply)); // WRITE_MULTIPLE_BLOCK
+}
+
+static bool sdio_session_send_blocks(uint32_t sector, const uint8_t *src, uint32_t num_blocks)
+{
+    sd_callback_t callback = get_stream_callback(src, num_blocks * 512, "writeSectors", sector);
+
+    if (!checkReturnOk(rp2040_sdio_tx_start(src, num_blocks))) // Start transmission
     {
         return false;
     }
@@ -415,20 +706,27 @@ bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
 
     if (g_sdio_error != SDIO_OK)
     {
-        logmsg("SdioCard::writeSectors(", sector, ",...,", (int)n, ") failed: ", (int)g_sdio_error);
-        stopTransmission(true);
+        logmsg("SdioCard::writeSectors(", sector, ",...,", (int)num_blocks, ") failed: ", (int)g_sdio_error);
         return false;
     }
-    else
-    {
-        // TODO: Instead of CMD12 stopTransmission command, according to SD spec we should send stopTran token.
-        // stopTransmission seems to work in practice.
-        return stopTransmission(true);
-    }
+
+    return true;
+}
+
+static bool sdio_session_stop()
+{
+    // TODO: Instead of CMD12 stopTransmission command, according to SD spec we should send stopTran token.
+    // stopTransmission seems to work in practice.
+    return sdio_stop_transmission(true);
 }
 
 bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
 {
+    if (!sdio_session_close(&g_sdio_session))
+    {
+        return false;
+    }
+
     uint8_t *real_dst = dst;
     if (((uint32_t)dst & 3) != 0)
     {
@@ -442,8 +740,7 @@ bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
     uint32_t address = (type() == SD_CARD_TYPE_SDHC) ? sector : (sector * 512);
 
     uint32_t reply;
-    if (!checkReturnOk(rp2040_sdio_command_R1(16, 512, &reply)) || // SET_BLOCKLEN
-        !checkReturnOk(rp2040_sdio_rx_start(dst, 1)) || // Prepare for reception
+    if (!checkReturnOk(rp2040_sdio_rx_start(dst, 1)) || // Prepare for reception
         !checkReturnOk(rp2040_sdio_command_R1(CMD17, address, &reply))) // READ_SINGLE_BLOCK
     {
         return false;
@@ -459,21 +756,32 @@ bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
         }
     } while (g_sdio_error == SDIO_BUSY);
 
-    if (g_sdio_error != SDIO_OK)
+    if (dst != real_dst)
     {
-        logmsg("SdioCard::readSector(", sector, ") failed: ", (int)g_sdio_error);
+        memcpy(real_dst, g_sdio_dma_buf, sizeof(g_sdio_dma_buf));
     }
 
-    if (dst != real_dst)
+    if (g_sdio_error != SDIO_OK)
     {
-        memcpy(real_dst, g_sdio_dma_buf, sizeof(g_sdio_dma_buf));
+        logmsg("SdioCard::readSector(", sector, ") failed: ", (int)g_sdio_error);
+
+        if (sdio_need_speed_fallback())
+        {
+            begin(SdioConfig(DMA_SDIO));
+        }
+        return false;
     }
 
-    return g_sdio_error == SDIO_OK;
+    return true;
 }
 
 bool SdioCard::readSectors(uint32_t sector, uint8_t* dst, size_t n)
 {
+    if (!sdio_session_close(&g_sdio_session))
+    {
+        return false;
+    }
+
     if (((uint32_t)dst & 3) != 0 || sector + n >= g_sdio_sector_count)
     {
         // Unaligned read or end-of-drive read, execute sector-by-sector
@@ -493,8 +801,7 @@ bool SdioCard::readSectors(uint32_t sector, uint8_t* dst, size_t n)
     uint32_t address = (type() == SD_CARD_TYPE_SDHC) ? sector : (sector * 512);
 
     uint32_t reply;
-    if (!checkReturnOk(rp2040_sdio_command_R1(16, 512, &reply)) || // SET_BLOCKLEN
-        !checkReturnOk(rp2040_sdio_rx_start(dst, n)) || // Prepare for reception
+    if (!checkReturnOk(rp2040_sdio_rx_start(dst, n)) || // Prepare for reception
         !checkReturnOk(rp2040_sdio_command_R1(CMD18, address, &reply))) // READ_MULTIPLE_BLOCK
     {
         return false;
@@ -514,6 +821,11 @@ bool SdioCard::readSectors(uint32_t sector, uint8_t* dst, size_t n)
     {
         logmsg("SdioCard::readSectors(", sector, ",...,", (int)n, ") failed: ", (int)g_sdio_error);
         stopTransmission(true);
+
+        if (sdio_need_speed_fallback())
+        {
+            begin(SdioConfig(DMA_SDIO));
+        }
         return false;
     }
     else
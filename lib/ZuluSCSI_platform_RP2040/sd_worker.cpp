@@ -0,0 +1,214 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "sd_worker.h"
+#include "spsc_queue.h"
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_log.h"
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+
+#define SD_WORKER_QUEUE_SIZE 4
+
+// SdFat and SDIO driver call chain needs more than the default 2 kB core1 stack
+#define SD_WORKER_STACK_SIZE 8192
+static uint32_t g_sd_worker_stack[SD_WORKER_STACK_SIZE / 4];
+
+static SPSCQueue<sd_worker_request_t, SD_WORKER_QUEUE_SIZE> g_sd_worker_requests;
+static SPSCQueue<sd_worker_completion_t, SD_WORKER_QUEUE_SIZE> g_sd_worker_completions;
+
+static struct {
+    bool running;
+
+    // Number of completed requests, written by core0
+    uint32_t completed;
+
+    // Progress of the request currently executing on core1.
+    // The sequence number tells which request the byte count belongs to.
+    volatile uint32_t active_seq;
+    volatile uint32_t active_bytes;
+
+    // Handshake for keeping core1 out of flash while it is written
+    volatile bool pause_request;
+    volatile bool paused;
+} g_sd_worker;
+
+// Wait in RAM with interrupts disabled until core0 has finished writing flash
+__attribute__((section(".time_critical.sd_worker_pause_loop")))
+static void sd_worker_pause_loop()
+{
+    uint32_t saved_irq = save_and_disable_interrupts();
+    g_sd_worker.paused = true;
+    __sev();
+
+    while (g_sd_worker.pause_request)
+    {
+        __wfe();
+    }
+
+    g_sd_worker.paused = false;
+    __sev();
+    restore_interrupts(saved_irq);
+}
+
+// Execute function pointers that audio code passes through the FIFO.
+// Each function takes no parameters and operates via side-effects only.
+static void sd_worker_run_fifo()
+{
+    while (multicore_fifo_rvalid())
+    {
+        void (*function)() = (void (*)()) multicore_fifo_pop_blocking();
+        (*function)();
+    }
+}
+
+// Called by the SD card driver on core1 during transfer
+static void sd_worker_progress(uint32_t bytes_complete)
+{
+    g_sd_worker.active_bytes = bytes_complete;
+
+    // Long transfers must not block audio processing
+    sd_worker_run_fifo();
+}
+
+static void sd_worker_core1_main()
+{
+    uint32_t seq = 0;
+    while (1)
+    {
+        if (g_sd_worker.pause_request)
+        {
+            sd_worker_pause_loop();
+        }
+
+        sd_worker_run_fifo();
+
+        sd_worker_request_t request;
+        if (!g_sd_worker_requests.pop(&request))
+        {
+            // Both the FIFO and sd_worker_submit() signal an event
+            __wfe();
+            continue;
+        }
+
+        g_sd_worker.active_bytes = 0;
+        g_sd_worker.active_seq = ++seq;
+
+        sd_worker_completion_t completion;
+        platform_set_sd_callback(&sd_worker_progress, request.buffer);
+        if (request.op == SD_WORKER_READ)
+        {
+            completion.result = request.file->read(request.buffer, request.count);
+        }
+        else
+        {
+            completion.result = request.file->write(request.buffer, request.count);
+        }
+        platform_set_sd_callback(NULL, NULL);
+
+        // Core0 never has more requests outstanding than fit in the completion queue
+        while (!g_sd_worker_completions.push(completion));
+        __sev();
+    }
+}
+
+void sd_worker_init()
+{
+    logmsg("Starting Core1 for SD card access");
+    g_sd_worker.completed = 0;
+    g_sd_worker.active_seq = 0;
+    g_sd_worker.active_bytes = 0;
+    g_sd_worker.pause_request = false;
+    g_sd_worker.paused = false;
+    multicore_launch_core1_with_stack(sd_worker_core1_main, g_sd_worker_stack, sizeof(g_sd_worker_stack));
+    g_sd_worker.running = true;
+}
+
+void sd_worker_pause()
+{
+    if (!g_sd_worker.running)
+    {
+        return;
+    }
+
+    g_sd_worker.pause_request = true;
+    __sev();
+    while (!g_sd_worker.paused)
+    {
+        __wfe();
+    }
+}
+
+void sd_worker_resume()
+{
+    if (!g_sd_worker.running)
+    {
+        return;
+    }
+
+    g_sd_worker.pause_request = false;
+    __sev();
+    while (g_sd_worker.paused)
+    {
+        __wfe();
+    }
+}
+
+bool sd_worker_is_running()
+{
+    return g_sd_worker.running;
+}
+
+bool sd_worker_submit(const sd_worker_request_t &request)
+{
+    if (!g_sd_worker.running || !g_sd_worker_requests.push(request))
+    {
+        return false;
+    }
+
+    __sev();
+    return true;
+}
+
+bool sd_worker_poll(uint32_t *bytes_done, sd_worker_completion_t *result)
+{
+    if (g_sd_worker_completions.pop(result))
+    {
+        g_sd_worker.completed++;
+        return true;
+    }
+
+    // Read sequence number before and after the byte count, so that
+    // a request change in between is detected.
+    uint32_t seq = g_sd_worker.active_seq;
+    uint32_t bytes = g_sd_worker.active_bytes;
+    if (seq == g_sd_worker.completed + 1 && g_sd_worker.active_seq == seq)
+    {
+        *bytes_done = bytes;
+    }
+    else
+    {
+        // Oldest request has not started yet
+        *bytes_done = 0;
+    }
+
+    return false;
+}
@@ -0,0 +1,75 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Storage I/O worker running on the second core.
+//
+// Image file reads and writes are passed to core1 through a request queue,
+// and results come back through a completion queue. While the request is
+// running, core0 polls the number of bytes transferred so far and keeps
+// the SCSI bus transfer going in parallel.
+//
+// SdFat is not thread safe, so core0 must not access the SD card while
+// a request is in progress. Callers wait for the completion before doing
+// any other file operations.
+
+#pragma once
+
+#include <stdint.h>
+#include "ImageBackingStore.h"
+
+enum sd_worker_op_t {
+    SD_WORKER_READ,
+    SD_WORKER_WRITE
+};
+
+struct sd_worker_request_t {
+    sd_worker_op_t op;
+    ImageBackingStore *file;
+    uint8_t *buffer;
+    uint32_t count;
+};
+
+struct sd_worker_completion_t {
+    ssize_t result; // Return value of read() or write()
+};
+
+// Launch core1 to process storage requests and the function calls
+// that audio code passes through the multicore FIFO.
+void sd_worker_init();
+
+// Stop core1 from executing code in flash, so that flash can be written.
+// Waits for the current request to finish, after which core1 waits in RAM
+// with interrupts disabled until sd_worker_resume() is called.
+void sd_worker_pause();
+void sd_worker_resume();
+
+// Check if worker is running and can accept requests
+bool sd_worker_is_running();
+
+// Queue a request for core1. Returns false if worker is not running
+// or request queue is full.
+bool sd_worker_submit(const sd_worker_request_t &request);
+
+// Check for request completion.
+// Returns true and fills in result when the oldest request has finished.
+// Otherwise returns false and stores the number of bytes transferred
+// so far in bytes_done.
+bool sd_worker_poll(uint32_t *bytes_done, sd_worker_completion_t *result);
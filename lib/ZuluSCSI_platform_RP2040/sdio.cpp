@@ -30,6 +30,7 @@
 // "SDIO Physical Layer Simplified Specification Version 8.00"
 
 #include "sdio.h"
+#include "sdio_crc.h"
 #include <hardware/pio.h>
 #include <hardware/dma.h>
 #include <hardware/gpio.h>
@@ -65,6 +66,7 @@ static struct {
     sdio_transfer_state_t transfer_state;
     uint32_t transfer_start_time;
     uint32_t *data_buf;
+    uint32_t block_size; // Size of received blocks in bytes
     uint32_t blocks_done; // Number of blocks transferred so far
     uint32_t total_blocks; // Total number of blocks to transfer
     uint32_t blocks_checksumed; // Number of blocks that have had CRC calculated
@@ -118,44 +120,6 @@ static const uint8_t crc7_table[256] = {
 	0x1c, 0x0e, 0x38, 0x2a, 0x54, 0x46, 0x70, 0x62,	0x8c, 0x9e, 0xa8, 0xba, 0xc4, 0xd6, 0xe0, 0xf2
 };
 
-// Calculate the CRC16 checksum for parallel 4 bit lines separately.
-// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
-// is applied to each line separately and generates total of
-// 4 x 16 = 64 bits of checksum.
-__attribute__((optimize("O3")))
-uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
-{
-    uint64_t crc = 0;
-    uint32_t *end = data + num_words;
-    while (data < end)
-    {
-        for (int unroll = 0; unroll < 4; unroll++)
-        {
-            // Each 32-bit word contains 8 bits per line.
-            // Reverse the bytes because SDIO protocol is big-endian.
-            uint32_t data_in = __builtin_bswap32(*data++);
-
-            // Shift out 8 bits for each line
-            uint32_t data_out = crc >> 32;
-            crc <<= 32;
-
-            // XOR outgoing data to itself with 4 bit delay
-            data_out ^= (data_out >> 16);
-
-            // XOR incoming data to outgoing data with 4 bit delay
-            data_out ^= (data_in >> 16);
-
-            // XOR outgoing and incoming data to accumulator at each tap
-            uint64_t xorred = data_out ^ data_in;
-            crc ^= xorred;
-            crc ^= xorred << (5 * 4);
-            crc ^= xorred << (12 * 4);
-        }
-    }
-
-    return crc;
-}
-
 /*******************************************************
  * Basic SDIO command execution
  *******************************************************/
@@ -376,25 +340,27 @@ sdio_status_t rp2040_sdio_command_R3(uint8_t command, uint32_t arg, uint32_t *re
  * Data reception from SD card
  *******************************************************/
 
-sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
+sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_t block_size)
 {
-    // Buffer must be aligned
+    // Buffer must be aligned, and checksum calculation processes 16 bytes at a time
     assert(((uint32_t)buffer & 3) == 0 && num_blocks <= SDIO_MAX_BLOCKS);
+    assert(block_size <= SDIO_BLOCK_SIZE && (block_size & 15) == 0);
 
     g_sdio.transfer_state = SDIO_RX;
     g_sdio.transfer_start_time = millis();
     g_sdio.data_buf = (uint32_t*)buffer;
+    g_sdio.block_size = block_size;
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
     g_sdio.blocks_checksumed = 0;
     g_sdio.checksum_errors = 0;
 
-    // Create DMA block descriptors to store each block of 512 bytes of data to buffer
+    // Create DMA block descriptors to store each block of data to buffer
     // and then 8 bytes to g_sdio.received_checksums.
     for (int i = 0; i < num_blocks; i++)
     {
-        g_sdio.dma_blocks[i * 2].write_addr = buffer + i * SDIO_BLOCK_SIZE;
-        g_sdio.dma_blocks[i * 2].transfer_count = SDIO_BLOCK_SIZE / sizeof(uint32_t);
+        g_sdio.dma_blocks[i * 2].write_addr = buffer + i * block_size;
+        g_sdio.dma_blocks[i * 2].transfer_count = block_size / sizeof(uint32_t);
 
         g_sdio.dma_blocks[i * 2 + 1].write_addr = &g_sdio.received_checksums[i];
         g_sdio.dma_blocks[i * 2 + 1].transfer_count = 2;
@@ -426,7 +392,7 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
     pio_sm_set_consecutive_pindirs(SDIO_PIO, SDIO_DATA_SM, SDIO_D0, 4, false);
 
     // Write number of nibbles to receive to Y register
-    pio_sm_put(SDIO_PIO, SDIO_DATA_SM, SDIO_BLOCK_SIZE * 2 + 16 - 1);
+    pio_sm_put(SDIO_PIO, SDIO_DATA_SM, block_size * 2 + 16 - 1);
     pio_sm_exec(SDIO_PIO, SDIO_DATA_SM, pio_encode_out(pio_y, 32));
 
     // Enable RX FIFO join because we don't need the TX FIFO during transfer.
@@ -447,8 +413,9 @@ static void sdio_verify_rx_checksums(uint32_t maxcount)
     {
         // Calculate checksum from received data
         int blockidx = g_sdio.blocks_checksumed++;
-        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
-                                                     SDIO_WORDS_PER_BLOCK);
+        uint32_t block_words = g_sdio.block_size / sizeof(uint32_t);
+        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * block_words,
+                                                     block_words);
 
         // Convert received checksum to little-endian format
         uint32_t top = __builtin_bswap32(g_sdio.received_checksums[blockidx].top);
@@ -483,7 +450,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
         uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&g_sdio.dma_blocks);
         dma_ctrl_block_count /= sizeof(g_sdio.dma_blocks[0]);
 
-        // Compute how many complete 512 byte SDIO blocks have been transferred
+        // Compute how many complete SDIO blocks have been transferred
         // When transfer ends, dma_ctrl_block_count == g_sdio.total_blocks * 2 + 1
         g_sdio.blocks_done = (dma_ctrl_block_count - 1) / 2;
 
@@ -495,7 +462,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
 
     if (bytes_complete)
     {
-        *bytes_complete = g_sdio.blocks_done * SDIO_BLOCK_SIZE;
+        *bytes_complete = g_sdio.blocks_done * g_sdio.block_size;
     }
 
     if (g_sdio.transfer_state == SDIO_IDLE)
@@ -756,7 +723,7 @@ sdio_status_t rp2040_sdio_stop()
     return SDIO_OK;
 }
 
-void rp2040_sdio_init(int clock_divider)
+void rp2040_sdio_init(int clock_divider, bool high_speed)
 {
     // Mark resources as being in use, unless it has been done already.
     static bool resources_claimed = false;
@@ -779,8 +746,15 @@ void rp2040_sdio_init(int clock_divider)
     // Load PIO programs
     pio_clear_instruction_memory(SDIO_PIO);
 
+    // The programs for high speed mode have shorter delays, giving a faster clock.
+    // Both sets do not fit in the instruction memory at the same time.
+    const pio_program_t *cmd_clk_program = high_speed ? &sdio_cmd_clk_hs_program : &sdio_cmd_clk_program;
+    const pio_program_t *data_rx_program = high_speed ? &sdio_data_rx_hs_program : &sdio_data_rx_program;
+    const pio_program_t *data_tx_program = high_speed ? &sdio_data_tx_hs_program : &sdio_data_tx_program;
+
     // Command & clock state machine
-    g_sdio.pio_cmd_clk_offset = pio_add_program(SDIO_PIO, &sdio_cmd_clk_program);
+    // The default configs only differ in the wrap addresses, which are the same for both sets.
+    g_sdio.pio_cmd_clk_offset = pio_add_program(SDIO_PIO, cmd_clk_program);
     pio_sm_config cfg = sdio_cmd_clk_program_get_default_config(g_sdio.pio_cmd_clk_offset);
     sm_config_set_out_pins(&cfg, SDIO_CMD, 1);
     sm_config_set_in_pins(&cfg, SDIO_CMD);
@@ -797,7 +771,7 @@ void rp2040_sdio_init(int clock_divider)
     pio_sm_set_enabled(SDIO_PIO, SDIO_CMD_SM, true);
 
     // Data reception program
-    g_sdio.pio_data_rx_offset = pio_add_program(SDIO_PIO, &sdio_data_rx_program);
+    g_sdio.pio_data_rx_offset = pio_add_program(SDIO_PIO, data_rx_program);
     g_sdio.pio_cfg_data_rx = sdio_data_rx_program_get_default_config(g_sdio.pio_data_rx_offset);
     sm_config_set_in_pins(&g_sdio.pio_cfg_data_rx, SDIO_D0);
     sm_config_set_in_shift(&g_sdio.pio_cfg_data_rx, false, true, 32);
@@ -805,7 +779,7 @@ void rp2040_sdio_init(int clock_divider)
     sm_config_set_clkdiv_int_frac(&g_sdio.pio_cfg_data_rx, clock_divider, 0);
 
     // Data transmission program
-    g_sdio.pio_data_tx_offset = pio_add_program(SDIO_PIO, &sdio_data_tx_program);
+    g_sdio.pio_data_tx_offset = pio_add_program(SDIO_PIO, data_tx_program);
     g_sdio.pio_cfg_data_tx = sdio_data_tx_program_get_default_config(g_sdio.pio_data_tx_offset);
     sm_config_set_in_pins(&g_sdio.pio_cfg_data_tx, SDIO_D0);
     sm_config_set_set_pins(&g_sdio.pio_cfg_data_tx, SDIO_D0, 4);
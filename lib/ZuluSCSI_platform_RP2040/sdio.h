@@ -41,6 +41,11 @@ enum sdio_status_t {
 #define SDIO_BLOCK_SIZE 512
 #define SDIO_WORDS_PER_BLOCK 128
 
+// Number of PIO cycles per SDIO clock cycle, these must match the .pio files.
+// The state machine clock divider is applied on top of these.
+#define SDIO_PIO_CLKDIV 5
+#define SDIO_PIO_CLKDIV_HS 3
+
 // Execute a command that has 48-bit reply (response types R1, R6, R7)
 // If response is NULL, does not wait for reply.
 sdio_status_t rp2040_sdio_command_R1(uint8_t command, uint32_t arg, uint32_t *response);
@@ -53,8 +58,8 @@ sdio_status_t rp2040_sdio_command_R2(uint8_t command, uint32_t arg, uint8_t *res
 sdio_status_t rp2040_sdio_command_R3(uint8_t command, uint32_t arg, uint32_t *response);
 
 // Start transferring data from SD card to memory buffer
-// Transfer block size is always 512 bytes.
-sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks);
+// Block size is 512 bytes except for special commands such as CMD6.
+sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_t block_size = SDIO_BLOCK_SIZE);
 
 // Check if reception is complete
 // Returns SDIO_BUSY while transferring, SDIO_OK when done and error on failure.
@@ -70,4 +75,6 @@ sdio_status_t rp2040_sdio_tx_poll(uint32_t *bytes_complete = nullptr);
 sdio_status_t rp2040_sdio_stop();
 
 // (Re)initialize the SDIO interface
-void rp2040_sdio_init(int clock_divider = 1);
+// High speed mode uses faster PIO programs, the card must be switched
+// to high speed mode with CMD6 first.
+void rp2040_sdio_init(int clock_divider = 1, bool high_speed = false);
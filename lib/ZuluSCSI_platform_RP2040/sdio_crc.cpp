@@ -0,0 +1,89 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "sdio_crc.h"
+
+// The four CRC16 lines are interleaved so that bit n of each line is
+// stored in nibble n of the 64-bit state. One 32-bit data word carries
+// 8 bits for each line, so every word shifts the state by 32 bits.
+//
+// Cortex-M0+ has no 64-bit instructions, and the compiler generates
+// multi-instruction sequences for the 64-bit shifts. Keeping the state
+// in two 32-bit halves reduces the update to a few shifts and XORs:
+//
+//   crc = (hi:lo << 32) ^ x ^ (x << 20) ^ (x << 48)
+//   => hi' = lo ^ (x >> 12) ^ (x << 16)
+//      lo' = x ^ (x << 20)
+__attribute__((optimize("O3")))
+uint64_t sdio_crc16_4bit_checksum(const uint32_t *data, uint32_t num_words)
+{
+    uint32_t hi = 0;
+    uint32_t lo = 0;
+    const uint32_t *end = data + num_words;
+    while (data < end)
+    {
+        for (int unroll = 0; unroll < 4; unroll++)
+        {
+            // Reverse the bytes because SDIO protocol is big-endian.
+            uint32_t data_in = __builtin_bswap32(*data++);
+
+            // XOR outgoing data to itself and to incoming data with 4 bit delay
+            uint32_t data_out = hi ^ (hi >> 16) ^ (data_in >> 16);
+
+            // XOR outgoing and incoming data to accumulator at each tap
+            uint32_t x = data_out ^ data_in;
+            hi = lo ^ (x >> 12) ^ (x << 16);
+            lo = x ^ (x << 20);
+        }
+    }
+
+    return ((uint64_t)hi << 32) | lo;
+}
+
+uint64_t sdio_crc16_4bit_checksum_reference(const uint32_t *data, uint32_t num_words)
+{
+    uint64_t crc = 0;
+    const uint32_t *end = data + num_words;
+    while (data < end)
+    {
+        // Each 32-bit word contains 8 bits per line.
+        // Reverse the bytes because SDIO protocol is big-endian.
+        uint32_t data_in = __builtin_bswap32(*data++);
+
+        // Shift out 8 bits for each line
+        uint32_t data_out = crc >> 32;
+        crc <<= 32;
+
+        // XOR outgoing data to itself with 4 bit delay
+        data_out ^= (data_out >> 16);
+
+        // XOR incoming data to outgoing data with 4 bit delay
+        data_out ^= (data_in >> 16);
+
+        // XOR outgoing and incoming data to accumulator at each tap
+        uint64_t xorred = data_out ^ data_in;
+        crc ^= xorred;
+        crc ^= xorred << (5 * 4);
+        crc ^= xorred << (12 * 4);
+    }
+
+    return crc;
+}
@@ -0,0 +1,38 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Data block checksum for the SDIO bus in 4-bit mode.
+// Kept separate from sdio.cpp so that it can be tested and benchmarked on PC.
+
+#pragma once
+
+#include <stdint.h>
+
+// Calculate the CRC16 checksum for parallel 4 bit lines separately.
+// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
+// is applied to each line separately and generates total of
+// 4 x 16 = 64 bits of checksum.
+// Number of words must be a multiple of 4.
+uint64_t sdio_crc16_4bit_checksum(const uint32_t *data, uint32_t num_words);
+
+// Straightforward implementation using 64-bit arithmetic.
+// Used for verifying the optimized version.
+uint64_t sdio_crc16_4bit_checksum_reference(const uint32_t *data, uint32_t num_words);
@@ -0,0 +1,73 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2022 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "sdio_session.h"
+
+void sdio_session_init(sdio_session_t *session, const sdio_session_ops_t *ops)
+{
+    session->ops = ops;
+    session->active = false;
+    session->next_sector = 0;
+}
+
+bool sdio_session_write(sdio_session_t *session, uint32_t sector, const uint8_t *src, uint32_t num_blocks)
+{
+    if (session->active && sector != session->next_sector)
+    {
+        // Non-sequential access, the previous write has to be stopped first
+        if (!sdio_session_close(session))
+        {
+            return false;
+        }
+    }
+
+    if (!session->active)
+    {
+        if (!session->ops->start_write(sector))
+        {
+            return false;
+        }
+
+        session->active = true;
+    }
+
+    if (!session->ops->send_blocks(sector, src, num_blocks))
+    {
+        // Card state is unknown after failure, try to get it back to idle
+        session->ops->stop();
+        session->active = false;
+        return false;
+    }
+
+    session->next_sector = sector + num_blocks;
+    return true;
+}
+
+bool sdio_session_close(sdio_session_t *session)
+{
+    if (!session->active)
+    {
+        return true;
+    }
+
+    session->active = false;
+    return session->ops->stop();
+}
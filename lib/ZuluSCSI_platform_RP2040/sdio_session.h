@@ -0,0 +1,60 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2022 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Open-ended multiple block write sessions for SD card.
+//
+// CMD25 WRITE_MULTIPLE_BLOCK is left open after the data has been sent,
+// so that a following write to the next sector can continue sending data
+// blocks without new commands. The session is closed with CMD12 on a
+// non-sequential write, or before any other access to the card.
+//
+// The card commands are performed through callbacks, so that this
+// has no hardware dependencies and can be unit tested on PC.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct sdio_session_ops_t {
+    // Send CMD25 to begin writing at sector
+    bool (*start_write)(uint32_t sector);
+
+    // Transfer data blocks to card in an already started write
+    bool (*send_blocks)(uint32_t sector, const uint8_t *src, uint32_t num_blocks);
+
+    // Send CMD12 and wait for card to finish programming
+    bool (*stop)();
+};
+
+struct sdio_session_t {
+    const sdio_session_ops_t *ops;
+    bool active;
+    uint32_t next_sector; // Sector where the open write continues
+};
+
+void sdio_session_init(sdio_session_t *session, const sdio_session_ops_t *ops);
+
+// Write blocks, continuing the open session if sector follows the previous write.
+bool sdio_session_write(sdio_session_t *session, uint32_t sector, const uint8_t *src, uint32_t num_blocks);
+
+// Stop the open write, if any. Must be called before other commands are sent to card.
+bool sdio_session_close(sdio_session_t *session);
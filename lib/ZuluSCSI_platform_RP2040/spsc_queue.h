@@ -0,0 +1,89 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Lock-free single producer, single consumer queue for passing
+// messages between the two RP2040 cores.
+//
+// Only the producer writes m_head and only the consumer writes m_tail.
+// The indexes run freely and wrap around at 2^32, so the queue size
+// must be a power of two. Acquire/release ordering makes sure that
+// the item contents are visible before the index update.
+
+#pragma once
+
+#include <stdint.h>
+
+template <typename T, uint32_t N>
+class SPSCQueue
+{
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Queue size must be a power of two");
+
+    SPSCQueue(): m_head(0), m_tail(0) {}
+
+    // Add item to queue, called only from the producer.
+    // Returns false if queue is full.
+    bool push(const T &item)
+    {
+        uint32_t head = m_head;
+        uint32_t tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+        if (head - tail >= N)
+        {
+            return false;
+        }
+
+        m_items[head & (N - 1)] = item;
+        __atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Remove item from queue, called only from the consumer.
+    // Returns false if queue is empty.
+    bool pop(T *item)
+    {
+        uint32_t tail = m_tail;
+        uint32_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            return false;
+        }
+
+        *item = m_items[tail & (N - 1)];
+        __atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Number of items currently in queue, can be called from either side.
+    uint32_t count() const
+    {
+        return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+    }
+
+    bool empty() const
+    {
+        return count() == 0;
+    }
+
+protected:
+    uint32_t m_head; // Next position to write, owned by producer
+    uint32_t m_tail; // Next position to read, owned by consumer
+    T m_items[N];
+};
@@ -0,0 +1,174 @@
+#include "scsiHostSync.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+bool test_accept()
+{
+    bool status = true;
+    scsi_host_sync_t sync;
+    uint8_t msg[SCSI_HOST_SYNC_MAX_MSGLEN];
+    uint8_t reply[SCSI_HOST_SYNC_MAX_MSGLEN];
+
+    COMMENT("test_accept()");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 15);
+    TEST(scsiHostSyncNeeded(&sync));
+
+    size_t len = scsiHostSyncBuildRequest(&sync, msg);
+    const uint8_t expected[] = {0x80, 0x01, 0x03, 0x01, 25, 15};
+    TEST(len == sizeof(expected));
+    TEST(memcmp(msg, expected, sizeof(expected)) == 0);
+    TEST(sync.state == SCSIHOST_SYNC_REQUESTED);
+    TEST(!scsiHostSyncNeeded(&sync));
+
+    COMMENT("Target responds with slower period and smaller offset");
+    const uint8_t response[] = {0x01, 0x03, 0x01, 50, 8};
+    TEST(scsiHostSyncMessageIn(&sync, response, sizeof(response), reply) == 0);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.period == 50);
+    TEST(sync.offset == 8);
+    TEST(!scsiHostSyncNeeded(&sync));
+
+    COMMENT("Bus reset returns to asynchronous mode");
+    scsiHostSyncReset(&sync);
+    TEST(sync.offset == 0);
+    TEST(scsiHostSyncNeeded(&sync));
+    TEST(sync.min_period == SCSI_SYNC_PERIOD_10MB);
+    TEST(sync.max_offset == 15);
+
+    return status;
+}
+
+bool test_async_fallback()
+{
+    bool status = true;
+    scsi_host_sync_t sync;
+    uint8_t msg[SCSI_HOST_SYNC_MAX_MSGLEN];
+    uint8_t reply[SCSI_HOST_SYNC_MAX_MSGLEN];
+
+    COMMENT("test_async_fallback()");
+
+    COMMENT("Target rejects SDTR");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 15);
+    scsiHostSyncBuildRequest(&sync, msg);
+    const uint8_t reject[] = {SCSI_MSG_REJECT};
+    TEST(scsiHostSyncMessageIn(&sync, reject, 1, reply) == 0);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.offset == 0);
+
+    COMMENT("Target ignores ATN and goes to command phase");
+    scsiHostSyncReset(&sync);
+    scsiHostSyncBuildRequest(&sync, msg);
+    scsiHostSyncNoResponse(&sync);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.offset == 0);
+
+    COMMENT("Target responds with offset 0");
+    scsiHostSyncReset(&sync);
+    scsiHostSyncBuildRequest(&sync, msg);
+    const uint8_t async[] = {0x01, 0x03, 0x01, 25, 0};
+    TEST(scsiHostSyncMessageIn(&sync, async, sizeof(async), reply) == 0);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.offset == 0);
+
+    COMMENT("Target responds with faster period than requested");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_5MB, 15);
+    scsiHostSyncBuildRequest(&sync, msg);
+    const uint8_t toofast[] = {0x01, 0x03, 0x01, 25, 15};
+    TEST(scsiHostSyncMessageIn(&sync, toofast, sizeof(toofast), reply) == 1);
+    TEST(reply[0] == SCSI_MSG_REJECT);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.offset == 0);
+
+    COMMENT("Target responds with larger offset than requested");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 8);
+    scsiHostSyncBuildRequest(&sync, msg);
+    const uint8_t bigoffset[] = {0x01, 0x03, 0x01, 25, 15};
+    TEST(scsiHostSyncMessageIn(&sync, bigoffset, sizeof(bigoffset), reply) == 1);
+    TEST(reply[0] == SCSI_MSG_REJECT);
+    TEST(sync.offset == 0);
+
+    COMMENT("Synchronous mode disabled in config");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 0);
+    TEST(!scsiHostSyncNeeded(&sync));
+
+    return status;
+}
+
+bool test_target_initiated()
+{
+    bool status = true;
+    scsi_host_sync_t sync;
+    uint8_t reply[SCSI_HOST_SYNC_MAX_MSGLEN];
+
+    COMMENT("test_target_initiated()");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 8);
+
+    const uint8_t request[] = {0x01, 0x03, 0x01, 12, 16};
+    size_t len = scsiHostSyncMessageIn(&sync, request, sizeof(request), reply);
+    const uint8_t expected[] = {0x01, 0x03, 0x01, 25, 8};
+    TEST(len == sizeof(expected));
+    TEST(memcmp(reply, expected, sizeof(expected)) == 0);
+    TEST(sync.state == SCSIHOST_SYNC_DONE);
+    TEST(sync.period == 25);
+    TEST(sync.offset == 8);
+
+    COMMENT("Synchronous mode disabled, respond with offset 0");
+    scsiHostSyncInit(&sync, SCSI_SYNC_PERIOD_10MB, 0);
+    len = scsiHostSyncMessageIn(&sync, request, sizeof(request), reply);
+    TEST(len == 5);
+    TEST(reply[4] == 0);
+    TEST(sync.offset == 0);
+
+    COMMENT("Wide transfer request is rejected");
+    const uint8_t wdtr[] = {0x01, 0x02, 0x03, 0x01};
+    TEST(scsiHostSyncMessageIn(&sync, wdtr, sizeof(wdtr), reply) == 1);
+    TEST(reply[0] == SCSI_MSG_REJECT);
+
+    COMMENT("Simple messages need no response");
+    const uint8_t complete[] = {SCSI_MSG_COMMAND_COMPLETE};
+    TEST(scsiHostSyncMessageIn(&sync, complete, 1, reply) == 0);
+
+    return status;
+}
+
+bool test_message_length()
+{
+    bool status = true;
+
+    COMMENT("test_message_length()");
+    const uint8_t sdtr[] = {0x01, 0x03, 0x01, 25, 15};
+    TEST(scsiHostSyncMessageLength(sdtr, 0) == 1);
+    TEST(scsiHostSyncMessageLength(sdtr, 1) == 2);
+    TEST(scsiHostSyncMessageLength(sdtr, 2) == 5);
+
+    const uint8_t simple[] = {0x04};
+    TEST(scsiHostSyncMessageLength(simple, 1) == 1);
+
+    const uint8_t twobyte[] = {0x23, 0x01};
+    TEST(scsiHostSyncMessageLength(twobyte, 1) == 2);
+
+    return status;
+}
+
+int main()
+{
+    if (test_accept() && test_async_fallback() && test_target_initiated() && test_message_length())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
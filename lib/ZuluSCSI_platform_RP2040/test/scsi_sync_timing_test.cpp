@@ -0,0 +1,147 @@
+#include "scsi_sync_timing.h"
+#include <stdio.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static bool delays_valid(const scsi_sync_timing_t &t)
+{
+    return t.writeDelay0 >= 0 && t.writeDelay0 <= SCSI_SYNC_MAX_DELAY &&
+           t.writeDelay1 >= 0 && t.writeDelay1 <= SCSI_SYNC_MAX_DELAY &&
+           t.writeDelay2 >= 0 && t.writeDelay2 <= SCSI_SYNC_MAX_DELAY &&
+           t.readDelay0 >= 0 && t.readDelay0 <= SCSI_SYNC_MAX_DELAY &&
+           t.readDelay1 >= 0 && t.readDelay1 <= SCSI_SYNC_MAX_DELAY;
+}
+
+bool test_fast20()
+{
+    bool status = true;
+    scsi_sync_timing_t t;
+
+    COMMENT("test_fast20()");
+    TEST(scsi_sync_timing_calc(15, SCSI_SYNC_PERIOD_FAST20, &t));
+    TEST(delays_valid(t));
+    TEST(scsi_sync_timing_period_ns(SCSI_SYNC_PERIOD_FAST20) == 50);
+
+    COMMENT("Fast-20 write timing meets minimums");
+    TEST(scsi_sync_timing_write_period_ns(&t) >= 50);
+    TEST(scsi_sync_timing_write_period_ns(&t) < 100);
+    TEST(scsi_sync_timing_write_setup_ns(&t) >= 12);
+    TEST(scsi_sync_timing_write_assert_ns(&t) >= 15);
+    TEST(scsi_sync_timing_write_negate_ns(&t) >= 15);
+
+    COMMENT("Fast-20 reads are paced at Fast-10");
+    TEST(scsi_sync_timing_read_period_ns(&t) >= 96);
+
+    COMMENT("Periods below Fast-20 are rejected");
+    TEST(!scsi_sync_timing_calc(15, 11, &t));
+    TEST(!scsi_sync_timing_calc(0, 25, &t));
+
+    return status;
+}
+
+bool test_fast10_unchanged()
+{
+    bool status = true;
+    scsi_sync_timing_t t;
+
+    COMMENT("test_fast10_unchanged()");
+    TEST(scsi_sync_timing_calc(15, SCSI_SYNC_PERIOD_FAST10, &t));
+    TEST(t.writeDelay0 == 3 && t.writeDelay1 == 5 && t.writeDelay2 == 1);
+    TEST(t.readDelay0 == 5 && t.readDelay1 == 5);
+    TEST(scsi_sync_timing_write_assert_ns(&t) >= 30);
+    TEST(scsi_sync_timing_write_setup_ns(&t) >= 25);
+
+    TEST(scsi_sync_timing_calc(15, SCSI_SYNC_PERIOD_FAST5, &t));
+    TEST(t.writeDelay0 == 6 && t.writeDelay1 == 12 && t.writeDelay2 == 4);
+    TEST(scsi_sync_timing_write_assert_ns(&t) >= 90);
+    TEST(scsi_sync_timing_write_setup_ns(&t) >= 55);
+
+    return status;
+}
+
+bool test_period_sweep()
+{
+    bool status = true;
+    scsi_sync_timing_t t;
+    int errors = 0;
+
+    COMMENT("test_period_sweep()");
+    for (int period = SCSI_SYNC_PERIOD_FAST20; period <= 80; period++)
+    {
+        if (!scsi_sync_timing_calc(8, period, &t) || !delays_valid(t))
+        {
+            printf("Invalid delays for period %d\n", period);
+            errors++;
+            continue;
+        }
+
+        // Transfers may be slower than negotiated, but not faster.
+        // PIO clock granularity may round the period down by at most one clock.
+        int nominal = scsi_sync_timing_period_ns(period);
+        int write = scsi_sync_timing_write_period_ns(&t);
+        int read = scsi_sync_timing_read_period_ns(&t);
+        if (write < nominal - SCSI_SYNC_PIO_CLK_NS ||
+            (read < nominal - SCSI_SYNC_PIO_CLK_NS && read != (2 + 2 * SCSI_SYNC_MAX_DELAY) * SCSI_SYNC_PIO_CLK_NS))
+        {
+            printf("Period %d: nominal %d ns, write %d ns, read %d ns\n", period, nominal, write, read);
+            errors++;
+        }
+
+        // Below Fast-10 the write period should follow the negotiated one
+        if (period < SCSI_SYNC_PERIOD_FAST10 && write > nominal + SCSI_SYNC_PIO_CLK_NS)
+        {
+            printf("Period %d: nominal %d ns, write %d ns too slow\n", period, nominal, write);
+            errors++;
+        }
+    }
+    TEST(errors == 0);
+
+    return status;
+}
+
+bool test_offsets()
+{
+    bool status = true;
+    scsi_sync_timing_t t;
+    int errors = 0;
+
+    COMMENT("test_offsets()");
+    for (int offset = 2; offset <= 15; offset++)
+    {
+        scsi_sync_timing_calc(offset, SCSI_SYNC_PERIOD_FAST20, &t);
+
+        // Must not exceed negotiated offset, and must leave one vacant FIFO slot
+        int max_offset = scsi_sync_timing_max_offset(&t);
+        if (max_offset > offset || max_offset < 1 || t.offsetPreload > 3)
+        {
+            printf("Offset %d: preload %d divider %d gives %d\n",
+                offset, t.offsetPreload, t.offsetDivider, max_offset);
+            errors++;
+        }
+    }
+    TEST(errors == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_fast20() && test_fast10_unchanged() && test_period_sweep() && test_offsets())
+    {
+        printf("All tests passed\n");
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,65 @@
+// Measure speed of the SDIO 4-bit CRC16 kernels.
+// Results on PC are only indicative, because the PC has native 64-bit
+// arithmetic. On Cortex-M0+ the 32-bit version avoids the multi-instruction
+// sequences generated for 64-bit shifts.
+
+#include "sdio_crc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+#endif
+
+#define WORDS_PER_BLOCK 128
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef uint64_t (*crc_func_t)(const uint32_t *data, uint32_t num_words);
+
+static void benchmark(const char *name, crc_func_t func, const uint32_t *buf, uint32_t blocks, int rounds)
+{
+    volatile uint64_t sink = 0;
+    double start = now();
+#ifdef HAVE_CYCLE_COUNTER
+    uint64_t cycles_start = __rdtsc();
+#endif
+
+    for (int i = 0; i < rounds; i++)
+    {
+        for (uint32_t j = 0; j < blocks; j++)
+        {
+            sink += func(buf + j * WORDS_PER_BLOCK, WORDS_PER_BLOCK);
+        }
+    }
+
+    double bytes = (double)rounds * blocks * WORDS_PER_BLOCK * 4;
+    double t = now() - start;
+    printf("%-10s %8.1f MB/s", name, bytes / t / 1e6);
+#ifdef HAVE_CYCLE_COUNTER
+    printf(" %6.2f cycles/byte", (__rdtsc() - cycles_start) / bytes);
+#endif
+    printf("\n");
+}
+
+int main()
+{
+    // Same size as the SCSI transfer buffer on RP2040
+    const uint32_t blocks = 128;
+    const int rounds = 2000;
+    uint32_t *buf = (uint32_t*)malloc(blocks * WORDS_PER_BLOCK * 4);
+    for (uint32_t i = 0; i < blocks * WORDS_PER_BLOCK; i++) buf[i] = rand();
+
+    benchmark("Reference:", sdio_crc16_4bit_checksum_reference, buf, blocks, rounds);
+    benchmark("Optimized:", sdio_crc16_4bit_checksum, buf, blocks, rounds);
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "sdio_crc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+#define WORDS_PER_BLOCK 128
+
+// Bit-by-bit CRC16-CCITT on each of the four data lines, as described in
+// the SD specification. Result is packed in the same interleaved format
+// as the card sends it: bit n of line k is stored at bit 4 * n + k.
+static uint64_t crc16_4bit_bitwise(const uint8_t *bytes, size_t len)
+{
+    uint16_t crc[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < len; i++)
+    {
+        // High nibble is sent first
+        for (int shift = 4; shift >= 0; shift -= 4)
+        {
+            uint8_t nibble = (bytes[i] >> shift) & 0x0F;
+            for (int line = 0; line < 4; line++)
+            {
+                int feedback = ((crc[line] >> 15) ^ (nibble >> line)) & 1;
+                crc[line] <<= 1;
+                if (feedback) crc[line] ^= 0x1021;
+            }
+        }
+    }
+
+    uint64_t result = 0;
+    for (int n = 0; n < 16; n++)
+    {
+        for (int line = 0; line < 4; line++)
+        {
+            result |= (uint64_t)((crc[line] >> n) & 1) << (4 * n + line);
+        }
+    }
+    return result;
+}
+
+bool test_known_values()
+{
+    bool status = true;
+    uint32_t block[WORDS_PER_BLOCK];
+
+    COMMENT("test_known_values()");
+
+    COMMENT("All zeros gives zero checksum");
+    memset(block, 0, sizeof(block));
+    TEST(sdio_crc16_4bit_checksum(block, WORDS_PER_BLOCK) == 0);
+
+    COMMENT("All ones, each line gets 128 bytes of 0xFF with CRC16 0xEDA9");
+    memset(block, 0xFF, sizeof(block));
+    TEST(sdio_crc16_4bit_checksum(block, WORDS_PER_BLOCK) == crc16_4bit_bitwise((uint8_t*)block, sizeof(block)));
+    TEST(sdio_crc16_4bit_checksum(block, WORDS_PER_BLOCK) == 0xFFF0FF0FF0F0F00FULL);
+
+    return status;
+}
+
+bool test_random_blocks()
+{
+    bool status = true;
+    uint32_t block[WORDS_PER_BLOCK * 4];
+    int mismatch_bitwise = 0;
+    int mismatch_reference = 0;
+
+    COMMENT("test_random_blocks()");
+    srand(1234);
+    for (int round = 0; round < 1000; round++)
+    {
+        uint8_t *bytes = (uint8_t*)block;
+        for (size_t i = 0; i < sizeof(block); i++) bytes[i] = rand();
+
+        // Test both single blocks and longer sequences
+        uint32_t num_words = (round & 1) ? WORDS_PER_BLOCK : (4 + 4 * (rand() % WORDS_PER_BLOCK));
+        uint64_t crc = sdio_crc16_4bit_checksum(block, num_words);
+        if (crc != sdio_crc16_4bit_checksum_reference(block, num_words)) mismatch_reference++;
+        if (crc != crc16_4bit_bitwise(bytes, num_words * 4)) mismatch_bitwise++;
+    }
+
+    TEST(mismatch_reference == 0);
+    TEST(mismatch_bitwise == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_known_values() && test_random_blocks())
+    {
+        printf("All tests passed\n");
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
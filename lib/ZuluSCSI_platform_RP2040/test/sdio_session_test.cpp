@@ -0,0 +1,228 @@
+#include "sdio_session.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Simulated SD card.
+ * Tracks the card state machine for data writes and reports
+ * commands that would be illegal in the current state. */
+#define SIM_SECTORS 64
+#define SIM_BLOCK_SIZE 512
+
+enum sim_state_t { SIM_TRAN, SIM_RCV };
+
+static struct {
+    sim_state_t state;
+    uint32_t write_pos;
+    int cmd25_count;
+    int cmd12_count;
+    int illegal_count;
+    int fail_after_blocks; // Simulate write failure after this many blocks, -1 to disable
+    uint8_t data[SIM_SECTORS][SIM_BLOCK_SIZE];
+} g_sim;
+
+static void sim_reset()
+{
+    memset(&g_sim, 0, sizeof(g_sim));
+    g_sim.state = SIM_TRAN;
+    g_sim.fail_after_blocks = -1;
+}
+
+static bool sim_start_write(uint32_t sector)
+{
+    if (g_sim.state != SIM_TRAN || sector >= SIM_SECTORS)
+    {
+        g_sim.illegal_count++;
+        return false;
+    }
+
+    g_sim.cmd25_count++;
+    g_sim.state = SIM_RCV;
+    g_sim.write_pos = sector;
+    return true;
+}
+
+static bool sim_send_blocks(uint32_t sector, const uint8_t *src, uint32_t num_blocks)
+{
+    if (g_sim.state != SIM_RCV || sector != g_sim.write_pos)
+    {
+        // Data blocks always go to the position following the previous block
+        g_sim.illegal_count++;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < num_blocks; i++)
+    {
+        if (g_sim.fail_after_blocks == 0 || g_sim.write_pos >= SIM_SECTORS)
+        {
+            return false;
+        }
+        if (g_sim.fail_after_blocks > 0) g_sim.fail_after_blocks--;
+
+        memcpy(g_sim.data[g_sim.write_pos++], src + i * SIM_BLOCK_SIZE, SIM_BLOCK_SIZE);
+    }
+
+    return true;
+}
+
+static bool sim_stop()
+{
+    if (g_sim.state != SIM_RCV)
+    {
+        g_sim.illegal_count++;
+        return false;
+    }
+
+    g_sim.cmd12_count++;
+    g_sim.state = SIM_TRAN;
+    return true;
+}
+
+static const sdio_session_ops_t g_sim_ops = {
+    sim_start_write,
+    sim_send_blocks,
+    sim_stop
+};
+
+static uint8_t g_buf[8 * SIM_BLOCK_SIZE];
+
+static void fill_buf(uint8_t pattern)
+{
+    for (size_t i = 0; i < sizeof(g_buf); i++)
+    {
+        g_buf[i] = (uint8_t)(pattern + i / SIM_BLOCK_SIZE);
+    }
+}
+
+bool test_sequential()
+{
+    bool status = true;
+    sdio_session_t session;
+    sim_reset();
+    sdio_session_init(&session, &g_sim_ops);
+
+    COMMENT("test_sequential()");
+    fill_buf(0x10);
+    TEST(sdio_session_write(&session, 4, g_buf, 8));
+    fill_buf(0x20);
+    TEST(sdio_session_write(&session, 12, g_buf, 8));
+    fill_buf(0x30);
+    TEST(sdio_session_write(&session, 20, g_buf, 2));
+
+    COMMENT("Only one CMD25 for consecutive writes, no CMD12 until closed");
+    TEST(g_sim.cmd25_count == 1);
+    TEST(g_sim.cmd12_count == 0);
+    TEST(g_sim.state == SIM_RCV);
+    TEST(session.next_sector == 22);
+
+    TEST(sdio_session_close(&session));
+    TEST(g_sim.cmd12_count == 1);
+    TEST(g_sim.state == SIM_TRAN);
+    TEST(!session.active);
+
+    COMMENT("Data ends up in correct sectors");
+    TEST(g_sim.data[3][0] == 0x00);
+    TEST(g_sim.data[4][0] == 0x10);
+    TEST(g_sim.data[11][511] == 0x17);
+    TEST(g_sim.data[12][0] == 0x20);
+    TEST(g_sim.data[21][0] == 0x31);
+    TEST(g_sim.data[22][0] == 0x00);
+
+    COMMENT("Closing again does nothing");
+    TEST(sdio_session_close(&session));
+    TEST(g_sim.cmd12_count == 1);
+    TEST(g_sim.illegal_count == 0);
+
+    return status;
+}
+
+bool test_nonsequential()
+{
+    bool status = true;
+    sdio_session_t session;
+    sim_reset();
+    sdio_session_init(&session, &g_sim_ops);
+
+    COMMENT("test_nonsequential()");
+    fill_buf(0x40);
+    TEST(sdio_session_write(&session, 0, g_buf, 4));
+    fill_buf(0x50);
+    TEST(sdio_session_write(&session, 32, g_buf, 4));
+
+    COMMENT("Jump to another sector stops previous write");
+    TEST(g_sim.cmd25_count == 2);
+    TEST(g_sim.cmd12_count == 1);
+    TEST(g_sim.data[3][0] == 0x43);
+    TEST(g_sim.data[4][0] == 0x00);
+    TEST(g_sim.data[32][0] == 0x50);
+
+    COMMENT("Rewriting the same sector also restarts");
+    fill_buf(0x60);
+    TEST(sdio_session_write(&session, 32, g_buf, 1));
+    TEST(g_sim.cmd25_count == 3);
+    TEST(g_sim.cmd12_count == 2);
+    TEST(g_sim.data[32][0] == 0x60);
+    TEST(g_sim.data[33][0] == 0x51);
+
+    TEST(sdio_session_close(&session));
+    TEST(g_sim.illegal_count == 0);
+
+    return status;
+}
+
+bool test_failure()
+{
+    bool status = true;
+    sdio_session_t session;
+    sim_reset();
+    sdio_session_init(&session, &g_sim_ops);
+
+    COMMENT("test_failure()");
+    fill_buf(0x70);
+    TEST(sdio_session_write(&session, 0, g_buf, 4));
+
+    COMMENT("Failed transfer stops the write");
+    g_sim.fail_after_blocks = 2;
+    TEST(!sdio_session_write(&session, 4, g_buf, 4));
+    TEST(!session.active);
+    TEST(g_sim.state == SIM_TRAN);
+    TEST(g_sim.cmd12_count == 1);
+
+    COMMENT("Retry of the same sectors starts a new write");
+    g_sim.fail_after_blocks = -1;
+    TEST(sdio_session_write(&session, 4, g_buf, 4));
+    TEST(g_sim.cmd25_count == 2);
+    TEST(g_sim.data[7][0] == 0x73);
+
+    COMMENT("Failed CMD25 leaves session closed");
+    TEST(sdio_session_close(&session));
+    TEST(!sdio_session_write(&session, SIM_SECTORS, g_buf, 1));
+    TEST(!session.active);
+    TEST(g_sim.state == SIM_TRAN);
+    TEST(g_sim.illegal_count == 1);
+
+    return status;
+}
+
+int main()
+{
+    if (test_sequential() && test_nonsequential() && test_failure())
+    {
+        printf("All tests passed\n");
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,103 @@
+#include "spsc_queue.h"
+#include <stdio.h>
+#include <thread>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+struct test_item_t {
+    uint32_t seq;
+    uint32_t check;
+};
+
+bool test_basic()
+{
+    bool status = true;
+    SPSCQueue<uint32_t, 4> queue;
+    uint32_t value = 0;
+
+    COMMENT("test_basic()");
+    TEST(queue.empty());
+    TEST(!queue.pop(&value));
+
+    COMMENT("Fill queue up to capacity");
+    TEST(queue.push(1));
+    TEST(queue.push(2));
+    TEST(queue.push(3));
+    TEST(queue.push(4));
+    TEST(!queue.push(5));
+    TEST(queue.count() == 4);
+
+    COMMENT("Items come out in order");
+    TEST(queue.pop(&value) && value == 1);
+    TEST(queue.pop(&value) && value == 2);
+    TEST(queue.push(5));
+    TEST(queue.pop(&value) && value == 3);
+    TEST(queue.pop(&value) && value == 4);
+    TEST(queue.pop(&value) && value == 5);
+    TEST(queue.empty());
+
+    return status;
+}
+
+bool test_threads()
+{
+    bool status = true;
+    const uint32_t total = 100000;
+    static SPSCQueue<test_item_t, 8> queue;
+    uint32_t errors = 0;
+    uint32_t received = 0;
+
+    COMMENT("test_threads()");
+
+    std::thread consumer([&]() {
+        test_item_t item;
+        while (received < total)
+        {
+            if (queue.pop(&item))
+            {
+                if (item.seq != received || item.check != ~item.seq) errors++;
+                received++;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    for (uint32_t i = 0; i < total; i++)
+    {
+        test_item_t item = {i, ~i};
+        while (!queue.push(item)) std::this_thread::yield();
+    }
+
+    consumer.join();
+
+    TEST(received == total);
+    TEST(errors == 0);
+    TEST(queue.empty());
+
+    return status;
+}
+
+int main()
+{
+    if (test_basic() && test_threads())
+    {
+        printf("All tests passed\n");
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
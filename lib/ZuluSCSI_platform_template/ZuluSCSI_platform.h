@@ -49,6 +49,11 @@ void platform_log(const char *s);
 unsigned long millis(void);
 void delay(unsigned long ms);
 
+// Optional microsecond timestamp for performance statistics.
+// If not provided, statistics are measured with millis().
+// unsigned long micros(void);
+// #define PLATFORM_HAS_MICROS 1
+
 // Short delays, can be called from interrupt mode
 static inline void delay_ns(unsigned long ns)
 {
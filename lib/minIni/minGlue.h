@@ -11,3 +11,7 @@ bool ini_close(INI_FILETYPE *fp);
 bool ini_read(char *buffer, int size, INI_FILETYPE *fp);
 void ini_tell(INI_FILETYPE *fp, INI_FILEPOS *pos);
 void ini_seek(INI_FILETYPE *fp, INI_FILEPOS *pos);
+
+/* Key lookup from an index built when the file is cached */
+#define INI_SEEKKEY 1
+int ini_seekkey(INI_FILETYPE *fp, const char *Section, const char *Key);
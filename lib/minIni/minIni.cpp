@@ -323,6 +323,13 @@ int ini_gets(const TCHAR *Section, const TCHAR *Key, const TCHAR *DefValue,
   if (Buffer == NULL || BufferSize <= 0 || Key == NULL)
     return 0;
   if (ini_openread(Filename, &fp)) {
+#if defined INI_SEEKKEY
+    /* the index gives the line of the key directly, or tells that it is absent */
+    int found = ini_seekkey(&fp, Section, Key);
+    if (found > 0)
+      ok = getkeystring(&fp, NULL, Key, -1, -1, Buffer, BufferSize, NULL);
+    else if (found < 0)
+#endif
     ok = getkeystring(&fp, Section, Key, -1, -1, Buffer, BufferSize, NULL);
     (void)ini_close(&fp);
   }
@@ -484,6 +491,12 @@ int ini_haskey(const mTCHAR *Section, const mTCHAR *Key, const mTCHAR *Filename)
   int ok = 0;
 
   if (ini_openread(Filename, &fp)) {
+#if defined INI_SEEKKEY
+    int found = ini_seekkey(&fp, Section, Key);
+    if (found > 0)
+      ok = getkeystring(&fp, NULL, Key, -1, -1, LocalBuffer, sizearray(LocalBuffer), NULL);
+    else if (found < 0)
+#endif
     ok = getkeystring(&fp, Section, Key, -1, -1, LocalBuffer, sizearray(LocalBuffer), NULL);
     (void)ini_close(&fp);
   }
@@ -1,9 +1,16 @@
 // Custom .ini file access caching layer for minIni.
 // This reduces boot delay by only reading the ini file once
 // after boot or SD-card removal.
+//
+// When the file fits in the cache, an index of the keys is also built
+// at load time. It maps hashed section and key names to the line that
+// contains the value, so that ini_gets() does not have to scan through
+// the whole file for every configuration setting of every SCSI ID.
 
 #include <minGlue.h>
+#include <minIni.h>
 #include <SdFat.h>
+#include <strings.h>
 
 // This can be overridden in platformio.ini
 // Set to 0 to disable the cache.
@@ -11,6 +18,31 @@
 #define INI_CACHE_SIZE 4096
 #endif
 
+// Number of slots in the key index, each takes 8 bytes of RAM.
+// If the file has more sections and keys than fit in 3/4 of the slots,
+// lookups scan the cached file instead. Set to 0 to disable the index.
+#ifndef INI_INDEX_SIZE
+#if INI_CACHE_SIZE > 0
+#define INI_INDEX_SIZE 256
+#else
+#define INI_INDEX_SIZE 0
+#endif
+#endif
+
+#if INI_INDEX_SIZE > 0 && INI_CACHE_SIZE >= 65535
+#error Key index stores 16-bit file positions, reduce INI_CACHE_SIZE or set INI_INDEX_SIZE=0
+#endif
+
+#define INI_INDEX_NO_SECTION 0xFFFF
+
+// Index entry for either a key or a section header.
+// Section entries have line_pos == section_pos.
+typedef struct {
+    uint32_t hash;
+    uint16_t line_pos;
+    uint16_t section_pos;
+} ini_index_entry_t;
+
 // Use the SdFs instance from main program
 extern SdFs SD;
 
@@ -24,8 +56,226 @@ static struct {
     INI_FILEPOS current_pos;
     char cachedata[INI_CACHE_SIZE];
 #endif
+
+#if INI_INDEX_SIZE > 0
+    bool index_valid;
+    ini_index_entry_t index[INI_INDEX_SIZE];
+#endif
 } g_ini_cache;
 
+#if INI_CACHE_SIZE > 0
+// Copy one line from cache, in the same way as fgets().
+// Returns position of the next line.
+static uint32_t ini_cache_getline(uint32_t srcpos, char *buffer, int size)
+{
+    int dstpos = 0;
+    while (srcpos < g_ini_cache.filelen &&
+           dstpos < size - 1)
+    {
+        char b = g_ini_cache.cachedata[srcpos++];
+        buffer[dstpos++] = b;
+
+        if (b == '\n') break;
+    }
+    buffer[dstpos] = 0;
+    return srcpos;
+}
+#endif
+
+#if INI_INDEX_SIZE > 0
+
+enum ini_linetype_t {
+    INI_LINE_OTHER,
+    INI_LINE_SECTION,
+    INI_LINE_BAD_SECTION, // Starts with '[' but has no ']'
+    INI_LINE_KEY
+};
+
+static bool ini_isspace(char c)
+{
+    // Same definition of whitespace as skipleading() in minIni.cpp
+    return '\0' < c && c <= ' ';
+}
+
+// Find the section or key name on a line.
+// This must follow the parsing done in getkeystring() in minIni.cpp.
+static ini_linetype_t ini_parse_line(const char *line, const char **name, int *namelen)
+{
+    const char *sp = line;
+    while (ini_isspace(*sp)) sp++;
+
+    if (*sp == '[')
+    {
+        const char *ep = strrchr(sp, ']');
+        if (ep == NULL) return INI_LINE_BAD_SECTION;
+
+        sp++;
+        while (ini_isspace(*sp)) sp++;
+        while (ep > sp && ini_isspace(ep[-1])) ep--;
+        *name = sp;
+        *namelen = ep - sp;
+        return INI_LINE_SECTION;
+    }
+
+    if (*sp == ';' || *sp == '#') return INI_LINE_OTHER;
+
+    const char *ep = strchr(sp, '=');
+    if (ep == NULL) ep = strchr(sp, ':');
+    if (ep == NULL) return INI_LINE_OTHER;
+
+    while (ep > sp && ini_isspace(ep[-1])) ep--;
+    *name = sp;
+    *namelen = ep - sp;
+    return INI_LINE_KEY;
+}
+
+// FNV-1a hash of lowercase characters, names are case insensitive
+static uint32_t ini_hash(uint32_t hash, const char *str, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        char c = str[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        hash = (hash ^ (uint8_t)c) * 16777619;
+    }
+    return hash;
+}
+
+static uint32_t ini_hash_section(const char *section, int seclen)
+{
+    // Zero byte separates section name from key name
+    return ini_hash(2166136261u, section, seclen) * 16777619;
+}
+
+static uint32_t ini_hash_final(uint32_t hash)
+{
+    // Zero marks an unused slot
+    return (hash == 0) ? 1 : hash;
+}
+
+// Check that the line at pos has the given section or key name
+static bool ini_index_match(uint16_t pos, ini_linetype_t type, const char *name, int len)
+{
+    char line[INI_BUFFERSIZE];
+    const char *linename;
+    int linelen;
+    ini_cache_getline(pos, line, sizeof(line));
+    return ini_parse_line(line, &linename, &linelen) == type &&
+           linelen == len && strncasecmp(linename, name, len) == 0;
+}
+
+// Find index slot of a section header.
+// Returns the slot containing the entry, or the empty slot where it would go.
+static int ini_index_find_section(uint32_t hash, const char *section, int seclen)
+{
+    int slot = hash % INI_INDEX_SIZE;
+    while (g_ini_cache.index[slot].hash != 0)
+    {
+        const ini_index_entry_t *entry = &g_ini_cache.index[slot];
+        if (entry->hash == hash && entry->line_pos == entry->section_pos &&
+            ini_index_match(entry->line_pos, INI_LINE_SECTION, section, seclen))
+        {
+            break;
+        }
+
+        slot = (slot + 1) % INI_INDEX_SIZE;
+    }
+    return slot;
+}
+
+// Find index slot of a key in the section starting at section_pos.
+static int ini_index_find_key(uint32_t hash, uint16_t section_pos, const char *key, int keylen)
+{
+    int slot = hash % INI_INDEX_SIZE;
+    while (g_ini_cache.index[slot].hash != 0)
+    {
+        const ini_index_entry_t *entry = &g_ini_cache.index[slot];
+        if (entry->hash == hash && entry->section_pos == section_pos &&
+            entry->line_pos != section_pos &&
+            ini_index_match(entry->line_pos, INI_LINE_KEY, key, keylen))
+        {
+            break;
+        }
+
+        slot = (slot + 1) % INI_INDEX_SIZE;
+    }
+    return slot;
+}
+
+static bool ini_index_add(int slot, uint32_t hash, uint32_t line_pos, uint32_t section_pos, int *count)
+{
+    if (++*count > INI_INDEX_SIZE * 3 / 4)
+    {
+        return false;
+    }
+
+    g_ini_cache.index[slot].hash = hash;
+    g_ini_cache.index[slot].line_pos = line_pos;
+    g_ini_cache.index[slot].section_pos = section_pos;
+    return true;
+}
+
+// Go through the cached file once and store positions of all keys that
+// minIni would find. Only the first section with a given name is searched
+// by minIni, and within it only the first occurrence of a key.
+static void ini_index_build()
+{
+    memset(g_ini_cache.index, 0, sizeof(g_ini_cache.index));
+    g_ini_cache.index_valid = false;
+
+    char line[INI_BUFFERSIZE];
+    int count = 0;
+    uint32_t section_pos = INI_INDEX_NO_SECTION;
+    uint32_t section_hash = ini_hash_section("", 0);
+    bool section_searchable = true;
+
+    uint32_t pos = 0;
+    while (pos < g_ini_cache.filelen)
+    {
+        uint32_t line_pos = pos;
+        pos = ini_cache_getline(pos, line, sizeof(line));
+
+        const char *name;
+        int len;
+        ini_linetype_t type = ini_parse_line(line, &name, &len);
+        if (type == INI_LINE_SECTION)
+        {
+            // Keys in sections with empty or repeated name are never found by minIni
+            section_pos = line_pos;
+            section_hash = ini_hash_section(name, len);
+            section_searchable = false;
+            if (len > 0)
+            {
+                uint32_t hash = ini_hash_final(section_hash);
+                int slot = ini_index_find_section(hash, name, len);
+                if (g_ini_cache.index[slot].hash == 0)
+                {
+                    if (!ini_index_add(slot, hash, line_pos, line_pos, &count)) return;
+                    section_searchable = true;
+                }
+            }
+        }
+        else if (type == INI_LINE_BAD_SECTION)
+        {
+            // Ends the previous section without starting a new one
+            section_searchable = false;
+        }
+        else if (type == INI_LINE_KEY && len > 0 && section_searchable)
+        {
+            uint32_t hash = ini_hash_final(ini_hash(section_hash, name, len));
+            int slot = ini_index_find_key(hash, section_pos, name, len);
+            if (g_ini_cache.index[slot].hash == 0)
+            {
+                if (!ini_index_add(slot, hash, line_pos, section_pos, &count)) return;
+            }
+        }
+    }
+
+    g_ini_cache.index_valid = true;
+}
+
+#endif
+
 // Invalidate any cached file contents
 void invalidate_ini_cache()
 {
@@ -52,6 +302,13 @@ void reload_ini_cache(const char *filename)
     }
     config.close();
 #endif
+
+#if INI_INDEX_SIZE > 0
+    if (g_ini_cache.valid)
+    {
+        ini_index_build();
+    }
+#endif
 }
 
 // Open .ini file either from cache or from SD card
@@ -95,18 +352,8 @@ bool ini_read(char *buffer, int size, INI_FILETYPE *fp)
     {
         // Read one line from cache
         uint32_t srcpos = g_ini_cache.current_pos.position;
-        int dstpos = 0;
-        while (srcpos < g_ini_cache.filelen &&
-               dstpos < size - 1)
-        {
-            char b = g_ini_cache.cachedata[srcpos++];
-            buffer[dstpos++] = b;
-
-            if (b == '\n') break;
-        }
-        buffer[dstpos] = 0;
-        g_ini_cache.current_pos.position = srcpos;
-        return dstpos > 0;
+        g_ini_cache.current_pos.position = ini_cache_getline(srcpos, buffer, size);
+        return g_ini_cache.current_pos.position > srcpos;
     }
     else
 #endif
@@ -145,3 +392,40 @@ void ini_seek(INI_FILETYPE *fp, INI_FILEPOS *pos)
         fp->fsetpos(pos);
     }
 }
+
+// Look up key from the index and go to the line containing it.
+// Returns 1 if found, 0 if the key does not exist in the section,
+// or -1 if the index is not available and the file must be searched.
+int ini_seekkey(INI_FILETYPE *fp, const char *Section, const char *Key)
+{
+#if INI_INDEX_SIZE > 0
+    if (g_ini_cache.fp != fp || !g_ini_cache.index_valid ||
+        Key == NULL || Key[0] == '\0')
+    {
+        return -1;
+    }
+
+    // Empty section name refers to keys before the first section
+    if (Section == NULL) Section = "";
+    int seclen = strlen(Section);
+    uint32_t section_hash = ini_hash_section(Section, seclen);
+    uint16_t section_pos = INI_INDEX_NO_SECTION;
+    if (seclen > 0)
+    {
+        int slot = ini_index_find_section(ini_hash_final(section_hash), Section, seclen);
+        if (g_ini_cache.index[slot].hash == 0) return 0;
+        section_pos = g_ini_cache.index[slot].section_pos;
+    }
+
+    int keylen = strlen(Key);
+    int slot = ini_index_find_key(ini_hash_final(ini_hash(section_hash, Key, keylen)),
+                                  section_pos, Key, keylen);
+    if (g_ini_cache.index[slot].hash == 0) return 0;
+
+    g_ini_cache.current_pos.position = g_ini_cache.index[slot].line_pos;
+    return 1;
+#else
+    (void)fp; (void)Section; (void)Key;
+    return -1;
+#endif
+}
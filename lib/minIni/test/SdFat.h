@@ -0,0 +1,83 @@
+// Minimal stand-in for SdFat library for running minIni tests on the host.
+// Files are accessed with stdio relative to the current directory.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+
+struct fspos_t {
+    uint32_t position;
+    uint32_t cluster;
+};
+
+class FsVolume {};
+
+class FsFile
+{
+public:
+    FsFile(): m_fp(NULL) {}
+    FsFile(FsFile &&other): m_fp(other.m_fp) { other.m_fp = NULL; }
+    FsFile(const FsFile&) = delete;
+    ~FsFile() { close(); }
+
+    bool open(FsVolume *vol, const char *path, int oflag)
+    {
+        close();
+        m_fp = fopen(path, "rb");
+        return m_fp != NULL;
+    }
+
+    bool close()
+    {
+        if (m_fp) fclose(m_fp);
+        m_fp = NULL;
+        return true;
+    }
+
+    bool isOpen() const { return m_fp != NULL; }
+
+    uint64_t fileSize()
+    {
+        if (!m_fp) return 0;
+        long pos = ftell(m_fp);
+        fseek(m_fp, 0, SEEK_END);
+        long size = ftell(m_fp);
+        fseek(m_fp, pos, SEEK_SET);
+        return size;
+    }
+
+    int read(void *buf, size_t count)
+    {
+        return fread(buf, 1, count, m_fp);
+    }
+
+    int fgets(char *str, int num)
+    {
+        return ::fgets(str, num, m_fp) ? (int)strlen(str) : -1;
+    }
+
+    void fgetpos(fspos_t *pos) { pos->position = ftell(m_fp); }
+    void fsetpos(const fspos_t *pos) { fseek(m_fp, pos->position, SEEK_SET); }
+
+private:
+    FILE *m_fp;
+};
+
+class SdFs
+{
+public:
+    FsVolume *vol() { return &m_vol; }
+
+    FsFile open(const char *path, int oflag)
+    {
+        FsFile file;
+        file.open(&m_vol, path, oflag);
+        return file;
+    }
+
+private:
+    FsVolume m_vol;
+};
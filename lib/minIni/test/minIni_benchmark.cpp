@@ -0,0 +1,114 @@
+#include "minIni.h"
+#include "minIni_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Simulates the configuration lookups done at boot with a large zuluscsi.ini.
+// Build with -DINI_INDEX_SIZE=0 to measure plain scanning of the cached file.
+
+SdFs SD;
+
+static const char *g_filename = "minIni_benchmark.ini";
+
+static const char *g_device_keys[] = {
+    "Type", "TypeModifier", "SectorsPerTrack", "HeadsPerCylinder", "Quirks",
+    "RightAlignStrings", "NameFromImage", "PrefetchBytes", "ReinsertCDOnInquiry",
+    "ReinsertAfterEject", "EjectButton", "Vendor", "Product", "Version", "Serial",
+    "ImgDir", "Dir", "IMG0", "IMG1", "IMG2", "IMG3"
+};
+
+static const char *g_system_keys[] = {
+    "System", "Debug", "DebugBinaryLog", "SelectionDelay", "MaxSyncSpeed",
+    "EnableUnitAttention", "EnableSCSI2", "EnableSelLatch", "MapLunsToIDs",
+    "EnableParity", "DisableStatusLED", "DisableROMDrive", "ROMDriveSCSIID",
+    "InitPreDelay", "InitPostDelay", "UseFATAllocSize", "StatsInterval",
+    "BusTrace", "BusTraceSizeMB", "BusTraceDigestBytes"
+};
+
+#if defined(INI_INDEX_SIZE) && INI_INDEX_SIZE == 0
+#define BENCHMARK_NAME "File scan"
+#else
+#define BENCHMARK_NAME "Key index"
+#endif
+
+#define ARRAYSIZE(x) (sizeof(x) / sizeof(x[0]))
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void write_config()
+{
+    FILE *f = fopen(g_filename, "wb");
+    fprintf(f, "; Example of a large configuration file with comments\n");
+    fprintf(f, "[SCSI]\n");
+    fprintf(f, "Debug = 0   # Same as the debug log option\n");
+    fprintf(f, "SelectionDelay = 255\nMaxSyncSpeed = 10\nEnableSCSI2 = 1\n");
+    fprintf(f, "EnableParity = 1\nEnableUnitAttention = 0\nMapLunsToIDs = 0\n");
+    fprintf(f, "Vendor = \"QUANTUM \"\nProduct = \"FIREBALL1       \"\n");
+    for (int id = 0; id < 7; id++)
+    {
+        fprintf(f, "\n; Settings for the drive at SCSI ID %d\n", id);
+        fprintf(f, "[SCSI%d]\n", id);
+        fprintf(f, "Type = %d\n", id % 3);
+        fprintf(f, "Vendor = \"VENDOR%d \"\nProduct = \"PRODUCT%d        \"\n", id, id);
+        fprintf(f, "Version = \"1.0 \"\nSerial = \"000000000000%d\"\n", id);
+        fprintf(f, "SectorsPerTrack = 63\nHeadsPerCylinder = 255\n");
+        fprintf(f, "PrefetchBytes = 8192\nQuirks = 0\n");
+        fprintf(f, "IMG0 = images/drive%d_a.img\nIMG1 = images/drive%d_b.img\n", id, id);
+    }
+    fclose(f);
+}
+
+// Same sequence of lookups as boot code does: system settings first,
+// then defaults from [SCSI] and overrides from [SCSIx] for every ID.
+static int boot_lookups()
+{
+    char buf[64];
+    int total = 0;
+    for (size_t i = 0; i < ARRAYSIZE(g_system_keys); i++)
+    {
+        total += ini_gets("SCSI", g_system_keys[i], "", buf, sizeof(buf), g_filename);
+    }
+
+    for (int id = 0; id < 8; id++)
+    {
+        char section[6] = "SCSI0";
+        section[4] = '0' + id;
+        for (size_t i = 0; i < ARRAYSIZE(g_device_keys); i++)
+        {
+            total += ini_gets("SCSI", g_device_keys[i], "", buf, sizeof(buf), g_filename);
+            total += ini_gets(section, g_device_keys[i], "", buf, sizeof(buf), g_filename);
+        }
+    }
+    return total;
+}
+
+int main()
+{
+    write_config();
+    reload_ini_cache(g_filename);
+
+    int lookups = ARRAYSIZE(g_system_keys) + 8 * 2 * ARRAYSIZE(g_device_keys);
+    int rounds = 2000;
+    volatile int sink = 0;
+
+    double start = now();
+    for (int i = 0; i < rounds; i++) sink += boot_lookups();
+    double t = now() - start;
+
+    start = now();
+    for (int i = 0; i < rounds; i++) reload_ini_cache(g_filename);
+    double t_load = now() - start;
+
+    remove(g_filename);
+
+    printf("%s: %d lookups per boot, %8.1f us per boot, %6.1f us to load the file\n",
+           BENCHMARK_NAME,
+           lookups, t * 1e6 / rounds, t_load * 1e6 / rounds);
+    return 0;
+}
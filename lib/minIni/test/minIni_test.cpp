@@ -0,0 +1,189 @@
+#include "minIni.h"
+#include "minIni_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+SdFs SD;
+
+static const char *g_filename = "minIni_test.ini";
+
+static void write_file(const char *text)
+{
+    FILE *f = fopen(g_filename, "wb");
+    fputs(text, f);
+    fclose(f);
+}
+
+// Compare lookup through the cache and key index against reading the file directly
+static bool same_as_uncached(const char *section, const char *key)
+{
+    char cached[INI_BUFFERSIZE];
+    char uncached[INI_BUFFERSIZE];
+
+    reload_ini_cache(g_filename);
+    int len1 = ini_gets(section, key, "default", cached, sizeof(cached), g_filename);
+    int has1 = ini_haskey(section, key, g_filename);
+
+    invalidate_ini_cache();
+    int len2 = ini_gets(section, key, "default", uncached, sizeof(uncached), g_filename);
+    int has2 = ini_haskey(section, key, g_filename);
+
+    if (len1 != len2 || strcmp(cached, uncached) != 0 || has1 != has2)
+    {
+        fprintf(stderr, "[%s] %s: cached '%s', uncached '%s'\n",
+                section ? section : "NULL", key, cached, uncached);
+        return false;
+    }
+    return true;
+}
+
+static const char *g_tricky_ini =
+    "toplevel = 1\n"
+    "; comment = 2\n"
+    "[SCSI]\r\n"
+    "  Debug = 1 ; trailing comment\r\n"
+    "Vendor=\"Quoted ; value\"\n"
+    "debug = 2\n"
+    "colon: 5\n"
+    "both: x = y\n"
+    "# hash = comment\n"
+    "=no key name\n"
+    "[ scsi2 ]\n"
+    "Type = 2\n"
+    "[SCSI]\n"
+    "Vendor = repeated section\n"
+    "Only = in repeated section\n"
+    "[bad section\n"
+    "Lost = 1\n"
+    "[ ]\n"
+    "Empty = 1\n"
+    "[SCSI3]\n"
+    "Type = 3\n"
+    "Type = 4\n"
+    "Product\n"
+    "  Serial   =   ABC   \n"
+    "[Last]\n"
+    "NoNewline = end";
+
+bool test_index_matches_minini()
+{
+    bool status = true;
+    COMMENT("test_index_matches_minini()");
+    write_file(g_tricky_ini);
+
+    TEST(same_as_uncached("", "toplevel"));
+    TEST(same_as_uncached(NULL, "toplevel"));
+    TEST(same_as_uncached("SCSI", "toplevel"));
+    TEST(same_as_uncached("", "comment"));
+    TEST(same_as_uncached("SCSI", "Debug"));
+    TEST(same_as_uncached("scsi", "DEBUG"));
+    TEST(same_as_uncached("SCSI", "Vendor"));
+    TEST(same_as_uncached("SCSI", "colon"));
+    TEST(same_as_uncached("SCSI", "both"));
+    TEST(same_as_uncached("SCSI", "both: x"));
+    TEST(same_as_uncached("SCSI", "hash"));
+    TEST(same_as_uncached("SCSI", "Only"));
+    TEST(same_as_uncached("SCSI2", "Type"));
+    TEST(same_as_uncached(" scsi2 ", "Type"));
+    TEST(same_as_uncached("bad section", "Lost"));
+    TEST(same_as_uncached("SCSI", "Lost"));
+    TEST(same_as_uncached("", "Empty"));
+    TEST(same_as_uncached(" ", "Empty"));
+    TEST(same_as_uncached("SCSI3", "Type"));
+    TEST(same_as_uncached("SCSI3", "Product"));
+    TEST(same_as_uncached("SCSI3", "Serial"));
+    TEST(same_as_uncached("Last", "NoNewline"));
+    TEST(same_as_uncached("Missing", "Type"));
+    TEST(same_as_uncached("SCSI", "Missing"));
+
+    reload_ini_cache(g_filename);
+    FsFile fp;
+    TEST(ini_openread(g_filename, &fp));
+    TEST(ini_seekkey(&fp, "scsi3", "type") == 1);
+    TEST(ini_seekkey(&fp, "SCSI3", "Missing") == 0);
+    TEST(ini_seekkey(&fp, "Missing", "Type") == 0);
+    ini_close(&fp);
+
+    TEST(ini_getl("SCSI3", "Type", 0, g_filename) == 3);
+    TEST(ini_getbool("SCSI", "Debug", 0, g_filename) == 1);
+    TEST(ini_getl("SCSI", "Missing", 42, g_filename) == 42);
+
+    return status;
+}
+
+bool test_long_lines()
+{
+    bool status = true;
+    COMMENT("test_long_lines()");
+
+    // Line longer than INI_BUFFERSIZE is split into pieces by minIni
+    char text[2048];
+    char *p = text;
+    p += sprintf(p, "[A]\nLong = ");
+    for (int i = 0; i < INI_BUFFERSIZE; i++) *p++ = 'x';
+    p += sprintf(p, " Hidden = 1\nAfter = 2\n");
+    write_file(text);
+
+    TEST(same_as_uncached("A", "Long"));
+    TEST(same_as_uncached("A", "Hidden"));
+    TEST(same_as_uncached("A", "After"));
+
+    return status;
+}
+
+bool test_index_full()
+{
+    bool status = true;
+    COMMENT("test_index_full()");
+
+    // More keys than fit in the index, lookups scan the file instead
+    char text[4096];
+    char *p = text;
+    p += sprintf(p, "[Many]\n");
+    for (int i = 0; i < 400; i++)
+    {
+        p += sprintf(p, "k%d=%d\n", i, i);
+    }
+    write_file(text);
+
+    TEST(same_as_uncached("Many", "k0"));
+    TEST(same_as_uncached("Many", "k399"));
+    TEST(same_as_uncached("Many", "k400"));
+
+    reload_ini_cache(g_filename);
+    FsFile fp;
+    TEST(ini_openread(g_filename, &fp));
+    TEST(ini_seekkey(&fp, "Many", "k0") == -1);
+    ini_close(&fp);
+
+    TEST(ini_getl("Many", "k399", -1, g_filename) == 399);
+
+    return status;
+}
+
+int main()
+{
+    bool ok = test_index_matches_minini() && test_long_lines() && test_index_full();
+    remove(g_filename);
+
+    if (ok)
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
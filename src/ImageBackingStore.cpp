@@ -25,6 +25,7 @@
 #include <ZuluSCSI_platform.h>
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
+#include "ZuluSCSI_manifest.h"
 #include <minIni.h>
 #include <strings.h>
 #include <string.h>
@@ -35,11 +36,17 @@ ImageBackingStore::ImageBackingStore()
     m_israw = false;
     m_isrom = false;
     m_isreadonly_attr = false;
+    m_deferred = false;
     m_blockdev = nullptr;
     m_bgnsector = m_endsector = m_cursector = 0;
+    m_isram = false;
+    m_ramsync = false;
+    m_ramdata = nullptr;
+    m_ramsize = m_rampos = 0;
+    m_ramdirty_bgn = m_ramdirty_end = 0;
 }
 
-ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_size): ImageBackingStore()
+ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_size, bool defer_raw_mapping): ImageBackingStore()
 {
     if (strncasecmp(filename, "RAW:", 4) == 0)
     {
@@ -69,6 +76,10 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
             m_endsector = sectorCount - 1;
         }
     }
+    else if (strncasecmp(filename, "RAM:", 4) == 0)
+    {
+        openRamDrive(filename + 4);
+    }
     else if (strncasecmp(filename, "ROM:", 4) == 0)
     {
         if (!romDriveCheckPresent(&m_romhdr))
@@ -93,41 +104,148 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
             m_fsfile = SD.open(filename, O_RDWR);
         }
 
-        uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
-        uint32_t begin = 0, end = 0;
-        if (m_fsfile.contiguousRange(&begin, &end) && end >= begin + sectorcount
-            && (scsi_block_size % SD_SECTOR_SIZE) == 0)
+        if (defer_raw_mapping)
+        {
+            m_deferred = m_fsfile.isOpen();
+        }
+        else
+        {
+            completeOpen(filename, scsi_block_size);
+        }
+    }
+}
+
+void ImageBackingStore::completeOpen(const char *filename, uint32_t scsi_block_size)
+{
+    m_deferred = false;
+    if (!m_fsfile.isOpen() || m_israw || m_isram)
+    {
+        return;
+    }
+
+    uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
+    uint32_t begin = 0, end = 0;
+    if (manifest_contiguous_range(m_fsfile, filename, &begin, &end) && end >= begin + sectorcount
+        && (scsi_block_size % SD_SECTOR_SIZE) == 0)
+    {
+        // Convert to raw mapping, this avoids some unnecessary
+        // access overhead in SdFat library.
+        // If non-aligned offsets are later requested, it automatically falls
+        // back to SdFat access mode.
+        m_israw = true;
+        m_blockdev = SD.card();
+        m_bgnsector = begin;
+
+        if (end != begin + sectorcount)
         {
-            // Convert to raw mapping, this avoids some unnecessary
-            // access overhead in SdFat library.
-            // If non-aligned offsets are later requested, it automatically falls
-            // back to SdFat access mode.
-            m_israw = true;
-            m_blockdev = SD.card();
-            m_bgnsector = begin;
-
-            if (end != begin + sectorcount)
+            uint32_t allocsize = end - begin + 1;
+            // Due to issue #80 in ZuluSCSI version 1.0.8 and 1.0.9 the allocated size was mistakenly reported to SCSI controller.
+            // If the drive was formatted using those versions, you may have problems accessing it with newer firmware.
+            // The old behavior can be restored with setting  [SCSI] UseFATAllocSize = 1 in config file.
+
+            if (ini_getbool("SCSI", "UseFATAllocSize", 0, CONFIGFILE))
             {
-                uint32_t allocsize = end - begin + 1;
-                // Due to issue #80 in ZuluSCSI version 1.0.8 and 1.0.9 the allocated size was mistakenly reported to SCSI controller.
-                // If the drive was formatted using those versions, you may have problems accessing it with newer firmware.
-                // The old behavior can be restored with setting  [SCSI] UseFATAllocSize = 1 in config file.
-
-                if (ini_getbool("SCSI", "UseFATAllocSize", 0, CONFIGFILE))
-                {
-                    sectorcount = allocsize;
-                }
+                sectorcount = allocsize;
             }
+        }
+
+        m_endsector = begin + sectorcount - 1;
+        m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
+    }
+}
+
+bool ImageBackingStore::isOpenDeferred()
+{
+    return m_deferred;
+}
 
-            m_endsector = begin + sectorcount - 1;
-            m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
+// Parse RAM drive parameters, allocate memory and load the initial contents
+void ImageBackingStore::openRamDrive(const char *params)
+{
+#ifndef PLATFORM_HAS_RAM_DRIVE
+    logmsg("---- Platform does not support RAM drive");
+#else
+    char *endptr;
+    uint32_t size = strtoul(params, &endptr, 0) * 1024;
+    if (*endptr != ':' && *endptr != '\0')
+    {
+        logmsg("---- Invalid format for RAM drive: RAM:", params);
+        return;
+    }
+
+    if (*endptr == ':')
+    {
+        char srcname[MAX_FILE_PATH + 1];
+        strncpy(srcname, endptr + 1, MAX_FILE_PATH);
+        srcname[MAX_FILE_PATH] = '\0';
+
+        char *suffix = strrchr(srcname, ':');
+        if (suffix && strcasecmp(suffix, ":sync") == 0)
+        {
+            *suffix = '\0';
+            m_ramsync = true;
+        }
+
+        m_fsfile = SD.open(srcname, m_ramsync ? O_RDWR : O_RDONLY);
+        if (!m_fsfile.isOpen())
+        {
+            logmsg("---- Failed to open RAM drive image file ", srcname);
+            return;
+        }
+
+        if (size == 0)
+        {
+            size = m_fsfile.size();
+        }
+        else if (m_fsfile.size() > size)
+        {
+            logmsg("---- RAM drive image file ", srcname, " is larger than drive size");
+            m_fsfile.close();
+            return;
         }
     }
+
+    if (size == 0)
+    {
+        logmsg("---- RAM drive size is not specified");
+        return;
+    }
+
+    m_ramdata = platform_alloc_ramdrive(size);
+    if (!m_ramdata)
+    {
+        logmsg("---- Not enough memory for ", (int)(size / 1024), " kB RAM drive");
+        m_fsfile.close();
+        return;
+    }
+
+    m_isram = true;
+    m_ramsize = size;
+    memset(m_ramdata, 0, size);
+
+    if (m_fsfile.isOpen())
+    {
+        uint32_t filesize = m_fsfile.size();
+        if (m_fsfile.read(m_ramdata, filesize) != (int)filesize)
+        {
+            logmsg("---- Failed to load RAM drive contents from file");
+        }
+
+        if (!m_ramsync)
+        {
+            m_fsfile.close();
+        }
+    }
+
+    logmsg("---- RAM drive size ", (int)(size / 1024), " kB", m_ramsync ? ", saved to file on sync" : "");
+#endif
 }
 
 bool ImageBackingStore::isOpen()
 {
-    if (m_israw)
+    if (m_isram)
+        return (m_ramdata != nullptr);
+    else if (m_israw)
         return (m_blockdev != NULL);
     else if (m_isrom)
         return (m_romhdr.imagesize > 0);
@@ -145,9 +263,23 @@ bool ImageBackingStore::isRom()
     return m_isrom;
 }
 
+bool ImageBackingStore::isRam()
+{
+    return m_isram;
+}
+
 bool ImageBackingStore::close()
 {
-    if (m_israw)
+    if (m_isram)
+    {
+#ifdef PLATFORM_HAS_RAM_DRIVE
+        platform_free_ramdrive(m_ramdata);
+#endif
+        m_ramdata = nullptr;
+        m_fsfile.close();
+        return true;
+    }
+    else if (m_israw)
     {
         m_blockdev = nullptr;
         return true;
@@ -163,9 +295,37 @@ bool ImageBackingStore::close()
     }
 }
 
+bool ImageBackingStore::closeSDCardFile()
+{
+    if (m_isram)
+    {
+        if (m_ramsync && m_ramdirty_bgn != m_ramdirty_end)
+        {
+            logmsg("RAM drive changes were not saved to SD card");
+        }
+
+        m_ramsync = false;
+        m_ramdirty_bgn = m_ramdirty_end = 0;
+        m_fsfile.close();
+        return true;
+    }
+    else if (m_isrom)
+    {
+        return true;
+    }
+    else
+    {
+        return close();
+    }
+}
+
 uint64_t ImageBackingStore::size()
 {
-    if (m_israw && m_blockdev)
+    if (m_isram)
+    {
+        return m_ramsize;
+    }
+    else if (m_israw && m_blockdev)
     {
         return (uint64_t)(m_endsector - m_bgnsector + 1) * SD_SECTOR_SIZE;
     }
@@ -181,7 +341,12 @@ uint64_t ImageBackingStore::size()
 
 bool ImageBackingStore::contiguousRange(uint32_t* bgnSector, uint32_t* endSector)
 {
-    if (m_israw && m_blockdev)
+    if (m_isram)
+    {
+        // Not on SD card
+        return false;
+    }
+    else if (m_israw && m_blockdev)
     {
         *bgnSector = m_bgnsector;
         *endSector = m_endsector;
@@ -201,6 +366,13 @@ bool ImageBackingStore::contiguousRange(uint32_t* bgnSector, uint32_t* endSector
 
 bool ImageBackingStore::seek(uint64_t pos)
 {
+    if (m_isram)
+    {
+        if (pos > m_ramsize) return false;
+        m_rampos = pos;
+        return true;
+    }
+
     uint32_t sectornum = pos / SD_SECTOR_SIZE;
 
     if (m_israw && (uint64_t)sectornum * SD_SECTOR_SIZE != pos)
@@ -229,6 +401,14 @@ bool ImageBackingStore::seek(uint64_t pos)
 
 ssize_t ImageBackingStore::read(void* buf, size_t count)
 {
+    if (m_isram)
+    {
+        if (count > m_ramsize - m_rampos) count = m_ramsize - m_rampos;
+        memcpy(buf, m_ramdata + m_rampos, count);
+        m_rampos += count;
+        return count;
+    }
+
     uint32_t sectorcount = count / SD_SECTOR_SIZE;
     if (m_israw && (uint64_t)sectorcount * SD_SECTOR_SIZE != count)
     {
@@ -269,8 +449,50 @@ ssize_t ImageBackingStore::read(void* buf, size_t count)
     }
 }
 
+const uint8_t *ImageBackingStore::readDirect(size_t count)
+{
+    if (!m_isrom)
+    {
+        return NULL;
+    }
+
+    uint32_t sectorcount = count / SD_SECTOR_SIZE;
+    uint32_t start = m_cursector * SD_SECTOR_SIZE;
+    if ((uint64_t)sectorcount * SD_SECTOR_SIZE != count || start + count > m_romhdr.imagesize)
+    {
+        return NULL;
+    }
+
+    const uint8_t *data = romDriveDirectPtr(start, count);
+    if (data)
+    {
+        m_cursector += sectorcount;
+    }
+    return data;
+}
+
 ssize_t ImageBackingStore::write(const void* buf, size_t count)
 {
+    if (m_isram)
+    {
+        if (count > m_ramsize - m_rampos) count = m_ramsize - m_rampos;
+        memcpy(m_ramdata + m_rampos, buf, count);
+
+        if (m_ramdirty_bgn == m_ramdirty_end)
+        {
+            m_ramdirty_bgn = m_rampos;
+            m_ramdirty_end = m_rampos + count;
+        }
+        else
+        {
+            if (m_rampos < m_ramdirty_bgn) m_ramdirty_bgn = m_rampos;
+            if (m_rampos + count > m_ramdirty_end) m_ramdirty_end = m_rampos + count;
+        }
+
+        m_rampos += count;
+        return count;
+    }
+
     uint32_t sectorcount = count / SD_SECTOR_SIZE;
     if (m_israw && (uint64_t)sectorcount * SD_SECTOR_SIZE != count)
     {
@@ -308,15 +530,47 @@ ssize_t ImageBackingStore::write(const void* buf, size_t count)
 
 void ImageBackingStore::flush()
 {
-    if (!m_israw && !m_isrom && !m_isreadonly_attr)
+    if (!m_israw && !m_isrom && !m_isram && !m_isreadonly_attr)
     {
         m_fsfile.flush();
     }
 }
 
+bool ImageBackingStore::sync()
+{
+    if (!m_isram)
+    {
+        flush();
+        return true;
+    }
+
+    if (!m_ramsync || m_ramdirty_bgn == m_ramdirty_end)
+    {
+        return true;
+    }
+
+    // Write back the modified range, the file grows if the drive is larger than it
+    uint32_t len = m_ramdirty_end - m_ramdirty_bgn;
+    if (!m_fsfile.seek(m_ramdirty_bgn) ||
+        m_fsfile.write(m_ramdata + m_ramdirty_bgn, len) != len)
+    {
+        logmsg("RAM drive write back failed: ", SD.sdErrorCode());
+        return false;
+    }
+
+    m_fsfile.flush();
+    dbgmsg("RAM drive wrote back ", (int)len, " bytes at offset ", (int)m_ramdirty_bgn);
+    m_ramdirty_bgn = m_ramdirty_end = 0;
+    return true;
+}
+
 uint64_t ImageBackingStore::position()
 {
-    if (!m_israw && !m_isrom)
+    if (m_isram)
+    {
+        return m_rampos;
+    }
+    else if (!m_israw && !m_isrom)
     {
         return m_fsfile.curPosition();
     }
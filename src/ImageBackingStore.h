@@ -4,6 +4,7 @@
  * - Files on SD card
  * - Raw SD card partitions
  * - Microcontroller flash ROM drive
+ * - RAM drive, optionally loaded from and saved to a file
  */
 
 #pragma once
@@ -28,6 +29,11 @@ extern SdFs SD;
 //
 // If the platform supports a ROM drive, it is activated by using
 // filename "ROM:".
+//
+// RAM drive is activated by filename "RAM:size_kB", "RAM:size_kB:file"
+// or "RAM:size_kB:file:sync". If a file is given, the drive is loaded from
+// it, and size 0 means same size as the file. With ":sync" changes are
+// written back to the file by sync().
 class ImageBackingStore
 {
 public:
@@ -38,7 +44,17 @@ public:
     // Special filename formats:
     //    RAW:start:end
     //    ROM:
-    ImageBackingStore(const char *filename, uint32_t scsi_block_size);
+    //    RAM:size_kB[:file[:sync]]
+    // If defer_raw_mapping is true, regular files are accessed through
+    // the filesystem until completeOpen() is called.
+    ImageBackingStore(const char *filename, uint32_t scsi_block_size, bool defer_raw_mapping = false);
+
+    // Check if a regular image file is contiguous on the SD card and switch
+    // to raw sector access if so. Done by the constructor unless deferred.
+    void completeOpen(const char *filename, uint32_t scsi_block_size);
+
+    // Is completeOpen() still pending?
+    bool isOpenDeferred();
 
     // Can the image be read?
     bool isOpen();
@@ -49,9 +65,18 @@ public:
     // Is this internal ROM drive in microcontroller flash?
     bool isRom();
 
+    // Is this drive stored in RAM?
+    bool isRam();
+
     // Close the image so that .isOpen() will return false.
+    // RAM drive contents are discarded, call sync() first to save them.
     bool close();
 
+    // Close the file on SD card before it is remounted.
+    // RAM drive keeps its contents, but changes are no longer saved to file.
+    // ROM drive is not affected.
+    bool closeSDCardFile();
+
     // Return image size in bytes
     uint64_t size();
 
@@ -65,12 +90,21 @@ public:
     // Read data from the image file, returns number of bytes read, or negative on error.
     ssize_t read(void* buf, size_t count);
 
+    // For ROM drive in memory-mapped flash, return pointer to the data at
+    // current position and advance the position by count bytes.
+    // Returns NULL if the image cannot be accessed directly.
+    const uint8_t *readDirect(size_t count);
+
     // Write data to image file, returns number of bytes written, or negative on error.
     ssize_t write(const void* buf, size_t count);
 
     // Flush any pending changes to filesystem
     void flush();
 
+    // Save data that is kept only in RAM to SD card.
+    // Used on SYNCHRONIZE CACHE and when the drive is stopped.
+    bool sync();
+
     // Gets current position for following read/write operations
     // Result is only valid for regular files, not raw or flash access
     uint64_t position();
@@ -79,10 +113,21 @@ protected:
     bool m_israw;
     bool m_isrom;
     bool m_isreadonly_attr;
+    bool m_deferred;
     romdrive_hdr_t m_romhdr;
     FsFile m_fsfile;
     SdCard *m_blockdev;
     uint32_t m_bgnsector;
     uint32_t m_endsector;
     uint32_t m_cursector;
+
+    bool m_isram;
+    bool m_ramsync; // Write changes back to m_fsfile
+    uint8_t *m_ramdata;
+    uint32_t m_ramsize;
+    uint32_t m_rampos;
+    uint32_t m_ramdirty_bgn; // Byte range modified since last sync()
+    uint32_t m_ramdirty_end;
+
+    void openRamDrive(const char *params);
 };
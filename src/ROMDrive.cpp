@@ -26,6 +26,7 @@
 #include <ZuluSCSI_platform.h>
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
+#include <LZ4Block.h>
 #include <strings.h>
 #include <string.h>
 
@@ -59,8 +60,24 @@ bool romDriveRead(uint8_t *buf, uint32_t start, uint32_t count)
     return false;
 }
 
+const uint8_t *romDriveDirectPtr(uint32_t start, uint32_t count)
+{
+    return NULL;
+}
+
 #else
 
+// Header of the active ROM drive and cache for compressed drive access.
+// Stored by romDriveCheckPresent().
+static struct {
+    romdrive_hdr_t hdr;
+    uint32_t cached_block;
+    uint32_t cache[ROMDRIVE_BLOCK_SIZE / 4];
+    uint32_t compressed[ROMDRIVE_BLOCK_SIZE / 4];
+} g_romdrive;
+
+#define ROMDRIVE_NO_BLOCK 0xFFFFFFFF
+
 // Check if the romdrive is present
 bool romDriveCheckPresent(romdrive_hdr_t *hdr)
 {
@@ -82,6 +99,15 @@ bool romDriveCheckPresent(romdrive_hdr_t *hdr)
         return false;
     }
 
+    if (hdr->compression != ROMDRIVE_COMPRESSION_NONE &&
+        (hdr->compression != ROMDRIVE_COMPRESSION_LZ4 ||
+         hdr->blockcount != (hdr->imagesize + ROMDRIVE_BLOCK_SIZE - 1) / ROMDRIVE_BLOCK_SIZE))
+    {
+        return false;
+    }
+
+    g_romdrive.hdr = *hdr;
+    g_romdrive.cached_block = ROMDRIVE_NO_BLOCK;
     return true;
 }
 
@@ -95,11 +121,168 @@ bool romDriveClear()
         logmsg("-- Failed to clear ROM drive");
         return false;
     }
+    g_romdrive.hdr = hdr;
     logmsg("-- Cleared ROM drive");
     SD.remove("CLEAR_ROM");
     return true;
 }
 
+// Program image as is, page by page
+static bool romDriveProgramUncompressed(FsFile &file, romdrive_hdr_t *hdr)
+{
+    // Program the drive metadata header
+    if (!platform_write_romdrive((const uint8_t*)hdr, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    {
+        logmsg("---- Failed to program ROM drive header");
+        return false;
+    }
+
+    // Program the drive contents
+    uint32_t pages = (hdr->imagesize + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) / PLATFORM_ROMDRIVE_PAGE_SIZE;
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        if (i % 2)
+            LED_ON();
+        else
+            LED_OFF();
+
+        if (file.read(scsiDev.data, PLATFORM_ROMDRIVE_PAGE_SIZE) <= 0 ||
+            !platform_write_romdrive(scsiDev.data, (i + 1) * PLATFORM_ROMDRIVE_PAGE_SIZE, PLATFORM_ROMDRIVE_PAGE_SIZE))
+        {
+            logmsg("---- Failed to program ROM drive page ", (int)i);
+            LED_OFF();
+            return false;
+        }
+    }
+
+    LED_OFF();
+    return true;
+}
+
+// Program image in blocks of LZ4 compressed data.
+// The scsiDev.data buffer is used as work area, as this runs before SCSI is active.
+static bool romDriveProgramCompressed(FsFile &file, romdrive_hdr_t *hdr)
+{
+    uint8_t *input = &scsiDev.data[0];
+    uint8_t *output = &scsiDev.data[ROMDRIVE_BLOCK_SIZE];
+    uint16_t *hashtable = (uint16_t*)&scsiDev.data[ROMDRIVE_BLOCK_SIZE * 2];
+    uint8_t *page = &scsiDev.data[ROMDRIVE_BLOCK_SIZE * 4];
+    uint32_t *index = (uint32_t*)&scsiDev.data[ROMDRIVE_BLOCK_SIZE * 5];
+    uint32_t max_blocks = (sizeof(scsiDev.data) - ROMDRIVE_BLOCK_SIZE * 5) / 4 - 1;
+    static_assert(LZ4BLOCK_HASH_SIZE * sizeof(uint16_t) <= ROMDRIVE_BLOCK_SIZE * 2, "Hash table does not fit");
+    static_assert(PLATFORM_ROMDRIVE_PAGE_SIZE == ROMDRIVE_BLOCK_SIZE, "Flash page size must match block size");
+
+    uint32_t blockcount = (hdr->imagesize + ROMDRIVE_BLOCK_SIZE - 1) / ROMDRIVE_BLOCK_SIZE;
+    if (blockcount > max_blocks)
+    {
+        logmsg("---- Image size exceeds compressed ROM drive limit, not loading");
+        return false;
+    }
+
+    // Clear the old header first, so that a partially programmed drive is not used
+    memset(page, 0, PLATFORM_ROMDRIVE_PAGE_SIZE);
+    if (!platform_write_romdrive(page, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    {
+        logmsg("---- Failed to clear ROM drive header");
+        return false;
+    }
+
+    uint32_t maxsize = platform_get_romdrive_maxsize();
+    uint32_t index_pages = ((blockcount + 1) * 4 + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) / PLATFORM_ROMDRIVE_PAGE_SIZE;
+    uint32_t pos = (1 + index_pages) * PLATFORM_ROMDRIVE_PAGE_SIZE;
+    uint32_t page_fill = 0;
+
+    for (uint32_t i = 0; i < blockcount; i++)
+    {
+        if (i % 2)
+            LED_ON();
+        else
+            LED_OFF();
+
+        memset(input, 0, ROMDRIVE_BLOCK_SIZE);
+        if (file.read(input, ROMDRIVE_BLOCK_SIZE) <= 0)
+        {
+            logmsg("---- Failed to read image file block ", (int)i);
+            return false;
+        }
+
+        // Incompressible blocks are stored as is.
+        // Compressed size is padded to keep flash reads aligned.
+        const uint8_t *data = output;
+        uint32_t size = lz4block_compress(input, ROMDRIVE_BLOCK_SIZE, output, ROMDRIVE_BLOCK_SIZE - 4, hashtable);
+        if (size == 0)
+        {
+            data = input;
+            size = ROMDRIVE_BLOCK_SIZE;
+        }
+        memset(output + size, 0, 3);
+        size = (size + 3) & ~3;
+
+        index[i] = pos;
+        if (pos + size > maxsize)
+        {
+            logmsg("---- Compressed image exceeds ROM space at block ", (int)i, " of ", (int)blockcount, ", not loading");
+            LED_OFF();
+            return false;
+        }
+
+        while (size > 0)
+        {
+            uint32_t len = PLATFORM_ROMDRIVE_PAGE_SIZE - page_fill;
+            if (len > size) len = size;
+            memcpy(page + page_fill, data, len);
+            page_fill += len;
+            data += len;
+            size -= len;
+            pos += len;
+
+            if (page_fill == PLATFORM_ROMDRIVE_PAGE_SIZE)
+            {
+                if (!platform_write_romdrive(page, pos - PLATFORM_ROMDRIVE_PAGE_SIZE, PLATFORM_ROMDRIVE_PAGE_SIZE))
+                {
+                    logmsg("---- Failed to program ROM drive at offset ", (int)pos);
+                    LED_OFF();
+                    return false;
+                }
+                page_fill = 0;
+            }
+        }
+    }
+    index[blockcount] = pos;
+
+    LED_OFF();
+
+    if (page_fill > 0)
+    {
+        memset(page + page_fill, 0xFF, PLATFORM_ROMDRIVE_PAGE_SIZE - page_fill);
+        if (!platform_write_romdrive(page, pos - page_fill, PLATFORM_ROMDRIVE_PAGE_SIZE))
+        {
+            logmsg("---- Failed to program ROM drive at offset ", (int)pos);
+            return false;
+        }
+    }
+
+    if (!platform_write_romdrive((const uint8_t*)index, PLATFORM_ROMDRIVE_PAGE_SIZE, index_pages * PLATFORM_ROMDRIVE_PAGE_SIZE))
+    {
+        logmsg("---- Failed to program ROM drive block index");
+        return false;
+    }
+
+    // Header is written last, after all data is in place
+    hdr->compression = ROMDRIVE_COMPRESSION_LZ4;
+    hdr->blockcount = blockcount;
+    memset(page, 0, PLATFORM_ROMDRIVE_PAGE_SIZE);
+    memcpy(page, hdr, sizeof(romdrive_hdr_t));
+    if (!platform_write_romdrive(page, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    {
+        logmsg("---- Failed to program ROM drive header");
+        return false;
+    }
+
+    logmsg("---- Compressed ", (int)(hdr->imagesize / 1024), " kB image to ", (int)(pos / 1024), " kB of flash");
+    return true;
+}
+
 // Load an image file to romdrive
 bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S2S_CFG_TYPE type)
 {
@@ -117,13 +300,6 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
     logmsg("---- ROM drive maximum size is ", (int)maxsize,
           " bytes, image file is ", (int)filesize, " bytes");
 
-    if (filesize > maxsize)
-    {
-        logmsg("---- Image size exceeds ROM space, not loading");
-        file.close();
-        return false;
-    }
-
     romdrive_hdr_t hdr = {};
     memcpy(hdr.magic, "ROMDRIVE", 8);
     hdr.scsi_id = scsi_id;
@@ -131,36 +307,24 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
     hdr.blocksize = blocksize;
     hdr.drivetype = type;
 
-    // Program the drive metadata header
-    if (!platform_write_romdrive((const uint8_t*)&hdr, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    bool status;
+    if (filesize > maxsize)
     {
-        logmsg("---- Failed to program ROM drive header");
-        file.close();
-        return false;
+        logmsg("---- Image size exceeds ROM space, trying compression");
+        status = (filesize <= 0xFFFFFFFF) && romDriveProgramCompressed(file, &hdr);
     }
-
-    // Program the drive contents
-    uint32_t pages = (filesize + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) / PLATFORM_ROMDRIVE_PAGE_SIZE;
-    for (uint32_t i = 0; i < pages; i++)
+    else
     {
-        if (i % 2)
-            LED_ON();
-        else
-            LED_OFF();
-
-        if (file.read(scsiDev.data, PLATFORM_ROMDRIVE_PAGE_SIZE) <= 0 ||
-            !platform_write_romdrive(scsiDev.data, (i + 1) * PLATFORM_ROMDRIVE_PAGE_SIZE, PLATFORM_ROMDRIVE_PAGE_SIZE))
-        {
-            logmsg("---- Failed to program ROM drive page ", (int)i);
-            file.close();
-            return false;
-        }
+        status = romDriveProgramUncompressed(file, &hdr);
     }
 
-    LED_OFF();
-
     file.close();
 
+    if (!status)
+    {
+        return false;
+    }
+
     char newname[MAX_FILE_PATH * 2] = "";
     strlcat(newname, filename, sizeof(newname));
     strlcat(newname, "_loaded", sizeof(newname));
@@ -170,9 +334,100 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
     return true;
 }
 
+// Decompress one block of compressed ROM drive to dest
+static bool romDriveLoadBlock(uint32_t block, uint8_t *dest)
+{
+    uint32_t index[2];
+    if (block >= g_romdrive.hdr.blockcount ||
+        !platform_read_romdrive((uint8_t*)index, PLATFORM_ROMDRIVE_PAGE_SIZE + block * 4, sizeof(index)))
+    {
+        return false;
+    }
+
+    uint32_t size = index[1] - index[0];
+    if (size == ROMDRIVE_BLOCK_SIZE)
+    {
+        // Block is stored uncompressed
+        return platform_read_romdrive(dest, index[0], ROMDRIVE_BLOCK_SIZE);
+    }
+    else if (size > ROMDRIVE_BLOCK_SIZE)
+    {
+        logmsg("ROM drive block index is corrupt at block ", (int)block);
+        return false;
+    }
+
+    uint8_t *compressed = (uint8_t*)g_romdrive.compressed;
+    if (!platform_read_romdrive(compressed, index[0], size))
+    {
+        return false;
+    }
+
+    if (lz4block_decompress(compressed, size, dest, ROMDRIVE_BLOCK_SIZE) != ROMDRIVE_BLOCK_SIZE)
+    {
+        logmsg("ROM drive decompression failed at block ", (int)block);
+        return false;
+    }
+
+    return true;
+}
+
 bool romDriveRead(uint8_t *buf, uint32_t start, uint32_t count)
 {
-    return platform_read_romdrive(buf, start + PLATFORM_ROMDRIVE_PAGE_SIZE, count);
+    if (g_romdrive.hdr.compression == ROMDRIVE_COMPRESSION_NONE)
+    {
+        return platform_read_romdrive(buf, start + PLATFORM_ROMDRIVE_PAGE_SIZE, count);
+    }
+
+    while (count > 0)
+    {
+        uint32_t block = start / ROMDRIVE_BLOCK_SIZE;
+        uint32_t offset = start % ROMDRIVE_BLOCK_SIZE;
+        uint32_t len = ROMDRIVE_BLOCK_SIZE - offset;
+        if (len > count) len = count;
+
+        if (len == ROMDRIVE_BLOCK_SIZE && block != g_romdrive.cached_block)
+        {
+            // Whole blocks are decompressed directly to destination
+            if (!romDriveLoadBlock(block, buf))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (block != g_romdrive.cached_block)
+            {
+                g_romdrive.cached_block = ROMDRIVE_NO_BLOCK;
+                if (!romDriveLoadBlock(block, (uint8_t*)g_romdrive.cache))
+                {
+                    return false;
+                }
+                g_romdrive.cached_block = block;
+            }
+
+            memcpy(buf, (uint8_t*)g_romdrive.cache + offset, len);
+        }
+
+        buf += len;
+        start += len;
+        count -= len;
+    }
+
+    return true;
+}
+
+const uint8_t *romDriveDirectPtr(uint32_t start, uint32_t count)
+{
+    if (g_romdrive.hdr.compression != ROMDRIVE_COMPRESSION_NONE)
+    {
+        return NULL;
+    }
+
+#ifdef PLATFORM_HAS_ROM_DRIVE_XIP
+    return platform_romdrive_xip_ptr(start + PLATFORM_ROMDRIVE_PAGE_SIZE, count);
+#else
+    return NULL;
+#endif
 }
 
 #endif
\ No newline at end of file
@@ -14,9 +14,18 @@ struct romdrive_hdr_t {
     uint32_t imagesize;
     uint32_t blocksize;
     S2S_CFG_TYPE drivetype;
-    uint32_t reserved[32];
+    uint32_t compression; // ROMDRIVE_COMPRESSION_NONE or ROMDRIVE_COMPRESSION_LZ4
+    uint32_t blockcount; // Number of compressed blocks
+    uint32_t reserved[30];
 };
 
+// Compressed ROM drive stores the image in blocks of ROMDRIVE_BLOCK_SIZE bytes.
+// Header page is followed by index of blockcount + 1 flash offsets, and then
+// LZ4 compressed block data. Blocks that don't compress are stored as is.
+#define ROMDRIVE_COMPRESSION_NONE 0
+#define ROMDRIVE_COMPRESSION_LZ4 1
+#define ROMDRIVE_BLOCK_SIZE 4096
+
 // Return true if ROM drive is found.
 // If hdr is not NULL, it will receive the ROM drive header information.
 // If flash is empty, returns false.
@@ -25,8 +34,13 @@ bool romDriveCheckPresent(romdrive_hdr_t *hdr = nullptr);
 // Clear any existing ROM drive, returning flash to empty state
 bool romDriveClear();
 
-// Program ROM drive image to flash
+// Program ROM drive image to flash.
+// Image is compressed if it does not otherwise fit.
 bool romDriveProgram(const char *filename, int scsi_id, int blocksize, S2S_CFG_TYPE type);
 
 // Read data from rom drive main data area
 bool romDriveRead(uint8_t *buf, uint32_t start, uint32_t count);
+
+// Get pointer to rom drive main data area, if it is memory-mapped.
+// Returns NULL if platform does not support direct access.
+const uint8_t *romDriveDirectPtr(uint32_t start, uint32_t count);
@@ -50,6 +50,9 @@
 #include "ZuluSCSI_platform.h"
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_log_trace.h"
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_bustrace.h"
+#include "ZuluSCSI_manifest.h"
 #include "ZuluSCSI_presets.h"
 #include "ZuluSCSI_disk.h"
 #include "ZuluSCSI_initiator.h"
@@ -57,6 +60,7 @@
 
 SdFs SD;
 FsFile g_logfile;
+FsFile g_binlogfile;
 static bool g_romdrive_active;
 static bool g_sdcard_present;
 
@@ -93,24 +97,122 @@ extern "C" void s2s_ledOff()
 /* Log saving */
 /**************/
 
+// Log data is written to SD card in the background while the SCSI bus is free.
+// Each write ends at a sector boundary in the file, so that SdFat can write
+// full sectors directly without reading them first. The directory entry is
+// updated only after all pending data has been written.
+struct logsave_t {
+  FsFile *file;
+  const uint8_t *(*get_data)(uint32_t *startpos, uint32_t *available);
+  uint32_t (*get_len)();
+  uint32_t pos; // Position in log buffer that has been written to file
+  bool unflushed; // Data written without updating directory entry
+};
+
+static const uint8_t *get_textlog(uint32_t *startpos, uint32_t *available)
+{
+  return (const uint8_t*)log_get_buffer(startpos, available);
+}
+
+static logsave_t g_logsave_text = {&g_logfile, get_textlog, log_get_buffer_len, 0, false};
+static logsave_t g_logsave_bin = {&g_binlogfile, log_get_binbuffer, log_get_binbuffer_len, 0, false};
+static uint32_t g_logsave_time;
+
+// Write pending log data to file, up to max_len bytes.
+// If allow_partial is false, only writes if the data reaches max_len.
+// Returns number of bytes written.
+static uint32_t logsave_write(logsave_t *log, uint32_t max_len, bool allow_partial)
+{
+  uint32_t pos = log->pos;
+  uint32_t available = 0;
+  const uint8_t *data = log->get_data(&pos, &available);
+  uint32_t start = pos - available;
+
+  // Data wrapping around end of log buffer is written in two parts
+  bool wraps = (log->get_len() != pos);
+  uint32_t len = (available > max_len) ? max_len : available;
+  if (len == 0 || (len < max_len && !allow_partial && !wraps))
+  {
+    return 0;
+  }
+
+  if (log->file->write(data, len) != len)
+  {
+    // Leave position unchanged, the data is retried on next save
+    return 0;
+  }
+
+  log->pos = start + len;
+  log->unflushed = true;
+  return len;
+}
+
+static void logsave_flush(logsave_t *log)
+{
+  if (log->unflushed)
+  {
+    log->file->flush();
+    log->unflushed = false;
+  }
+}
+
+static void save_logfile_all(logsave_t *log)
+{
+  if (log->file->isOpen())
+  {
+    while (logsave_write(log, 0xFFFFFFFF, true) > 0);
+    logsave_flush(log);
+  }
+}
+
 void save_logfile(bool always = false)
 {
-  static uint32_t prev_log_pos = 0;
-  static uint32_t prev_log_len = 0;
-  static uint32_t prev_log_save = 0;
-  uint32_t loglen = log_get_buffer_len();
+  if (!g_sdcard_present) return;
 
-  if (loglen != prev_log_len && g_sdcard_present)
+  // When debug is off, save log at most every LOG_SAVE_INTERVAL_MS
+  // When debug is on, save every time.
+  if (always || g_log_debug || (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - g_logsave_time) > LOG_SAVE_INTERVAL_MS))
   {
-    // When debug is off, save log at most every LOG_SAVE_INTERVAL_MS
-    // When debug is on, save after every SCSI command.
-    if (always || g_log_debug || (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - prev_log_save) > LOG_SAVE_INTERVAL_MS))
+    save_logfile_all(&g_logsave_text);
+    save_logfile_all(&g_logsave_bin);
+    g_logsave_time = millis();
+  }
+}
+
+// Called from main loop while SCSI bus is free.
+// Writes log in sector sized chunks, and stops as soon as the host selects us.
+static void save_logfile_async()
+{
+  if (!g_sdcard_present) return;
+
+  // Incomplete sectors are written after LOG_SAVE_INTERVAL_MS,
+  // or immediately if debug mode is on.
+  bool allow_partial = g_log_debug || (uint32_t)(millis() - g_logsave_time) > LOG_SAVE_INTERVAL_MS;
+  logsave_t *logs[2] = {&g_logsave_text, &g_logsave_bin};
+  for (int i = 0; i < 2; i++)
+  {
+    logsave_t *log = logs[i];
+    if (!log->file->isOpen()) continue;
+
+    while (true)
+    {
+      if (scsiHostWantsBus())
+      {
+        // Host wants to use the bus, continue later
+        return;
+      }
+
+      uint32_t sector_remain = 512 - (uint32_t)(log->file->curPosition() % 512);
+      if (logsave_write(log, sector_remain, allow_partial) == 0)
+      {
+        break;
+      }
+    }
+
+    if (log->get_len() == log->pos && log->unflushed)
     {
-      g_logfile.write(log_get_buffer(&prev_log_pos));
-      g_logfile.flush();
-      
-      prev_log_len = loglen;
-      prev_log_save = millis();
+      logsave_flush(log);
+      g_logsave_time = millis();
     }
   }
 }
@@ -126,7 +228,24 @@ void init_logfile()
   {
     logmsg("Failed to open log file: ", SD.sdErrorCode());
   }
+
+  g_binlogfile.close();
+  if (g_log_debug && g_log_binary)
+  {
+    g_binlogfile = SD.open(BINLOGFILE, flags);
+    if (!g_binlogfile.isOpen())
+    {
+      logmsg("Failed to open binary log file: ", SD.sdErrorCode());
+    }
+    else
+    {
+      logmsg("Debug messages are saved in binary format to " BINLOGFILE);
+      dbgmsg("Firmware version ", g_log_firmwareversion);
+    }
+  }
+
   save_logfile(true);
+  bustrace_init();
 
   first_open_after_boot = false;
 }
@@ -148,6 +267,21 @@ void print_sd_info()
     logmsg("SD Date: ", (int)sd_cid.mdtMonth(), "/", sd_cid.mdtYear());
     logmsg("SD Serial: ", sd_cid.psn());
   }
+
+#ifdef PLATFORM_HAS_SD_BUS_INFO
+  bool high_speed;
+  uint32_t clock_khz;
+  platform_get_sd_bus_info(&high_speed, &clock_khz);
+  logmsg("SD bus: ", high_speed ? "high speed" : "default speed", " mode, ",
+         (int)(clock_khz / 1000), " MHz");
+#endif
+
+#ifdef PLATFORM_HAS_SD_WRITE_SIZES
+  uint32_t min_size, max_size, last_size, au_size;
+  platform_get_sd_write_sizes(&min_size, &max_size, &last_size, &au_size);
+  logmsg("SD allocation unit: ", (int)(au_size / 1024), " kB, write size ",
+         (int)(min_size / 1024), " to ", (int)(max_size / 1024), " kB");
+#endif
 }
 
 /*********************************/
@@ -528,14 +662,28 @@ void readSCSIDeviceConfig()
 /* Main SCSI handling loop       */
 /*********************************/
 
+// Close all files on the SD card. ROM and RAM drives remain usable.
+static void closeSDCardFiles()
+{
+  invalidate_ini_cache();
+  g_logfile.close();
+  g_binlogfile.close();
+  bustrace_close();
+  scsiDiskCloseSDCardImages();
+#ifdef PLATFORM_HAS_INITIATOR_MODE
+  if (platform_is_initiator_mode_enabled())
+  {
+    scsiInitiatorCloseFiles();
+  }
+#endif
+}
+
 static bool mountSDCard()
 {
   // Prepare for mounting new SD card by closing all old files.
   // When switching between FAT and exFAT cards the pointers
   // are invalidated and accessing old files results in crash.
-  invalidate_ini_cache();
-  g_logfile.close();
-  scsiDiskCloseSDCardImages();
+  closeSDCardFiles();
 
   // Check for the common case, FAT filesystem as first partition
   if (SD.begin(SD_CONFIG))
@@ -563,6 +711,9 @@ static void reinitSCSI()
     g_log_debug = true;
   }
 
+  g_log_binary = (BINLOGBUFSIZE > 0) && ini_getbool("SCSI", "DebugBinaryLog", 0, CONFIGFILE);
+  stats_set_save_interval(ini_getl("SCSI", "StatsInterval", 0, CONFIGFILE));
+
 #ifdef PLATFORM_HAS_INITIATOR_MODE
   if (platform_is_initiator_mode_enabled())
   {
@@ -579,8 +730,10 @@ static void reinitSCSI()
 #endif
 
   scsiDiskResetImages();
+  manifest_load();
   readSCSIDeviceConfig();
   findHDDImages();
+  manifest_save();
 
   // Error if there are 0 image files
   if (scsiDiskCheckAnyImagesConfigured())
@@ -607,6 +760,93 @@ static void reinitSCSI()
   
 }
 
+/*********************************/
+/* SD card hotplug               */
+/*********************************/
+
+// Card presence is polled while the SCSI bus is free. Each call does at
+// most one SD card command or one mount attempt, so that a selection
+// arriving meanwhile is delayed as little as possible. A failed status
+// check is repeated on a later call before the card is considered removed.
+// While the card is missing, ROM and RAM drives keep serving requests.
+#define SD_CARD_CHECK_INTERVAL_MS 5000
+#define SD_CARD_RECHECK_DELAY_MS 10
+#define SD_CARD_REMOUNT_INTERVAL_MS 1000
+
+// Non-blocking version of blinkStatus(), called repeatedly.
+// The blinks are followed by one second pause.
+static void blinkStatusPoll(int count)
+{
+  uint32_t phase = millis() % (count * 500 + 1000);
+  if (phase < (uint32_t)count * 500 && (phase % 500) < 250)
+  {
+    LED_ON();
+  }
+  else
+  {
+    LED_OFF();
+  }
+}
+
+static void sdCardHotplugPoll()
+{
+  static uint32_t last_check_time = 0;
+  static bool check_failed = false;
+
+  uint32_t elapsed = (uint32_t)(millis() - last_check_time);
+
+  if (g_sdcard_present)
+  {
+    uint32_t interval = check_failed ? SD_CARD_RECHECK_DELAY_MS : SD_CARD_CHECK_INTERVAL_MS;
+    if (elapsed <= interval)
+    {
+      return;
+    }
+
+    last_check_time = millis();
+    uint32_t ocr;
+    if (SD.card()->readOCR(&ocr))
+    {
+      check_failed = false;
+    }
+    else if (!check_failed)
+    {
+      check_failed = true;
+    }
+    else
+    {
+      logmsg("SD card removed, trying to reinit");
+      check_failed = false;
+      g_sdcard_present = false;
+      closeSDCardFiles();
+    }
+  }
+  else
+  {
+    if (!g_romdrive_active)
+    {
+      blinkStatusPoll(BLINK_ERROR_NO_SD_CARD);
+    }
+
+    if (elapsed <= SD_CARD_REMOUNT_INTERVAL_MS)
+    {
+      return;
+    }
+
+    last_check_time = millis();
+    g_sdcard_present = mountSDCard();
+    if (g_sdcard_present)
+    {
+      logmsg("SD card reinit succeeded");
+      print_sd_info();
+
+      reinitSCSI();
+      init_logfile();
+      LED_OFF();
+    }
+  }
+}
+
 extern "C" void zuluscsi_setup(void)
 {
   platform_init();
@@ -686,7 +926,6 @@ extern "C" void zuluscsi_setup(void)
 
 extern "C" void zuluscsi_main_loop(void)
 {
-  static uint32_t sd_card_check_time = 0;
   static uint32_t last_request_time = 0;
 
   platform_reset_watchdog();
@@ -696,7 +935,11 @@ extern "C" void zuluscsi_main_loop(void)
 #ifdef PLATFORM_HAS_INITIATOR_MODE
   if (platform_is_initiator_mode_enabled())
   {
-    scsiInitiatorMainLoop();
+    // Imaging needs the SD card, wait until it has been remounted
+    if (g_sdcard_present)
+    {
+      scsiInitiatorMainLoop();
+    }
     save_logfile();
   }
   else
@@ -706,64 +949,36 @@ extern "C" void zuluscsi_main_loop(void)
     scsiDiskPoll();
     scsiLogPhaseChange(scsiDev.phase);
 
-    // Save log periodically during status phase if there are new messages.
-    // In debug mode, also save every 2 seconds if no SCSI requests come in.
+    // Save log in the background while the bus is free.
+    // In debug mode, also save if the bus has been busy for 2 seconds.
     // SD card writing takes a while, during which the code can't handle new
-    // SCSI requests, so normally we only want to save during a phase where
-    // the host is waiting for us. But for debugging issues where no requests
-    // come through or a request hangs, it's useful to force saving of log.
-    if (scsiDev.phase == STATUS || (g_log_debug && (uint32_t)(millis() - last_request_time) > 2000))
+    // SCSI requests, so normally the writes are split in small pieces that
+    // stop when a new selection comes in. But for debugging issues where a
+    // request hangs, it's useful to force saving of log.
+    if (scsiDev.phase == BUS_FREE)
     {
-      save_logfile();
-      last_request_time = millis();
-    }
-  }
-
-  if (g_sdcard_present)
-  {
-    // Check SD card status for hotplug
-    if (scsiDev.phase == BUS_FREE &&
-        (uint32_t)(millis() - sd_card_check_time) > 5000)
-    {
-      sd_card_check_time = millis();
-      uint32_t ocr;
-      if (!SD.card()->readOCR(&ocr))
+      save_logfile_async();
+      if (g_sdcard_present)
       {
-        if (!SD.card()->readOCR(&ocr))
+        stats_poll_save();
+        bustrace_poll();
+
+        if (!scsiHostWantsBus())
         {
-          g_sdcard_present = false;
-          logmsg("SD card removed, trying to reinit");
+          manifest_save();
         }
       }
+      last_request_time = millis();
     }
-  }
-
-  if (!g_sdcard_present)
-  {
-    // Try to remount SD card
-    do 
+    else if (g_log_debug && (uint32_t)(millis() - last_request_time) > 2000)
     {
-      g_sdcard_present = mountSDCard();
-
-      if (g_sdcard_present)
-      {
-        logmsg("SD card reinit succeeded");
-        print_sd_info();
-
-        reinitSCSI();
-        init_logfile();
-      }
-      else if (!g_romdrive_active)
-      {
-        blinkStatus(BLINK_ERROR_NO_SD_CARD);
-        delay(1000);
-        platform_reset_watchdog();
-        platform_poll();
-      }
-    } while (!g_sdcard_present && !g_romdrive_active);
+      save_logfile(true);
+      last_request_time = millis();
+    }
   }
-  else
+
+  if (scsiDev.phase == BUS_FREE)
   {
-    
+    sdCardHotplugPoll();
   }
 }
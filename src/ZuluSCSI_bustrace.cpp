@@ -0,0 +1,343 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_bustrace.h"
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_disk.h"
+#include <SdFat.h>
+#include <minIni.h>
+#include <DataHash.h>
+#include <scsi2sd.h>
+#include <string.h>
+
+extern "C" {
+#include <scsi.h>
+#include <scsiPhy.h>
+}
+
+extern SdFs SD;
+
+#if BUSTRACEBUFSIZE > 0
+
+static_assert(sizeof(bustrace_header_t) <= BUSTRACE_HEADER_SIZE, "Header must fit in one sector");
+static_assert(sizeof(bustrace_record_t) == 64, "Records must evenly fill sectors");
+static_assert(BUSTRACEBUFSIZE % 512 == 0 && (BUSTRACEBUFSIZE & (BUSTRACEBUFSIZE - 1)) == 0,
+              "Buffer size must be a power of 2 and multiple of sector size");
+
+// Write out partially filled sector after the bus has been idle for this long
+#define BUSTRACE_IDLE_SYNC_MS 1000
+
+static struct {
+    bool enabled;
+    FsFile file;
+    uint64_t file_limit;
+    uint16_t session;
+    uint32_t digest_limit;
+    uint32_t seq;
+    uint16_t dropped;
+
+    // Record for the command in progress
+    bool active;
+    bool in_data_phase;
+    uint32_t start_us;
+    uint32_t data_start_us;
+    uint32_t digest_bytes;
+    bustrace_record_t rec;
+
+    // Completed records waiting to be written.
+    // Sectors are written whole, tail is always at a sector boundary.
+    uint32_t head;
+    uint32_t tail;
+    uint32_t last_record_time;
+    bool synced;
+    uint8_t buffer[BUSTRACEBUFSIZE] __attribute__((aligned(4)));
+} g_bustrace;
+
+void bustrace_close()
+{
+    g_bustrace.file.close();
+    g_bustrace.enabled = false;
+    g_bustrace.active = false;
+}
+
+void bustrace_init()
+{
+    g_bustrace.file.close();
+    g_bustrace.enabled = false;
+    g_bustrace.active = false;
+    g_bustrace.in_data_phase = false;
+    g_bustrace.head = g_bustrace.tail = 0;
+    g_bustrace.seq = 0;
+    g_bustrace.dropped = 0;
+    g_bustrace.synced = true;
+
+    if (!ini_getbool("SCSI", "BusTrace", 0, CONFIGFILE))
+    {
+        return;
+    }
+
+    uint32_t size_mb = ini_getl("SCSI", "BusTraceSizeMB", 256, CONFIGFILE);
+    if (size_mb < 1) size_mb = 1;
+    if (size_mb > 4095) size_mb = 4095;
+    g_bustrace.file_limit = (uint64_t)size_mb << 20;
+    g_bustrace.digest_limit = ini_getl("SCSI", "BusTraceDigestBytes", 512, CONFIGFILE);
+
+    // The preallocated file can reuse the clusters of the previous trace.
+    // Use a different session number so that old records are not mistaken for new ones.
+    bustrace_header_t header;
+    g_bustrace.session = (uint16_t)millis();
+    FsFile oldfile = SD.open(BUSTRACEFILE, O_RDONLY);
+    if (oldfile.isOpen() &&
+        oldfile.read(&header, sizeof(header)) == sizeof(header) &&
+        memcmp(header.magic, BUSTRACE_MAGIC, sizeof(header.magic)) == 0)
+    {
+        g_bustrace.session = header.session + 1;
+    }
+    oldfile.close();
+
+    g_bustrace.file = SD.open(BUSTRACEFILE, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!g_bustrace.file.isOpen())
+    {
+        logmsg("Failed to open bus trace file: ", SD.sdErrorCode());
+        return;
+    }
+
+    // Contiguous preallocated file avoids FAT updates while recording.
+    // If there is no large enough free area, the file grows as needed.
+    // Only preallocate on exFAT, on FAT32 the file size would cover the
+    // whole preallocated area and expose old card contents after the trace.
+    if (SD.fatType() == FAT_TYPE_EXFAT &&
+        !g_bustrace.file.preAllocate(g_bustrace.file_limit))
+    {
+        logmsg("---- Could not preallocate bus trace file, writes will be slower");
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUSTRACE_MAGIC, sizeof(header.magic));
+    header.version = BUSTRACE_VERSION;
+    header.record_size = sizeof(bustrace_record_t);
+    header.session = g_bustrace.session;
+    header.digest_limit = g_bustrace.digest_limit;
+    strncpy(header.firmware, g_log_firmwareversion, sizeof(header.firmware) - 1);
+
+    // Buffer is empty at this point, use it to pad the header to sector size
+    memset(g_bustrace.buffer, 0, BUSTRACE_HEADER_SIZE);
+    memcpy(g_bustrace.buffer, &header, sizeof(header));
+    if (g_bustrace.file.write(g_bustrace.buffer, BUSTRACE_HEADER_SIZE) != BUSTRACE_HEADER_SIZE ||
+        !g_bustrace.file.flush())
+    {
+        logmsg("Failed to write bus trace file header");
+        g_bustrace.file.close();
+        return;
+    }
+
+    logmsg("Recording SCSI bus trace to " BUSTRACEFILE ", maximum size ", (int)size_mb, " MB");
+    g_bustrace.enabled = true;
+}
+
+void bustrace_command_start()
+{
+    if (!g_bustrace.enabled || scsiDev.target == NULL) return;
+
+    bustrace_record_t *rec = &g_bustrace.rec;
+    memset(rec, 0, sizeof(*rec));
+    rec->time_ms = millis();
+    rec->target = scsiDev.target->targetId;
+    rec->lun = scsiDev.lun;
+    rec->initiator = scsiDev.initiatorId;
+
+    g_bustrace.active = true;
+    g_bustrace.in_data_phase = false;
+    g_bustrace.digest_bytes = 0;
+    g_bustrace.start_us = stats_time_us();
+}
+
+static void bustrace_append(bustrace_record_t *rec)
+{
+    if (g_bustrace.head - g_bustrace.tail + sizeof(*rec) > BUSTRACEBUFSIZE)
+    {
+        if (g_bustrace.dropped != 0xFFFF) g_bustrace.dropped++;
+        return;
+    }
+
+    rec->magic = BUSTRACE_RECORD_MAGIC;
+    rec->session = g_bustrace.session;
+    rec->seq = g_bustrace.seq++;
+    rec->dropped = g_bustrace.dropped;
+    g_bustrace.dropped = 0;
+
+    memcpy(&g_bustrace.buffer[g_bustrace.head & (BUSTRACEBUFSIZE - 1)], rec, sizeof(*rec));
+    g_bustrace.head += sizeof(*rec);
+    g_bustrace.last_record_time = millis();
+    g_bustrace.synced = false;
+}
+
+void bustrace_phase_change(int new_phase)
+{
+    if (!g_bustrace.active) return;
+
+    bustrace_record_t *rec = &g_bustrace.rec;
+    uint32_t now = stats_time_us();
+    if (g_bustrace.in_data_phase)
+    {
+        rec->data_us += (uint32_t)(now - g_bustrace.data_start_us);
+    }
+
+    g_bustrace.in_data_phase = (new_phase == DATA_IN || new_phase == DATA_OUT);
+    if (g_bustrace.in_data_phase)
+    {
+        g_bustrace.data_start_us = now;
+    }
+
+    if (new_phase == STATUS)
+    {
+        rec->duration_us = now - g_bustrace.start_us;
+        rec->status = scsiDev.status;
+        rec->cdb_len = scsiDev.cdbLen;
+        memcpy(rec->cdb, scsiDev.cdb, sizeof(rec->cdb));
+        rec->sync_period = scsiDev.target->syncPeriod;
+        rec->sync_offset = scsiDev.target->syncOffset;
+
+        if (scsiDev.status == CHECK_CONDITION)
+        {
+            rec->sense_key = scsiDev.target->sense.code;
+            rec->sense_asc = scsiDev.target->sense.asc;
+        }
+
+        bustrace_append(rec);
+        g_bustrace.active = false;
+    }
+}
+
+void bustrace_data(bool in, const uint8_t *buf, uint32_t length)
+{
+    if (!g_bustrace.in_data_phase) return;
+
+    bustrace_record_t *rec = &g_bustrace.rec;
+    if (in)
+        rec->bytes_in += length;
+    else
+        rec->bytes_out += length;
+
+    if (g_bustrace.digest_bytes < g_bustrace.digest_limit)
+    {
+        uint32_t len = g_bustrace.digest_limit - g_bustrace.digest_bytes;
+        if (len > length) len = length;
+        rec->data_crc = crc32_update(rec->data_crc, buf, len);
+        g_bustrace.digest_bytes += len;
+    }
+}
+
+// Write the sector at tail of the buffer to the current file position
+static bool bustrace_write_sector()
+{
+    if (g_bustrace.file.curPosition() + 512 > g_bustrace.file_limit)
+    {
+        logmsg("Bus trace file is full, recording stopped");
+        g_bustrace.file.close();
+        g_bustrace.enabled = false;
+        return false;
+    }
+
+    uint8_t *sector = &g_bustrace.buffer[g_bustrace.tail & (BUSTRACEBUFSIZE - 1)];
+    if (g_bustrace.file.write(sector, 512) != 512)
+    {
+        logmsg("Bus trace file write failed, recording stopped");
+        g_bustrace.file.close();
+        g_bustrace.enabled = false;
+        return false;
+    }
+
+    return true;
+}
+
+void bustrace_poll()
+{
+    if (!g_bustrace.enabled) return;
+
+    // Write full sectors
+    while (g_bustrace.head - g_bustrace.tail >= 512)
+    {
+        if (scsiHostWantsBus() || !bustrace_write_sector())
+        {
+            return;
+        }
+
+        g_bustrace.tail += 512;
+    }
+
+    // When the host has been idle for a while, also write out the partial sector
+    // so that the trace survives power off. It is rewritten when it fills up.
+    if (!g_bustrace.synced &&
+        (uint32_t)(millis() - g_bustrace.last_record_time) > BUSTRACE_IDLE_SYNC_MS &&
+        !scsiHostWantsBus())
+    {
+        uint32_t pending = g_bustrace.head - g_bustrace.tail;
+        if (pending > 0)
+        {
+            // Rest of the sector is free space in the buffer
+            uint32_t start = g_bustrace.head & (BUSTRACEBUFSIZE - 1);
+            memset(&g_bustrace.buffer[start], 0, 512 - pending);
+
+            uint64_t pos = g_bustrace.file.curPosition();
+            if (!bustrace_write_sector()) return;
+            g_bustrace.file.seekSet(pos);
+        }
+
+        g_bustrace.file.flush();
+        g_bustrace.synced = true;
+    }
+}
+
+#else
+
+// Bus trace recorder disabled at compile time
+void bustrace_init()
+{
+    if (ini_getbool("SCSI", "BusTrace", 0, CONFIGFILE))
+    {
+        logmsg("---- BusTrace is not supported in this firmware build");
+    }
+}
+
+void bustrace_close()
+{
+}
+
+void bustrace_command_start()
+{
+}
+
+void bustrace_phase_change(int new_phase)
+{
+}
+
+void bustrace_data(bool in, const uint8_t *buf, uint32_t length)
+{
+}
+
+void bustrace_poll()
+{
+}
+
+#endif
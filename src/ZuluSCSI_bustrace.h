@@ -0,0 +1,94 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Binary SCSI bus trace recorder.
+// Stores one fixed size record per command to a file on the SD card,
+// for capturing long real-world workloads with little overhead.
+// Convert to CSV with utils/bustrace_convert.py.
+//
+// File format, all values little-endian:
+//   Header sector of 512 bytes, see bustrace_header_t.
+//   Followed by 64 byte bustrace_record_t entries.
+// The file is preallocated, so it may contain stale data after the last
+// record. Readers should stop at the first record with wrong magic,
+// session or sequence number.
+
+#pragma once
+
+#include <stdint.h>
+
+#define BUSTRACE_VERSION 1
+#define BUSTRACE_HEADER_SIZE 512
+#define BUSTRACE_MAGIC "ZSTRACE"
+#define BUSTRACE_RECORD_MAGIC 0x5442
+
+struct bustrace_header_t
+{
+    char magic[8]; // BUSTRACE_MAGIC
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t session;
+    uint16_t reserved;
+    uint32_t digest_limit; // Maximum bytes per command included in data_crc
+    char firmware[32];
+};
+
+struct bustrace_record_t
+{
+    uint16_t magic; // BUSTRACE_RECORD_MAGIC
+    uint16_t session; // Must match header
+    uint32_t seq; // Increments by one for each record, starting from 0
+    uint32_t time_ms; // Command start time
+    uint32_t duration_us; // From command start to status phase
+    uint8_t target;
+    uint8_t lun;
+    uint8_t initiator;
+    uint8_t status;
+    uint8_t cdb_len;
+    uint8_t sense_key;
+    uint16_t sense_asc;
+    uint8_t cdb[12];
+    uint32_t bytes_in; // Transferred to initiator in DATA_IN phase
+    uint32_t bytes_out; // Received from initiator in DATA_OUT phase
+    uint32_t data_crc; // CRC-32 of the first digest_limit bytes of data
+    uint32_t data_us; // Time spent in data phases
+    uint16_t dropped; // Records lost before this one due to full buffer
+    uint8_t sync_period;
+    uint8_t sync_offset;
+    uint8_t reserved[8];
+};
+
+// Open trace file if enabled with BusTrace setting in zuluscsi.ini.
+// Called after SD card has been mounted.
+void bustrace_init();
+
+// Close trace file before SD card is remounted.
+// Records that have not been written yet are discarded.
+void bustrace_close();
+
+// Called from SCSI trace hooks on target side
+void bustrace_command_start();
+void bustrace_phase_change(int new_phase);
+void bustrace_data(bool in, const uint8_t *buf, uint32_t length);
+
+// Write buffered records to SD card.
+// Returns early if a new selection comes in.
+void bustrace_poll();
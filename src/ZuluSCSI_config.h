@@ -45,6 +45,43 @@
 #endif
 #define LOG_SAVE_INTERVAL_MS 1000
 
+// Binary debug log file and buffer size, must be a power of 2.
+// Size 0 disables the DebugBinaryLog setting.
+#define BINLOGFILE  "zululog.bin"
+#ifndef BINLOGBUFSIZE
+#define BINLOGBUFSIZE 8192
+#endif
+
+// Binary SCSI bus trace file and buffer size, must be a power of 2 and multiple of 512.
+// Size 0 leaves out the BusTrace recorder.
+#define BUSTRACEFILE "zulutrace.bin"
+#ifndef BUSTRACEBUFSIZE
+#define BUSTRACEBUFSIZE 4096
+#endif
+
+// Performance statistics summary file, saved every StatsInterval seconds if enabled.
+// ENABLE_STATS=0 leaves out the per-target counters to save RAM.
+#define STATSFILE   "zulustat.txt"
+#ifndef ENABLE_STATS
+#define ENABLE_STATS 1
+#endif
+
+// Cached image contiguity checks, saved at boot if ImageManifest is enabled
+#define MANIFESTFILE "zuluimg.bin"
+
+// How often to save imaging progress map in initiator mode
+#define INITIATOR_MAP_SAVE_INTERVAL_MS 5000
+
+// Maximum amount of data to checksum at once while waiting for SD card in initiator mode
+#define INITIATOR_HASH_CHUNK_SIZE 2048
+
+// Selection timeout in initiator mode, 250 ms is the value recommended by SCSI-2.
+// Bus scan uses a shorter timeout because targets normally respond within microseconds,
+// drives that are still starting up are found on a later scan.
+#define INITIATOR_SELECT_TIMEOUT_US 250000
+#define INITIATOR_SCAN_SELECT_TIMEOUT_US 2000
+#define INITIATOR_SCAN_INTERVAL_MS 1000
+
 // Watchdog timeout
 // Watchdog will first issue a bus reset and if that does not help, crashdump.
 #define WATCHDOG_BUS_RESET_TIMEOUT 15000
@@ -94,6 +131,11 @@
 #define DEFAULT_SCSI_DELAY_US 10
 #define DEFAULT_REQ_TYPE_SETUP_NS 500
 
+// Support LazyImageOpen setting, takes MAX_FILE_PATH * 2 bytes of RAM per target
+#ifndef ENABLE_LAZY_IMAGE_OPEN
+#define ENABLE_LAZY_IMAGE_OPEN 1
+#endif
+
 // Use prefetch buffer in read requests
 #ifndef PREFETCH_BUFFER_SIZE
 #define PREFETCH_BUFFER_SIZE 8192
@@ -31,6 +31,7 @@
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_presets.h"
 #include "ZuluSCSI_cdrom.h"
+#include "ZuluSCSI_stats.h"
 #include "ImageBackingStore.h"
 #include "ROMDrive.h"
 #include <minIni.h>
@@ -39,6 +40,10 @@
 #include <assert.h>
 #include <SdFat.h>
 
+#ifdef PLATFORM_HAS_SD_WORKER
+#include <sd_worker.h>
+#endif
+
 extern "C" {
 #include <scsi2sd_time.h>
 #include <sd.h>
@@ -136,6 +141,10 @@ bool scsiDiskActivateRomDrive()
     }
 
     logmsg("---- Activating ROM drive, SCSI id ", (int)hdr.scsi_id, " size ", (int)(hdr.imagesize / 1024), " kB");
+    if (hdr.compression == ROMDRIVE_COMPRESSION_LZ4)
+    {
+        logmsg("---- ROM drive is compressed, ", (int)hdr.blockcount, " blocks");
+    }
     bool status = scsiDiskOpenHDDImage(hdr.scsi_id, "ROM:", hdr.scsi_id, 0, hdr.blocksize, hdr.drivetype);
 
     if (!status)
@@ -165,6 +174,12 @@ void scsiDiskResetImages()
 {
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
     {
+        // RAM drive may have been kept while SD card was remounted
+        if (g_DiskImages[i].file.isRam())
+        {
+            g_DiskImages[i].file.close();
+        }
+
         g_DiskImages[i].clear();
     }
 }
@@ -179,12 +194,11 @@ void scsiDiskCloseSDCardImages()
 {
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
     {
-        if (!g_DiskImages[i].file.isRom())
-        {
-            g_DiskImages[i].file.close();
-        }
-
+        g_DiskImages[i].file.closeSDCardFile();
         g_DiskImages[i].cuesheetfile.close();
+#if ENABLE_LAZY_IMAGE_OPEN
+        g_DiskImages[i].deferred_filename[0] = '\0';
+#endif
     }
 }
 
@@ -365,11 +379,77 @@ static void setDefaultDriveInfo(int target_idx)
     formatDriveInfoField(img.serial, sizeof(img.serial), true);
 }
 
+// Check if image is contiguous on SD card, used for aligning writes
+static void checkImageContiguity(image_config_t &img, const char *filename)
+{
+    uint32_t sector_begin = 0, sector_end = 0;
+    if (img.file.isRom())
+    {
+        // ROM is always contiguous, no need to log
+    }
+    else if (img.file.contiguousRange(&sector_begin, &sector_end))
+    {
+        dbgmsg("---- Image file is contiguous, SD card sectors ", (int)sector_begin, " to ", (int)sector_end);
+        img.sdContiguous = true;
+        img.sdContiguousStart = sector_begin;
+    }
+    else
+    {
+        logmsg("---- WARNING: file ", filename, " is not contiguous. This will increase read latency.");
+    }
+}
+
+// Open the CUE sheet accompanying a .bin CD-ROM image
+static void openCueSheet(image_config_t &img, const char *filename)
+{
+    if (img.deviceType == S2S_CFG_OPTICAL &&
+        strncasecmp(filename + strlen(filename) - 4, ".bin", 4) == 0)
+    {
+        char cuesheetname[MAX_FILE_PATH + 1] = {0};
+        strncpy(cuesheetname, filename, strlen(filename) - 4);
+        strlcat(cuesheetname, ".cue", sizeof(cuesheetname));
+        img.cuesheetfile = SD.open(cuesheetname, O_RDONLY);
+
+        if (img.cuesheetfile.isOpen())
+        {
+            logmsg("---- Found CD-ROM CUE sheet at ", cuesheetname);
+            if (!cdromValidateCueSheet(img))
+            {
+                logmsg("---- Failed to parse cue sheet, using as plain binary image");
+                img.cuesheetfile.close();
+            }
+        }
+        else
+        {
+            logmsg("---- No CUE sheet found at ", cuesheetname, ", using as plain binary image");
+        }
+    }
+}
+
 bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int scsi_lun, int blocksize, S2S_CFG_TYPE type)
 {
     image_config_t &img = g_DiskImages[target_idx];
     img.cuesheetfile.close();
-    img.file = ImageBackingStore(filename, blocksize);
+#if ENABLE_LAZY_IMAGE_OPEN
+    img.deferred_filename[0] = '\0';
+#endif
+    if (img.file.isRam())
+    {
+        // Release the memory before allocating a new drive
+        img.file.close();
+    }
+
+    // With LazyImageOpen the slow parts of opening, contiguity check and
+    // cue sheet parsing, are done on the first command that may access
+    // the image. This way the bus comes up quickly even with many images.
+    // UseFATAllocSize changes image size based on the check, so it can't be deferred.
+#if ENABLE_LAZY_IMAGE_OPEN
+    bool lazy = ini_getbool("SCSI", "LazyImageOpen", 0, CONFIGFILE) &&
+                !ini_getbool("SCSI", "UseFATAllocSize", 0, CONFIGFILE);
+#else
+    bool lazy = false;
+#endif
+    img.file = ImageBackingStore(filename, blocksize, lazy);
 
     if (img.file.isOpen())
     {
@@ -377,6 +457,8 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int
         img.scsiSectors = img.file.size() / blocksize;
         img.scsiId = scsi_id | S2S_CFG_TARGET_ENABLED;
         img.sdSectorStart = 0;
+        img.sdContiguous = false;
+        img.sdContiguousStart = 0;
         
         if (img.scsiSectors == 0)
         {
@@ -385,18 +467,13 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int
             return false;
         }
 
-        uint32_t sector_begin = 0, sector_end = 0;
-        if (img.file.isRom())
-        {
-            // ROM is always contiguous, no need to log
-        }
-        else if (img.file.contiguousRange(&sector_begin, &sector_end))
+        if (img.file.isOpenDeferred())
         {
-            dbgmsg("---- Image file is contiguous, SD card sectors ", (int)sector_begin, " to ", (int)sector_end);
+            dbgmsg("---- Image contiguity check deferred until first access");
         }
         else
         {
-            logmsg("---- WARNING: file ", filename, " is not contiguous. This will increase read latency.");
+            checkImageContiguity(img, filename);
         }
 
         if (type == S2S_CFG_OPTICAL)
@@ -446,27 +523,16 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int
             logmsg("---- Read prefetch disabled");
         }
 
-        if (img.deviceType == S2S_CFG_OPTICAL &&
-            strncasecmp(filename + strlen(filename) - 4, ".bin", 4) == 0)
+#if ENABLE_LAZY_IMAGE_OPEN
+        if (img.file.isOpenDeferred())
         {
-            char cuesheetname[MAX_FILE_PATH + 1] = {0};
-            strncpy(cuesheetname, filename, strlen(filename) - 4);
-            strlcat(cuesheetname, ".cue", sizeof(cuesheetname));
-            img.cuesheetfile = SD.open(cuesheetname, O_RDONLY);
-
-            if (img.cuesheetfile.isOpen())
-            {
-                logmsg("---- Found CD-ROM CUE sheet at ", cuesheetname);
-                if (!cdromValidateCueSheet(img))
-                {
-                    logmsg("---- Failed to parse cue sheet, using as plain binary image");
-                    img.cuesheetfile.close();
-                }
-            }
-            else
-            {
-                logmsg("---- No CUE sheet found at ", cuesheetname, ", using as plain binary image");
-            }
+            // Checked on first access, see scsiDiskCompleteDeferredOpen()
+            strlcpy(img.deferred_filename, filename, sizeof(img.deferred_filename));
+        }
+        else
+#endif
+        {
+            openCueSheet(img, filename);
         }
 
         return true;
@@ -900,6 +966,8 @@ void s2s_configInit(S2S_BoardCfg* config)
         config->scsiSpeed = S2S_CFG_SPEED_ASYNC_50;
     else if (maxSyncSpeed < 10 && config->scsiSpeed > S2S_CFG_SPEED_SYNC_5)
         config->scsiSpeed = S2S_CFG_SPEED_SYNC_5;
+    else if (maxSyncSpeed < 20 && config->scsiSpeed > S2S_CFG_SPEED_SYNC_10)
+        config->scsiSpeed = S2S_CFG_SPEED_SYNC_10;
     
     logmsg("-- SelectionDelay = ", (int)config->selectionDelay);
 
@@ -1345,6 +1413,39 @@ void diskDataOut_callback(uint32_t bytes_complete)
     }
 }
 
+// Read or write image file while calling callback with the number of bytes
+// transferred so far. The callback continues the SCSI transfer in parallel.
+static ssize_t diskStreamFile(image_config_t &img, bool write, uint8_t *buf, uint32_t count, sd_callback_t callback)
+{
+    uint32_t start = stats_time_us();
+
+#ifdef PLATFORM_HAS_SD_WORKER
+    // SD card access runs on second core, while this core keeps the SCSI bus busy
+    sd_worker_request_t request;
+    request.op = write ? SD_WORKER_WRITE : SD_WORKER_READ;
+    request.file = &img.file;
+    request.buffer = buf;
+    request.count = count;
+    if (sd_worker_submit(request))
+    {
+        uint32_t bytes_done = 0;
+        sd_worker_completion_t completion;
+        while (!sd_worker_poll(&bytes_done, &completion))
+        {
+            callback(bytes_done);
+        }
+        stats_sd_time(scsiDev.target->targetId, write, start);
+        return completion.result;
+    }
+#endif
+
+    platform_set_sd_callback(callback, buf);
+    ssize_t result = write ? img.file.write(buf, count) : img.file.read(buf, count);
+    platform_set_sd_callback(NULL, NULL);
+    stats_sd_time(scsiDev.target->targetId, write, start);
+    return result;
+}
+
 void diskDataOut()
 {
     scsiEnterPhase(DATA_OUT);
@@ -1359,6 +1460,25 @@ void diskDataOut()
     g_disk_transfer.sd_transfer_start = 0;
     g_disk_transfer.parityError = 0;
 
+    uint32_t min_size = PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE;
+    uint32_t max_size = PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE;
+    uint32_t last_size = PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE;
+    uint32_t au_size = 0;
+#ifdef PLATFORM_HAS_SD_WRITE_SIZES
+    platform_get_sd_write_sizes(&min_size, &max_size, &last_size, &au_size);
+#endif
+
+    // Position of the write on SD card, for aligning to allocation unit boundaries.
+    // Writes are aligned to max_size, which is a divisor of the allocation unit size.
+    uint64_t sd_offset = 0;
+    bool align_writes = (au_size != 0 && img.sdContiguous);
+    if (align_writes)
+    {
+        uint64_t image_offset = (uint64_t)(transfer.lba + transfer.currentBlock) * bytesPerSector;
+        sd_offset = (uint64_t)img.sdContiguousStart * SD_SECTOR_SIZE + image_offset;
+        align_writes = (sd_offset % SD_SECTOR_SIZE) == 0;
+    }
+
     while (g_disk_transfer.bytes_sd < g_disk_transfer.bytes_scsi
            && scsiDev.phase == DATA_OUT
            && !scsiDev.resetFlag)
@@ -1395,21 +1515,33 @@ void diskDataOut()
             len = available;
         }
 
-        // Apply platform-specific write size blocks for optimization
-        if (len > PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE)
+        // Apply card-specific write size blocks for optimization
+        if (len > max_size)
         {
-            len = PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE;
+            len = max_size;
+        }
+
+        // Split write at the next alignment boundary on SD card, so that following
+        // writes cover whole allocation units.
+        uint32_t to_boundary = max_size;
+        if (align_writes)
+        {
+            to_boundary = max_size - (uint32_t)((sd_offset + g_disk_transfer.bytes_sd) % max_size);
+            if (len > to_boundary)
+            {
+                len = to_boundary;
+            }
         }
 
         uint32_t remain_in_transfer = g_disk_transfer.bytes_scsi - g_disk_transfer.bytes_sd;
-        if (len < bufsize - start && len < remain_in_transfer)
+        if (len < bufsize - start && len < remain_in_transfer && len < to_boundary)
         {
             // Use large write blocks in middle of transfer and smaller at the end of transfer.
             // This improves performance for large writes and reduces latency at end of request.
-            uint32_t min_write_size = PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE;
-            if (remain_in_transfer <= PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE)
+            uint32_t min_write_size = min_size;
+            if (remain_in_transfer <= max_size)
             {
-                min_write_size = PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE;
+                min_write_size = last_size;
             }
 
             if (len < min_write_size)
@@ -1443,8 +1575,7 @@ void diskDataOut()
             uint8_t *buf = &scsiDev.data[start];
             g_disk_transfer.sd_transfer_start = start;
             // dbgmsg("SD write ", (int)start, " + ", (int)len, " ", bytearray(buf, len));
-            platform_set_sd_callback(&diskDataOut_callback, buf);
-            if (img.file.write(buf, len) != len)
+            if (diskStreamFile(img, true, buf, len, &diskDataOut_callback) != len)
             {
                 logmsg("SD card write failed: ", SD.sdErrorCode());
                 scsiDev.status = CHECK_CONDITION;
@@ -1452,7 +1583,6 @@ void diskDataOut()
                 scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
                 scsiDev.phase = STATUS;
             }
-            platform_set_sd_callback(NULL, NULL);
             g_disk_transfer.bytes_sd += len;
         }
     }
@@ -1524,6 +1654,7 @@ void scsiDiskStartRead(uint32_t lba, uint32_t blocks)
             if (count > transfer.blocks) count = transfer.blocks;
             scsiStartWrite(g_scsi_prefetch.buffer + start_offset * bytesPerSector, count * bytesPerSector);
             dbgmsg("------ Found ", (int)count, " sectors in prefetch cache");
+            stats_prefetch_hit(scsiDev.target->targetId);
             transfer.currentBlock += count;
         }
 
@@ -1611,9 +1742,7 @@ static void start_dataInTransfer(uint8_t *buffer, uint32_t count)
 
     // Start transferring from SD card
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    platform_set_sd_callback(&diskDataIn_callback, buffer);
-
-    if (img.file.read(buffer, count) != count)
+    if (diskStreamFile(img, false, buffer, count, &diskDataIn_callback) != count)
     {
         logmsg("SD card read failed: ", SD.sdErrorCode());
         scsiDev.status = CHECK_CONDITION;
@@ -1623,7 +1752,6 @@ static void start_dataInTransfer(uint8_t *buffer, uint32_t count)
     }
 
     diskDataIn_callback(count);
-    platform_set_sd_callback(NULL, NULL);
 
     platform_poll();
     diskEjectButtonUpdate(false);
@@ -1635,10 +1763,27 @@ static void diskDataIn()
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
     uint32_t maxblocks = sizeof(scsiDev.data) / bytesPerSector;
     uint32_t maxblocks_half = maxblocks / 2;
-    
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+
+    // ROM drive in memory-mapped flash can be sent to SCSI bus directly,
+    // which leaves the data buffer unused.
+    uint32_t remain = (transfer.blocks - transfer.currentBlock);
+    const uint8_t *direct = NULL;
+    if (remain > 0 && img.file.isRom())
+    {
+        direct = img.file.readDirect(remain * bytesPerSector);
+    }
+
+    if (direct)
+    {
+        scsiEnterPhase(DATA_IN);
+        scsiStartWrite(direct, remain * bytesPerSector);
+        transfer.currentBlock += remain;
+        remain = 0;
+    }
+
     // Start transfer in first half of buffer
     // Waits for the previous first half transfer to finish first.
-    uint32_t remain = (transfer.blocks - transfer.currentBlock);
     if (remain > 0)
     {
         uint32_t transfer_blocks = std::min(remain, maxblocks_half);
@@ -1663,7 +1808,6 @@ static void diskDataIn()
         // This was the last block, verify that everything finishes
 
 #ifdef PREFETCH_BUFFER_SIZE
-        image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
         int prefetchbytes = img.prefetchbytes;
         if (prefetchbytes > PREFETCH_BUFFER_SIZE) prefetchbytes = PREFETCH_BUFFER_SIZE;
         uint32_t prefetch_sectors = prefetchbytes / bytesPerSector;
@@ -1678,6 +1822,12 @@ static void diskDataIn()
             prefetch_sectors = img_sector_count - g_scsi_prefetch.sector;
         }
 
+        if (direct)
+        {
+            // Directly accessible data does not benefit from prefetch
+            prefetch_sectors = 0;
+        }
+
         while (!scsiIsWriteFinished(NULL) && prefetch_sectors > 0 && !scsiDev.resetFlag)
         {
             platform_poll();
@@ -1696,7 +1846,9 @@ static void diskDataIn()
             g_disk_transfer.bytes_sd = bytesPerSector;
             g_disk_transfer.bytes_scsi = bytesPerSector; // Tell callback not to send to SCSI
             platform_set_sd_callback(&diskDataIn_callback, g_disk_transfer.buffer);
+            uint32_t start = stats_time_us();
             int status = img.file.read(g_disk_transfer.buffer, bytesPerSector);
+            stats_sd_time(scsiDev.target->targetId, false, start);
             if (status <= 0)
             {
                 logmsg("Prefetch read failed");
@@ -1746,6 +1898,9 @@ int scsiDiskCommand()
         else
         {
             scsiDev.target->started = 0;
+
+            // Host is shutting down, save RAM drive contents
+            img.file.sync();
         }
     }
     else if (unlikely(command == 0x00))
@@ -1884,7 +2039,14 @@ int scsiDiskCommand()
     else if (unlikely(command == 0x35))
     {
         // SYNCHRONIZE CACHE
-        // We don't have a cache. do nothing.
+        // Only RAM drive keeps data that is not yet on SD card.
+        if (!img.file.sync())
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
+            scsiDev.phase = STATUS;
+        }
     }
     else if (unlikely(command == 0x2F))
     {
@@ -1940,6 +2102,36 @@ int scsiDiskCommand()
     return commandHandled;
 }
 
+extern "C"
+void scsiDiskCompleteDeferredOpen()
+{
+#if ENABLE_LAZY_IMAGE_OPEN
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    if (likely(img.deferred_filename[0] == '\0'))
+    {
+        return;
+    }
+
+    // INQUIRY, REQUEST SENSE and TEST UNIT READY don't access the image
+    uint8_t command = scsiDev.cdb[0];
+    if (scsiDev.resetFlag || command == 0x12 || command == 0x03 || command == 0x00)
+    {
+        return;
+    }
+
+    dbgmsg("---- Completing deferred open of ", img.deferred_filename);
+    img.file.completeOpen(img.deferred_filename, img.bytesPerSector);
+    checkImageContiguity(img, img.deferred_filename);
+    openCueSheet(img, img.deferred_filename);
+    img.deferred_filename[0] = '\0';
+#endif
+}
+
+bool scsiHostWantsBus()
+{
+    return scsiDev.phase != BUS_FREE || scsiDev.selFlag || *SCSI_STS_SELECTED;
+}
+
 extern "C"
 void scsiDiskPoll()
 {
@@ -73,6 +73,11 @@ struct image_config_t: public S2S_TargetCfg
     // Cue sheet file for CD-ROM images
     FsFile cuesheetfile;
 
+#if ENABLE_LAZY_IMAGE_OPEN
+    // Image path while opening is deferred by LazyImageOpen, empty otherwise
+    char deferred_filename[MAX_FILE_PATH * 2 + 2];
+#endif
+
     // Right-align vendor / product type strings (for Apple)
     // Standard SCSI uses left alignment
     // This field uses -1 for default when field is not set in .ini
@@ -87,6 +92,11 @@ struct image_config_t: public S2S_TargetCfg
     // Warning about geometry settings
     bool geometrywarningprinted;
 
+    // SD card sector where a contiguous image file starts.
+    // Used for aligning writes to card allocation units.
+    bool sdContiguous;
+    uint32_t sdContiguousStart;
+
     // Clear any image state to zeros
     void clear();
 
@@ -100,10 +110,15 @@ private:
 // Returns a mask of the buttons that registered an 'eject' action.
 uint8_t diskEjectButtonUpdate(bool immediate);
 
+// Returns true if the host is selecting us or a command is in progress.
+// Background SD card writes done while bus is free stop when this is set.
+bool scsiHostWantsBus();
+
 // Reset all image configuration to empty reset state, close all images.
 void scsiDiskResetImages();
 
-// Close any files opened from SD card (prepare for remounting SD)
+// Close any files opened from SD card (prepare for remounting SD).
+// ROM and RAM drives remain available.
 void scsiDiskCloseSDCardImages();
 
 bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int scsi_lun, int blocksize, S2S_CFG_TYPE type = S2S_CFG_FIXED);
@@ -28,7 +28,10 @@
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_initiator.h"
+#include "ZuluSCSI_initiator_map.h"
 #include <ZuluSCSI_platform.h>
+#include <minIni.h>
+#include <DataHash.h>
 #include "SdFat.h"
 
 #include <scsi2sd.h>
@@ -46,6 +49,10 @@ void scsiInitiatorMainLoop()
 {
 }
 
+void scsiInitiatorCloseFiles()
+{
+}
+
 int scsiInitiatorRunCommand(const uint8_t *command, size_t cmdlen,
                             uint8_t *bufIn, size_t bufInLen,
                             const uint8_t *bufOut, size_t bufOutLen)
@@ -60,6 +67,8 @@ bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *s
 
 #else
 
+#include <scsiHostSync.h>
+
 /*************************************
  * High level initiator mode logic   *
  *************************************/
@@ -68,9 +77,20 @@ static struct {
     // Bitmap of all drives that have been imaged
     uint32_t drives_imaged;
 
+    // Bitmap of drives that responded in last bus scan and are waiting to be imaged
+    uint32_t drives_found;
+    uint32_t scan_time;
+
     // Is imaging a drive in progress, or are we scanning?
     bool imaging;
 
+    // Is restoring an image to a drive in progress?
+    // Restore is started if HDxx_restore.hda exists for the drive ID.
+    bool restoring;
+    bool restore_verify; // Read back and compare data after writing
+    bool verifying; // Restore is in verify pass
+    uint32_t verify_errors;
+
     // Information about currently selected drive
     int target_id;
     uint32_t sectorsize;
@@ -80,29 +100,90 @@ static struct {
     uint32_t max_sector_per_transfer;
 
     // Retry information for sector reads.
-    // If a large read fails, retry is done sector-by-sector.
+    // Failed areas are skipped in the first pass and split into smaller
+    // pieces in the second pass, see ZuluSCSI_initiator_map.h.
     int retrycount;
-    uint32_t failposition;
+    int failcount; // Consecutive bus errors, used for falling back to asynchronous mode
 
     FsFile target_file;
+    char imagefilename[MAX_FILE_PATH];
+    char mapfilename[MAX_FILE_PATH];
+    uint32_t map_save_time;
 } g_initiator_state;
 
+// Sector status map of the drive being imaged, saved periodically
+// to allow resuming after power loss or SD card removal.
+static ImagingMap g_initiator_map;
+
+// Checksum of the image, calculated while the data is copied.
+// If the image is not copied sequentially in one go, the checksum
+// is calculated by reading back the image file at the end.
+enum initiator_hash_t { INITIATOR_HASH_NONE = 0, INITIATOR_HASH_MD5, INITIATOR_HASH_CRC32 };
+static struct {
+    initiator_hash_t type;
+    bool streaming; // True as long as data has been hashed sequentially from start
+    uint64_t bytes; // Number of bytes hashed
+    md5_ctx_t md5;
+    uint32_t crc32;
+} g_initiator_hash;
+
 extern SdFs SD;
 
+// Synchronous transfer negotiation state for each target
+static scsi_host_sync_t g_initiator_sync[8];
+
+// Message to send in next MESSAGE OUT phase
+static struct {
+    uint8_t data[SCSI_HOST_SYNC_MAX_MSGLEN];
+    size_t len;
+} g_initiator_msgout;
+
+// Reset the SCSI bus, which also clears synchronous transfer agreements
+static void scsiInitiatorBusReset()
+{
+    scsiHostPhyReset();
+
+    for (int i = 0; i < 8; i++)
+    {
+        scsiHostSyncReset(&g_initiator_sync[i]);
+    }
+}
+
 // Initialization of initiator mode
 void scsiInitiatorInit()
 {
-    scsiHostPhyReset();
+    int maxSyncSpeed = ini_getl("SCSI", "InitiatorMaxSyncSpeed", 10, CONFIGFILE);
+    uint8_t minPeriod = (maxSyncSpeed >= 10) ? SCSI_SYNC_PERIOD_10MB : SCSI_SYNC_PERIOD_5MB;
+    uint8_t maxOffset = (maxSyncSpeed >= 5) ? 15 : 0;
+    for (int i = 0; i < 8; i++)
+    {
+        scsiHostSyncInit(&g_initiator_sync[i], minPeriod, maxOffset);
+    }
+
+    scsiInitiatorBusReset();
 
     g_initiator_state.drives_imaged = 0;
+    g_initiator_state.drives_found = 0;
+    g_initiator_state.scan_time = millis() - INITIATOR_SCAN_INTERVAL_MS;
     g_initiator_state.imaging = false;
+    g_initiator_state.restoring = false;
+    g_initiator_state.restore_verify = ini_getbool("SCSI", "InitiatorRestoreVerify", true, CONFIGFILE);
     g_initiator_state.target_id = -1;
     g_initiator_state.sectorsize = 0;
     g_initiator_state.sectorcount = 0;
     g_initiator_state.sectors_done = 0;
     g_initiator_state.retrycount = 0;
-    g_initiator_state.failposition = 0;
+    g_initiator_state.failcount = 0;
     g_initiator_state.max_sector_per_transfer = 512;
+
+    char hashtype[8] = {0};
+    ini_gets("SCSI", "InitiatorImageHash", "md5", hashtype, sizeof(hashtype), CONFIGFILE);
+    if (strcasecmp(hashtype, "md5") == 0)
+        g_initiator_hash.type = INITIATOR_HASH_MD5;
+    else if (strcasecmp(hashtype, "crc32") == 0)
+        g_initiator_hash.type = INITIATOR_HASH_CRC32;
+    else
+        g_initiator_hash.type = INITIATOR_HASH_NONE;
 }
 
 // Update progress bar LED during transfers
@@ -127,13 +208,738 @@ static void scsiInitiatorUpdateLed()
     }
 }
 
-void delay_with_poll(uint32_t ms)
-{
-    uint32_t start = millis();
-    while ((uint32_t)(millis() - start) < ms)
+void delay_with_poll(uint32_t ms)
+{
+    uint32_t start = millis();
+    while ((uint32_t)(millis() - start) < ms)
+    {
+        platform_poll();
+        delay(1);
+    }
+}
+
+static void scsiInitiatorHashReset()
+{
+    g_initiator_hash.bytes = 0;
+    g_initiator_hash.crc32 = 0;
+    md5_init(&g_initiator_hash.md5);
+}
+
+static void scsiInitiatorHashData(const uint8_t *buf, uint32_t len)
+{
+    if (g_initiator_hash.type == INITIATOR_HASH_MD5)
+    {
+        md5_update(&g_initiator_hash.md5, buf, len);
+    }
+    else if (g_initiator_hash.type == INITIATOR_HASH_CRC32)
+    {
+        g_initiator_hash.crc32 = crc32_update(g_initiator_hash.crc32, buf, len);
+    }
+
+    g_initiator_hash.bytes += len;
+}
+
+// Calculate checksum by reading back the image file
+static bool scsiInitiatorHashFile()
+{
+    logmsg("Calculating checksum from image file");
+    scsiInitiatorHashReset();
+
+    uint64_t total = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize;
+    g_initiator_state.target_file.seek(0);
+    while (g_initiator_hash.bytes < total)
+    {
+        uint32_t len = sizeof(scsiDev.data);
+        if (len > total - g_initiator_hash.bytes) len = total - g_initiator_hash.bytes;
+
+        if (g_initiator_state.target_file.read(scsiDev.data, len) != (int)len)
+        {
+            logmsg("Failed to read image file at ", g_initiator_hash.bytes);
+            return false;
+        }
+
+        scsiInitiatorHashData(scsiDev.data, len);
+        platform_poll();
+        LED_ON();
+    }
+
+    LED_OFF();
+    return true;
+}
+
+// Write checksum file next to the image, in md5sum or .sfv format
+static void scsiInitiatorWriteHashFile(const char *imagename)
+{
+    const char *nibble = "0123456789abcdef";
+    char filename[MAX_FILE_PATH];
+    char line[MAX_FILE_PATH + 40];
+    char *p = line;
+
+    strncpy(filename, g_initiator_state.mapfilename, sizeof(filename) - 5);
+    filename[sizeof(filename) - 5] = '\0';
+    char *extension = strrchr(filename, '.');
+    if (extension) *extension = '\0';
+
+    if (g_initiator_hash.type == INITIATOR_HASH_MD5)
+    {
+        uint8_t digest[MD5_DIGEST_SIZE];
+        md5_final(&g_initiator_hash.md5, digest);
+        for (int i = 0; i < MD5_DIGEST_SIZE; i++)
+        {
+            *p++ = nibble[digest[i] >> 4];
+            *p++ = nibble[digest[i] & 0xF];
+        }
+        *p++ = ' ';
+        *p++ = ' ';
+        strcpy(p, imagename);
+        strcat(p, "\n");
+        strcat(filename, ".md5");
+    }
+    else
+    {
+        strcpy(p, imagename);
+        p += strlen(p);
+        *p++ = ' ';
+        for (int i = 28; i >= 0; i -= 4)
+        {
+            *p++ = nibble[(g_initiator_hash.crc32 >> i) & 0xF];
+        }
+        *p++ = '\n';
+        *p = '\0';
+        strcat(filename, ".sfv");
+    }
+
+    FsFile file = SD.open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen() || file.write(line, strlen(line)) != strlen(line) || !file.close())
+    {
+        logmsg("Failed to write checksum file ", filename);
+        return;
+    }
+
+    line[strlen(line) - 1] = '\0';
+    logmsg("Image checksum saved to ", filename, ": ", line);
+}
+
+// Open image file and map, resuming earlier interrupted imaging if possible.
+static void scsiInitiatorStartImaging(const char *filename, const char *identity)
+{
+    // Map file has the same name as image, but with .map extension
+    strncpy(g_initiator_state.mapfilename, filename, sizeof(g_initiator_state.mapfilename) - 5);
+    g_initiator_state.mapfilename[sizeof(g_initiator_state.mapfilename) - 5] = '\0';
+    char *extension = strrchr(g_initiator_state.mapfilename, '.');
+    if (extension) *extension = '\0';
+    strcat(g_initiator_state.mapfilename, ".map");
+
+    bool resume = SD.exists(filename) &&
+        g_initiator_map.load(g_initiator_state.mapfilename,
+                             g_initiator_state.sectorcount, g_initiator_state.sectorsize,
+                             identity);
+
+    if (resume)
+    {
+        g_initiator_state.target_file = SD.open(filename, O_RDWR);
+        if (!g_initiator_state.target_file.isOpen())
+        {
+            logmsg("Failed to open file for writing: ", filename);
+            return;
+        }
+
+        uint32_t finished = g_initiator_map.countSectors(IMAGINGMAP_FINISHED);
+        logmsg("Resuming imaging to ", filename, " from map file ", g_initiator_state.mapfilename,
+               ", ", (int)finished, " / ", (int)g_initiator_state.sectorcount, " sectors already done");
+    }
+    else
+    {
+        SD.remove(filename);
+        g_initiator_state.target_file = SD.open(filename, O_RDWR | O_CREAT | O_TRUNC);
+        if (!g_initiator_state.target_file.isOpen())
+        {
+            logmsg("Failed to open file for writing: ", filename);
+            return;
+        }
+
+        if (SD.fatType() == FAT_TYPE_EXFAT)
+        {
+            // Only preallocate on exFAT, on FAT32 preallocating can result in false garbage data in the
+            // file if write is interrupted.
+            logmsg("Preallocating image file");
+            g_initiator_state.target_file.preAllocate((uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize);
+        }
+
+        g_initiator_map.clear(g_initiator_state.sectorcount, g_initiator_state.sectorsize, identity);
+        g_initiator_map.save(g_initiator_state.mapfilename);
+        logmsg("Starting to copy drive data to ", filename);
+    }
+
+    g_initiator_state.sectors_done = g_initiator_map.countSectors(IMAGINGMAP_FINISHED)
+                                   + g_initiator_map.countSectors(IMAGINGMAP_BAD);
+    g_initiator_state.map_save_time = millis();
+    g_initiator_state.imaging = true;
+
+    strncpy(g_initiator_state.imagefilename, filename, sizeof(g_initiator_state.imagefilename) - 1);
+    scsiInitiatorHashReset();
+    g_initiator_hash.streaming = (g_initiator_state.sectors_done == 0);
+}
+
+static void scsiInitiatorFinishImaging()
+{
+    g_initiator_map.save(g_initiator_state.mapfilename);
+
+    scsiStartStopUnit(g_initiator_state.target_id, false);
+    logmsg("Finished imaging drive with id ", g_initiator_state.target_id);
+    LED_OFF();
+
+    uint32_t badsectors = g_initiator_map.countSectors(IMAGINGMAP_BAD);
+    if (badsectors > 0)
+    {
+        logmsg("WARNING: ", (int)badsectors, " sectors could not be read, see ", g_initiator_state.mapfilename);
+    }
+
+    if (g_initiator_hash.type != INITIATOR_HASH_NONE)
+    {
+        uint64_t total = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize;
+        if ((g_initiator_hash.streaming && g_initiator_hash.bytes == total) || scsiInitiatorHashFile())
+        {
+            scsiInitiatorWriteHashFile(g_initiator_state.imagefilename);
+        }
+    }
+
+    if (g_initiator_state.sectorcount != g_initiator_state.sectorcount_all)
+    {
+        logmsg("NOTE: Image size was limited to first 4 GiB due to SD card filesystem limit");
+        logmsg("Please reformat the SD card with exFAT format to image this drive fully");
+    }
+
+    g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
+    g_initiator_state.imaging = false;
+    g_initiator_state.target_file.close();
+}
+
+void scsiInitiatorCloseFiles()
+{
+    if (g_initiator_state.imaging || g_initiator_state.restoring)
+    {
+        logmsg("Stopping transfer of drive with id ", g_initiator_state.target_id, " until SD card is remounted");
+    }
+
+    g_initiator_state.imaging = false;
+    g_initiator_state.restoring = false;
+    g_initiator_state.target_file.close();
+    LED_OFF();
+}
+
+// Give up on imaging current drive, e.g. if the map becomes full.
+// The map file is kept so that imaging can be continued with PC tools.
+static void scsiInitiatorAbortImaging()
+{
+    logmsg("Stopping imaging of drive with id ", g_initiator_state.target_id,
+           ", progress is saved in ", g_initiator_state.mapfilename);
+    g_initiator_map.save(g_initiator_state.mapfilename);
+    g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
+    g_initiator_state.imaging = false;
+    g_initiator_state.target_file.close();
+    LED_OFF();
+}
+
+// Set image file position for writing the sectors starting at pos.
+// SdFat cannot seek past the end of file, so when an earlier area was
+// skipped the file is first extended with zeros. The zeros are replaced
+// when the skipped sectors are read on a later pass.
+static bool scsiInitiatorSeekImage(uint64_t pos)
+{
+    FsFile &file = g_initiator_state.target_file;
+    uint64_t size = file.size();
+    if (pos > size)
+    {
+        if (!file.seek(size))
+        {
+            return false;
+        }
+
+        memset(scsiDev.data, 0, sizeof(scsiDev.data));
+        while (size < pos)
+        {
+            uint32_t len = sizeof(scsiDev.data);
+            if (pos - size < len)
+                len = pos - size;
+
+            if (file.write(scsiDev.data, len) != len)
+            {
+                return false;
+            }
+
+            size += len;
+            platform_reset_watchdog();
+        }
+    }
+
+    return file.seek(pos);
+}
+
+// Read one block of sectors according to the current imaging pass
+static void scsiInitiatorImagingStep()
+{
+    // Select which sectors to read next
+    imagingmap_range_t range;
+    uint32_t numtoread;
+    if (g_initiator_map.pass == IMAGINGMAP_PASS_COPY)
+    {
+        if (!g_initiator_map.findNext(IMAGINGMAP_NONTRIED, g_initiator_map.current_pos, &range) &&
+            !g_initiator_map.findNext(IMAGINGMAP_NONTRIED, 0, &range))
+        {
+            uint32_t failed = g_initiator_map.countSectors(IMAGINGMAP_FAILED)
+                            + g_initiator_map.countSectors(IMAGINGMAP_SPLIT);
+            logmsg("First pass complete, retrying ", (int)failed, " sectors in failed areas");
+            g_initiator_map.pass = IMAGINGMAP_PASS_SPLIT;
+            g_initiator_map.current_pos = 0;
+            g_initiator_map.save(g_initiator_state.mapfilename);
+            return;
+        }
+
+        numtoread = range.count;
+        if (numtoread > g_initiator_state.max_sector_per_transfer)
+            numtoread = g_initiator_state.max_sector_per_transfer;
+    }
+    else
+    {
+        if (!g_initiator_map.findSplit(&range))
+        {
+            return;
+        }
+
+        if (range.count > 1)
+        {
+            // Split the failed area in half and try to read the first half.
+            // If it fails again, it will be split further on next call.
+            numtoread = range.count / 2;
+            if (numtoread > g_initiator_state.max_sector_per_transfer)
+                numtoread = g_initiator_state.max_sector_per_transfer;
+
+            if (!g_initiator_map.setStatus(range.start, range.count, IMAGINGMAP_SPLIT) ||
+                !g_initiator_map.setStatus(range.start, numtoread, IMAGINGMAP_SPLIT))
+            {
+                scsiInitiatorAbortImaging();
+                return;
+            }
+        }
+        else
+        {
+            numtoread = 1;
+        }
+    }
+
+    uint32_t start = range.start;
+    g_initiator_map.current_pos = start;
+    if (!scsiInitiatorSeekImage((uint64_t)start * g_initiator_state.sectorsize))
+    {
+        logmsg("Failed to seek to sector ", (int)start, " in image file, SD card full?");
+        scsiInitiatorAbortImaging();
+        return;
+    }
+
+    uint32_t time_start = millis();
+    bool bus_error = false;
+    bool status = scsiInitiatorReadDataToFile(g_initiator_state.target_id,
+        start, numtoread, g_initiator_state.sectorsize,
+        g_initiator_state.target_file, &bus_error);
+
+    char newstatus = 0;
+    if (!status)
+    {
+        logmsg("Failed to transfer ", (int)numtoread, " sectors starting at ", (int)start);
+
+        // Read errors reported by the drive are expected on a failing disk
+        // and don't mean that synchronous transfers are unreliable.
+        if (bus_error)
+        {
+            g_initiator_state.failcount++;
+        }
+
+        delay_with_poll(200);
+        scsiInitiatorBusReset();
+        delay_with_poll(200);
+
+        scsi_host_sync_t *sync = &g_initiator_sync[g_initiator_state.target_id];
+        if (g_initiator_state.failcount > 2 && sync->max_offset > 0)
+        {
+            logmsg("Multiple bus errors, falling back to asynchronous transfers");
+            scsiHostSyncInit(sync, sync->min_period, 0);
+        }
+
+        if (g_initiator_map.pass == IMAGINGMAP_PASS_COPY)
+        {
+            // Retry once to recover from bus glitches, then skip the area.
+            if (g_initiator_state.retrycount < 1)
+            {
+                g_initiator_state.retrycount++;
+                logmsg("Retrying..");
+            }
+            else
+            {
+                logmsg("Skipping failed area, it will be retried after the first pass");
+                newstatus = IMAGINGMAP_FAILED;
+            }
+        }
+        else if (numtoread == 1)
+        {
+            if (g_initiator_state.retrycount < 5)
+            {
+                g_initiator_state.retrycount++;
+                logmsg("Retrying.. ", g_initiator_state.retrycount, "/5");
+            }
+            else
+            {
+                logmsg("Retry limit exceeded, marking sector ", (int)start, " as bad");
+                newstatus = IMAGINGMAP_BAD;
+            }
+        }
+        else
+        {
+            // Failed piece is left with split status and will be split further on next call.
+            g_initiator_map.save(g_initiator_state.mapfilename);
+        }
+    }
+    else
+    {
+        g_initiator_state.failcount = 0;
+        g_initiator_state.target_file.flush();
+        newstatus = IMAGINGMAP_FINISHED;
+    }
+
+    if (newstatus != 0)
+    {
+        g_initiator_state.retrycount = 0;
+        if (!g_initiator_map.setStatus(start, numtoread, newstatus))
+        {
+            scsiInitiatorAbortImaging();
+            return;
+        }
+
+        g_initiator_map.current_pos = start + numtoread;
+        g_initiator_state.sectors_done = g_initiator_map.countSectors(IMAGINGMAP_FINISHED)
+                                       + g_initiator_map.countSectors(IMAGINGMAP_BAD);
+
+        if (newstatus == IMAGINGMAP_FINISHED)
+        {
+            int speed_kbps = numtoread * g_initiator_state.sectorsize / (millis() - time_start);
+            logmsg("SCSI read succeeded, sectors done: ",
+                  (int)g_initiator_state.sectors_done, " / ", (int)g_initiator_state.sectorcount,
+                  " speed ", speed_kbps, " kB/s");
+        }
+
+        // Failures are saved immediately, successful progress periodically
+        if (newstatus != IMAGINGMAP_FINISHED ||
+            (uint32_t)(millis() - g_initiator_state.map_save_time) > INITIATOR_MAP_SAVE_INTERVAL_MS)
+        {
+            g_initiator_map.save(g_initiator_state.mapfilename);
+            g_initiator_state.map_save_time = millis();
+        }
+    }
+}
+
+// Start writing image file to a drive
+static void scsiInitiatorStartRestore(const char *filename)
+{
+    g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
+
+    g_initiator_state.target_file = SD.open(filename, O_RDONLY);
+    if (!g_initiator_state.target_file.isOpen())
+    {
+        logmsg("Failed to open file for reading: ", filename);
+        return;
+    }
+
+    uint64_t filesize = g_initiator_state.target_file.size();
+    uint32_t sectorsize = g_initiator_state.sectorsize;
+    if (filesize == 0 || filesize % sectorsize != 0)
+    {
+        logmsg("Image ", filename, " size ", filesize, " is not a multiple of drive sector size ", (int)sectorsize);
+        g_initiator_state.target_file.close();
+        return;
+    }
+
+    if (filesize / sectorsize > g_initiator_state.sectorcount_all)
+    {
+        logmsg("Image ", filename, " has ", (int)(filesize / sectorsize), " sectors, but drive only has ",
+               (int)g_initiator_state.sectorcount_all);
+        g_initiator_state.target_file.close();
+        return;
+    }
+
+    // Data is sent with bit-banged asynchronous transfers.
+    // Reset the bus to clear any synchronous mode negotiated earlier.
+    scsi_host_sync_t *sync = &g_initiator_sync[g_initiator_state.target_id];
+    scsiHostSyncInit(sync, sync->min_period, 0);
+    scsiInitiatorBusReset();
+
+    strncpy(g_initiator_state.imagefilename, filename, sizeof(g_initiator_state.imagefilename) - 1);
+    g_initiator_state.sectorcount = filesize / sectorsize;
+    g_initiator_state.sectors_done = 0;
+    g_initiator_state.verifying = false;
+    g_initiator_state.verify_errors = 0;
+    g_initiator_state.restoring = true;
+
+    logmsg("Starting to restore ", filename, " to SCSI id ", g_initiator_state.target_id,
+           ", ", (int)g_initiator_state.sectorcount, " sectors");
+}
+
+static void scsiInitiatorFinishRestore()
+{
+    g_initiator_state.restoring = false;
+    g_initiator_state.target_file.close();
+    LED_OFF();
+
+    if (g_initiator_state.verify_errors > 0)
+    {
+        logmsg("WARNING: Restore to SCSI id ", g_initiator_state.target_id, " finished with ",
+               (int)g_initiator_state.verify_errors, " sectors failing verification");
+        return;
+    }
+
+    logmsg("Finished restoring drive with id ", g_initiator_state.target_id);
+
+    // Rename the image so that the drive is not written again on next boot
+    char newname[32] = "HD00_restored.hda";
+    newname[2] += g_initiator_state.target_id;
+    SD.remove(newname);
+    if (SD.rename(g_initiator_state.imagefilename, newname))
+    {
+        logmsg("Renamed ", g_initiator_state.imagefilename, " to ", newname);
+    }
+}
+
+// Write or verify one block of sectors when restoring image to drive
+static void scsiInitiatorRestoreStep()
+{
+    uint32_t start = g_initiator_state.sectors_done;
+    uint32_t sectorsize = g_initiator_state.sectorsize;
+    uint32_t numsectors = g_initiator_state.sectorcount - start;
+    bool status;
+
+    uint32_t time_start = millis();
+    g_initiator_state.target_file.seek((uint64_t)start * sectorsize);
+
+    if (!g_initiator_state.verifying)
+    {
+        if (numsectors > g_initiator_state.max_sector_per_transfer)
+            numsectors = g_initiator_state.max_sector_per_transfer;
+
+        status = scsiInitiatorWriteDataFromFile(g_initiator_state.target_id,
+            start, numsectors, sectorsize, g_initiator_state.target_file);
+    }
+    else
+    {
+        // Read from drive to first half of buffer and from image to second half
+        uint32_t halfsize = sizeof(scsiDev.data) / 2;
+        if (numsectors > halfsize / sectorsize)
+            numsectors = halfsize / sectorsize;
+
+        uint8_t *drivedata = &scsiDev.data[0];
+        uint8_t *filedata = &scsiDev.data[halfsize];
+        uint32_t len = numsectors * sectorsize;
+        uint8_t command[10] = {0x28, 0x00,
+            (uint8_t)(start >> 24), (uint8_t)(start >> 16),
+            (uint8_t)(start >> 8), (uint8_t)start,
+            0x00,
+            (uint8_t)(numsectors >> 8), (uint8_t)(numsectors),
+            0x00
+        };
+
+        status = scsiInitiatorRunCommand(g_initiator_state.target_id,
+                                         command, sizeof(command),
+                                         drivedata, len, NULL, 0) == 0;
+
+        if (status)
+        {
+            if (g_initiator_state.target_file.read(filedata, len) != (int)len)
+            {
+                logmsg("Failed to read image file at sector ", (int)start);
+                g_initiator_state.verify_errors += numsectors;
+            }
+            else
+            {
+                for (uint32_t i = 0; i < numsectors; i++)
+                {
+                    if (memcmp(drivedata + i * sectorsize, filedata + i * sectorsize, sectorsize) != 0)
+                    {
+                        logmsg("Verify failed at sector ", (int)(start + i));
+                        g_initiator_state.verify_errors++;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!status)
+    {
+        logmsg("Failed to ", g_initiator_state.verifying ? "verify " : "write ",
+               (int)numsectors, " sectors starting at ", (int)start);
+
+        delay_with_poll(200);
+        scsiInitiatorBusReset();
+        delay_with_poll(200);
+
+        if (g_initiator_state.retrycount < 5)
+        {
+            g_initiator_state.retrycount++;
+            logmsg("Retrying.. ", g_initiator_state.retrycount, "/5");
+            return;
+        }
+
+        g_initiator_state.retrycount = 0;
+        if (!g_initiator_state.verifying)
+        {
+            logmsg("Retry limit exceeded, stopping restore of drive ", g_initiator_state.target_id);
+            g_initiator_state.restoring = false;
+            g_initiator_state.target_file.close();
+            LED_OFF();
+            return;
+        }
+
+        logmsg("Retry limit exceeded, marking sectors as failed");
+        g_initiator_state.verify_errors += numsectors;
+    }
+    else
+    {
+        g_initiator_state.retrycount = 0;
+        int speed_kbps = numsectors * sectorsize / (millis() - time_start + 1);
+        dbgmsg("SCSI ", g_initiator_state.verifying ? "verify" : "write", " succeeded, sectors done: ",
+               (int)(start + numsectors), " / ", (int)g_initiator_state.sectorcount,
+               " speed ", speed_kbps, " kB/s");
+    }
+
+    g_initiator_state.sectors_done = start + numsectors;
+    if (g_initiator_state.sectors_done >= g_initiator_state.sectorcount)
+    {
+        if (!g_initiator_state.verifying && g_initiator_state.restore_verify)
+        {
+            logmsg("Write complete, verifying data on drive ", g_initiator_state.target_id);
+            g_initiator_state.verifying = true;
+            g_initiator_state.sectors_done = 0;
+        }
+        else
+        {
+            scsiInitiatorFinishRestore();
+        }
+    }
+}
+
+// Test which SCSI IDs respond to selection.
+// Uses a short selection timeout so that the whole bus can be checked quickly.
+static void scsiInitiatorScanBus()
+{
+    LED_ON();
+    for (int target_id = 0; target_id < 8; target_id++)
+    {
+        if (g_initiator_state.drives_imaged & (1 << target_id)) continue;
+
+        uint8_t command[6] = {0x00, 0, 0, 0, 0, 0};
+        int status = scsiInitiatorRunCommand(target_id,
+                                             command, sizeof(command),
+                                             NULL, 0,
+                                             NULL, 0,
+                                             false, INITIATOR_SCAN_SELECT_TIMEOUT_US);
+
+        if (status != -1)
+        {
+            dbgmsg("------ Target ", target_id, " responded to scan");
+            g_initiator_state.drives_found |= (1 << target_id);
+        }
+    }
+    LED_OFF();
+}
+
+// Run the full start-up sequence on a drive that was found in bus scan
+// and start imaging or restoring it.
+static void scsiInitiatorProbeDrive()
+{
+    uint8_t inquiry_data[36];
+
+    LED_ON();
+    bool startstopok =
+        scsiTestUnitReady(g_initiator_state.target_id) &&
+        scsiStartStopUnit(g_initiator_state.target_id, true);
+
+    bool readcapok = startstopok &&
+        scsiInitiatorReadCapacity(g_initiator_state.target_id,
+                                  &g_initiator_state.sectorcount,
+                                  &g_initiator_state.sectorsize);
+
+    bool inquiryok = startstopok &&
+        scsiInquiry(g_initiator_state.target_id, inquiry_data);
+    LED_OFF();
+
+    if (readcapok)
+    {
+        logmsg("SCSI id ", g_initiator_state.target_id,
+            " capacity ", (int)g_initiator_state.sectorcount,
+            " sectors x ", (int)g_initiator_state.sectorsize, " bytes");
+
+        g_initiator_state.sectorcount_all = g_initiator_state.sectorcount;
+
+        uint64_t total_bytes = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize;
+        logmsg("Drive total size is ", (int)(total_bytes / (1024 * 1024)), " MiB");
+        if (total_bytes >= 0xFFFFFFFF && SD.fatType() != FAT_TYPE_EXFAT)
+        {
+            // Note: the FAT32 limit is 4 GiB - 1 byte
+            logmsg("Image files equal or larger than 4 GiB are only possible on exFAT filesystem");
+            logmsg("Please reformat the SD card with exFAT format to image this drive fully");
+
+            g_initiator_state.sectorcount = (uint32_t)0xFFFFFFFF / g_initiator_state.sectorsize;
+            logmsg("Will image first 4 GiB - 1 = ", (int)g_initiator_state.sectorcount, " sectors");
+        }
+    }
+    else if (startstopok)
+    {
+        logmsg("SCSI id ", g_initiator_state.target_id, " responds but ReadCapacity command failed");
+        logmsg("Possibly SCSI-1 drive? Attempting to read up to 1 GB.");
+        g_initiator_state.sectorsize = 512;
+        g_initiator_state.sectorcount = g_initiator_state.sectorcount_all = 2097152;
+        g_initiator_state.max_sector_per_transfer = 128;
+    }
+    else
+    {
+        dbgmsg("Failed to connect to SCSI id ", g_initiator_state.target_id);
+        g_initiator_state.sectorsize = 0;
+        g_initiator_state.sectorcount = g_initiator_state.sectorcount_all = 0;
+    }
+
+    const char *filename_format = "HD00_imaged.hda";
+    if (inquiryok)
+    {
+        if ((inquiry_data[0] & 0x1F) == 5)
+        {
+            filename_format = "CD00_imaged.iso";
+        }
+    }
+
+    char restorename[32] = "HD00_restore.hda";
+    restorename[2] += g_initiator_state.target_id;
+
+    if (readcapok && SD.exists(restorename))
     {
-        platform_poll();
-        delay(1);
+        scsiInitiatorStartRestore(restorename);
+    }
+    else if (g_initiator_state.sectorcount > 0)
+    {
+        char filename[32] = {0};
+        strncpy(filename, filename_format, sizeof(filename) - 1);
+        filename[2] += g_initiator_state.target_id;
+
+        // Drive identity is stored in the map file to detect if a different
+        // drive has been connected to the same ID before resuming.
+        char identity[IMAGINGMAP_IDENTITY_LEN] = "unknown";
+        if (inquiryok)
+        {
+            memcpy(identity, &inquiry_data[8], 28);
+            identity[28] = '\0';
+            for (int i = 0; i < 28; i++)
+            {
+                if (identity[i] < 0x20 || identity[i] > 0x7E) identity[i] = '_';
+            }
+        }
+
+        scsiInitiatorStartImaging(filename, identity);
     }
 }
 
@@ -143,200 +949,162 @@ void scsiInitiatorMainLoop()
     if (g_scsiHostPhyReset)
     {
         logmsg("Executing BUS RESET after aborted command");
-        scsiHostPhyReset();
+        scsiInitiatorBusReset();
     }
 
-    if (!g_initiator_state.imaging)
+    if (!g_initiator_state.imaging && !g_initiator_state.restoring)
     {
-        // Scan for SCSI drives one at a time
-        g_initiator_state.target_id = (g_initiator_state.target_id + 1) % 8;
-        g_initiator_state.sectors_done = 0;
-        g_initiator_state.retrycount = 0;
-        g_initiator_state.max_sector_per_transfer = 512;
-
-        if (!(g_initiator_state.drives_imaged & (1 << g_initiator_state.target_id)))
+        if (g_initiator_state.drives_found == 0)
         {
-            delay_with_poll(1000);
-
-            uint8_t inquiry_data[36];
-
-            LED_ON();
-            bool startstopok =
-                scsiTestUnitReady(g_initiator_state.target_id) &&
-                scsiStartStopUnit(g_initiator_state.target_id, true);
-
-            bool readcapok = startstopok &&
-                scsiInitiatorReadCapacity(g_initiator_state.target_id,
-                                          &g_initiator_state.sectorcount,
-                                          &g_initiator_state.sectorsize);
-
-            bool inquiryok = startstopok &&
-                scsiInquiry(g_initiator_state.target_id, inquiry_data);
-            LED_OFF();
-
-            if (readcapok)
-            {
-                logmsg("SCSI id ", g_initiator_state.target_id,
-                    " capacity ", (int)g_initiator_state.sectorcount,
-                    " sectors x ", (int)g_initiator_state.sectorsize, " bytes");
-
-                g_initiator_state.sectorcount_all = g_initiator_state.sectorcount;
-
-                uint64_t total_bytes = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize;
-                logmsg("Drive total size is ", (int)(total_bytes / (1024 * 1024)), " MiB");
-                if (total_bytes >= 0xFFFFFFFF && SD.fatType() != FAT_TYPE_EXFAT)
-                {
-                    // Note: the FAT32 limit is 4 GiB - 1 byte
-                    logmsg("Image files equal or larger than 4 GiB are only possible on exFAT filesystem");
-                    logmsg("Please reformat the SD card with exFAT format to image this drive fully");
-
-                    g_initiator_state.sectorcount = (uint32_t)0xFFFFFFFF / g_initiator_state.sectorsize;
-                    logmsg("Will image first 4 GiB - 1 = ", (int)g_initiator_state.sectorcount, " sectors");
-                }
-            }
-            else if (startstopok)
-            {
-                logmsg("SCSI id ", g_initiator_state.target_id, " responds but ReadCapacity command failed");
-                logmsg("Possibly SCSI-1 drive? Attempting to read up to 1 GB.");
-                g_initiator_state.sectorsize = 512;
-                g_initiator_state.sectorcount = g_initiator_state.sectorcount_all = 2097152;
-                g_initiator_state.max_sector_per_transfer = 128;
-            }
-            else
-            {
-                dbgmsg("Failed to connect to SCSI id ", g_initiator_state.target_id);
-                g_initiator_state.sectorsize = 0;
-                g_initiator_state.sectorcount = g_initiator_state.sectorcount_all = 0;
-            }
-
-            const char *filename_format = "HD00_imaged.hda";
-            if (inquiryok)
+            // Rescan the bus periodically to find drives that have been connected or powered on later
+            if ((uint32_t)(millis() - g_initiator_state.scan_time) < INITIATOR_SCAN_INTERVAL_MS)
             {
-                if ((inquiry_data[0] & 0x1F) == 5)
-                {
-                    filename_format = "CD00_imaged.iso";
-                }
+                return;
             }
 
-            if (g_initiator_state.sectorcount > 0)
-            {
-                char filename[32] = {0};
-                strncpy(filename, filename_format, sizeof(filename) - 1);
-                filename[2] += g_initiator_state.target_id;
+            g_initiator_state.scan_time = millis();
+            scsiInitiatorScanBus();
+            return;
+        }
 
-                SD.remove(filename);
-                g_initiator_state.target_file = SD.open(filename, O_RDWR | O_CREAT | O_TRUNC);
-                if (!g_initiator_state.target_file.isOpen())
-                {
-                    logmsg("Failed to open file for writing: ", filename);
-                    return;
-                }
+        // Handle the found drives one at a time
+        int target_id = 0;
+        while (!(g_initiator_state.drives_found & (1 << target_id))) target_id++;
+        g_initiator_state.drives_found &= ~(1 << target_id);
 
-                if (SD.fatType() == FAT_TYPE_EXFAT)
-                {
-                    // Only preallocate on exFAT, on FAT32 preallocating can result in false garbage data in the
-                    // file if write is interrupted.
-                    logmsg("Preallocating image file");
-                    g_initiator_state.target_file.preAllocate((uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize);
-                }
+        g_initiator_state.target_id = target_id;
+        g_initiator_state.sectors_done = 0;
+        g_initiator_state.retrycount = 0;
+        g_initiator_state.failcount = 0;
+        g_initiator_state.max_sector_per_transfer = 512;
 
-                logmsg("Starting to copy drive data to ", filename);
-                g_initiator_state.imaging = true;
-            }
-        }
+        scsiInitiatorProbeDrive();
+    }
+    else if (g_initiator_state.restoring)
+    {
+        // Copy sectors from file to SCSI drive
+        scsiInitiatorUpdateLed();
+        scsiInitiatorRestoreStep();
     }
     else
     {
         // Copy sectors from SCSI drive to file
-        if (g_initiator_state.sectors_done >= g_initiator_state.sectorcount)
+        if (g_initiator_map.isComplete())
         {
-            scsiStartStopUnit(g_initiator_state.target_id, false);
-            logmsg("Finished imaging drive with id ", g_initiator_state.target_id);
-            LED_OFF();
-
-            if (g_initiator_state.sectorcount != g_initiator_state.sectorcount_all)
-            {
-                logmsg("NOTE: Image size was limited to first 4 GiB due to SD card filesystem limit");
-                logmsg("Please reformat the SD card with exFAT format to image this drive fully");
-            }
-
-            g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
-            g_initiator_state.imaging = false;
-            g_initiator_state.target_file.close();
+            scsiInitiatorFinishImaging();
             return;
         }
 
         scsiInitiatorUpdateLed();
+        scsiInitiatorImagingStep();
+    }
+}
 
-        // How many sectors to read in one batch?
-        int numtoread = g_initiator_state.sectorcount - g_initiator_state.sectors_done;
-        if (numtoread > g_initiator_state.max_sector_per_transfer)
-            numtoread = g_initiator_state.max_sector_per_transfer;
-
-        // Retry sector-by-sector after failure
-        if (g_initiator_state.sectors_done < g_initiator_state.failposition)
-            numtoread = 1;
+/*************************************
+ * Low level command implementations *
+ *************************************/
 
-        uint32_t time_start = millis();
-        bool status = scsiInitiatorReadDataToFile(g_initiator_state.target_id,
-            g_initiator_state.sectors_done, numtoread, g_initiator_state.sectorsize,
-            g_initiator_state.target_file);
+// Apply the negotiated transfer mode to host PHY
+static void scsiInitiatorApplySyncMode(int target_id)
+{
+    scsi_host_sync_t *sync = &g_initiator_sync[target_id];
+    scsiHostPhySetSyncMode(sync->offset, sync->period);
+}
 
-        if (!status)
+// Receive a complete message from target and handle synchronous transfer negotiation.
+static void scsiInitiatorMessageIn(int target_id)
+{
+    uint8_t msg[8] = {0};
+    size_t len = 0;
+    size_t total = 1;
+    while (len < total)
+    {
+        uint8_t byte = 0;
+        if (scsiHostRead(&byte, 1) != 1)
         {
-            logmsg("Failed to transfer ", numtoread, " sectors starting at ", (int)g_initiator_state.sectors_done);
+            logmsg("scsiInitiatorMessageIn: failed to receive message, got ", bytearray(msg, len));
+            return;
+        }
 
-            if (g_initiator_state.retrycount < 5)
-            {
-                logmsg("Retrying.. ", g_initiator_state.retrycount, "/5");
-                delay_with_poll(200);
-                scsiHostPhyReset();
-                delay_with_poll(200);
+        // Bytes of long extended messages that do not fit in buffer are discarded
+        if (len < sizeof(msg)) msg[len] = byte;
+        len++;
+        total = scsiHostSyncMessageLength(msg, len);
+    }
 
-                g_initiator_state.retrycount++;
-                g_initiator_state.target_file.seek((uint64_t)g_initiator_state.sectors_done * g_initiator_state.sectorsize);
+    if (len > sizeof(msg)) len = sizeof(msg);
 
-                if (g_initiator_state.retrycount > 1 && numtoread > 1)
-                {
-                    logmsg("Multiple failures, retrying sector-by-sector");
-                    g_initiator_state.failposition = g_initiator_state.sectors_done + numtoread;
-                }
-            }
-            else
-            {
-                logmsg("Retry limit exceeded, skipping one sector");
-                g_initiator_state.retrycount = 0;
-                g_initiator_state.sectors_done++;
-                g_initiator_state.target_file.seek((uint64_t)g_initiator_state.sectors_done * g_initiator_state.sectorsize);
-            }
+    scsi_host_sync_t *sync = &g_initiator_sync[target_id];
+    scsi_host_sync_state_t oldstate = sync->state;
+    size_t replylen = scsiHostSyncMessageIn(sync, msg, len, g_initiator_msgout.data);
+
+    if (sync->state == SCSIHOST_SYNC_DONE && oldstate != SCSIHOST_SYNC_DONE)
+    {
+        if (sync->offset > 0)
+        {
+            logmsg("Target ", target_id, " negotiated synchronous transfer, period ", (int)sync->period * 4,
+                   " ns, offset ", (int)sync->offset);
         }
         else
         {
-            g_initiator_state.retrycount = 0;
-            g_initiator_state.sectors_done += numtoread;
-            g_initiator_state.target_file.flush();
-
-            int speed_kbps = numtoread * g_initiator_state.sectorsize / (millis() - time_start);
-            logmsg("SCSI read succeeded, sectors done: ",
-                  (int)g_initiator_state.sectors_done, " / ", (int)g_initiator_state.sectorcount,
-                  " speed ", speed_kbps, " kB/s");
+            dbgmsg("------ Target ", target_id, " uses asynchronous transfers");
         }
+
+        scsiInitiatorApplySyncMode(target_id);
+    }
+
+    if (replylen > 0)
+    {
+        // Request MESSAGE OUT phase to send the response
+        g_initiator_msgout.len = replylen;
+        scsiHostPhySetATN(true);
     }
 }
 
-/*************************************
- * Low level command implementations *
- *************************************/
+// Send queued message to target, or IDENTIFY if nothing has been queued.
+// ATN is released before the last byte to indicate end of message.
+static void scsiInitiatorMessageOut()
+{
+    if (g_initiator_msgout.len == 0)
+    {
+        g_initiator_msgout.data[0] = SCSI_MSG_IDENTIFY;
+        g_initiator_msgout.len = 1;
+    }
+
+    size_t len = g_initiator_msgout.len;
+    g_initiator_msgout.len = 0;
+
+    if (len > 1)
+    {
+        scsiHostWrite(g_initiator_msgout.data, len - 1);
+    }
+
+    scsiHostPhySetATN(false);
+    scsiHostWrite(&g_initiator_msgout.data[len - 1], 1);
+}
 
 int scsiInitiatorRunCommand(int target_id,
                             const uint8_t *command, size_t cmdLen,
                             uint8_t *bufIn, size_t bufInLen,
                             const uint8_t *bufOut, size_t bufOutLen,
-                            bool returnDataPhase)
+                            bool returnDataPhase, uint32_t selectTimeoutUs)
 {
-    if (!scsiHostPhySelect(target_id))
+    // Negotiate synchronous transfers on the first command after bus reset.
+    // Select with ATN so that target goes to MESSAGE OUT phase.
+    scsi_host_sync_t *sync = &g_initiator_sync[target_id];
+    g_initiator_msgout.len = 0;
+    if (scsiHostSyncNeeded(sync))
+    {
+        g_initiator_msgout.len = scsiHostSyncBuildRequest(sync, g_initiator_msgout.data);
+        scsiHostPhySetATN(true);
+    }
+
+    scsiInitiatorApplySyncMode(target_id);
+
+    if (!scsiHostPhySelect(target_id, selectTimeoutUs))
     {
         dbgmsg("------ Target ", target_id, " did not respond");
+        scsiHostSyncReset(sync);
         scsiHostPhyRelease();
         return -1;
     }
@@ -349,16 +1117,23 @@ int scsiInitiatorRunCommand(int target_id,
 
         if (phase == MESSAGE_IN)
         {
-            uint8_t dummy = 0;
-            scsiHostRead(&dummy, 1);
+            scsiInitiatorMessageIn(target_id);
         }
         else if (phase == MESSAGE_OUT)
         {
-            uint8_t identify_msg = 0x80;
-            scsiHostWrite(&identify_msg, 1);
+            scsiInitiatorMessageOut();
         }
         else if (phase == COMMAND)
         {
+            if (sync->state == SCSIHOST_SYNC_REQUESTED)
+            {
+                // Target did not respond to SDTR, it is probably a SCSI-1 device
+                dbgmsg("------ Target ", target_id, " did not respond to SDTR, using asynchronous transfers");
+                scsiHostSyncNoResponse(sync);
+                scsiInitiatorApplySyncMode(target_id);
+            }
+
+            scsiHostPhySetATN(false);
             scsiHostWrite(command, cmdLen);
         }
         else if (phase == DATA_IN)
@@ -545,6 +1320,35 @@ bool scsiTestUnitReady(int target_id)
     return false;
 }
 
+// Handle the phases after data transfer and release the bus.
+// Status is updated if target sends STATUS byte.
+static void scsiInitiatorCompleteCommand(int target_id, int *status)
+{
+    SCSI_PHASE phase;
+    while ((phase = (SCSI_PHASE)scsiHostPhyGetPhase()) != BUS_FREE)
+    {
+        platform_poll();
+
+        if (phase == MESSAGE_IN)
+        {
+            scsiInitiatorMessageIn(target_id);
+        }
+        else if (phase == MESSAGE_OUT)
+        {
+            scsiInitiatorMessageOut();
+        }
+        else if (phase == STATUS)
+        {
+            uint8_t tmp = 0;
+            scsiHostRead(&tmp, 1);
+            *status = tmp;
+            dbgmsg("------ STATUS: ", tmp);
+        }
+    }
+
+    scsiHostPhyRelease();
+}
+
 // This uses callbacks to run SD and SCSI transfers in parallel
 static struct {
     uint32_t bytes_sd; // Number of bytes that have been transferred on SD card side
@@ -554,8 +1358,35 @@ static struct {
     
     uint32_t bytes_per_sector;
     bool all_ok;
+    bool bus_error; // SCSI side of the transfer failed
+
+    // Image checksum is calculated from the transfer buffer if this transfer
+    // continues directly from where the previous one ended.
+    bool hash;
+    uint32_t bytes_hashed;
 } g_initiator_transfer;
 
+// Calculate checksum over data that has been received from SCSI bus.
+// The amount processed at once is limited so that the SCSI transfer can
+// continue soon, the remaining data is processed in later calls.
+static void scsiInitiatorHashPending(uint32_t maxlen)
+{
+    if (!g_initiator_transfer.hash) return;
+
+    uint32_t bufsize = sizeof(scsiDev.data);
+    while (g_initiator_transfer.bytes_hashed < g_initiator_transfer.bytes_scsi_done && maxlen > 0)
+    {
+        uint32_t start = g_initiator_transfer.bytes_hashed % bufsize;
+        uint32_t len = g_initiator_transfer.bytes_scsi_done - g_initiator_transfer.bytes_hashed;
+        if (start + len > bufsize) len = bufsize - start;
+        if (len > maxlen) len = maxlen;
+
+        scsiInitiatorHashData(&scsiDev.data[start], len);
+        g_initiator_transfer.bytes_hashed += len;
+        maxlen -= len;
+    }
+}
+
 static void initiatorReadSDCallback(uint32_t bytes_complete)
 {
     if (g_initiator_transfer.bytes_scsi_done < g_initiator_transfer.bytes_scsi)
@@ -586,6 +1417,12 @@ static void initiatorReadSDCallback(uint32_t bytes_complete)
         if (start + len > bufsize)
             len = bufsize - start;
 
+        // Data must be hashed before it gets overwritten
+        if (g_initiator_transfer.hash && g_initiator_transfer.bytes_scsi_done + len > g_initiator_transfer.bytes_hashed + bufsize)
+        {
+            scsiInitiatorHashPending(g_initiator_transfer.bytes_scsi_done + len - g_initiator_transfer.bytes_hashed - bufsize);
+        }
+
         // Don't overwrite data that has not yet been written to SD card
         uint32_t sd_ready_cnt = g_initiator_transfer.bytes_sd + bytes_complete;
         if (g_initiator_transfer.bytes_scsi_done + len > sd_ready_cnt + bufsize)
@@ -606,16 +1443,26 @@ static void initiatorReadSDCallback(uint32_t bytes_complete)
         }
 
         if (len == 0)
+        {
+            // Waiting for SD card, use the time for checksum calculation
+            scsiInitiatorHashPending(INITIATOR_HASH_CHUNK_SIZE);
             return;
+        }
 
         // dbgmsg("SCSI read ", (int)start, " + ", (int)len, ", sd ready cnt ", (int)sd_ready_cnt, " ", (int)bytes_complete, ", scsi done ", (int)g_initiator_transfer.bytes_scsi_done);
         if (scsiHostRead(&scsiDev.data[start], len) != len)
         {
             logmsg("Read failed at byte ", (int)g_initiator_transfer.bytes_scsi_done);
             g_initiator_transfer.all_ok = false;
+            g_initiator_transfer.bus_error = true;
         }
         g_initiator_transfer.bytes_scsi_done += len;
     }
+    else
+    {
+        // SCSI transfer is complete, use the time while SD card is writing for checksum calculation
+        scsiInitiatorHashPending(INITIATOR_HASH_CHUNK_SIZE);
+    }
 }
 
 static void scsiInitiatorWriteDataToSd(FsFile &file, bool use_callback)
@@ -650,9 +1497,10 @@ static void scsiInitiatorWriteDataToSd(FsFile &file, bool use_callback)
 }
 
 bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
-                                 FsFile &file)
+                                 FsFile &file, bool *bus_error)
 {
     int status = -1;
+    if (bus_error) *bus_error = false;
 
     if (start_sector < 0xFFFFFF && sectorcount <= 256)
     {
@@ -691,6 +1539,9 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
 
         logmsg("scsiInitiatorReadDataToFile: READ failed: ", status, " sense key ", sense_key);
         scsiHostPhyRelease();
+
+        // Negative status means the command did not complete on the bus
+        if (bus_error) *bus_error = (status < 0);
         return false;
     }
 
@@ -702,6 +1553,10 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
     g_initiator_transfer.bytes_sd_scheduled = 0;
     g_initiator_transfer.bytes_scsi_done = 0;
     g_initiator_transfer.all_ok = true;
+    g_initiator_transfer.bus_error = false;
+    g_initiator_transfer.hash = g_initiator_hash.type != INITIATOR_HASH_NONE && g_initiator_hash.streaming &&
+                                g_initiator_hash.bytes == (uint64_t)start_sector * sectorsize;
+    g_initiator_transfer.bytes_hashed = 0;
 
     while (true)
     {
@@ -733,6 +1588,8 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
         scsiInitiatorWriteDataToSd(file, false);
     }
 
+    scsiInitiatorHashPending(g_initiator_transfer.bytes_scsi);
+
     if (g_initiator_transfer.bytes_sd != g_initiator_transfer.bytes_scsi)
     {
         logmsg("SCSI read from sector ", (int)start_sector, " was incomplete: expected ",
@@ -740,33 +1597,177 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
         g_initiator_transfer.all_ok = false;
     }
 
-    while ((phase = (SCSI_PHASE)scsiHostPhyGetPhase()) != BUS_FREE)
+    scsiInitiatorCompleteCommand(target_id, &status);
+
+    if (status != 0 || !g_initiator_transfer.all_ok)
+    {
+        // Checksum includes data from failed transfer, it must be recalculated from file
+        g_initiator_hash.streaming = false;
+
+        // Target ending the data phase early with an error status is a read error,
+        // ending it early with GOOD status or without status is a bus error.
+        if (bus_error)
+        {
+            *bus_error = g_initiator_transfer.bus_error || status < 0 ||
+                         (status == 0 && g_initiator_transfer.bytes_scsi_done != g_initiator_transfer.bytes_scsi);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+// Data is read from SD card to the buffer and the SD callback sends it to
+// SCSI bus while the rest of the SD read is still in progress.
+static void initiatorWriteSDCallback(uint32_t bytes_complete)
+{
+    if (!g_initiator_transfer.all_ok) return;
+
+    uint32_t sd_ready_cnt = g_initiator_transfer.bytes_sd + bytes_complete;
+    if (g_initiator_transfer.bytes_scsi_done >= sd_ready_cnt) return;
+
+    uint32_t len = sd_ready_cnt - g_initiator_transfer.bytes_scsi_done;
+    uint32_t remain = g_initiator_transfer.bytes_scsi - g_initiator_transfer.bytes_scsi_done;
+    uint32_t bytesPerSector = g_initiator_transfer.bytes_per_sector;
+
+    // Split write so that it doesn't wrap around buffer edge
+    uint32_t bufsize = sizeof(scsiDev.data);
+    uint32_t start = (g_initiator_transfer.bytes_scsi_done % bufsize);
+    if (start + len > bufsize)
+        len = bufsize - start;
+
+    // Keep transfers a multiple of sector size.
+    if (remain >= bytesPerSector && len % bytesPerSector != 0)
+    {
+        len -= len % bytesPerSector;
+    }
+
+    if (len == 0)
+        return;
+
+    if (scsiHostWrite(&scsiDev.data[start], len) != len)
+    {
+        logmsg("Write failed at byte ", (int)g_initiator_transfer.bytes_scsi_done);
+        g_initiator_transfer.all_ok = false;
+    }
+    g_initiator_transfer.bytes_scsi_done += len;
+}
+
+static void scsiInitiatorReadDataFromSd(FsFile &file, bool use_callback)
+{
+    // Figure out longest continuous free block in buffer
+    uint32_t bufsize = sizeof(scsiDev.data);
+    uint32_t start = g_initiator_transfer.bytes_sd % bufsize;
+    uint32_t len = g_initiator_transfer.bytes_scsi - g_initiator_transfer.bytes_sd;
+    uint32_t space = bufsize - (g_initiator_transfer.bytes_sd - g_initiator_transfer.bytes_scsi_done);
+    if (len > space) len = space;
+    if (start + len > bufsize) len = bufsize - start;
+
+    // Try to do reads in multiple of 512 bytes
+    // This allows better performance for SD card access.
+    if (len >= 512) len &= ~511;
+
+    // Start reading from SD card and simultaneously writing to SCSI bus
+    uint8_t *buf = &scsiDev.data[start];
+
+    if (use_callback)
+    {
+        platform_set_sd_callback(&initiatorWriteSDCallback, buf);
+    }
+
+    g_initiator_transfer.bytes_sd_scheduled = g_initiator_transfer.bytes_sd + len;
+    if (file.read(buf, len) != (int)len)
+    {
+        logmsg("scsiInitiatorWriteDataFromFile: SD card read failed");
+        g_initiator_transfer.all_ok = false;
+    }
+    platform_set_sd_callback(NULL, NULL);
+    g_initiator_transfer.bytes_sd += len;
+}
+
+bool scsiInitiatorWriteDataFromFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
+                                    FsFile &file)
+{
+    uint8_t command[10] = {0x2A, 0x00,
+        (uint8_t)(start_sector >> 24), (uint8_t)(start_sector >> 16),
+        (uint8_t)(start_sector >> 8), (uint8_t)start_sector,
+        0x00,
+        (uint8_t)(sectorcount >> 8), (uint8_t)(sectorcount),
+        0x00
+    };
+
+    // Start executing command, return in data phase
+    int status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, NULL, 0, true);
+
+    if (status != 0)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+
+        logmsg("scsiInitiatorWriteDataFromFile: WRITE failed: ", status, " sense key ", sense_key);
+        scsiHostPhyRelease();
+        return false;
+    }
+
+    SCSI_PHASE phase;
+
+    g_initiator_transfer.bytes_scsi = sectorcount * sectorsize;
+    g_initiator_transfer.bytes_per_sector = sectorsize;
+    g_initiator_transfer.bytes_sd = 0;
+    g_initiator_transfer.bytes_sd_scheduled = 0;
+    g_initiator_transfer.bytes_scsi_done = 0;
+    g_initiator_transfer.all_ok = true;
+    g_initiator_transfer.hash = false;
+
+    while (g_initiator_transfer.all_ok &&
+           g_initiator_transfer.bytes_scsi_done < g_initiator_transfer.bytes_scsi)
     {
         platform_poll();
 
-        if (phase == MESSAGE_IN)
+        phase = (SCSI_PHASE)scsiHostPhyGetPhase();
+        if (phase != DATA_OUT && phase != BUS_BUSY)
         {
-            uint8_t dummy = 0;
-            scsiHostRead(&dummy, 1);
+            break;
         }
-        else if (phase == MESSAGE_OUT)
+
+        if (g_initiator_transfer.bytes_sd < g_initiator_transfer.bytes_scsi &&
+            g_initiator_transfer.bytes_sd - g_initiator_transfer.bytes_scsi_done < sizeof(scsiDev.data))
         {
-            uint8_t identify_msg = 0x80;
-            scsiHostWrite(&identify_msg, 1);
+            // Read data from SD card and simultaneously write to SCSI
+            scsiInitiatorUpdateLed();
+            scsiInitiatorReadDataFromSd(file, true);
         }
-        else if (phase == STATUS)
+        else
         {
-            uint8_t tmp = 0;
-            scsiHostRead(&tmp, 1);
-            status = tmp;
-            dbgmsg("------ STATUS: ", tmp);
+            // Buffer is full or whole transfer has been read, send rest to SCSI bus
+            initiatorWriteSDCallback(0);
         }
     }
 
-    scsiHostPhyRelease();
+    if (g_initiator_transfer.bytes_scsi_done != g_initiator_transfer.bytes_scsi)
+    {
+        logmsg("SCSI write to sector ", (int)start_sector, " was incomplete: expected ",
+             (int)g_initiator_transfer.bytes_scsi, " sent ", (int)g_initiator_transfer.bytes_scsi_done, " bytes");
+        g_initiator_transfer.all_ok = false;
+    }
 
-    return status == 0 && g_initiator_transfer.all_ok;
-}
+    if (!g_initiator_transfer.all_ok)
+    {
+        // Target is still waiting for data, bus reset is needed to abort the command
+        scsiHostPhyRelease();
+        return false;
+    }
+
+    scsiInitiatorCompleteCommand(target_id, &status);
 
+    if (status == 2)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+        logmsg("WRITE on target ", target_id, " failed, sense key ", sense_key);
+    }
+
+    return status == 0;
+}
 
 #endif
@@ -25,17 +25,23 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include "ZuluSCSI_config.h"
 
 void scsiInitiatorInit();
 
 void scsiInitiatorMainLoop();
 
+// Stop imaging or restoring and close the image file before SD card is
+// remounted. Imaging continues from the saved map after scsiInitiatorInit().
+void scsiInitiatorCloseFiles();
+
 // Select target and execute SCSI command
 int scsiInitiatorRunCommand(int target_id,
                             const uint8_t *command, size_t cmdLen,
                             uint8_t *bufIn, size_t bufInLen,
                             const uint8_t *bufOut, size_t bufOutLen,
-                            bool returnDataPhase = false);
+                            bool returnDataPhase = false,
+                            uint32_t selectTimeoutUs = INITIATOR_SELECT_TIMEOUT_US);
 
 // Execute READ CAPACITY command
 bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *sectorsize);
@@ -52,7 +58,13 @@ bool scsiInquiry(int target_id, uint8_t inquiry_data[36]);
 // Execute TEST UNIT READY command and handle unit attention state
 bool scsiTestUnitReady(int target_id);
 
-// Read a block of data from SCSI device and write to file on SD card
+// Read a block of data from SCSI device and write to file on SD card.
+// On failure, bus_error tells if the transfer itself failed (timeout, parity
+// or phase error) rather than the target reporting an error status.
 class FsFile;
 bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
-                                 FsFile &file);
+                                 FsFile &file, bool *bus_error = nullptr);
+
+// Read a block of data from file on SD card and write to SCSI device
+bool scsiInitiatorWriteDataFromFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
+                                    FsFile &file);
@@ -0,0 +1,401 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_initiator_map.h"
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_log.h"
+#include <SdFat.h>
+#include <string.h>
+#include <stdlib.h>
+
+extern SdFs SD;
+
+void ImagingMap::clear(uint32_t sectorcount, uint32_t sectorsize, const char *identity)
+{
+    m_sectorcount = sectorcount;
+    m_sectorsize = sectorsize;
+    strncpy(m_identity, identity, sizeof(m_identity) - 1);
+    m_identity[sizeof(m_identity) - 1] = '\0';
+
+    m_rangecount = 1;
+    m_ranges[0].start = 0;
+    m_ranges[0].count = sectorcount;
+    m_ranges[0].status = IMAGINGMAP_NONTRIED;
+
+    pass = IMAGINGMAP_PASS_COPY;
+    current_pos = 0;
+}
+
+int ImagingMap::splitAt(uint32_t sector)
+{
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        imagingmap_range_t *r = &m_ranges[i];
+        if (r->start == sector)
+        {
+            return i;
+        }
+        else if (sector > r->start && sector < r->start + r->count)
+        {
+            if (m_rangecount >= IMAGINGMAP_MAX_RANGES)
+            {
+                return -1;
+            }
+
+            memmove(&m_ranges[i + 2], &m_ranges[i + 1], (m_rangecount - i - 1) * sizeof(imagingmap_range_t));
+            m_rangecount++;
+
+            m_ranges[i + 1].start = sector;
+            m_ranges[i + 1].count = r->start + r->count - sector;
+            m_ranges[i + 1].status = r->status;
+            r->count = sector - r->start;
+            return i + 1;
+        }
+    }
+
+    // Sector is at end of drive
+    return m_rangecount;
+}
+
+void ImagingMap::merge()
+{
+    // Split pieces are kept separate, because each of them is an unit that
+    // gets split into halves until the bad sectors are found.
+    int dst = 0;
+    for (int src = 1; src < m_rangecount; src++)
+    {
+        if (m_ranges[src].status == m_ranges[dst].status &&
+            m_ranges[src].status != IMAGINGMAP_SPLIT)
+        {
+            m_ranges[dst].count += m_ranges[src].count;
+        }
+        else
+        {
+            m_ranges[++dst] = m_ranges[src];
+        }
+    }
+    m_rangecount = dst + 1;
+}
+
+bool ImagingMap::setStatus(uint32_t start, uint32_t count, char status)
+{
+    if (count == 0 || start + count > m_sectorcount)
+    {
+        return false;
+    }
+
+    int first = splitAt(start);
+    int last = splitAt(start + count);
+    if (first < 0 || last < 0)
+    {
+        logmsg("Imaging map is full, too many separate failed areas");
+        return false;
+    }
+
+    // The ranges between first and last are now fully covered by the new status.
+    // Combine them to one entry.
+    m_ranges[first].count = count;
+    m_ranges[first].status = status;
+    if (last > first + 1)
+    {
+        memmove(&m_ranges[first + 1], &m_ranges[last], (m_rangecount - last) * sizeof(imagingmap_range_t));
+        m_rangecount -= last - first - 1;
+    }
+
+    merge();
+    return true;
+}
+
+bool ImagingMap::findNext(char status, uint32_t from, imagingmap_range_t *result) const
+{
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        const imagingmap_range_t *r = &m_ranges[i];
+        if (r->status == status && r->start + r->count > from)
+        {
+            *result = *r;
+            if (result->start < from)
+            {
+                result->count -= from - result->start;
+                result->start = from;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ImagingMap::findSplit(imagingmap_range_t *result) const
+{
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        const imagingmap_range_t *r = &m_ranges[i];
+        if (r->status == IMAGINGMAP_FAILED || r->status == IMAGINGMAP_SPLIT)
+        {
+            *result = *r;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t ImagingMap::countSectors(char status) const
+{
+    uint32_t total = 0;
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        if (m_ranges[i].status == status)
+        {
+            total += m_ranges[i].count;
+        }
+    }
+    return total;
+}
+
+bool ImagingMap::isComplete() const
+{
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        char status = m_ranges[i].status;
+        if (status != IMAGINGMAP_FINISHED && status != IMAGINGMAP_BAD)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*************************************
+ * Map file reading and writing      *
+ *************************************/
+
+static const char g_imagingmap_title[] = "# Mapfile. Created by ZuluSCSI " ZULU_FW_VERSION "\n";
+static const char g_imagingmap_identity_prefix[] = "# Drive: ";
+static const char g_imagingmap_status_columns[] = "\n# current_pos  current_status  current_pass\n";
+
+// Temporary file that the map is written to before renaming it
+static void imagingmap_tmpname(char tmpname[MAX_FILE_PATH + 8], const char *filename)
+{
+    strncpy(tmpname, filename, MAX_FILE_PATH);
+    tmpname[MAX_FILE_PATH] = '\0';
+    strcat(tmpname, ".tmp");
+}
+
+// Append value as hexadecimal with 0x prefix, ddrescue uses byte positions so this needs 64 bits
+static char *append_hex(char *p, uint64_t value)
+{
+    const char *nibble = "0123456789ABCDEF";
+    *p++ = '0';
+    *p++ = 'x';
+
+    // Print at least 8 digits to keep the columns aligned
+    int digits = 8;
+    while (digits < 16 && (value >> (digits * 4)) != 0) digits++;
+
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        *p++ = nibble[(value >> (i * 4)) & 0xF];
+    }
+    return p;
+}
+
+static char *append_str(char *p, const char *str)
+{
+    while (*str) *p++ = *str++;
+    return p;
+}
+
+bool ImagingMap::load(const char *filename, uint32_t sectorcount, uint32_t sectorsize, const char *identity)
+{
+    FsFile file = SD.open(filename, O_RDONLY);
+    if (!file.isOpen())
+    {
+        // Power loss during save() can leave only the complete temporary file
+        char tmpname[MAX_FILE_PATH + 8];
+        imagingmap_tmpname(tmpname, filename);
+        file = SD.open(tmpname, O_RDONLY);
+        if (!file.isOpen())
+        {
+            return false;
+        }
+
+        logmsg("Imaging map ", filename, " not found, using ", tmpname);
+    }
+
+    // Identity is compared with the same truncation as it is stored with
+    clear(sectorcount, sectorsize, identity);
+    m_rangecount = 0;
+
+    bool identity_ok = false;
+    bool status_line = false;
+    uint64_t expected_pos = 0;
+    char line[sizeof(g_imagingmap_identity_prefix) + IMAGINGMAP_IDENTITY_LEN + 64];
+    int len;
+    while ((len = file.fgets(line, sizeof(line))) > 0)
+    {
+        if (line[0] == '#')
+        {
+            size_t prefixlen = sizeof(g_imagingmap_identity_prefix) - 1;
+            if (strncmp(line, g_imagingmap_identity_prefix, prefixlen) == 0)
+            {
+                char *end = line + strlen(line);
+                while (end > line && (end[-1] == '\n' || end[-1] == '\r')) *--end = '\0';
+                identity_ok = (strcmp(line + prefixlen, m_identity) == 0);
+            }
+            continue;
+        }
+
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '\n') continue;
+
+        if (!status_line)
+        {
+            // First data line: current_pos current_status current_pass
+            uint64_t pos = strtoull(p, &p, 0);
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p != '\0') p++;
+            int filepass = strtoul(p, NULL, 0);
+            current_pos = pos / sectorsize;
+            pass = (filepass == IMAGINGMAP_PASS_SPLIT) ? IMAGINGMAP_PASS_SPLIT : IMAGINGMAP_PASS_COPY;
+            status_line = true;
+            continue;
+        }
+
+        // Block lines: pos size status
+        uint64_t pos = strtoull(p, &p, 0);
+        uint64_t size = strtoull(p, &p, 0);
+        while (*p == ' ' || *p == '\t') p++;
+        char status = *p;
+
+        if (pos != expected_pos || size == 0 || pos % sectorsize != 0 || size % sectorsize != 0)
+        {
+            logmsg("Imaging map ", filename, " has invalid block at position ", pos);
+            return false;
+        }
+
+        if (status != IMAGINGMAP_NONTRIED && status != IMAGINGMAP_FAILED &&
+            status != IMAGINGMAP_SPLIT && status != IMAGINGMAP_BAD &&
+            status != IMAGINGMAP_FINISHED)
+        {
+            // Statuses from other tools, e.g. ddrescue trimming state, are retried as failed areas
+            status = IMAGINGMAP_FAILED;
+        }
+
+        if (m_rangecount >= IMAGINGMAP_MAX_RANGES)
+        {
+            logmsg("Imaging map ", filename, " has too many entries");
+            return false;
+        }
+
+        m_ranges[m_rangecount].start = pos / sectorsize;
+        m_ranges[m_rangecount].count = size / sectorsize;
+        m_ranges[m_rangecount].status = status;
+        m_rangecount++;
+        expected_pos = pos + size;
+    }
+
+    if (!identity_ok)
+    {
+        logmsg("Imaging map ", filename, " belongs to a different drive, starting over");
+        clear(sectorcount, sectorsize, identity);
+        return false;
+    }
+
+    if (expected_pos != (uint64_t)sectorcount * sectorsize)
+    {
+        logmsg("Imaging map ", filename, " does not cover the whole drive, starting over");
+        clear(sectorcount, sectorsize, identity);
+        return false;
+    }
+
+    merge();
+
+    // Map saved partway through the copy pass, e.g. by ddrescue, still has
+    // untried areas that the split pass would never read.
+    if (pass == IMAGINGMAP_PASS_SPLIT && countSectors(IMAGINGMAP_NONTRIED) > 0)
+    {
+        pass = IMAGINGMAP_PASS_COPY;
+    }
+
+    return true;
+}
+
+bool ImagingMap::save(const char *filename)
+{
+    char tmpname[MAX_FILE_PATH + 8];
+    imagingmap_tmpname(tmpname, filename);
+
+    FsFile file = SD.open(tmpname, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen())
+    {
+        logmsg("Failed to open imaging map for writing: ", tmpname);
+        return false;
+    }
+
+    char header[sizeof(g_imagingmap_title) + sizeof(g_imagingmap_identity_prefix) +
+                IMAGINGMAP_IDENTITY_LEN + sizeof(g_imagingmap_status_columns)];
+    char *p = append_str(header, g_imagingmap_title);
+    p = append_str(p, g_imagingmap_identity_prefix);
+    p = append_str(p, m_identity);
+    p = append_str(p, g_imagingmap_status_columns);
+    file.write(header, p - header);
+
+    char line[128];
+    char passchar = isComplete() ? IMAGINGMAP_FINISHED :
+                    (pass == IMAGINGMAP_PASS_COPY) ? IMAGINGMAP_NONTRIED : IMAGINGMAP_SPLIT;
+
+    p = append_hex(line, (uint64_t)current_pos * m_sectorsize);
+    *p++ = ' '; *p++ = ' ';
+    *p++ = passchar;
+    *p++ = ' '; *p++ = ' ';
+    *p++ = '0' + pass;
+    p = append_str(p, "\n#      pos        size  status\n");
+    file.write(line, p - line);
+
+    for (int i = 0; i < m_rangecount; i++)
+    {
+        p = append_hex(line, (uint64_t)m_ranges[i].start * m_sectorsize);
+        *p++ = ' '; *p++ = ' ';
+        p = append_hex(p, (uint64_t)m_ranges[i].count * m_sectorsize);
+        *p++ = ' '; *p++ = ' ';
+        *p++ = m_ranges[i].status;
+        *p++ = '\n';
+        file.write(line, p - line);
+    }
+
+    if (!file.close())
+    {
+        logmsg("Failed to write imaging map: ", tmpname);
+        return false;
+    }
+
+    SD.remove(filename);
+    if (!SD.rename(tmpname, filename))
+    {
+        logmsg("Failed to rename ", tmpname, " to ", filename);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,107 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Sector status map for resumable drive imaging in initiator mode.
+// The map is stored in GNU ddrescue mapfile format, so that imaging
+// can also be continued with ddrescue on a PC.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Maximum number of separate ranges in the map.
+// Each failed area takes up to three entries.
+#ifndef IMAGINGMAP_MAX_RANGES
+#define IMAGINGMAP_MAX_RANGES 256
+#endif
+
+// Maximum length of drive identity string stored in map file
+#define IMAGINGMAP_IDENTITY_LEN 64
+
+// Sector status values, these match the ddrescue mapfile characters.
+#define IMAGINGMAP_NONTRIED  '?'  // Not read yet
+#define IMAGINGMAP_FAILED    '*'  // Read failed in first pass, area not split yet
+#define IMAGINGMAP_SPLIT     '/'  // Part of a failed area, to be split further
+#define IMAGINGMAP_BAD       '-'  // Single sector that could not be read
+#define IMAGINGMAP_FINISHED  '+'  // Successfully copied
+
+// Imaging passes
+#define IMAGINGMAP_PASS_COPY  1   // Copy all sectors, skipping over failed areas
+#define IMAGINGMAP_PASS_SPLIT 2   // Retry failed areas in progressively smaller pieces
+
+struct imagingmap_range_t {
+    uint32_t start;
+    uint32_t count;
+    char status;
+};
+
+class ImagingMap
+{
+public:
+    // Reset the map to cover a drive of given size, with all sectors untried
+    void clear(uint32_t sectorcount, uint32_t sectorsize, const char *identity);
+
+    // Load map from file. Returns false if file does not exist, is not valid
+    // or belongs to a different drive. If the file is missing, the temporary
+    // file left by an interrupted save() is used instead.
+    bool load(const char *filename, uint32_t sectorcount, uint32_t sectorsize, const char *identity);
+
+    // Save map to file. Written through a temporary file, which replaces the
+    // old map only after it is complete. If power is lost while replacing,
+    // load() finds the new version in the temporary file.
+    bool save(const char *filename);
+
+    // Set status of a range of sectors.
+    // Returns false if the map is full.
+    bool setStatus(uint32_t start, uint32_t count, char status);
+
+    // Find the first range with given status starting at or after sector 'from'
+    bool findNext(char status, uint32_t from, imagingmap_range_t *result) const;
+
+    // Find the first range that needs to be split in IMAGINGMAP_PASS_SPLIT
+    bool findSplit(imagingmap_range_t *result) const;
+
+    // Count total number of sectors with given status
+    uint32_t countSectors(char status) const;
+
+    // True if there are no sectors left to read
+    bool isComplete() const;
+
+    // Current imaging pass and position, stored in map file as checkpoint
+    int pass;
+    uint32_t current_pos;
+
+protected:
+    // Split the range containing sector so that a range starts at it.
+    // Returns index of that range, or -1 if map is full.
+    int splitAt(uint32_t sector);
+
+    // Merge adjacent entries with same status
+    void merge();
+
+    uint32_t m_sectorcount;
+    uint32_t m_sectorsize;
+    char m_identity[IMAGINGMAP_IDENTITY_LEN];
+
+    int m_rangecount;
+    imagingmap_range_t m_ranges[IMAGINGMAP_MAX_RANGES];
+};
@@ -23,9 +23,20 @@
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_platform.h"
+#include <string.h>
+
+// On multicore platforms the log buffers can be written from either core
+#ifdef PLATFORM_HAS_LOG_LOCK
+#define LOG_LOCK() uint32_t log_lock_state = platform_log_lock()
+#define LOG_UNLOCK() platform_log_unlock(log_lock_state)
+#else
+#define LOG_LOCK()
+#define LOG_UNLOCK()
+#endif
 
 const char *g_log_firmwareversion = ZULU_FW_VERSION " " __DATE__ " " __TIME__;
 bool g_log_debug = true;
+bool g_log_binary = false;
 
 // This memory buffer can be read by debugger and is also saved to zululog.txt
 #define LOGBUFMASK (LOGBUFSIZE - 1)
@@ -38,6 +49,8 @@ uint32_t g_logpos;
 
 void log_raw(const char *str)
 {
+    LOG_LOCK();
+
     // Keep log from reboot / bootloader if magic matches expected value
     if (g_log_magic != 0xAA55AA55)
     {
@@ -55,6 +68,8 @@ void log_raw(const char *str)
     // Keep buffer null-terminated
     g_logbuffer[g_logpos & LOGBUFMASK] = '\0';
 
+    LOG_UNLOCK();
+
     platform_log(str);
 }
 
@@ -195,3 +210,200 @@ const char *log_get_buffer(uint32_t *startpos, uint32_t *available)
     return result;
 }
 
+
+/*************************/
+/* Binary debug log      */
+/*************************/
+
+#if BINLOGBUFSIZE > 0
+#define BINLOGBUFMASK (BINLOGBUFSIZE - 1)
+
+uint8_t g_binlogbuffer[BINLOGBUFSIZE];
+uint32_t g_binlogpos;   // Total number of bytes written
+uint32_t g_binlogfirst; // Position of oldest complete record in buffer
+#endif
+
+// Item type tags
+#define BINLOG_CONSTSTR 'S' // 32-bit pointer to string in flash
+#define BINLOG_STR      's' // Length byte and string data
+#define BINLOG_HEX8     'b'
+#define BINLOG_HEX32    'x'
+#define BINLOG_HEX64    'X'
+#define BINLOG_DEC      'd'
+#define BINLOG_BYTES    'a' // 16-bit total length, length byte and data
+#define BINLOG_TRUNC    '~' // Rest of items did not fit in record
+
+// Add item tag and reserve space for len bytes of item data.
+// Returns NULL and marks record truncated if the item does not fit.
+static uint8_t *binlog_reserve(binlog_record_t *rec, uint8_t tag, size_t len)
+{
+    if (rec->truncated)
+    {
+        return NULL;
+    }
+
+    if (rec->len + 1 + len >= BINLOG_MAX_RECORD)
+    {
+        rec->data[rec->len++] = BINLOG_TRUNC;
+        rec->truncated = true;
+        return NULL;
+    }
+
+    rec->data[rec->len++] = tag;
+    uint8_t *item = &rec->data[rec->len];
+    rec->len += len;
+    return item;
+}
+
+// Copy item to record
+static void binlog_put(binlog_record_t *rec, uint8_t tag, const void *data, size_t len)
+{
+    uint8_t *item = binlog_reserve(rec, tag, len);
+    if (item)
+    {
+        memcpy(item, data, len);
+    }
+}
+
+void binlog_start(binlog_record_t *rec)
+{
+    uint32_t timestamp = millis();
+    rec->data[0] = BINLOG_RECORD_START;
+    rec->data[1] = 0;
+    memcpy(&rec->data[2], &timestamp, 4);
+    rec->len = 6;
+    rec->truncated = false;
+}
+
+void binlog_commit(binlog_record_t *rec)
+{
+#if BINLOGBUFSIZE > 0
+    uint32_t len = rec->len;
+    rec->data[1] = len;
+
+    LOG_LOCK();
+
+    // Drop old records that will be overwritten
+    uint32_t pos = g_binlogpos;
+    while (pos + len - g_binlogfirst > BINLOGBUFSIZE)
+    {
+        g_binlogfirst += g_binlogbuffer[(g_binlogfirst + 1) & BINLOGBUFMASK];
+    }
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        g_binlogbuffer[(pos + i) & BINLOGBUFMASK] = rec->data[i];
+    }
+    g_binlogpos = pos + len;
+
+    LOG_UNLOCK();
+#endif
+}
+
+void binlog_add(binlog_record_t *rec, const char *str)
+{
+#ifdef PLATFORM_FLASH_ADDR_START
+    uint32_t addr = (uint32_t)(uintptr_t)str;
+    if (addr >= PLATFORM_FLASH_ADDR_START && addr < PLATFORM_FLASH_ADDR_END)
+    {
+        binlog_put(rec, BINLOG_CONSTSTR, &addr, 4);
+        return;
+    }
+#endif
+
+    // String in RAM, e.g. file name, up to 64 characters
+    size_t len = strnlen(str, 64);
+    uint8_t *item = binlog_reserve(rec, BINLOG_STR, len + 1);
+    if (item)
+    {
+        item[0] = len;
+        memcpy(item + 1, str, len);
+    }
+}
+
+void binlog_add(binlog_record_t *rec, uint8_t value)
+{
+    binlog_put(rec, BINLOG_HEX8, &value, 1);
+}
+
+void binlog_add(binlog_record_t *rec, uint32_t value)
+{
+    binlog_put(rec, BINLOG_HEX32, &value, 4);
+}
+
+void binlog_add(binlog_record_t *rec, uint64_t value)
+{
+    binlog_put(rec, BINLOG_HEX64, &value, 8);
+}
+
+void binlog_add(binlog_record_t *rec, int value)
+{
+    binlog_put(rec, BINLOG_DEC, &value, 4);
+}
+
+void binlog_add(binlog_record_t *rec, bytearray array)
+{
+    // Same limit as in text log
+    size_t len = (array.len > 34) ? 34 : array.len;
+    uint16_t total = (array.len > 0xFFFF) ? 0xFFFF : array.len;
+    uint8_t *item = binlog_reserve(rec, BINLOG_BYTES, len + 3);
+    if (item)
+    {
+        memcpy(item, &total, 2);
+        item[2] = len;
+        memcpy(item + 3, array.data, len);
+    }
+}
+
+#if BINLOGBUFSIZE > 0
+
+uint32_t log_get_binbuffer_len()
+{
+    return g_binlogpos;
+}
+
+const uint8_t *log_get_binbuffer(uint32_t *startpos, uint32_t *available)
+{
+    uint32_t default_pos = 0;
+    if (startpos == NULL)
+    {
+        startpos = &default_pos;
+    }
+
+    // Skip to oldest record if data has been overwritten
+    if ((int32_t)(*startpos - g_binlogfirst) < 0)
+    {
+        *startpos = g_binlogfirst;
+    }
+
+    const uint8_t *result = &g_binlogbuffer[*startpos & BINLOGBUFMASK];
+
+    // Read up to end of buffer now and continue from beginning on next call.
+    uint32_t len = g_binlogpos - *startpos;
+    uint32_t to_end = BINLOGBUFSIZE - (*startpos & BINLOGBUFMASK);
+    if (len > to_end)
+    {
+        len = to_end;
+    }
+
+    if (available) { *available = len; }
+    *startpos += len;
+
+    return result;
+}
+
+#else
+
+// Binary log disabled at compile time
+uint32_t log_get_binbuffer_len()
+{
+    return 0;
+}
+
+const uint8_t *log_get_binbuffer(uint32_t *startpos, uint32_t *available)
+{
+    if (available) { *available = 0; }
+    return NULL;
+}
+
+#endif
@@ -37,6 +37,9 @@ const char *log_get_buffer(uint32_t *startpos, uint32_t *available = nullptr);
 // Whether to enable debug messages
 extern bool g_log_debug;
 
+// Whether to store debug messages in binary format
+extern bool g_log_binary;
+
 // Firmware version string
 extern const char *g_log_firmwareversion;
 
@@ -79,6 +82,51 @@ inline void log_raw(T first, T2 second, Rest... rest)
     log_raw(rest...);
 }
 
+// Binary log records store pointers to constant strings and the raw
+// argument values. Text formatting is done afterwards on the PC by
+// utils/decode_binlog.py, using the firmware .elf file to look up the strings.
+//
+// Record format: 0xA5, total length byte, 32-bit millis() and then
+// items, each consisting of a type tag and the little-endian value.
+#define BINLOG_RECORD_START 0xA5
+#define BINLOG_MAX_RECORD 255
+struct binlog_record_t {
+    uint8_t len;
+    bool truncated;
+    uint8_t data[BINLOG_MAX_RECORD];
+};
+
+// Get total number of bytes that have been written to binary log
+uint32_t log_get_binbuffer_len();
+
+// Get binary log data, works similar to log_get_buffer().
+// The data always begins at a record boundary.
+const uint8_t *log_get_binbuffer(uint32_t *startpos, uint32_t *available = nullptr);
+
+void binlog_start(binlog_record_t *rec);
+void binlog_commit(binlog_record_t *rec);
+
+// Add constant string pointer, or copy of string if it is in RAM
+void binlog_add(binlog_record_t *rec, const char *str);
+void binlog_add(binlog_record_t *rec, uint8_t value);
+void binlog_add(binlog_record_t *rec, uint32_t value);
+void binlog_add(binlog_record_t *rec, uint64_t value);
+void binlog_add(binlog_record_t *rec, int value);
+void binlog_add(binlog_record_t *rec, bytearray array);
+
+inline void binlog_add(binlog_record_t *)
+{
+    // End of template recursion
+}
+
+template<typename T, typename T2, typename... Rest>
+inline void binlog_add(binlog_record_t *rec, T first, T2 second, Rest... rest)
+{
+    binlog_add(rec, first);
+    binlog_add(rec, second);
+    binlog_add(rec, rest...);
+}
+
 // Format a complete log message
 template<typename... Params>
 inline void logmsg(Params... params)
@@ -88,14 +136,33 @@ inline void logmsg(Params... params)
     log_raw("\r\n");
 }
 
+// Store a debug message in binary log.
+// Kept out of line so that the record buffer is on the stack only
+// when binary logging is enabled, not in every dbgmsg() caller.
+template<typename... Params>
+__attribute__((noinline)) void dbgmsg_binary(Params... params)
+{
+    binlog_record_t rec;
+    binlog_start(&rec);
+    binlog_add(&rec, params...);
+    binlog_commit(&rec);
+}
+
 // Format a complete debug message
 template<typename... Params>
 inline void dbgmsg(Params... params)
 {
     if (g_log_debug)
     {
-        log_raw("[", (int)millis(), "ms] DBG ");
-        log_raw(params...);
-        log_raw("\r\n");
+        if (g_log_binary)
+        {
+            dbgmsg_binary(params...);
+        }
+        else
+        {
+            log_raw("[", (int)millis(), "ms] DBG ");
+            log_raw(params...);
+            log_raw("\r\n");
+        }
     }
 }
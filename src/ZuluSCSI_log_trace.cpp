@@ -24,7 +24,10 @@
 
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_log.h"
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_bustrace.h"
 #include <scsi2sd.h>
+#include <DataHash.h>
 
 extern "C" {
 #include <scsi.h>
@@ -35,7 +38,7 @@ static bool g_LogData = false;
 static bool g_LogInitiatorCommand = false;
 static int g_InByteCount = 0;
 static int g_OutByteCount = 0;
-static uint16_t g_DataChecksum = 0;
+static uint32_t g_DataChecksum = 0;
 
 static const char *getCommandName(uint8_t cmd)
 {
@@ -208,7 +211,7 @@ void scsiLogPhaseChange(int new_phase)
     {
         if (old_phase == DATA_IN || old_phase == DATA_OUT)
         {
-            dbgmsg("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", (int)g_DataChecksum);
+            dbgmsg("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CRC32: ", g_DataChecksum);
         }
 	// log Xebec vendor command
         if (old_phase == DATA_OUT && scsiDev.cdb[0] == 0x0C && g_OutByteCount == 8)
@@ -248,10 +251,15 @@ void scsiLogPhaseChange(int new_phase)
             }
         }
 
+        stats_phase_change(new_phase);
+        bustrace_phase_change(new_phase);
         printNewPhase(new_phase);
         old_phase = new_phase;
-        old_sync_period = scsiDev.target->syncPeriod;
-        old_scsi_id = scsiDev.target->targetId;
+        if (scsiDev.target != NULL)
+        {
+            old_sync_period = scsiDev.target->syncPeriod;
+            old_scsi_id = scsiDev.target->targetId;
+        }
     }
 }
 
@@ -263,7 +271,7 @@ void scsiLogInitiatorPhaseChange(int new_phase)
     {
         if (old_phase == DATA_IN || old_phase == DATA_OUT)
         {
-            dbgmsg("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", (int)g_DataChecksum);
+            dbgmsg("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CRC32: ", g_DataChecksum);
         }
         g_InByteCount = g_OutByteCount = 0;
         g_DataChecksum = 0;
@@ -282,19 +290,24 @@ void scsiLogDataIn(const uint8_t *buf, uint32_t length)
 
     if (g_log_debug)
     {
-        // BSD checksum algorithm
-        for (uint32_t i = 0; i < length; i++)
-        {
-            g_DataChecksum = (g_DataChecksum >> 1) + ((g_DataChecksum & 1) << 15);
-            g_DataChecksum += buf[i];
-        }
+        // Table based CRC-32 processes a word per iteration, so that
+        // long transfers are not slowed down much by debug logging.
+        g_DataChecksum = crc32_update(g_DataChecksum, buf, length);
     }
 
     g_InByteCount += length;
+    stats_data_bytes(true, length);
+    bustrace_data(true, buf, length);
 }
 
 void scsiLogDataOut(const uint8_t *buf, uint32_t length)
 {
+    if (buf == scsiDev.cdb)
+    {
+        stats_command_start(buf);
+        bustrace_command_start();
+    }
+
     if (buf == scsiDev.cdb || g_LogInitiatorCommand)
     {
         dbgmsg("---- COMMAND: ", getCommandName(buf[0]));
@@ -307,13 +320,10 @@ void scsiLogDataOut(const uint8_t *buf, uint32_t length)
 
     if (g_log_debug)
     {
-        // BSD checksum algorithm
-        for (uint32_t i = 0; i < length; i++)
-        {
-            g_DataChecksum = (g_DataChecksum >> 1) + ((g_DataChecksum & 1) << 15);
-            g_DataChecksum += buf[i];
-        }
+        g_DataChecksum = crc32_update(g_DataChecksum, buf, length);
     }
 
     g_OutByteCount += length;
+    stats_data_bytes(false, length);
+    bustrace_data(false, buf, length);
 }
@@ -0,0 +1,198 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_manifest.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include <minIni.h>
+#include <DataHash.h>
+#include <string.h>
+
+extern SdFs SD;
+
+#define MANIFEST_MAGIC "ZSIMGMAN"
+#define MANIFEST_VERSION 1
+
+// Manifest file has a header followed by the entries.
+// Structures are stored as is, all supported platforms are little-endian.
+struct manifest_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t crc; // CRC-32 of the entries
+    uint32_t reserved;
+};
+
+struct manifest_entry_t
+{
+    // Key fields
+    uint32_t path_crc;
+    uint32_t first_sector;
+    uint64_t file_size;
+    uint16_t modify_date;
+    uint16_t modify_time;
+
+    // Result of contiguousRange()
+    uint32_t contiguous;
+    uint32_t bgn_sector;
+    uint32_t end_sector;
+};
+
+static struct {
+    bool enabled;
+    bool changed;
+    uint32_t count;
+    manifest_entry_t entries[MANIFEST_MAX_ENTRIES];
+    bool used[MANIFEST_MAX_ENTRIES];
+} g_manifest;
+
+void manifest_load()
+{
+    memset(&g_manifest, 0, sizeof(g_manifest));
+    g_manifest.enabled = ini_getbool("SCSI", "ImageManifest", 0, CONFIGFILE);
+    if (!g_manifest.enabled)
+    {
+        return;
+    }
+
+    FsFile file = SD.open(MANIFESTFILE, O_RDONLY);
+    if (!file.isOpen())
+    {
+        dbgmsg("Image manifest ", MANIFESTFILE, " not found, it will be created");
+        return;
+    }
+
+    manifest_header_t hdr;
+    uint32_t len = 0;
+    if (file.read(&hdr, sizeof(hdr)) == sizeof(hdr) &&
+        memcmp(hdr.magic, MANIFEST_MAGIC, sizeof(hdr.magic)) == 0 &&
+        hdr.version == MANIFEST_VERSION &&
+        hdr.count <= MANIFEST_MAX_ENTRIES)
+    {
+        len = hdr.count * sizeof(manifest_entry_t);
+    }
+
+    if (len > 0 && file.read(g_manifest.entries, len) == (int)len &&
+        crc32_update(0, g_manifest.entries, len) == hdr.crc)
+    {
+        g_manifest.count = hdr.count;
+        dbgmsg("Loaded ", (int)g_manifest.count, " entries from image manifest ", MANIFESTFILE);
+    }
+    else
+    {
+        logmsg("Ignoring invalid image manifest ", MANIFESTFILE);
+        memset(g_manifest.entries, 0, sizeof(g_manifest.entries));
+    }
+
+    file.close();
+}
+
+static bool manifest_key_equal(const manifest_entry_t *a, const manifest_entry_t *b)
+{
+    return a->path_crc == b->path_crc &&
+           a->first_sector == b->first_sector &&
+           a->file_size == b->file_size &&
+           a->modify_date == b->modify_date &&
+           a->modify_time == b->modify_time;
+}
+
+bool manifest_contiguous_range(FsFile &file, const char *path, uint32_t *bgnSector, uint32_t *endSector)
+{
+    manifest_entry_t key = {};
+    if (!g_manifest.enabled || !file.getModifyDateTime(&key.modify_date, &key.modify_time))
+    {
+        return file.contiguousRange(bgnSector, endSector);
+    }
+
+    key.path_crc = crc32_update(0, path, strlen(path));
+    key.first_sector = file.firstSector();
+    key.file_size = file.fileSize();
+
+    for (uint32_t i = 0; i < g_manifest.count; i++)
+    {
+        const manifest_entry_t *entry = &g_manifest.entries[i];
+        if (manifest_key_equal(entry, &key))
+        {
+            dbgmsg("---- Using contiguity check result from ", MANIFESTFILE);
+            g_manifest.used[i] = true;
+            *bgnSector = entry->bgn_sector;
+            *endSector = entry->end_sector;
+            return entry->contiguous != 0;
+        }
+    }
+
+    key.contiguous = file.contiguousRange(&key.bgn_sector, &key.end_sector);
+    *bgnSector = key.bgn_sector;
+    *endSector = key.end_sector;
+
+    // Add new entry, or replace one that has not been used since loading
+    uint32_t idx = g_manifest.count;
+    if (idx >= MANIFEST_MAX_ENTRIES)
+    {
+        idx = 0;
+        while (idx < MANIFEST_MAX_ENTRIES && g_manifest.used[idx]) idx++;
+        if (idx >= MANIFEST_MAX_ENTRIES)
+        {
+            return key.contiguous != 0;
+        }
+    }
+    else
+    {
+        g_manifest.count++;
+    }
+
+    g_manifest.entries[idx] = key;
+    g_manifest.used[idx] = true;
+    g_manifest.changed = true;
+    return key.contiguous != 0;
+}
+
+void manifest_save()
+{
+    if (!g_manifest.enabled || !g_manifest.changed)
+    {
+        return;
+    }
+
+    manifest_header_t hdr = {};
+    memcpy(hdr.magic, MANIFEST_MAGIC, sizeof(hdr.magic));
+    hdr.version = MANIFEST_VERSION;
+    hdr.count = g_manifest.count;
+    uint32_t len = g_manifest.count * sizeof(manifest_entry_t);
+    hdr.crc = crc32_update(0, g_manifest.entries, len);
+
+    // On failure, retry only after new entries have been added
+    g_manifest.changed = false;
+
+    FsFile file = SD.open(MANIFESTFILE, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen() ||
+        file.write(&hdr, sizeof(hdr)) != sizeof(hdr) ||
+        file.write(g_manifest.entries, len) != len)
+    {
+        logmsg("Failed to write image manifest ", MANIFESTFILE);
+        file.close();
+        return;
+    }
+
+    file.close();
+    dbgmsg("Saved ", (int)g_manifest.count, " entries to image manifest ", MANIFESTFILE);
+}
@@ -0,0 +1,50 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Image manifest caches the results of image file contiguity checks
+// on the SD card. For a large image on a FAT filesystem, the check walks
+// through the whole cluster chain, which can take hundreds of milliseconds
+// per image and delay the boot past the host's SCSI bus scan.
+//
+// Each entry is keyed by the image path together with the size, first
+// sector and modification time from its directory entry. Files that
+// have been changed, moved or rewritten get a new entry. When the manifest
+// is full, entries that were not used during this boot are replaced.
+
+#pragma once
+
+#include <stdint.h>
+#include <SdFat.h>
+
+#define MANIFEST_MAX_ENTRIES 16
+
+// Load manifest from SD card, if enabled by ImageManifest = 1 in zuluscsi.ini.
+void manifest_load();
+
+// Get the contiguous sector range of an image file.
+// Uses the stored result if the file is unchanged, otherwise calls
+// file.contiguousRange() and stores the result.
+bool manifest_contiguous_range(FsFile &file, const char *path, uint32_t *bgnSector, uint32_t *endSector);
+
+// Save manifest to SD card if it has changed since loading or last save.
+// Called after image setup, and from main loop for images whose opening
+// was deferred to first access.
+void manifest_save();
@@ -0,0 +1,488 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_disk.h"
+#include <SdFat.h>
+#include <scsi2sd.h>
+#include <string.h>
+
+extern "C" {
+#include <scsi.h>
+#include <scsiPhy.h>
+#include <diagnostic.h>
+}
+
+extern SdFs SD;
+
+uint32_t stats_time_us()
+{
+#ifdef PLATFORM_HAS_MICROS
+    return micros();
+#else
+    return millis() * 1000;
+#endif
+}
+
+int stats_command_class(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x08: // Read6
+        case 0x28: // Read10
+        case 0xA8: // Read12
+        case 0xB9: // ReadCDMSF
+        case 0xBE: // ReadCD
+            return STATS_CLASS_READ;
+
+        case 0x0A: // Write6
+        case 0x2A: // Write10
+        case 0xAA: // Write12
+        case 0x2E: // WriteVerify
+            return STATS_CLASS_WRITE;
+
+        default:
+            return STATS_CLASS_OTHER;
+    }
+}
+
+#if ENABLE_STATS
+
+static target_stats_t g_target_stats[STATS_MAX_TARGETS];
+
+// State of the command currently being processed
+static struct {
+    target_stats_t *active; // NULL if no command in progress
+    uint8_t opcode;
+    bool in_data_phase;
+    uint32_t command_start;
+    uint32_t data_start;
+
+    uint32_t save_interval_ms;
+    uint32_t save_time;
+    uint32_t saved_commands;
+} g_stats;
+
+static int stats_latency_bucket(uint32_t us)
+{
+    if (us == 0) return 0;
+    int bucket = 31 - __builtin_clz(us);
+    if (bucket >= STATS_LATENCY_BUCKETS) bucket = STATS_LATENCY_BUCKETS - 1;
+    return bucket;
+}
+
+void stats_command_start(const uint8_t *cdb)
+{
+    if (scsiDev.target == NULL) return;
+
+    target_stats_t *st = &g_target_stats[scsiDev.target->targetId & 7];
+    st->commands++;
+    if (st->opcodes[cdb[0]] != 0xFFFF) st->opcodes[cdb[0]]++;
+
+    g_stats.active = st;
+    g_stats.opcode = cdb[0];
+    g_stats.in_data_phase = false;
+    g_stats.command_start = stats_time_us();
+}
+
+void stats_phase_change(int new_phase)
+{
+    target_stats_t *st = g_stats.active;
+    if (st == NULL) return;
+
+    uint32_t now = stats_time_us();
+    if (g_stats.in_data_phase)
+    {
+        st->bus_us += (uint32_t)(now - g_stats.data_start);
+    }
+
+    g_stats.in_data_phase = (new_phase == DATA_IN || new_phase == DATA_OUT);
+    if (g_stats.in_data_phase)
+    {
+        g_stats.data_start = now;
+    }
+
+    if (new_phase == STATUS)
+    {
+        uint32_t latency = now - g_stats.command_start;
+        st->latency[stats_command_class(g_stats.opcode)][stats_latency_bucket(latency)]++;
+
+        if (scsiDev.status != GOOD)
+        {
+            st->errors++;
+        }
+
+        g_stats.active = NULL;
+    }
+}
+
+void stats_data_bytes(bool in, uint32_t count)
+{
+    if (g_stats.in_data_phase)
+    {
+        if (in)
+            g_stats.active->bytes_in += count;
+        else
+            g_stats.active->bytes_out += count;
+    }
+}
+
+void stats_prefetch_hit(int target_id)
+{
+    g_target_stats[target_id & 7].prefetch_hits++;
+}
+
+void stats_sd_time(int target_id, bool write, uint32_t start_us)
+{
+    uint32_t elapsed = stats_time_us() - start_us;
+    if (write)
+        g_target_stats[target_id & 7].sd_write_us += elapsed;
+    else
+        g_target_stats[target_id & 7].sd_read_us += elapsed;
+}
+
+const target_stats_t *stats_get(int target_id)
+{
+    return &g_target_stats[target_id & 7];
+}
+
+void stats_reset(int target_id)
+{
+    target_stats_t *st = &g_target_stats[target_id & 7];
+    if (g_stats.active == st)
+    {
+        // Latency of the current command will still be counted
+        g_stats.in_data_phase = false;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->reset_time = millis();
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    *p++ = (uint8_t)(value >> 8);
+    *p++ = (uint8_t)(value >> 0);
+    return p;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p = put_u16(p, (uint16_t)(value >> 16));
+    p = put_u16(p, (uint16_t)(value >> 0));
+    return p;
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t value)
+{
+    p = put_u32(p, (uint32_t)(value >> 32));
+    p = put_u32(p, (uint32_t)(value >> 0));
+    return p;
+}
+
+size_t stats_serialize(int target_id, uint8_t *buf, size_t buflen)
+{
+    if (buflen < STATS_SERIALIZED_SIZE) return 0;
+
+    const target_stats_t *st = &g_target_stats[target_id & 7];
+    uint8_t *p = buf;
+    *p++ = 'Z';
+    *p++ = 'S';
+    *p++ = STATS_FORMAT_VERSION;
+    *p++ = target_id & 7;
+    p = put_u32(p, millis() - st->reset_time);
+    p = put_u32(p, st->commands);
+    p = put_u32(p, st->errors);
+    p = put_u32(p, st->prefetch_hits);
+    p = put_u32(p, 0);
+    p = put_u64(p, st->bytes_in);
+    p = put_u64(p, st->bytes_out);
+    p = put_u64(p, st->sd_read_us);
+    p = put_u64(p, st->sd_write_us);
+    p = put_u64(p, st->bus_us);
+
+    for (int c = 0; c < STATS_CLASS_COUNT; c++)
+    {
+        for (int i = 0; i < STATS_LATENCY_BUCKETS; i++)
+        {
+            p = put_u32(p, st->latency[c][i]);
+        }
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        p = put_u16(p, st->opcodes[i]);
+    }
+
+    return p - buf;
+}
+
+// Vendor specific READ BUFFER mode, called from scsiReadBuffer().
+// Buffer ID bits 0-2 select the SCSI ID, bit 7 resets the counters after reading.
+extern "C" int scsiStatsReadBuffer(uint8_t bufferId, uint8_t *buf, uint32_t buflen)
+{
+    if (bufferId & 0x78)
+    {
+        return 0;
+    }
+
+    int target_id = bufferId & 7;
+    size_t len = stats_serialize(target_id, buf, buflen);
+
+    if (len > 0 && (bufferId & 0x80))
+    {
+        stats_reset(target_id);
+    }
+
+    return len;
+}
+
+/***********************/
+/* Summary file saving */
+/***********************/
+
+static char *append_str(char *p, const char *str)
+{
+    while (*str) *p++ = *str++;
+    return p;
+}
+
+static char *append_dec(char *p, uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0) *p++ = digits[--count];
+    return p;
+}
+
+static char *append_hex8(char *p, uint8_t value)
+{
+    const char *nibble = "0123456789ABCDEF";
+    *p++ = '0';
+    *p++ = 'x';
+    *p++ = nibble[value >> 4];
+    *p++ = nibble[value & 0xF];
+    return p;
+}
+
+// Write out the line buffer when it is getting full.
+// The buffer has space for one more item after this.
+static char *flush_line(FsFile &file, char *line, char *p)
+{
+    if (p - line > 128)
+    {
+        file.write(line, p - line);
+        return line;
+    }
+    return p;
+}
+
+static void save_target_summary(FsFile &file, int target_id, const target_stats_t *st)
+{
+    char line[160];
+    char *p = line;
+
+    p = append_str(p, "\nSCSI ID ");
+    p = append_dec(p, target_id);
+    p = append_str(p, ": ");
+    p = append_dec(p, (uint32_t)(millis() - st->reset_time) / 1000);
+    p = append_str(p, " s since reset\n  commands ");
+    p = append_dec(p, st->commands);
+    p = append_str(p, ", errors ");
+    p = append_dec(p, st->errors);
+    p = append_str(p, ", prefetch hits ");
+    p = append_dec(p, st->prefetch_hits);
+    file.write(line, p - line);
+
+    p = append_str(line, "\n  bytes in ");
+    p = append_dec(p, st->bytes_in);
+    p = append_str(p, ", bytes out ");
+    p = append_dec(p, st->bytes_out);
+    p = append_str(p, "\n  SD read ");
+    p = append_dec(p, st->sd_read_us / 1000);
+    p = append_str(p, " ms, SD write ");
+    p = append_dec(p, st->sd_write_us / 1000);
+    p = append_str(p, " ms, bus data phases ");
+    p = append_dec(p, st->bus_us / 1000);
+    p = append_str(p, " ms\n");
+    file.write(line, p - line);
+
+    // Nonzero histogram buckets as "lower_limit_us:count"
+    static const char *class_names[STATS_CLASS_COUNT] = {"read", "write", "other"};
+    for (int c = 0; c < STATS_CLASS_COUNT; c++)
+    {
+        p = append_str(line, "  ");
+        p = append_str(p, class_names[c]);
+        p = append_str(p, " latency us:");
+        for (int i = 0; i < STATS_LATENCY_BUCKETS; i++)
+        {
+            if (st->latency[c][i] == 0) continue;
+            p = flush_line(file, line, p);
+            *p++ = ' ';
+            p = append_dec(p, (i == 0) ? 0 : (1UL << i));
+            *p++ = ':';
+            p = append_dec(p, st->latency[c][i]);
+        }
+        *p++ = '\n';
+        file.write(line, p - line);
+    }
+
+    p = append_str(line, "  opcodes:");
+    for (int i = 0; i < 256; i++)
+    {
+        if (st->opcodes[i] == 0) continue;
+        p = flush_line(file, line, p);
+        *p++ = ' ';
+        p = append_hex8(p, i);
+        *p++ = ':';
+        p = append_dec(p, st->opcodes[i]);
+    }
+    *p++ = '\n';
+    file.write(line, p - line);
+}
+
+bool stats_save_summary(const char *filename)
+{
+    FsFile file = SD.open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen())
+    {
+        logmsg("Failed to open statistics file ", filename);
+        return false;
+    }
+
+    const char *header = "# ZuluSCSI " ZULU_FW_VERSION " performance statistics\n";
+    file.write(header, strlen(header));
+
+    for (int i = 0; i < STATS_MAX_TARGETS; i++)
+    {
+        if (g_target_stats[i].commands > 0)
+        {
+            save_target_summary(file, i, &g_target_stats[i]);
+        }
+    }
+
+    if (!file.close())
+    {
+        logmsg("Failed to write statistics file ", filename);
+        return false;
+    }
+
+    return true;
+}
+
+void stats_set_save_interval(uint32_t seconds)
+{
+    g_stats.save_interval_ms = seconds * 1000;
+}
+
+void stats_poll_save()
+{
+    if (g_stats.save_interval_ms == 0 ||
+        (uint32_t)(millis() - g_stats.save_time) < g_stats.save_interval_ms)
+    {
+        return;
+    }
+
+    // Don't delay response if a new command is already coming in
+    if (scsiHostWantsBus())
+    {
+        return;
+    }
+
+    uint32_t commands = 0;
+    for (int i = 0; i < STATS_MAX_TARGETS; i++)
+    {
+        commands += g_target_stats[i].commands;
+    }
+
+    g_stats.save_time = millis();
+    if (commands != g_stats.saved_commands)
+    {
+        g_stats.saved_commands = commands;
+        stats_save_summary(STATSFILE);
+    }
+}
+
+#else
+
+// Statistics disabled at compile time
+
+void stats_command_start(const uint8_t *cdb)
+{
+}
+
+void stats_phase_change(int new_phase)
+{
+}
+
+void stats_data_bytes(bool in, uint32_t count)
+{
+}
+
+void stats_prefetch_hit(int target_id)
+{
+}
+
+void stats_sd_time(int target_id, bool write, uint32_t start_us)
+{
+}
+
+const target_stats_t *stats_get(int target_id)
+{
+    return NULL;
+}
+
+void stats_reset(int target_id)
+{
+}
+
+size_t stats_serialize(int target_id, uint8_t *buf, size_t buflen)
+{
+    return 0;
+}
+
+extern "C" int scsiStatsReadBuffer(uint8_t bufferId, uint8_t *buf, uint32_t buflen)
+{
+    return 0;
+}
+
+bool stats_save_summary(const char *filename)
+{
+    return false;
+}
+
+void stats_set_save_interval(uint32_t seconds)
+{
+}
+
+void stats_poll_save()
+{
+}
+
+#endif
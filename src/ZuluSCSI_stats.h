@@ -0,0 +1,105 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Per-target performance counters and command latency histograms.
+// The counters are updated from the SCSI trace hooks and the disk data paths,
+// and can be read by the host with a vendor specific READ BUFFER mode or
+// saved periodically to a summary file on the SD card.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define STATS_MAX_TARGETS 8
+
+// Command classes for latency histograms
+#define STATS_CLASS_READ  0
+#define STATS_CLASS_WRITE 1
+#define STATS_CLASS_OTHER 2
+#define STATS_CLASS_COUNT 3
+
+// Bucket N counts commands that took 2^N to 2^(N+1)-1 microseconds,
+// the last bucket also includes everything longer than that.
+#define STATS_LATENCY_BUCKETS 24
+
+// Size of the big-endian binary representation returned by READ BUFFER.
+// Layout, with byte offsets:
+//   0: 'Z', 'S', format version 1, SCSI ID
+//   4: u32 milliseconds since last reset
+//   8: u32 commands, u32 errors, u32 prefetch hits, u32 reserved
+//  24: u64 bytes in, bytes out, SD read us, SD write us, bus us
+//  64: u32 latency histograms [STATS_CLASS_COUNT][STATS_LATENCY_BUCKETS]
+// 352: u16 command counts by opcode [256]
+#define STATS_FORMAT_VERSION 1
+#define STATS_SERIALIZED_SIZE 864
+
+struct target_stats_t
+{
+    uint32_t reset_time;
+    uint32_t commands;
+    uint32_t errors; // Commands that returned status other than GOOD
+    uint32_t prefetch_hits;
+
+    uint64_t bytes_in; // Transferred to initiator
+    uint64_t bytes_out; // Received from initiator
+    uint64_t sd_read_us;
+    uint64_t sd_write_us;
+    uint64_t bus_us; // Time spent in DATA_IN and DATA_OUT phases
+
+    uint32_t latency[STATS_CLASS_COUNT][STATS_LATENCY_BUCKETS];
+    uint16_t opcodes[256]; // Saturates at 65535
+};
+
+// Timestamp for measuring durations.
+// Has microsecond resolution on platforms that define PLATFORM_HAS_MICROS,
+// otherwise millisecond resolution scaled to microseconds.
+uint32_t stats_time_us();
+
+// Returns STATS_CLASS_* for a command opcode
+int stats_command_class(uint8_t opcode);
+
+// Called from SCSI trace hooks on target side
+void stats_command_start(const uint8_t *cdb);
+void stats_phase_change(int new_phase);
+void stats_data_bytes(bool in, uint32_t count);
+
+// Called from disk data paths
+void stats_prefetch_hit(int target_id);
+void stats_sd_time(int target_id, bool write, uint32_t start_us);
+
+// Returns NULL if statistics are disabled with ENABLE_STATS=0
+const target_stats_t *stats_get(int target_id);
+void stats_reset(int target_id);
+
+// Store statistics in the binary format described above.
+// Returns number of bytes written, or 0 if buffer is too small.
+size_t stats_serialize(int target_id, uint8_t *buf, size_t buflen);
+
+// Write human-readable summary of all active targets to a file
+bool stats_save_summary(const char *filename);
+
+// Set by StatsInterval setting in zuluscsi.ini, 0 disables summary file.
+void stats_set_save_interval(uint32_t seconds);
+
+// Save summary file if interval has elapsed and there is new data.
+// Should be called only when SCSI bus is free.
+void stats_poll_save();
@@ -0,0 +1,126 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''This script converts the SCSI bus trace zulutrace.bin to CSV,
+with one line per command. The file can be opened in a spreadsheet
+or loaded with e.g. pandas for analyzing access patterns.
+
+Usage: bustrace_convert.py zulutrace.bin > zulutrace.csv'''
+
+import sys
+import struct
+import csv
+
+HEADER_SIZE = 512
+HEADER_FORMAT = "<8sHHHHI32s"
+RECORD_FORMAT = "<HHIIIBBBBBBH12sIIIIHBB8x"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+RECORD_MAGIC = 0x5442
+
+COMMAND_NAMES = {
+    0x00: "TestUnitReady", 0x01: "RezeroUnit", 0x03: "RequestSense",
+    0x04: "FormatUnit", 0x08: "Read6", 0x0A: "Write6", 0x0B: "Seek6",
+    0x12: "Inquiry", 0x15: "ModeSelect6", 0x16: "Reserve", 0x17: "Release",
+    0x1A: "ModeSense6", 0x1B: "StartStopUnit", 0x1E: "PreventAllowMediumRemoval",
+    0x25: "ReadCapacity", 0x28: "Read10", 0x2A: "Write10", 0x2B: "Seek10",
+    0x2E: "WriteVerify", 0x2F: "Verify10", 0x35: "SynchronizeCache",
+    0x3B: "WriteBuffer", 0x3C: "ReadBuffer", 0x43: "ReadTOC",
+    0x55: "ModeSelect10", 0x5A: "ModeSense10", 0xA8: "Read12", 0xAA: "Write12",
+    0xBE: "ReadCD",
+}
+
+def decode_lba(cdb):
+    '''Returns (lba, blocks) for block access commands, or (None, None)'''
+    opcode = cdb[0]
+    if opcode in (0x08, 0x0A, 0x0B):
+        lba = ((cdb[1] & 0x1F) << 16) | (cdb[2] << 8) | cdb[3]
+        blocks = cdb[4] if cdb[4] != 0 or opcode == 0x0B else 256
+        return (lba, blocks)
+    elif opcode in (0x28, 0x2A, 0x2B, 0x2E, 0x2F):
+        lba, blocks = struct.unpack_from(">IxH", cdb, 2)
+        return (lba, blocks)
+    elif opcode in (0xA8, 0xAA):
+        lba, blocks = struct.unpack_from(">II", cdb, 2)
+        return (lba, blocks)
+    return (None, None)
+
+def read_records(data):
+    '''Yields records as dicts until the end of valid data'''
+    (magic, version, record_size, session, _, digest_limit, firmware) = \
+        struct.unpack_from(HEADER_FORMAT, data, 0)
+
+    if magic != b"ZSTRACE\0" or version != 1 or record_size != RECORD_SIZE:
+        raise ValueError("Not a ZuluSCSI bus trace file or unsupported version")
+
+    pos = HEADER_SIZE
+    seq = 0
+    while pos + RECORD_SIZE <= len(data):
+        fields = struct.unpack_from(RECORD_FORMAT, data, pos)
+        pos += RECORD_SIZE
+
+        # Preallocated file contains stale data after the last record
+        if fields[0] != RECORD_MAGIC or fields[1] != session or fields[2] != seq:
+            break
+
+        seq += 1
+        (_, _, rec_seq, time_ms, duration_us, target, lun, initiator, status,
+         cdb_len, sense_key, sense_asc, cdb, bytes_in, bytes_out, data_crc,
+         data_us, dropped, sync_period, sync_offset) = fields
+
+        cdb = cdb[:cdb_len]
+        lba, blocks = decode_lba(cdb)
+        yield {
+            "seq": rec_seq,
+            "time_ms": time_ms,
+            "duration_us": duration_us,
+            "target": target,
+            "lun": lun,
+            "initiator": initiator,
+            "command": COMMAND_NAMES.get(cdb[0], "0x%02X" % cdb[0]) if cdb else "",
+            "cdb": cdb.hex(" "),
+            "lba": "" if lba is None else lba,
+            "blocks": "" if blocks is None else blocks,
+            "status": status,
+            "sense_key": sense_key,
+            "asc": "0x%04X" % sense_asc,
+            "bytes_in": bytes_in,
+            "bytes_out": bytes_out,
+            "data_us": data_us,
+            "data_crc": "%08X" % data_crc,
+            "sync_period": sync_period,
+            "sync_offset": sync_offset,
+            "dropped": dropped,
+        }
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        print("Usage: " + sys.argv[0] + " zulutrace.bin > zulutrace.csv")
+        sys.exit(1)
+
+    data = open(sys.argv[1], "rb").read()
+    writer = None
+    for record in read_records(data):
+        if writer is None:
+            writer = csv.DictWriter(sys.stdout, fieldnames=list(record.keys()))
+            writer.writeheader()
+        writer.writerow(record)
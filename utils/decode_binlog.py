@@ -0,0 +1,126 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''This script converts the binary debug log zululog.bin to text.
+The firmware .elf file of the exact same build is needed for looking up
+the constant strings referenced by the log.
+
+Usage: decode_binlog.py zululog.bin firmware.elf > zululog_debug.txt'''
+
+import sys
+import struct
+
+RECORD_START = 0xA5
+
+class ElfStrings:
+    '''Minimal ELF32 little-endian reader for looking up strings by address'''
+
+    def __init__(self, path):
+        self.data = open(path, "rb").read()
+        if self.data[0:4] != b'\x7fELF' or self.data[4] != 1:
+            raise ValueError(path + " is not a 32-bit ELF file")
+
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+
+        self.sections = []
+        for i in range(shnum):
+            (name, sh_type, flags, addr, offset, size) = struct.unpack_from(
+                "<IIIIII", self.data, shoff + i * shentsize)
+            SHT_PROGBITS = 1
+            SHF_ALLOC = 2
+            if sh_type == SHT_PROGBITS and (flags & SHF_ALLOC) and size > 0:
+                self.sections.append((addr, offset, size))
+
+    def get_string(self, addr):
+        for (start, offset, size) in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.index(b'\0', pos, offset + size)
+                return self.data[pos:end].decode("latin-1")
+        return "<unknown string 0x%08x>" % addr
+
+def decode_record(rec, strings):
+    '''Decode items of one record to text, formatted like the text log'''
+    timestamp, = struct.unpack_from("<I", rec, 2)
+    text = "[%dms] DBG " % timestamp
+    pos = 6
+    while pos < len(rec):
+        tag = chr(rec[pos])
+        pos += 1
+        if tag == 'S':
+            addr, = struct.unpack_from("<I", rec, pos)
+            text += strings.get_string(addr)
+            pos += 4
+        elif tag == 's':
+            length = rec[pos]
+            text += rec[pos + 1 : pos + 1 + length].decode("latin-1")
+            pos += 1 + length
+        elif tag == 'b':
+            text += "0x%02X" % rec[pos]
+            pos += 1
+        elif tag == 'x':
+            text += "0x%08X" % struct.unpack_from("<I", rec, pos)
+            pos += 4
+        elif tag == 'X':
+            text += "0x%016X" % struct.unpack_from("<Q", rec, pos)
+            pos += 8
+        elif tag == 'd':
+            text += "%d" % struct.unpack_from("<i", rec, pos)
+            pos += 4
+        elif tag == 'a':
+            total, length = struct.unpack_from("<HB", rec, pos)
+            data = rec[pos + 3 : pos + 3 + length]
+            text += "".join("0x%02X " % b for b in data)
+            if total > length:
+                text += "... (total %d)" % total
+            pos += 3 + length
+        elif tag == '~':
+            text += " ... (truncated)"
+        else:
+            text += " <invalid item 0x%02x>" % ord(tag)
+            break
+    return text
+
+def decode_log(data, strings):
+    '''Decode a complete log file, yields one line per record'''
+    pos = 0
+    while pos + 6 <= len(data):
+        length = data[pos + 1]
+        if data[pos] != RECORD_START or length < 6 or pos + length > len(data):
+            # Resynchronize after a corrupted or partially written record
+            pos += 1
+            continue
+
+        yield decode_record(data[pos : pos + length], strings)
+        pos += length
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print("Usage: " + sys.argv[0] + " zululog.bin firmware.elf")
+        sys.exit(1)
+
+    logdata = open(sys.argv[1], "rb").read()
+    strings = ElfStrings(sys.argv[2])
+    for line in decode_log(logdata, strings):
+        print(line)
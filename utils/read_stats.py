@@ -0,0 +1,182 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''This script reads per-target performance statistics from ZuluSCSI
+using the vendor specific READ BUFFER mode 1, and prints them.
+The device must be a Linux SCSI generic device, e.g. /dev/sg1.
+Statistics of all SCSI IDs can be read through any one of the emulated drives.
+
+Usage: read_stats.py /dev/sg1 [--id 0] [--reset] [--save stats.bin]
+       read_stats.py --file stats.bin'''
+
+import sys
+import struct
+import argparse
+import ctypes
+import fcntl
+import os
+
+STATS_SIZE = 864
+CLASS_NAMES = ["read", "write", "other"]
+LATENCY_BUCKETS = 24
+
+class SgIoHdr(ctypes.Structure):
+    '''struct sg_io_hdr from <scsi/sg.h>'''
+    _fields_ = [
+        ("interface_id", ctypes.c_int),
+        ("dxfer_direction", ctypes.c_int),
+        ("cmd_len", ctypes.c_ubyte),
+        ("mx_sb_len", ctypes.c_ubyte),
+        ("iovec_count", ctypes.c_ushort),
+        ("dxfer_len", ctypes.c_uint),
+        ("dxferp", ctypes.c_void_p),
+        ("cmdp", ctypes.c_void_p),
+        ("sbp", ctypes.c_void_p),
+        ("timeout", ctypes.c_uint),
+        ("flags", ctypes.c_uint),
+        ("pack_id", ctypes.c_int),
+        ("usr_ptr", ctypes.c_void_p),
+        ("status", ctypes.c_ubyte),
+        ("masked_status", ctypes.c_ubyte),
+        ("msg_status", ctypes.c_ubyte),
+        ("sb_len_wr", ctypes.c_ubyte),
+        ("host_status", ctypes.c_ushort),
+        ("driver_status", ctypes.c_ushort),
+        ("resid", ctypes.c_int),
+        ("duration", ctypes.c_uint),
+        ("info", ctypes.c_uint),
+    ]
+
+SG_IO = 0x2285
+SG_DXFER_FROM_DEV = -3
+
+def read_buffer(device, buffer_id):
+    '''Execute READ BUFFER with vendor specific mode 1'''
+    cdb = (ctypes.c_ubyte * 10)(0x3C, 0x01, buffer_id, 0, 0, 0,
+        (STATS_SIZE >> 16) & 0xFF, (STATS_SIZE >> 8) & 0xFF, STATS_SIZE & 0xFF, 0)
+    data = (ctypes.c_ubyte * STATS_SIZE)()
+    sense = (ctypes.c_ubyte * 32)()
+
+    hdr = SgIoHdr()
+    hdr.interface_id = ord('S')
+    hdr.dxfer_direction = SG_DXFER_FROM_DEV
+    hdr.cmd_len = len(cdb)
+    hdr.mx_sb_len = len(sense)
+    hdr.dxfer_len = STATS_SIZE
+    hdr.dxferp = ctypes.addressof(data)
+    hdr.cmdp = ctypes.addressof(cdb)
+    hdr.sbp = ctypes.addressof(sense)
+    hdr.timeout = 5000
+
+    fd = os.open(device, os.O_RDWR)
+    try:
+        fcntl.ioctl(fd, SG_IO, hdr)
+    finally:
+        os.close(fd)
+
+    if hdr.status != 0 or hdr.host_status != 0 or hdr.driver_status != 0:
+        raise IOError("READ BUFFER failed, status 0x%02x, sense key 0x%x" %
+            (hdr.status, sense[2] & 0x0F))
+
+    return bytes(data)[:STATS_SIZE - hdr.resid]
+
+def parse_stats(data):
+    '''Parse binary statistics block, returns dict or None if not valid'''
+    if len(data) < STATS_SIZE or data[0:2] != b'ZS' or data[2] != 1:
+        return None
+
+    stats = {}
+    stats["id"] = data[3]
+    (stats["uptime_ms"], stats["commands"], stats["errors"],
+        stats["prefetch_hits"], _) = struct.unpack_from(">5I", data, 4)
+    (stats["bytes_in"], stats["bytes_out"], stats["sd_read_us"],
+        stats["sd_write_us"], stats["bus_us"]) = struct.unpack_from(">5Q", data, 24)
+
+    histograms = struct.unpack_from(">%dI" % (3 * LATENCY_BUCKETS), data, 64)
+    stats["latency"] = [histograms[i * LATENCY_BUCKETS : (i + 1) * LATENCY_BUCKETS] for i in range(3)]
+    stats["opcodes"] = struct.unpack_from(">256H", data, 352)
+    return stats
+
+def mb_per_s(count, us):
+    if us == 0:
+        return "-"
+    return "%.2f MB/s" % (count / us)
+
+def print_stats(s):
+    print("SCSI ID %d, %.1f s since reset" % (s["id"], s["uptime_ms"] / 1000))
+    print("  Commands:       %d (%d errors)" % (s["commands"], s["errors"]))
+    print("  Prefetch hits:  %d" % s["prefetch_hits"])
+    print("  Bytes in/out:   %d / %d" % (s["bytes_in"], s["bytes_out"]))
+    print("  Bus data time:  %.1f ms, %s" % (s["bus_us"] / 1000,
+        mb_per_s(s["bytes_in"] + s["bytes_out"], s["bus_us"])))
+    print("  SD read time:   %.1f ms" % (s["sd_read_us"] / 1000))
+    print("  SD write time:  %.1f ms" % (s["sd_write_us"] / 1000))
+
+    for name, hist in zip(CLASS_NAMES, s["latency"]):
+        total = sum(hist)
+        if total == 0:
+            continue
+
+        print("  Latency of %d %s commands:" % (total, name))
+        peak = max(hist)
+        for i, count in enumerate(hist):
+            if count == 0:
+                continue
+            low = 0 if i == 0 else (1 << i)
+            bar = "#" * max(1, count * 40 // peak)
+            print("    %9d us  %8d  %s" % (low, count, bar))
+
+    print("  Commands by opcode:")
+    for opcode, count in enumerate(s["opcodes"]):
+        if count > 0:
+            print("    0x%02X  %d" % (opcode, count))
+    print()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Read ZuluSCSI performance statistics")
+    parser.add_argument("device", nargs="?", help="SCSI generic device, e.g. /dev/sg1")
+    parser.add_argument("--id", type=int, help="Read only this SCSI ID, default is all")
+    parser.add_argument("--reset", action="store_true", help="Reset counters after reading")
+    parser.add_argument("--save", help="Save raw statistics blocks to file")
+    parser.add_argument("--file", help="Print statistics from a file saved earlier")
+    args = parser.parse_args()
+
+    if args.file:
+        data = open(args.file, "rb").read()
+        blocks = [data[i : i + STATS_SIZE] for i in range(0, len(data), STATS_SIZE)]
+    elif args.device:
+        ids = [args.id] if args.id is not None else range(8)
+        blocks = [read_buffer(args.device, i | (0x80 if args.reset else 0)) for i in ids]
+    else:
+        parser.print_help()
+        sys.exit(1)
+
+    if args.save:
+        open(args.save, "wb").write(b"".join(blocks))
+
+    for block in blocks:
+        stats = parse_stats(block)
+        if stats is None:
+            print("Invalid statistics data")
+        elif stats["commands"] > 0 or args.id is not None:
+            print_stats(stats)
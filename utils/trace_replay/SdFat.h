@@ -0,0 +1,144 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Subset of the SdFat API used by the SCSI command handlers,
+// implemented on top of host files for the trace replay tool.
+// File paths are relative to the current directory, which acts as
+// the SD card root. Accesses advance the simulated clock according
+// to the SD card timing model in replay_sd.cpp.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+
+#define FS_ATTRIB_READ_ONLY 0x01
+#define FS_ATTRIB_DIRECTORY 0x10
+#define FAT_TYPE_EXFAT 64
+
+struct fspos_t
+{
+    uint64_t position;
+    uint32_t cluster;
+};
+
+// SD card identification register
+struct cid_t
+{
+    uint32_t serial;
+    uint32_t psn() const { return serial; }
+};
+
+class FsVolume
+{
+};
+
+class FsFile
+{
+public:
+    FsFile();
+    FsFile(const FsFile &other);
+    FsFile &operator=(const FsFile &other);
+    ~FsFile();
+
+    bool open(const char *path, int oflag = O_RDONLY);
+    bool open(FsVolume *vol, const char *path, int oflag = O_RDONLY);
+    bool openNext(FsFile *dir, int oflag = O_RDONLY);
+    bool close();
+
+    bool isOpen() const { return m_file != NULL || m_dir != NULL; }
+    bool isDir() const { return m_dir != NULL; }
+    bool isWritable() const { return m_writable; }
+    size_t getName(char *name, size_t len);
+
+    int read(void *buf, size_t count);
+    size_t write(const void *buf, size_t count);
+    int fgets(char *str, int num);
+
+    bool seek(uint64_t pos) { return seekSet(pos); }
+    bool seekSet(uint64_t pos);
+    uint64_t position() const { return m_pos; }
+    uint64_t curPosition() const { return m_pos; }
+    uint64_t size() const { return m_size; }
+    uint64_t fileSize() const { return m_size; }
+    void fgetpos(fspos_t *pos) const { pos->position = m_pos; pos->cluster = 0; }
+    void fsetpos(const fspos_t *pos) { seekSet(pos->position); }
+
+    bool flush();
+    bool sync() { return flush(); }
+    bool preAllocate(uint64_t length);
+
+    // Files on the host are not mapped to SD card sectors
+    bool contiguousRange(uint32_t *bgnSector, uint32_t *endSector) { return false; }
+    uint32_t firstSector() const { return 0; }
+    bool getModifyDateTime(uint16_t *pdate, uint16_t *ptime) { return false; }
+
+private:
+    // Copies of an FsFile share the same host file, like SdFat's file objects
+    // share the same directory entry.
+    struct shared_t
+    {
+        int refcount;
+    };
+
+    void release();
+
+    FILE *m_file;
+    DIR *m_dir;
+    shared_t *m_shared;
+    char m_path[256];
+    bool m_writable;
+    bool m_discard_writes;
+    uint64_t m_pos;
+    uint64_t m_size;
+};
+
+class SdCard
+{
+public:
+    uint32_t sectorCount() { return 0; }
+    bool readCID(cid_t *cid) { cid->serial = 0x5A554C55; return true; }
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t ns) { return false; }
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t ns) { return false; }
+};
+
+class SdFs
+{
+public:
+    FsFile open(const char *path, int oflag = O_RDONLY);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *oldPath, const char *newPath);
+    uint8_t attrib(const char *path);
+    FsVolume *vol() { return &m_vol; }
+    SdCard *card() { return &m_card; }
+    uint8_t sdErrorCode() { return 0; }
+    uint32_t sdErrorData() { return 0; }
+    uint8_t fatType() { return FAT_TYPE_EXFAT; }
+
+private:
+    FsVolume m_vol;
+    SdCard m_card;
+};
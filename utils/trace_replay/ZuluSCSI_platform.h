@@ -0,0 +1,101 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Platform definitions for running the firmware SCSI command handlers
+// on a PC, driven by the trace replay tool.
+//
+// All timing functions use a simulated clock, which is advanced by
+// the simulated SCSI bus and SD card. The buffer size settings
+// follow the RP2040 platform, but SD card access happens on the same
+// thread as the SCSI transfers, like on the GD32 platforms.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* These are used in debug output and default SCSI strings */
+extern const char *g_platform_name;
+#define PLATFORM_NAME "Replay"
+#define PLATFORM_REVISION "1.0"
+#define PLATFORM_MAX_SCSI_SPEED S2S_CFG_SPEED_SYNC_20
+#define PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE 32768
+#define PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE 65536
+#define PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE 8192
+
+// No firmware image in flash
+#define PLATFORM_FLASH_ADDR_START 0
+#define PLATFORM_FLASH_ADDR_END 0
+
+// Debug logging function, output goes to stderr when --log is given
+void platform_log(const char *s);
+
+// Simulated clock, in nanoseconds since start of replay
+extern uint64_t g_replay_time_ns;
+void replay_advance_ns(uint64_t ns);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+#define PLATFORM_HAS_MICROS 1
+
+static inline void delay_ns(unsigned long ns)
+{
+    replay_advance_ns(ns);
+}
+
+static inline void delay_100ns()
+{
+    replay_advance_ns(100);
+}
+
+static inline void delayMicroseconds(unsigned long us)
+{
+    replay_advance_ns((uint64_t)us * 1000);
+}
+
+void platform_init();
+void platform_late_init();
+void platform_disable_led(void);
+void platform_reset_watchdog();
+void platform_poll();
+uint8_t platform_get_buttons();
+
+// Called from the simulated SD card every 512 bytes during file access
+typedef void (*sd_callback_t)(uint32_t bytes_complete);
+void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer);
+
+// Provided by newlib on the target, but only by glibc 2.38 and later
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#define PLATFORM_NEEDS_STRLCPY 1
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,114 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Checks loading of initiator mode imaging maps, using the simulated
+// SD card of the trace replay tool. Run in the directory where the
+// map files are written.
+
+#include "ZuluSCSI_initiator_map.h"
+#include <SdFat.h>
+#include <stdio.h>
+#include <string.h>
+
+SdFs SD;
+
+static int g_failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        g_failures++; } } while (0)
+
+static const char *g_identity = "QUANTUM FIREBALL1080S 1Q09 SN123456";
+
+static void write_map(const char *filename, const char *content)
+{
+    FILE *f = fopen(filename, "wb");
+    fputs(content, f);
+    fclose(f);
+}
+
+// ddrescue can save a map in the split pass while untried areas remain
+static void test_split_pass_with_untried()
+{
+    write_map("test1.map",
+        "# Drive: QUANTUM FIREBALL1080S 1Q09 SN123456\n"
+        "0x00000400  /  2\n"
+        "0x00000000  0x00000400  +\n"
+        "0x00000400  0x00000200  *\n"
+        "0x00000600  0x00000A00  ?\n");
+
+    static ImagingMap map;
+    CHECK(map.load("test1.map", 8, 512, g_identity));
+    CHECK(map.pass == IMAGINGMAP_PASS_COPY);
+    CHECK(map.countSectors(IMAGINGMAP_NONTRIED) == 5);
+
+    imagingmap_range_t range;
+    CHECK(map.findNext(IMAGINGMAP_NONTRIED, 0, &range) && range.start == 3);
+}
+
+static void test_split_pass()
+{
+    write_map("test2.map",
+        "# Drive: QUANTUM FIREBALL1080S 1Q09 SN123456\n"
+        "0x00000400  /  2\n"
+        "0x00000000  0x00000400  +\n"
+        "0x00000400  0x00000200  *\n"
+        "0x00000600  0x00000A00  +\n");
+
+    static ImagingMap map;
+    CHECK(map.load("test2.map", 8, 512, g_identity));
+    CHECK(map.pass == IMAGINGMAP_PASS_SPLIT);
+    CHECK(map.current_pos == 2);
+
+    imagingmap_range_t range;
+    CHECK(map.findSplit(&range) && range.start == 2 && range.count == 1);
+}
+
+// Map saved with an identity longer than the stored length, and only the
+// temporary file left after interrupted save
+static void test_long_identity_tmp()
+{
+    char identity[IMAGINGMAP_IDENTITY_LEN * 2];
+    memset(identity, 'A', sizeof(identity) - 1);
+    identity[sizeof(identity) - 1] = '\0';
+
+    static ImagingMap map;
+    map.clear(8, 512, identity);
+    map.setStatus(0, 4, IMAGINGMAP_FINISHED);
+    remove("test3.map");
+    CHECK(map.save("test3.map"));
+    CHECK(rename("test3.map", "test3.map.tmp") == 0);
+
+    static ImagingMap loaded;
+    CHECK(loaded.load("test3.map", 8, 512, identity));
+    CHECK(loaded.countSectors(IMAGINGMAP_FINISHED) == 4);
+    CHECK(!loaded.load("test3.map", 8, 512, g_identity));
+}
+
+int main(int argc, char *argv[])
+{
+    test_split_pass_with_untried();
+    test_split_pass();
+    test_long_identity_tmp();
+
+    printf("Imaging map tests: %d failures\n", g_failures);
+    return g_failures ? 1 : 0;
+}
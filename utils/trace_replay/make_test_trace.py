@@ -0,0 +1,85 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''Generates a small bus trace file for testing the replay tool.
+The trace resembles a host boot on SCSI ID 0 followed by sequential
+reads and a few writes, against a zero-filled disk image.
+
+Usage: make_test_trace.py output.bin'''
+
+import sys
+import struct
+import zlib
+
+HEADER_FORMAT = "<8sHHHHI32s"
+RECORD_FORMAT = "<HHIIIBBBBBBH12sIIIIHBB8x"
+DIGEST_LIMIT = 512
+SESSION = 1
+
+def record(seq, time_ms, cdb, status=0, bytes_in=0, bytes_out=0, sync=(0, 0)):
+    crc = zlib.crc32(bytes(min(bytes_in, DIGEST_LIMIT))) if bytes_in else 0
+    return struct.pack(RECORD_FORMAT, 0x5442, SESSION, seq, time_ms, 1000,
+        0, 0, 7, status, len(cdb), 0, 0, bytes(cdb).ljust(12, b"\0"),
+        bytes_in, bytes_out, crc, 0, 0, sync[0], sync[1])
+
+def read10(lba, blocks):
+    return [0x28, 0, *struct.pack(">I", lba), 0, *struct.pack(">H", blocks), 0]
+
+def write10(lba, blocks):
+    return [0x2A, 0, *struct.pack(">I", lba), 0, *struct.pack(">H", blocks), 0]
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        print("Usage: " + sys.argv[0] + " output.bin")
+        sys.exit(1)
+
+    # Only commands with data that is known in advance are included,
+    # so that the replay should report no mismatches.
+    commands = [
+        ([0x00, 0, 0, 0, 0, 0], 0, 0, 0), # TEST UNIT READY
+        ([0x00, 0, 0, 0, 0, 0], 0, 0, 0),
+        ([0x2F, 0, 0, 0, 0, 0, 0, 0, 8, 0], 0, 0, 0), # VERIFY
+        ([0x2B, 0, 0, 0, 0, 64, 0, 0, 0, 0], 0, 0, 0), # SEEK
+        (read10(0, 1), 0, 512, 0),
+    ]
+
+    # Sequential reads that benefit from prefetch
+    for i in range(32):
+        commands.append((read10(64 + i * 16, 16), 0, 8192, 0))
+
+    # Writes followed by reads from elsewhere on the disk
+    for i in range(8):
+        commands.append((write10(2048 + i * 64, 64), 0, 0, 32768))
+        commands.append((read10(4096 + i * 256, 8), 0, 4096, 0))
+
+    data = bytearray(struct.pack(HEADER_FORMAT, b"ZSTRACE\0", 1, 64, SESSION, 0,
+        DIGEST_LIMIT, b"test trace"))
+    data += bytes(512 - len(data))
+
+    time_ms = 100
+    for seq, (cdb, status, bytes_in, bytes_out) in enumerate(commands):
+        sync = (25, 15) if seq >= 4 else (0, 0)
+        data += record(seq, time_ms, cdb, status, bytes_in, bytes_out, sync)
+        time_ms += 2
+
+    open(sys.argv[1], "wb").write(data)
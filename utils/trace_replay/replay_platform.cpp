@@ -0,0 +1,506 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Simulated clock, platform functions and SCSI bus for the trace replay tool.
+// The initiator side of the bus is simulated here: it selects the target,
+// sends IDENTIFY and optional SDTR messages, the command bytes and
+// DATA_OUT data, and collects the status and DATA_IN data.
+
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_log_trace.h"
+#include "trace_replay.h"
+#include <scsi2sd.h>
+#include <DataHash.h>
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+#include <scsi.h>
+#include <scsiPhy.h>
+#include <scsi2sd_time.h>
+}
+
+const char *g_platform_name = PLATFORM_NAME;
+bool g_replay_log;
+
+replay_bus_config_t g_replay_bus = {
+    250, // 4 MB/s asynchronous
+    512
+};
+
+/*******************/
+/* Simulated clock */
+/*******************/
+
+uint64_t g_replay_time_ns;
+
+// Pending selection, latched when the simulated clock reaches select_time_ns
+static struct {
+    bool pending;
+    uint64_t select_time_ns;
+    uint8_t sts;
+} g_replay_selection;
+
+void replay_advance_ns(uint64_t ns)
+{
+    g_replay_time_ns += ns;
+
+    if (g_replay_selection.pending && g_replay_time_ns >= g_replay_selection.select_time_ns)
+    {
+        // Same as the BSY deassert interrupt on real hardware
+        g_replay_selection.pending = false;
+        g_scsi_sts_selection = g_replay_selection.sts;
+        scsiDev.selFlag = g_replay_selection.sts;
+    }
+}
+
+extern "C" unsigned long millis(void)
+{
+    return (unsigned long)(g_replay_time_ns / 1000000);
+}
+
+extern "C" unsigned long micros(void)
+{
+    return (unsigned long)(g_replay_time_ns / 1000);
+}
+
+extern "C" void delay(unsigned long ms)
+{
+    replay_advance_ns((uint64_t)ms * 1000000);
+}
+
+/**********************/
+/* Platform functions */
+/**********************/
+
+extern "C" void platform_log(const char *s)
+{
+    if (g_replay_log)
+    {
+        fputs(s, stderr);
+    }
+}
+
+void platform_init() {}
+void platform_late_init() {}
+void platform_disable_led(void) {}
+void platform_reset_watchdog() {}
+void platform_poll() {}
+uint8_t platform_get_buttons() { return 0; }
+
+extern "C" void s2s_ledOn() {}
+extern "C" void s2s_ledOff() {}
+
+#ifdef PLATFORM_NEEDS_STRLCPY
+extern "C" size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0)
+    {
+        size_t n = (len < size - 1) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+extern "C" size_t strlcat(char *dst, const char *src, size_t size)
+{
+    size_t dstlen = strnlen(dst, size);
+    if (dstlen == size)
+    {
+        return size + strlen(src);
+    }
+    return dstlen + strlcpy(dst + dstlen, src, size - dstlen);
+}
+#endif
+
+/*************************/
+/* Simulated SCSI bus    */
+/*************************/
+
+volatile uint8_t g_scsi_sts_selection;
+volatile uint8_t g_scsi_ctrl_bsy;
+
+// Maximum number of queued nonblocking transfers, as in scsi_accel_rp2040
+#define REPLAY_MAX_PENDING 8
+
+static struct {
+    int phase;
+    replay_command_t cmd;
+    replay_result_t *result;
+
+    // Message bytes for MESSAGE_OUT phase, ATN is asserted until all are read
+    uint8_t msgout[8];
+    int msgout_len;
+    int msgout_pos;
+    int cdb_pos;
+
+    // Last SDTR request sent to each target
+    uint8_t sdtr_period[8];
+    uint8_t sdtr_offset[8];
+
+    // Nonblocking transfers in progress, in order of completion
+    struct {
+        const uint8_t *start;
+        const uint8_t *end;
+        uint64_t done_ns;
+    } pending[REPLAY_MAX_PENDING];
+    int pending_count;
+    uint64_t bus_done_ns;
+    uint32_t digest_bytes;
+} g_replay_phy;
+
+void replay_bus_start_command(const replay_command_t &cmd, uint64_t select_time_ns, replay_result_t *result)
+{
+    g_replay_phy.cmd = cmd;
+    g_replay_phy.result = result;
+    g_replay_phy.cdb_pos = 0;
+    g_replay_phy.digest_bytes = 0;
+    memset(result, 0, sizeof(*result));
+
+    // IDENTIFY without disconnect privilege
+    g_replay_phy.msgout_pos = 0;
+    g_replay_phy.msgout_len = 0;
+    g_replay_phy.msgout[g_replay_phy.msgout_len++] = 0x80 | (cmd.lun & 7);
+
+    // Repeat the synchronous transfer negotiation done by the original host
+    int id = cmd.target & 7;
+    if (cmd.sync_period != g_replay_phy.sdtr_period[id] ||
+        cmd.sync_offset != g_replay_phy.sdtr_offset[id])
+    {
+        g_replay_phy.msgout[g_replay_phy.msgout_len++] = 0x01;
+        g_replay_phy.msgout[g_replay_phy.msgout_len++] = 0x03;
+        g_replay_phy.msgout[g_replay_phy.msgout_len++] = 0x01;
+        g_replay_phy.msgout[g_replay_phy.msgout_len++] = cmd.sync_period;
+        g_replay_phy.msgout[g_replay_phy.msgout_len++] = cmd.sync_offset;
+        g_replay_phy.sdtr_period[id] = cmd.sync_period;
+        g_replay_phy.sdtr_offset[id] = cmd.sync_offset;
+    }
+
+    g_replay_selection.sts = SCSI_STS_SELECTION_SUCCEEDED | SCSI_STS_SELECTION_ATN
+                             | ((cmd.initiator & 7) << 3) | id;
+    g_replay_selection.select_time_ns = select_time_ns;
+    g_replay_selection.pending = true;
+    result->start_ns = (select_time_ns > g_replay_time_ns) ? select_time_ns : g_replay_time_ns;
+    replay_advance_ns(0);
+}
+
+// Nanoseconds to transfer one byte in the current phase
+static uint32_t replay_ns_per_byte()
+{
+    int phase = g_replay_phy.phase;
+    if ((phase == DATA_IN || phase == DATA_OUT) &&
+        scsiDev.target && scsiDev.target->syncOffset > 0)
+    {
+        // Transfer period factor is in units of 4 ns
+        return scsiDev.target->syncPeriod * 4;
+    }
+
+    return g_replay_bus.async_ns_per_byte;
+}
+
+static void replay_digest(const uint8_t *data, uint32_t count)
+{
+    if (g_replay_phy.digest_bytes < g_replay_bus.digest_limit && g_replay_phy.result)
+    {
+        uint32_t len = g_replay_bus.digest_limit - g_replay_phy.digest_bytes;
+        if (len > count) len = count;
+        g_replay_phy.result->data_crc = crc32_update(g_replay_phy.result->data_crc, data, len);
+        g_replay_phy.digest_bytes += len;
+    }
+}
+
+// Remove transfers that have completed by now
+static void replay_retire_transfers()
+{
+    int done = 0;
+    while (done < g_replay_phy.pending_count &&
+           g_replay_phy.pending[done].done_ns <= g_replay_time_ns)
+    {
+        done++;
+    }
+
+    if (done > 0)
+    {
+        g_replay_phy.pending_count -= done;
+        memmove(&g_replay_phy.pending[0], &g_replay_phy.pending[done],
+                g_replay_phy.pending_count * sizeof(g_replay_phy.pending[0]));
+    }
+}
+
+// Queue transfer on the bus, blocks if the queue is full
+static void replay_queue_transfer(const uint8_t *data, uint32_t count)
+{
+    replay_retire_transfers();
+    if (g_replay_phy.pending_count == REPLAY_MAX_PENDING)
+    {
+        if (g_replay_time_ns < g_replay_phy.pending[0].done_ns)
+        {
+            replay_advance_ns(g_replay_phy.pending[0].done_ns - g_replay_time_ns);
+        }
+        replay_retire_transfers();
+    }
+
+    uint64_t start = g_replay_phy.bus_done_ns;
+    if (start < g_replay_time_ns) start = g_replay_time_ns;
+    g_replay_phy.bus_done_ns = start + (uint64_t)count * replay_ns_per_byte();
+
+    int i = g_replay_phy.pending_count++;
+    g_replay_phy.pending[i].start = data;
+    g_replay_phy.pending[i].end = data + count;
+    g_replay_phy.pending[i].done_ns = g_replay_phy.bus_done_ns;
+}
+
+// Check if transfer containing data pointer has completed.
+// If data is NULL, checks all transfers.
+// Firmware polls this in a loop, so each unsuccessful poll takes a bit of time.
+static bool replay_is_transfer_finished(const uint8_t *data)
+{
+    replay_retire_transfers();
+
+    bool finished = true;
+    for (int i = 0; i < g_replay_phy.pending_count; i++)
+    {
+        if (data == NULL ||
+            (data >= g_replay_phy.pending[i].start && data < g_replay_phy.pending[i].end))
+        {
+            finished = false;
+            break;
+        }
+    }
+
+    if (!finished && !g_replay_sd_busy)
+    {
+        uint64_t wait = g_replay_phy.pending[0].done_ns - g_replay_time_ns;
+        replay_advance_ns(wait < 1000 ? wait : 1000);
+    }
+
+    return finished;
+}
+
+// Wait for transfers overlapping the data range to complete.
+// If data is NULL, waits for all transfers.
+static void replay_finish_transfers(const uint8_t *data = NULL, uint32_t count = 0)
+{
+    uint64_t done_ns = g_replay_phy.bus_done_ns;
+    if (data != NULL)
+    {
+        done_ns = 0;
+        for (int i = 0; i < g_replay_phy.pending_count; i++)
+        {
+            if (g_replay_phy.pending[i].start < data + count && g_replay_phy.pending[i].end > data)
+            {
+                done_ns = g_replay_phy.pending[i].done_ns;
+            }
+        }
+    }
+
+    if (g_replay_time_ns < done_ns)
+    {
+        replay_advance_ns(done_ns - g_replay_time_ns);
+    }
+    replay_retire_transfers();
+}
+
+extern "C" bool scsiStatusATN()
+{
+    return g_replay_phy.msgout_pos < g_replay_phy.msgout_len;
+}
+
+extern "C" bool scsiStatusBSY()
+{
+    return false;
+}
+
+extern "C" bool scsiStatusSEL()
+{
+    // Initiator releases SEL as soon as target asserts BSY
+    g_scsi_ctrl_bsy = 0;
+    return false;
+}
+
+extern "C" void scsiPhyReset(void)
+{
+    g_scsi_sts_selection = 0;
+    g_scsi_ctrl_bsy = 0;
+    g_replay_phy.phase = BUS_FREE;
+    g_replay_phy.pending_count = 0;
+    memset(g_replay_phy.sdtr_period, 0, sizeof(g_replay_phy.sdtr_period));
+    memset(g_replay_phy.sdtr_offset, 0, sizeof(g_replay_phy.sdtr_offset));
+}
+
+extern "C" void scsiEnterPhase(int phase)
+{
+    int delay = scsiEnterPhaseImmediate(phase);
+    if (delay > 0)
+    {
+        s2s_delay_ns(delay);
+    }
+}
+
+extern "C" uint32_t scsiEnterPhaseImmediate(int phase)
+{
+    if (phase == g_replay_phy.phase)
+    {
+        return 0;
+    }
+
+    int oldphase = g_replay_phy.phase;
+    g_replay_phy.phase = phase;
+    scsiLogPhaseChange(phase);
+
+    if (phase < 0)
+    {
+        return 0;
+    }
+
+    // Same delays as on RP2040
+    uint32_t delayNs = 400;
+    if ((oldphase & __scsiphase_io) != (phase & __scsiphase_io))
+    {
+        delayNs += 400;
+    }
+
+    if (scsiDev.compatMode < COMPAT_SCSI2)
+    {
+        delayNs += 100000;
+    }
+
+    return delayNs;
+}
+
+extern "C" void scsiEnterBusFree(void)
+{
+    replay_finish_transfers();
+    g_replay_phy.phase = BUS_FREE;
+    g_scsi_sts_selection = 0;
+    g_scsi_ctrl_bsy = 0;
+    scsiDev.cdbLen = 0;
+
+    if (g_replay_phy.result && !g_replay_phy.result->done)
+    {
+        g_replay_phy.result->done = true;
+        g_replay_phy.result->end_ns = g_replay_time_ns;
+    }
+}
+
+/********************/
+/* Transmit to host */
+/********************/
+
+extern "C" void scsiWriteByte(uint8_t value)
+{
+    scsiStartWrite(&value, 1);
+    scsiFinishWrite();
+}
+
+extern "C" void scsiWrite(const uint8_t* data, uint32_t count)
+{
+    scsiStartWrite(data, count);
+    scsiFinishWrite();
+}
+
+extern "C" void scsiStartWrite(const uint8_t* data, uint32_t count)
+{
+    scsiLogDataIn(data, count);
+
+    replay_result_t *result = g_replay_phy.result;
+    if (result && g_replay_phy.phase == DATA_IN)
+    {
+        result->bytes_in += count;
+        replay_digest(data, count);
+    }
+    else if (result && g_replay_phy.phase == STATUS && count > 0)
+    {
+        result->status = data[count - 1];
+    }
+
+    replay_queue_transfer(data, count);
+}
+
+extern "C" bool scsiIsWriteFinished(const uint8_t *data)
+{
+    return replay_is_transfer_finished(data);
+}
+
+extern "C" void scsiFinishWrite()
+{
+    replay_finish_transfers();
+}
+
+/*********************/
+/* Receive from host */
+/*********************/
+
+extern "C" uint8_t scsiReadByte(void)
+{
+    uint8_t r;
+    int parityError = 0;
+    scsiRead(&r, 1, &parityError);
+    return r;
+}
+
+extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
+{
+    *parityError = 0;
+    scsiStartRead(data, count, parityError);
+    scsiFinishRead(data, count, parityError);
+}
+
+extern "C" void scsiStartRead(uint8_t* data, uint32_t count, int *parityError)
+{
+    // Original data is not stored in the trace, so DATA_OUT phase sends zeros
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t value = 0;
+        if (g_replay_phy.phase == MESSAGE_OUT && scsiStatusATN())
+        {
+            value = g_replay_phy.msgout[g_replay_phy.msgout_pos++];
+        }
+        else if (g_replay_phy.phase == COMMAND && g_replay_phy.cdb_pos < (int)sizeof(g_replay_phy.cmd.cdb))
+        {
+            value = g_replay_phy.cmd.cdb[g_replay_phy.cdb_pos++];
+        }
+        data[i] = value;
+    }
+
+    replay_queue_transfer(data, count);
+}
+
+extern "C" void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError)
+{
+    replay_finish_transfers(data, count);
+    scsiLogDataOut(data, count);
+
+    replay_result_t *result = g_replay_phy.result;
+    if (result && g_replay_phy.phase == DATA_OUT && count > 0)
+    {
+        result->bytes_out += count;
+        replay_digest(data, count);
+    }
+}
+
+extern "C" bool scsiIsReadFinished(const uint8_t *data)
+{
+    return replay_is_transfer_finished(data);
+}
@@ -0,0 +1,394 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Simulated SD card for the trace replay tool.
+// File contents come from host files, while access time is computed
+// from a simple model: a fixed latency for non-sequential reads and
+// for every write, plus transfer time based on the throughput.
+// The SD callback is called after every 512 bytes, like the DMA based
+// SD drivers do, so that the firmware can overlap SCSI transfers.
+
+#include "SdFat.h"
+#include "ZuluSCSI_platform.h"
+#include "trace_replay.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+replay_sd_config_t g_replay_sd = {
+    20000, // read_kBps
+    12000, // write_kBps
+    200, // read_latency_us
+    500, // write_latency_us
+    false // write_images
+};
+
+replay_sd_counters_t g_replay_sd_counters;
+bool g_replay_sd_busy;
+
+static sd_callback_t g_sd_callback;
+
+extern "C" void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer)
+{
+    g_sd_callback = func;
+}
+
+// End of the previous access, for detecting sequential reads
+static const void *g_sd_last_file;
+static uint64_t g_sd_last_end;
+
+// Advance simulated clock for the transfer and report progress to the callback
+static void replay_sd_transfer(const void *file, uint64_t pos, size_t count, bool write)
+{
+    g_replay_sd_busy = true;
+
+    if (write)
+    {
+        g_replay_sd_counters.write_ops++;
+        g_replay_sd_counters.write_bytes += count;
+        replay_advance_ns((uint64_t)g_replay_sd.write_latency_us * 1000);
+    }
+    else
+    {
+        g_replay_sd_counters.read_ops++;
+        g_replay_sd_counters.read_bytes += count;
+        if (file != g_sd_last_file || pos != g_sd_last_end)
+        {
+            g_replay_sd_counters.random_reads++;
+            replay_advance_ns((uint64_t)g_replay_sd.read_latency_us * 1000);
+        }
+    }
+
+    uint32_t kBps = write ? g_replay_sd.write_kBps : g_replay_sd.read_kBps;
+    uint64_t ns_per_sector = 512 * 1000000ULL / kBps;
+    for (size_t done = 0; done < count; )
+    {
+        size_t len = count - done;
+        if (len > 512) len = 512;
+        replay_advance_ns(ns_per_sector * len / 512);
+        done += len;
+
+        if (g_sd_callback)
+        {
+            g_sd_callback(done);
+        }
+    }
+
+    g_sd_last_file = file;
+    g_sd_last_end = pos + count;
+    g_replay_sd_busy = false;
+}
+
+/**********/
+/* FsFile */
+/**********/
+
+FsFile::FsFile():
+    m_file(NULL), m_dir(NULL), m_shared(NULL), m_writable(false),
+    m_discard_writes(false), m_pos(0), m_size(0)
+{
+    m_path[0] = '\0';
+}
+
+FsFile::FsFile(const FsFile &other):
+    FsFile()
+{
+    *this = other;
+}
+
+FsFile &FsFile::operator=(const FsFile &other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    release();
+    m_file = other.m_file;
+    m_dir = other.m_dir;
+    m_shared = other.m_shared;
+    memcpy(m_path, other.m_path, sizeof(m_path));
+    m_writable = other.m_writable;
+    m_discard_writes = other.m_discard_writes;
+    m_pos = other.m_pos;
+    m_size = other.m_size;
+    if (m_shared) m_shared->refcount++;
+    return *this;
+}
+
+FsFile::~FsFile()
+{
+    release();
+}
+
+void FsFile::release()
+{
+    if (m_shared && --m_shared->refcount == 0)
+    {
+        if (m_file) fclose(m_file);
+        if (m_dir) closedir(m_dir);
+        delete m_shared;
+    }
+
+    m_file = NULL;
+    m_dir = NULL;
+    m_shared = NULL;
+}
+
+bool FsFile::open(const char *path, int oflag)
+{
+    release();
+    m_pos = 0;
+    m_size = 0;
+    strncpy(m_path, path, sizeof(m_path) - 1);
+    m_path[sizeof(m_path) - 1] = '\0';
+
+    // SdFat paths start from the card root
+    const char *hostpath = path;
+    while (*hostpath == '/') hostpath++;
+    if (*hostpath == '\0') hostpath = ".";
+
+    struct stat st;
+    bool exists = (stat(hostpath, &st) == 0);
+    if (exists && S_ISDIR(st.st_mode))
+    {
+        m_dir = opendir(hostpath);
+    }
+    else
+    {
+        int access = oflag & O_ACCMODE;
+        m_writable = (access != O_RDONLY);
+
+        // Keep disk images unchanged unless requested otherwise
+        m_discard_writes = exists && m_writable && !(oflag & O_TRUNC) && !g_replay_sd.write_images;
+
+        const char *mode = "rb";
+        if (m_writable && !m_discard_writes)
+        {
+            if (oflag & O_TRUNC)
+                mode = "w+b";
+            else if (exists)
+                mode = "r+b";
+            else if (oflag & O_CREAT)
+                mode = "w+b";
+            else
+                return false;
+        }
+        else if (!exists)
+        {
+            return false;
+        }
+
+        m_file = fopen(hostpath, mode);
+        if (m_file && exists && !(oflag & O_TRUNC))
+        {
+            m_size = st.st_size;
+        }
+    }
+
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    m_shared = new shared_t;
+    m_shared->refcount = 1;
+    return true;
+}
+
+bool FsFile::open(FsVolume *vol, const char *path, int oflag)
+{
+    return open(path, oflag);
+}
+
+bool FsFile::openNext(FsFile *dir, int oflag)
+{
+    if (!dir->m_dir)
+    {
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir->m_dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char path[sizeof(m_path)];
+        size_t len = strlen(dir->m_path);
+        if (len + 1 + strlen(entry->d_name) >= sizeof(path))
+        {
+            continue;
+        }
+
+        memcpy(path, dir->m_path, len);
+        path[len] = '/';
+        strcpy(path + len + 1, entry->d_name);
+        if (open(path, oflag))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FsFile::close()
+{
+    release();
+    return true;
+}
+
+size_t FsFile::getName(char *name, size_t len)
+{
+    const char *base = strrchr(m_path, '/');
+    base = base ? base + 1 : m_path;
+    if (len == 0 || strlen(base) >= len)
+    {
+        return 0;
+    }
+
+    strcpy(name, base);
+    return strlen(name);
+}
+
+int FsFile::read(void *buf, size_t count)
+{
+    if (!m_file) return -1;
+
+    if (m_pos >= m_size)
+    {
+        return 0;
+    }
+    else if (m_pos + count > m_size)
+    {
+        count = m_size - m_pos;
+    }
+
+    if (fseeko(m_file, m_pos, SEEK_SET) != 0 || fread(buf, 1, count, m_file) != count)
+    {
+        return -1;
+    }
+
+    replay_sd_transfer(m_shared, m_pos, count, false);
+    m_pos += count;
+    return count;
+}
+
+size_t FsFile::write(const void *buf, size_t count)
+{
+    if (!m_file || !m_writable) return 0;
+
+    if (!m_discard_writes)
+    {
+        if (fseeko(m_file, m_pos, SEEK_SET) != 0 || fwrite(buf, 1, count, m_file) != count)
+        {
+            return 0;
+        }
+    }
+
+    replay_sd_transfer(m_shared, m_pos, count, true);
+    m_pos += count;
+    if (m_pos > m_size) m_size = m_pos;
+    return count;
+}
+
+int FsFile::fgets(char *str, int num)
+{
+    // Used only for reading configuration files, does not take simulated time
+    if (!m_file || num <= 1 || fseeko(m_file, m_pos, SEEK_SET) != 0 ||
+        !::fgets(str, num, m_file))
+    {
+        return -1;
+    }
+
+    int len = strlen(str);
+    m_pos += len;
+    return len;
+}
+
+bool FsFile::seekSet(uint64_t pos)
+{
+    if (!m_file) return false;
+    m_pos = pos;
+    return true;
+}
+
+bool FsFile::flush()
+{
+    if (m_file && !m_discard_writes)
+    {
+        fflush(m_file);
+    }
+    return true;
+}
+
+bool FsFile::preAllocate(uint64_t length)
+{
+    if (!m_file || m_size != 0) return false;
+    m_size = length;
+    return true;
+}
+
+/********/
+/* SdFs */
+/********/
+
+FsFile SdFs::open(const char *path, int oflag)
+{
+    FsFile file;
+    file.open(path, oflag);
+    return file;
+}
+
+bool SdFs::exists(const char *path)
+{
+    while (*path == '/') path++;
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+bool SdFs::remove(const char *path)
+{
+    while (*path == '/') path++;
+    return ::remove(path) == 0;
+}
+
+bool SdFs::rename(const char *oldPath, const char *newPath)
+{
+    while (*oldPath == '/') oldPath++;
+    while (*newPath == '/') newPath++;
+    return ::rename(oldPath, newPath) == 0;
+}
+
+uint8_t SdFs::attrib(const char *path)
+{
+    while (*path == '/') path++;
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+
+    uint8_t attrib = 0;
+    if (S_ISDIR(st.st_mode)) attrib |= FS_ATTRIB_DIRECTORY;
+    if (access(path, W_OK) != 0) attrib |= FS_ATTRIB_READ_ONLY;
+    return attrib;
+}
@@ -0,0 +1,401 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Replays a SCSI bus trace recorded with the BusTrace setting against
+// the firmware command handlers running on a PC. The SCSI bus and SD card
+// are simulated, so the reported times show how changes to caching,
+// prefetch or write handling would affect the recorded workload.
+//
+// The tool is run in a directory that acts as the SD card root,
+// zuluscsi.ini is read from there. Image files are given on the command line.
+
+#include "trace_replay.h"
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_bustrace.h"
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_disk.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_log_trace.h"
+#include <scsi2sd.h>
+#include <minIni.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <scsi.h>
+#include <scsiPhy.h>
+}
+
+SdFs SD;
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] zulutrace.bin\n"
+        "  --image ID:FILE[:BLOCKSIZE[:TYPE]]  Attach image, TYPE is hd, cd, fd, mo, re or tp\n"
+        "  --csv FILE             Write per-command results to CSV file\n"
+        "  --no-gaps              Issue commands back-to-back instead of keeping host idle time\n"
+        "  --limit N              Replay only first N commands\n"
+        "  --async-kBps N         Asynchronous SCSI transfer speed (default 4000)\n"
+        "  --sd-read-kBps N       SD card read throughput (default %u)\n"
+        "  --sd-write-kBps N      SD card write throughput (default %u)\n"
+        "  --sd-read-latency US   Latency of non-sequential SD reads (default %u)\n"
+        "  --sd-write-latency US  Latency of each SD write (default %u)\n"
+        "  --write-images         Store written data to image files, default is to discard\n"
+        "  --log                  Print firmware log to stderr\n",
+        name, g_replay_sd.read_kBps, g_replay_sd.write_kBps,
+        g_replay_sd.read_latency_us, g_replay_sd.write_latency_us);
+    exit(1);
+}
+
+struct replay_image_t
+{
+    int id;
+    char filename[MAX_FILE_PATH + 1];
+    int blocksize;
+    S2S_CFG_TYPE type;
+};
+
+static bool parse_image_arg(const char *arg, replay_image_t *img)
+{
+    char buf[MAX_FILE_PATH + 32];
+    strncpy(buf, arg, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *id = strtok(buf, ":");
+    char *filename = strtok(NULL, ":");
+    char *blocksize = strtok(NULL, ":");
+    char *type = strtok(NULL, ":");
+    if (!id || !filename || atoi(id) < 0 || atoi(id) > 7) return false;
+
+    img->id = atoi(id);
+    strncpy(img->filename, filename, sizeof(img->filename) - 1);
+    img->blocksize = blocksize ? atoi(blocksize) : 0;
+    img->type = S2S_CFG_FIXED;
+
+    if (type)
+    {
+        if (strcasecmp(type, "hd") == 0) img->type = S2S_CFG_FIXED;
+        else if (strcasecmp(type, "cd") == 0) img->type = S2S_CFG_OPTICAL;
+        else if (strcasecmp(type, "fd") == 0) img->type = S2S_CFG_FLOPPY_14MB;
+        else if (strcasecmp(type, "mo") == 0) img->type = S2S_CFG_MO;
+        else if (strcasecmp(type, "re") == 0) img->type = S2S_CFG_REMOVEABLE;
+        else if (strcasecmp(type, "tp") == 0) img->type = S2S_CFG_SEQUENTIAL;
+        else return false;
+    }
+
+    if (img->blocksize == 0)
+    {
+        img->blocksize = (img->type == S2S_CFG_OPTICAL) ? 2048 : 512;
+    }
+
+    return true;
+}
+
+// Load trace records until the end of valid data
+static bool load_trace(const char *filename, std::vector<bustrace_record_t> &records, bustrace_header_t &header)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        perror(filename);
+        return false;
+    }
+
+    uint8_t sector[BUSTRACE_HEADER_SIZE];
+    if (fread(sector, 1, sizeof(sector), f) != sizeof(sector))
+    {
+        fprintf(stderr, "%s: file too short\n", filename);
+        fclose(f);
+        return false;
+    }
+
+    memcpy(&header, sector, sizeof(header));
+    if (memcmp(header.magic, BUSTRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BUSTRACE_VERSION ||
+        header.record_size != sizeof(bustrace_record_t))
+    {
+        fprintf(stderr, "%s: not a ZuluSCSI bus trace file or unsupported version\n", filename);
+        fclose(f);
+        return false;
+    }
+
+    bustrace_record_t rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1)
+    {
+        // Preallocated file contains stale data after the last record
+        if (rec.magic != BUSTRACE_RECORD_MAGIC || rec.session != header.session ||
+            rec.seq != records.size())
+        {
+            break;
+        }
+
+        records.push_back(rec);
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Run the firmware main loop until bus is free and the command has completed
+static void run_until_done(replay_result_t *result)
+{
+    while (!result || !result->done || scsiDev.phase != BUS_FREE)
+    {
+        scsiPoll();
+        scsiDiskPoll();
+        scsiLogPhaseChange(scsiDev.phase);
+        replay_advance_ns(1000);
+
+        if (!result && scsiDev.phase == BUS_FREE && !scsiDev.resetFlag)
+        {
+            break;
+        }
+    }
+}
+
+struct latency_summary_t
+{
+    std::vector<uint32_t> recorded_us;
+    std::vector<uint32_t> replay_us;
+};
+
+static uint32_t percentile(std::vector<uint32_t> &values, int pct)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t idx = (values.size() - 1) * pct / 100;
+    return values[idx];
+}
+
+static void print_latency(const char *name, latency_summary_t &lat)
+{
+    if (lat.replay_us.empty()) return;
+
+    printf("  %-6s %7zu commands, latency us  p50 %7u / %-7u  p90 %7u / %-7u  p99 %7u / %-7u  max %7u / %u\n",
+        name, lat.replay_us.size(),
+        percentile(lat.recorded_us, 50), percentile(lat.replay_us, 50),
+        percentile(lat.recorded_us, 90), percentile(lat.replay_us, 90),
+        percentile(lat.recorded_us, 99), percentile(lat.replay_us, 99),
+        percentile(lat.recorded_us, 100), percentile(lat.replay_us, 100));
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<replay_image_t> images;
+    const char *tracefile = NULL;
+    const char *csvfile = NULL;
+    bool keep_gaps = true;
+    size_t limit = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--image") == 0 && value)
+        {
+            replay_image_t img = {};
+            if (!parse_image_arg(value, &img)) usage(argv[0]);
+            images.push_back(img);
+            i++;
+        }
+        else if (strcmp(arg, "--csv") == 0 && value) { csvfile = value; i++; }
+        else if (strcmp(arg, "--limit") == 0 && value) { limit = atoi(value); i++; }
+        else if (strcmp(arg, "--async-kBps") == 0 && value) { g_replay_bus.async_ns_per_byte = 1000000 / atoi(value); i++; }
+        else if (strcmp(arg, "--sd-read-kBps") == 0 && value) { g_replay_sd.read_kBps = atoi(value); i++; }
+        else if (strcmp(arg, "--sd-write-kBps") == 0 && value) { g_replay_sd.write_kBps = atoi(value); i++; }
+        else if (strcmp(arg, "--sd-read-latency") == 0 && value) { g_replay_sd.read_latency_us = atoi(value); i++; }
+        else if (strcmp(arg, "--sd-write-latency") == 0 && value) { g_replay_sd.write_latency_us = atoi(value); i++; }
+        else if (strcmp(arg, "--no-gaps") == 0) { keep_gaps = false; }
+        else if (strcmp(arg, "--write-images") == 0) { g_replay_sd.write_images = true; }
+        else if (strcmp(arg, "--log") == 0) { g_replay_log = true; }
+        else if (arg[0] != '-' && !tracefile) { tracefile = arg; }
+        else { usage(argv[0]); }
+    }
+
+    if (!tracefile || images.empty() || g_replay_sd.read_kBps == 0 || g_replay_sd.write_kBps == 0)
+    {
+        usage(argv[0]);
+    }
+
+    std::vector<bustrace_record_t> records;
+    bustrace_header_t header;
+    if (!load_trace(tracefile, records, header))
+    {
+        return 1;
+    }
+
+    if (limit > 0 && records.size() > limit)
+    {
+        records.resize(limit);
+    }
+
+    g_replay_bus.digest_limit = header.digest_limit;
+
+    // Same initialization sequence as reinitSCSI() in ZuluSCSI.cpp
+    g_log_debug = g_replay_log && ini_getbool("SCSI", "Debug", 0, CONFIGFILE);
+    scsiDiskResetImages();
+    s2s_configInit(&scsiDev.boardCfg);
+    for (int i = 0; i < NUM_SCSIID; i++)
+    {
+        scsiDiskLoadConfig(i);
+    }
+
+    for (const replay_image_t &img : images)
+    {
+        if (!scsiDiskOpenHDDImage(img.id, img.filename, img.id, 0, img.blocksize, img.type))
+        {
+            fprintf(stderr, "Failed to open image %s\n", img.filename);
+            return 1;
+        }
+    }
+
+    scsiPhyReset();
+    scsiDiskInit();
+    scsiInit();
+    run_until_done(NULL);
+
+    FILE *csv = NULL;
+    if (csvfile)
+    {
+        csv = fopen(csvfile, "w");
+        if (!csv)
+        {
+            perror(csvfile);
+            return 1;
+        }
+        fprintf(csv, "seq,target,opcode,recorded_us,replay_us,recorded_status,replay_status,"
+                     "bytes_in,bytes_out,data_match,sd_read_bytes,sd_write_bytes\n");
+    }
+
+    latency_summary_t latency[STATS_CLASS_COUNT];
+    uint64_t recorded_busy_us = 0;
+    uint64_t replay_busy_ns = 0;
+    uint32_t status_mismatch = 0;
+    uint32_t data_mismatch = 0;
+    uint32_t skipped = 0;
+    uint64_t start_ns = g_replay_time_ns;
+    uint64_t prev_end_ns = g_replay_time_ns;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const bustrace_record_t &rec = records[i];
+        if (rec.cdb_len == 0 || rec.cdb_len > sizeof(rec.cdb) || rec.target > 7)
+        {
+            skipped++;
+            continue;
+        }
+
+        // Keep the idle time the host had between end of previous command and this one
+        uint64_t select_ns = prev_end_ns;
+        if (keep_gaps && i > 0)
+        {
+            const bustrace_record_t &prev = records[i - 1];
+            int64_t gap_us = (int64_t)(rec.time_ms - prev.time_ms) * 1000 - prev.duration_us;
+            if (gap_us > 0) select_ns += gap_us * 1000;
+        }
+
+        replay_command_t cmd = {};
+        cmd.target = rec.target;
+        cmd.lun = rec.lun;
+        cmd.initiator = rec.initiator;
+        cmd.cdb_len = rec.cdb_len;
+        memcpy(cmd.cdb, rec.cdb, sizeof(cmd.cdb));
+        cmd.sync_period = rec.sync_period;
+        cmd.sync_offset = rec.sync_offset;
+
+        replay_sd_counters_t sd_before = g_replay_sd_counters;
+        replay_result_t result;
+        replay_bus_start_command(cmd, select_ns, &result);
+        run_until_done(&result);
+        prev_end_ns = result.end_ns;
+
+        uint32_t replay_us = (uint32_t)((result.end_ns - result.start_ns) / 1000);
+        int cls = stats_command_class(rec.cdb[0]);
+        latency[cls].recorded_us.push_back(rec.duration_us);
+        latency[cls].replay_us.push_back(replay_us);
+        recorded_busy_us += rec.duration_us;
+        replay_busy_ns += result.end_ns - result.start_ns;
+
+        if (result.status != rec.status)
+        {
+            status_mismatch++;
+        }
+
+        // Data sent by the original host is not known, so only DATA_IN can be compared
+        bool data_match = (result.bytes_in == rec.bytes_in &&
+                           (rec.bytes_in == 0 || result.data_crc == rec.data_crc));
+        if (!data_match)
+        {
+            data_mismatch++;
+        }
+
+        if (csv)
+        {
+            fprintf(csv, "%u,%u,0x%02X,%u,%u,%u,%u,%u,%u,%d,%llu,%llu\n",
+                rec.seq, rec.target, rec.cdb[0], rec.duration_us, replay_us,
+                rec.status, result.status, result.bytes_in, result.bytes_out, data_match ? 1 : 0,
+                (unsigned long long)(g_replay_sd_counters.read_bytes - sd_before.read_bytes),
+                (unsigned long long)(g_replay_sd_counters.write_bytes - sd_before.write_bytes));
+        }
+    }
+
+    if (csv)
+    {
+        fclose(csv);
+    }
+
+    size_t count = records.size() - skipped;
+    printf("Replayed %zu commands from %s (firmware %.32s)\n", count, tracefile, header.firmware);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t recorded_total_us = (uint64_t)(records.back().time_ms - records.front().time_ms) * 1000
+                                 + records.back().duration_us;
+    printf("  Total time:     recorded %.3f s, replay %.3f s\n",
+        recorded_total_us / 1e6, (prev_end_ns - start_ns) / 1e9);
+    printf("  Command time:   recorded %.3f s, replay %.3f s\n",
+        recorded_busy_us / 1e6, replay_busy_ns / 1e9);
+    printf("  Latency (recorded / replay):\n");
+    print_latency("read", latency[STATS_CLASS_READ]);
+    print_latency("write", latency[STATS_CLASS_WRITE]);
+    print_latency("other", latency[STATS_CLASS_OTHER]);
+    printf("  SD reads:       %u ops, %llu bytes, %u non-sequential\n",
+        g_replay_sd_counters.read_ops, (unsigned long long)g_replay_sd_counters.read_bytes,
+        g_replay_sd_counters.random_reads);
+    printf("  SD writes:      %u ops, %llu bytes\n",
+        g_replay_sd_counters.write_ops, (unsigned long long)g_replay_sd_counters.write_bytes);
+
+    uint32_t prefetch_hits = 0;
+    for (const replay_image_t &img : images)
+    {
+        prefetch_hits += stats_get(img.id)->prefetch_hits;
+    }
+    printf("  Prefetch hits:  %u\n", prefetch_hits);
+    printf("  Mismatches:     %u status, %u data\n", status_mismatch, data_mismatch);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Interface between the trace replay main program and the simulated
+// SCSI bus and SD card.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Command issued by the simulated initiator
+struct replay_command_t
+{
+    uint8_t target;
+    uint8_t lun;
+    uint8_t initiator;
+    uint8_t cdb[12];
+    uint8_t cdb_len;
+    uint8_t sync_period; // Negotiated with SDTR if different from current setting
+    uint8_t sync_offset;
+};
+
+// Result of the command, collected by the simulated initiator
+struct replay_result_t
+{
+    bool done;
+    uint8_t status;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint32_t data_crc; // CRC-32 of first digest_limit bytes of DATA_IN / DATA_OUT
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// Simulated SCSI bus timing
+struct replay_bus_config_t
+{
+    uint32_t async_ns_per_byte; // Asynchronous transfer speed
+    uint32_t digest_limit; // Maximum bytes per command included in data_crc
+};
+
+// Simulated SD card timing
+struct replay_sd_config_t
+{
+    uint32_t read_kBps;
+    uint32_t write_kBps;
+    uint32_t read_latency_us; // Added when read does not continue from previous access
+    uint32_t write_latency_us; // Added to every write for card programming time
+    bool write_images; // If false, writes to existing files are discarded
+};
+
+struct replay_sd_counters_t
+{
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint32_t read_ops;
+    uint32_t write_ops;
+    uint32_t random_reads;
+};
+
+extern replay_bus_config_t g_replay_bus;
+extern replay_sd_config_t g_replay_sd;
+extern replay_sd_counters_t g_replay_sd_counters;
+extern bool g_replay_log;
+
+// Set while the simulated SD card is transferring data. Polling the SCSI
+// transfer status from the SD callback does not take additional time then.
+extern bool g_replay_sd_busy;
+
+// Select the target at given simulated time, and start the command.
+// The result is updated as the command progresses.
+void replay_bus_start_command(const replay_command_t &cmd, uint64_t select_time_ns, replay_result_t *result);